@@ -20,14 +20,53 @@ QT += gui
 SOURCES += \
 	$$PWD/src/Server/Resources/ImageResource/ImageResource.cpp \
 	$$PWD/src/Server/Resources/ImageResource/ImageResourceFactory.cpp \
-	$$PWD/src/Storage/ImageResourceFilesystemStorage.cpp
+	$$PWD/src/Storage/ImageResourceFilesystemStorage.cpp \
+	$$PWD/src/Storage/ImageBlobStore.cpp
 
 HEADERS += \
 	$$PWD/src/Server/Resources/ImageResource/ImageResource.h \
 	$$PWD/src/Server/Resources/ImageResource/ImageResourceFactory.h \
 	$$PWD/src/Server/Resources/ImageResource/IImageResourceStorage.h \
 	$$PWD/src/Server/Resources/ImageResource/IImageResourceStorageFactory.h \
-	$$PWD/src/Storage/ImageResourceFilesystemStorage.h
+	$$PWD/src/Storage/ImageResourceFilesystemStorage.h \
+	$$PWD/src/Storage/ImageBlobStore.h
+}
+
+!contains(DEFINES, NO_SQL) {
+
+QT += sql
+
+SOURCES += \
+	$$PWD/src/Storage/SQLiteDatabase.cpp \
+	$$PWD/src/Storage/ListResourceSQLiteStorage.cpp \
+	$$PWD/src/Storage/ListResourceSQLiteStorageFactory.cpp \
+	$$PWD/src/Storage/ObjectResourceSQLiteStorage.cpp \
+	$$PWD/src/Storage/ObjectResourceSQLiteStorageFactory.cpp
+
+HEADERS += \
+	$$PWD/src/Storage/SQLiteDatabase.h \
+	$$PWD/src/Storage/ListResourceSQLiteStorage.h \
+	$$PWD/src/Storage/ListResourceSQLiteStorageFactory.h \
+	$$PWD/src/Storage/ObjectResourceSQLiteStorage.h \
+	$$PWD/src/Storage/ObjectResourceSQLiteStorageFactory.h
+}
+
+# the QML automation is optional, add "DEFINES += QML_AUTOMATION" to build it
+contains(DEFINES, QML_AUTOMATION) {
+
+QT += qml
+
+SOURCES += \
+	$$PWD/src/Server/Automation/AutomationEngine.cpp \
+	$$PWD/src/Server/Automation/AutomationWorker.cpp \
+	$$PWD/src/Server/Automation/QmlComponents/AutomationRule.cpp \
+	$$PWD/src/Server/Automation/QmlComponents/DeviceQmlAdapter.cpp
+
+HEADERS += \
+	$$PWD/src/Server/Automation/AutomationEngine.h \
+	$$PWD/src/Server/Automation/AutomationWorker.h \
+	$$PWD/src/Server/Automation/QmlComponents/AutomationRule.h \
+	$$PWD/src/Server/Automation/QmlComponents/DeviceQmlAdapter.h
 }
 
 SOURCES += $$PWD/src/Server/Authentication/AuthentificationService.cpp \
@@ -38,9 +77,16 @@ SOURCES += $$PWD/src/Server/Authentication/AuthentificationService.cpp \
 	$$PWD/src/Connection/Connection.cpp \
 	$$PWD/src/Server/Devices/DevicePermissionManager.cpp \
 	$$PWD/src/Server/Devices/DeviceService.cpp \
+	$$PWD/src/Server/Devices/DeviceBulkCommand.cpp \
+	$$PWD/src/Server/Devices/PropertyTable.cpp \
 	$$PWD/src/Server/Devices/DeviceUpdateLogic.cpp \
+	$$PWD/src/Server/Devices/FirmwareRollout.cpp \
+	$$PWD/src/Server/Devices/FirmwareStore.cpp \
+	$$PWD/src/Server/Automation/RuleEngine.cpp \
+	$$PWD/src/Server/Automation/AutomationService.cpp \
 	$$PWD/src/Server/Devices/IDevicePermissionController.cpp \
 	$$PWD/src/Server/Resources/ListResource/ListResource.cpp \
+	$$PWD/src/Server/Resources/ListResource/CappedListResource.cpp \
 	$$PWD/src/Server/Resources/ListResource/QObjectListResource.cpp \
 	$$PWD/src/Server/Resources/ObjectResource/QObjectResource.cpp \
 	$$PWD/src/Server/Resources/ResourceManager/ResourceManager.cpp \
@@ -52,6 +98,8 @@ SOURCES += $$PWD/src/Server/Authentication/AuthentificationService.cpp \
 	$$PWD/src/Server/Devices/IDevice.cpp \
 	$$PWD/src/Server/Devices/DeviceHandle.cpp \
 	$$PWD/src/Server/Devices/DeviceProperty.cpp \
+	$$PWD/src/Server/Devices/PropertyHistory.cpp \
+	$$PWD/src/Server/Devices/DeviceRpcQueue.cpp \
 	$$PWD/src/Server/Settings/SettingsManager.cpp \
 	$$PWD/src/Server/Settings/SettingsResource.cpp \
 	$$PWD/src/Storage/FileSystemPaths.cpp \
@@ -62,21 +110,38 @@ SOURCES += $$PWD/src/Server/Authentication/AuthentificationService.cpp \
 	$$PWD/src/Storage/ListResourceTemporaryStorage.cpp \
 	$$PWD/src/Server/Authentication/IUser.cpp \
 	$$PWD/src/Server/Authentication/DefaultAuthenticator.cpp \
-	$$PWD/src/Storage/FileSystemLoader.cpp
+	$$PWD/src/Server/Authentication/PasswordHasher.cpp \
+	$$PWD/src/Storage/FileSystemLoader.cpp \
+	$$PWD/src/Storage/PersistenceScheduler.cpp \
+	$$PWD/src/Storage/ListSnapshot.cpp \
+	$$PWD/src/Storage/SegmentStore.cpp \
+	$$PWD/src/Storage/ListResourceSegmentStorage.cpp \
+	$$PWD/src/Storage/ListResourceSegmentStorageFactory.cpp \
+	$$PWD/src/Storage/ObjectResourceSegmentStorage.cpp \
+	$$PWD/src/Storage/ObjectResourceSegmentStorageFactory.cpp
 
 HEADERS += \
 	$$PWD/src/Server/Authentication/AuthentificationService.h \
 	$$PWD/src/Server/Authentication/Controller.h \
 	$$PWD/src/Server/Authentication/IIdentitiy.h \
 	$$PWD/src/Server/Authentication/User.h \
+	$$PWD/src/Server/Authentication/PasswordHasher.h \
 	$$PWD/src/Connection/VirtualConnection.h \
 	$$PWD/src/Connection/Connection.h \
 	$$PWD/src/Server/Devices/DevicePermissionManager.h \
 	$$PWD/src/Server/Devices/DeviceService.h \
+	$$PWD/src/Server/Devices/DeviceBulkCommand.h \
+	$$PWD/src/Server/Devices/Snapshot.h \
+	$$PWD/src/Server/Devices/PropertyTable.h \
 	$$PWD/src/Server/Resources/ListResource/ListResourceFactory.h \
 	$$PWD/src/Server/Devices/DeviceUpdateLogic.h \
+	$$PWD/src/Server/Devices/FirmwareRollout.h \
+	$$PWD/src/Server/Devices/FirmwareStore.h \
+	$$PWD/src/Server/Automation/RuleEngine.h \
+	$$PWD/src/Server/Automation/AutomationService.h \
 	$$PWD/src/Server/Devices/IDevicePermissionController.h \
 	$$PWD/src/Server/Resources/ListResource/ListResource.h \
+	$$PWD/src/Server/Resources/ListResource/CappedListResource.h \
 	$$PWD/src/Server/Resources/ListResource/QObjectListResource.h \
 	$$PWD/src/Server/Resources/ObjectResource/QObjectResource.h \
 	$$PWD/src/Server/Resources/ResourceManager/IResource.h \
@@ -94,6 +159,8 @@ HEADERS += \
 	$$PWD/src/Server/Settings/SettingsResource.h \
 	$$PWD/src/Storage/FileSystemPaths.h \
 	$$PWD/src/Server/Devices/DeviceProperty.h \
+	$$PWD/src/Server/Devices/PropertyHistory.h \
+	$$PWD/src/Server/Devices/DeviceRpcQueue.h \
 	$$PWD/src/Server/Resources/ListResource/IListResourceStorage.h \
 	$$PWD/src/Storage/ListResourceFileSystemStorage.h \
 	$$PWD/src/Server/Resources/ListResource/IListResourceStorageFactory.h \
@@ -107,4 +174,11 @@ HEADERS += \
 	$$PWD/src/Server/Authentication/IAuthenticator.h \
 	$$PWD/src/Server/Authentication/IUser.h \
 	$$PWD/src/Server/Authentication/DefaultAuthenticator.h \
-	$$PWD/src/Storage/FileSystemLoader.h
+	$$PWD/src/Storage/FileSystemLoader.h \
+	$$PWD/src/Storage/PersistenceScheduler.h \
+	$$PWD/src/Storage/ListSnapshot.h \
+	$$PWD/src/Storage/SegmentStore.h \
+	$$PWD/src/Storage/ListResourceSegmentStorage.h \
+	$$PWD/src/Storage/ListResourceSegmentStorageFactory.h \
+	$$PWD/src/Storage/ObjectResourceSegmentStorage.h \
+	$$PWD/src/Storage/ObjectResourceSegmentStorageFactory.h
@@ -11,12 +11,37 @@
 #include <QJsonDocument>
 #include <QTimer>
 #include <QtConcurrent>
+#include <QtEndian>
+#include <QCborValue>
+
+#define CONNECTION_DATA_FRAME_MARKER    0x00
+#define CONNECTION_DATA_FRAME_HEADER    14 // marker(1) uuid size(1) transfer(4) offset(8) + uuid
+#define CONNECTION_CBOR_FRAME_MARKER    0x01 // marker(1) + CBOR encoded message
 
 void Connection::sendVariant(const QVariant& data)
 {
     Q_EMIT doSendVariant(data);
 }
 
+void Connection::sendData(QString uuid, quint32 transfer, qint64 offset, const QByteArray &data)
+{
+    QByteArray rawUuid = uuid.toUtf8();
+    if(rawUuid.size() > 255)
+        return;
+
+    QByteArray frame(CONNECTION_DATA_FRAME_HEADER + rawUuid.size(), 0);
+    uchar* header = reinterpret_cast<uchar*>(frame.data());
+    header[0] = CONNECTION_DATA_FRAME_MARKER;
+    header[1] = uchar(rawUuid.size());
+    memcpy(header + 2, rawUuid.constData(), size_t(rawUuid.size()));
+    qToBigEndian<quint32>(transfer, header + 2 + rawUuid.size());
+    qToBigEndian<qint64>(offset, header + 6 + rawUuid.size());
+    frame.append(data);
+
+    // same queue as the messages - the order of chunks and messages is kept
+    Q_EMIT doSendData(frame);
+}
+
 Connection::Connection(QWebSocket *socket, QObject *parent): IConnectable(parent),
     _socket(socket),
     _connected(socket->state() > 0)
@@ -35,6 +60,7 @@ Connection::Connection(ISocket* socket, QObject *parent):IConnectable(parent),
     QObject::connect(socket, &ISocket::disconnected, this, &Connection::socketDisconnected);
     QObject::connect(socket, &ISocket::messageReceived, this, &Connection::variantMessageReceived);
     QObject::connect(this, &Connection::doSendVariant, this, &Connection::invokeSendingVariant, Qt::QueuedConnection);
+    QObject::connect(this, &Connection::doSendData, this, &Connection::invokeSendingData, Qt::QueuedConnection);
 }
 
 
@@ -53,6 +79,7 @@ void Connection::setupConnections()
     QObject::connect(_socket,SIGNAL(binaryMessageReceived(QByteArray)), this,SLOT(binaryMessageReceived(QByteArray)));
     QObject::connect(_socket,SIGNAL(textMessageReceived(QString)), this,SLOT(textMessageReceived(QString)));
     QObject::connect(this, &Connection::doSendVariant, this, &Connection::invokeSendingVariant, Qt::QueuedConnection);
+    QObject::connect(this, &Connection::doSendData, this, &Connection::invokeSendingData, Qt::QueuedConnection);
 }
 
 
@@ -176,7 +203,9 @@ void Connection::invokeSendingVariant(const QVariant &data)
 {
     if(_socket)
     {
-        if(_binary)
+        if(_cbor)
+            _socket->sendBinaryMessage(QByteArray(1, CONNECTION_CBOR_FRAME_MARKER) + QCborValue::fromVariant(data).toCbor());
+        else if(_binary)
             _socket->sendBinaryMessage(QJsonDocument::fromVariant(data.toMap()).toJson());
         else
             _socket->sendTextMessage(QJsonDocument::fromVariant(data.toMap()).toJson());
@@ -184,9 +213,39 @@ void Connection::invokeSendingVariant(const QVariant &data)
     else if(_isocket)
         _isocket->sendVariant(data);
 }
+void Connection::invokeSendingData(const QByteArray &frame)
+{
+    if(_socket)
+        _socket->sendBinaryMessage(frame);
+    else
+        qWarning()<<"Warning: Binary data can't be sent over this connection.";
+}
+
 void Connection::binaryMessageReceived(QByteArray message)
 {
+    if(!message.isEmpty() && message.at(0) == CONNECTION_DATA_FRAME_MARKER)
+    {
+        dataFrameReceived(message);
+        return;
+    }
+
+    // peers which talk CBOR are answered in CBOR
+    if(!message.isEmpty() && message.at(0) == CONNECTION_CBOR_FRAME_MARKER)
+    {
+        QCborParserError error;
+        QCborValue msg = QCborValue::fromCbor(message.mid(1), &error);
+        if(error.error != QCborError::NoError || !msg.isMap())
+        {
+            qDebug()<<"Connection: Invalid CBOR.";
+            return;
+        }
+        _cbor = true;
+        variantMessageReceived(msg.toVariant());
+        return;
+    }
+
     _binary = true;
+    _cbor = false;
     QJsonParseError error;
     QVariantMap msg = QJsonDocument::fromJson(message, &error).toVariant().toMap();
     if(error.error != QJsonParseError::NoError)
@@ -250,9 +309,35 @@ void Connection::variantMessageReceived(QVariant message)
    }
 }
 
+void Connection::dataFrameReceived(const QByteArray &frame)
+{
+    if(_keepAlive)
+    {
+        _timeoutTimer->stop();
+        _keepAliveTimer->start();
+    }
+
+    const uchar* header = reinterpret_cast<const uchar*>(frame.constData());
+    int uuidSize = frame.size() > 1 ? header[1] : 0;
+    if(frame.size() < CONNECTION_DATA_FRAME_HEADER + uuidSize)
+    {
+        qDebug()<<"Connection: Invalid data frame.";
+        return;
+    }
+
+    QString uuid = QString::fromUtf8(frame.constData() + 2, uuidSize);
+    quint32 transfer = qFromBigEndian<quint32>(header + 2 + uuidSize);
+    qint64 offset = qFromBigEndian<qint64>(header + 6 + uuidSize);
+
+    VirtualConnection* handle = _handles.value(uuid, nullptr);
+    if(handle)
+        handle->deployData(transfer, offset, frame.mid(CONNECTION_DATA_FRAME_HEADER + uuidSize));
+}
+
 void Connection::textMessageReceived(QString message)
 {
     _binary = false;
+    _cbor = false;
     QJsonParseError error;
     QVariantMap msg = QJsonDocument::fromJson(message.toUtf8(), &error).toVariant().toMap();
     if(error.error != QJsonParseError::NoError)
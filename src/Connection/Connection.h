@@ -52,9 +52,17 @@ public:
 
     /*!
         Send a QVariant to the endpoint. In most cases, the QVariant object will be serialized to JSON.
+        Peers which send CBOR messages (marker 0x01 followed by the CBOR encoded message) are answered in CBOR.
     */
     void        sendVariant(const QVariant &data) override;
 
+    /*!
+        Sends a chunk of raw bytes for the given virtual connection as binary frame:
+        marker (0x00) | uuid size (1 byte) | uuid | transfer (4 bytes) | offset (8 bytes) | data.
+        The marker can't be the first byte of a JSON message, so data frames and messages share the socket.
+    */
+    void        sendData(QString uuid, quint32 transfer, qint64 offset, const QByteArray& data);
+
     /*!
         Adds a virtual connection. Incoming messages for the registered VirtualConnections will be delivered after calling this function.
     */
@@ -94,23 +102,27 @@ private:
     QTimer*                             _timeoutTimer =  nullptr;
     QThread*                            _trhead = nullptr;
     bool                                _binary = true;
+    bool                                _cbor = false;
 
 signals:
     void connected();
     void disconnected();
     void socketError(QAbstractSocket::SocketError error);
     void doSendVariant(const QVariant& variant);
+    void doSendData(const QByteArray& frame);
 
 private slots:
     void socketDisconnected();
     void socketConnected();
     void variantMessageReceived(QVariant message);
     void binaryMessageReceived(QByteArray message);
+    void dataFrameReceived(const QByteArray& frame);
     void textMessageReceived(QString message);
     void sendPing();
     void timeout();
     void handleDeleted();
     void invokeSendingVariant(const QVariant& data);
+    void invokeSendingData(const QByteArray& frame);
 
 
 };
@@ -23,10 +23,23 @@ public:
     virtual bool isConnected() = 0;
     virtual IConnectable* getConnection(){return nullptr;}
 
+    /*!
+        \fn void ISocket::sendData(quint32 transfer, qint64 offset, const QByteArray& data)
+        Sends a chunk of raw bytes which belongs to the given transfer as binary frame, without JSON encoding.
+        Chunks and messages are delivered in the order they were sent. The default implementation drops the data.
+    */
+    virtual void sendData(quint32 transfer, qint64 offset, const QByteArray& data)
+    {
+        Q_UNUSED(transfer);
+        Q_UNUSED(offset);
+        Q_UNUSED(data);
+    }
+
 signals:
     void connected();
     void disconnected();
     void messageReceived(const QVariant& message);
+    void dataReceived(quint32 transfer, qint64 offset, const QByteArray& data);
 
 public slots:
 };
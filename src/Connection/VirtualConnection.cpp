@@ -105,6 +105,12 @@ void VirtualConnection::deployMessage(const QVariantMap &message)
     }
 }
 
+void VirtualConnection::deployData(quint32 transfer, qint64 offset, const QByteArray &data)
+{
+    if(_state == CONNECTED)
+        Q_EMIT dataReceived(transfer, offset, data);
+}
+
 bool VirtualConnection::isConnected()
 {
     return _state == CONNECTED;
@@ -145,6 +151,14 @@ void VirtualConnection::sendVariant(const QVariant& data)
     _connection->sendVariant(msg);
 }
 
+void VirtualConnection::sendData(quint32 transfer, qint64 offset, const QByteArray &data)
+{
+    if(!_connection | (_state != CONNECTED))
+        return;
+
+    _connection->sendData(_uuid, transfer, offset, data);
+}
+
 void VirtualConnection::connectionConnected()
 {
     this->open();
@@ -35,6 +35,8 @@ public:
 
     //          make connection as friend and do private
     void        deployMessage(const QVariantMap &message);
+    void        deployData(quint32 transfer, qint64 offset, const QByteArray& data);
+    void        sendData(quint32 transfer, qint64 offset, const QByteArray& data) override;
     bool        isConnected() override;
 
 public slots:
@@ -11,10 +11,21 @@
 #include "Server/Devices/DeviceService.h"
 #include "Server/Devices/DeviceService.h"
 #include "Server/Services/ServiceManager.h"
+#include "Server/Automation/AutomationService.h"
+#include "SocketApi/Devices/DeviceHandleHandler.h"
+#include "Server/Devices/PropertyHistory.h"
 
 #include "Server/Resources/ListResource/ListResourceFactory.h"
 #include "Server/Resources/ObjectResource/ObjectResourceFactory.h"
 #include "Server/Resources/ResourceManager/ResourceManager.h"
+#include "Storage/PersistenceScheduler.h"
+#include "Storage/SegmentStore.h"
+#include "Storage/ListResourceSegmentStorageFactory.h"
+#include "Storage/ObjectResourceSegmentStorageFactory.h"
+#ifndef NO_SQL
+#include "Storage/ListResourceSQLiteStorageFactory.h"
+#include "Storage/ObjectResourceSQLiteStorageFactory.h"
+#endif
 
 #include "PluginManager.h"
 
@@ -27,7 +38,41 @@ bool QHCorePlugin::init(QVariantMap parameters)
     int port = parameters.value("p", 4711).toInt();
     QString path =  parameters.value("f", QStandardPaths::standardLocations(QStandardPaths::DataLocation).at(0)+"/v1.3/").toString();
     ServiceManager::instance()->registerService(new DeviceService(this));
+    ServiceManager::instance()->registerService(new AutomationService(this));
+
+    // "telemetry=<ms>" sets the interval in which device property changes are collected, 0 disables it
+    if(parameters.contains("telemetry"))
+        DeviceHandleHandler::setTelemetryInterval(parameters.value("telemetry").toInt());
+
+    // "historyretention=<s>" and "historylimit=<bytes>" limit the recorded history of each device property
+    if(parameters.contains("historyretention"))
+        PropertyHistory::setRetention(parameters.value("historyretention").toLongLong() * 1000);
+
+    if(parameters.contains("historylimit"))
+        PropertyHistory::setMemoryLimit(parameters.value("historylimit").toInt());
+
+    // "historytotal=<bytes>" limits the recorded history of all device properties together
+    if(parameters.contains("historytotal"))
+        PropertyHistory::setGlobalMemoryLimit(parameters.value("historytotal").toInt());
+
     SocketServer::instance()->start(path, static_cast<quint16>(port));
+
+    // "storage=segments" stores all lists and objects in a few shared segment files
+    if(parameters.value("storage").toString() == "segments")
+    {
+        SocketServer::instance()->setListResourceStorageFactory(new ListResourceSegmentStorageFactory(this));
+        SocketServer::instance()->setObjectResourceStorageFactory(new ObjectResourceSegmentStorageFactory(this));
+    }
+
+#ifndef NO_SQL
+    // "storage=sqlite" selects the embedded SQLite backend. Storage plugins still take precedence.
+    if(parameters.value("storage").toString() == "sqlite")
+    {
+        SocketServer::instance()->setListResourceStorageFactory(new ListResourceSQLiteStorageFactory(this));
+        SocketServer::instance()->setObjectResourceStorageFactory(new ObjectResourceSQLiteStorageFactory(this));
+    }
+#endif
+
     QList<IListResourceStorageFactory*> listStoragePlugins = PluginManager::getInstance()->getObjects<IListResourceStorageFactory>();
     if(listStoragePlugins.count() > 0)
     {
@@ -46,6 +91,8 @@ bool QHCorePlugin::init(QVariantMap parameters)
 
 bool QHCorePlugin::shutdown()
 {
+    PersistenceScheduler::flushAll();
+    SegmentStore::flushAll();
     return false;
 }
 
@@ -15,9 +15,13 @@
 #include <QUuid>
 #include <QDateTime>
 #include <QCoreApplication>
+#include <algorithm>
 #include "User.h"
 #include "IAuthenticator.h"
 
+// the expirations are kept in a heap, a check only looks at the sessions which are due
+#define SESSION_CHECK_INTERVAL 1000
+
 Q_GLOBAL_STATIC(AuthenticationService, authenticationService);
 
 AuthenticationService::~AuthenticationService()
@@ -41,38 +45,34 @@ void AuthenticationService::registerAuthenticator(IAuthenticator *authenticator)
 AuthenticationService::AuthenticationService(QObject *parent) : QObject(parent),
     _lock(QReadWriteLock::Recursive)
 {
-    // check every minute for timeouts
-    _sessionTimeoutKicker.setInterval(60*1000);
+    _sessionTimeoutKicker.setInterval(SESSION_CHECK_INTERVAL);
     connect(&_sessionTimeoutKicker, &QTimer::timeout, this, &AuthenticationService::checkTimeouts);
     _sessionTimeoutKicker.start();
 }
 
 iIdentityPtr AuthenticationService::validateToken(QString token)
 {
-    _lock.lockForRead();
-    iIdentityPtr identitiy = _tokenToUserMap.value(token, QSharedPointer<User>());
-    _lock.unlock();
-    if(!identitiy.isNull())
+    sessionPtr session = findSession(token);
+    if(!session)
+        return QSharedPointer<User>();
+
+    iIdentityPtr identitiy = session->identity;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if(identitiy->sessionExpiration() > 0)
     {
-        if(identitiy->sessionExpiration() > 0)
+        qint64 tokenExpiration = session->expiration.load();
+        if(tokenExpiration > 0 && tokenExpiration < now)
         {
-            _lock.lockForRead();
-            qint64 tokenExpiration = _tokenToExpiration.value(token, 0);
-            _lock.unlock();
-            if(tokenExpiration > 0 && tokenExpiration < QDateTime::currentDateTime().toMSecsSinceEpoch())
-            {
-                qInfo()<< "Token expired. "<< identitiy->identityID() <<" was forcibly logged out.";
-                logout(token);
-                return QSharedPointer<User>();
-            }
-            qint64 expiration = QDateTime::currentDateTime().addSecs(identitiy->sessionExpiration()).toMSecsSinceEpoch();
-            _lock.lockForWrite();
-            _tokenToExpiration.insert(token, expiration);
-            _lock.unlock();
+            qInfo()<< "Token expired. "<< identitiy->identityID() <<" was forcibly logged out.";
+            logout(token);
+            return QSharedPointer<User>();
         }
 
-        identitiy->setLastActivity(QDateTime::currentMSecsSinceEpoch());
+        // the deadline heap is not touched, its entry is moved when it is due (see checkTimeouts)
+        session->expiration.store(now + qint64(identitiy->sessionExpiration()) * 1000);
     }
+
+    identitiy->setLastActivity(now);
     return identitiy;
 }
 
@@ -80,17 +80,19 @@ iIdentityPtr AuthenticationService::validateToken(QString token)
 
 iUserPtr AuthenticationService::getUserForToken(QString token) const
 {
-    QReadLocker locker(&_lock);
-    iIdentityPtr identity = _tokenToUserMap.value(token, QSharedPointer<IIdentity>());
-    return qSharedPointerCast<IUser>(identity);
+    sessionPtr session = findSession(token);
+    if(!session)
+        return iUserPtr();
+
+    return qSharedPointerCast<IUser>(session->identity);
 }
 
 
 
 qint64 AuthenticationService::getTokenExpiration(QString token)
 {
-    QReadLocker locker(&_lock);
-    return _tokenToExpiration.value(token, 0);
+    sessionPtr session = findSession(token);
+    return session ? session->expiration.load() : 0;
 }
 
 
@@ -122,83 +124,154 @@ iUserPtr AuthenticationService::validateUser(QString userID, QString password, E
 QString AuthenticationService::login(QString userID, QString password, ErrorCode *error)
 {
     iUserPtr userObj = validateUser(userID, password, error);
-    QString token = "";
 
     if(!userObj.isNull() && *error == NoError)
+        return createSession(userObj, error);
+
+    return "";
+}
+
+void AuthenticationService::loginAsync(QString userID, QString password, QObject *context, LoginCallback callback)
+{
+    iUserPtr userObj = getUserForUserID(userID);
+    if(userObj.isNull())
+    {
+        callback("", UserNotExists);
+        return;
+    }
+
+    userObj->checkPasswordAsync(password, context, [this, userObj, callback](PasswordHasher::Result result, QString newHash)
     {
-        if(userObj->isAuthorizedTo(SERVICE) && userObj->sessionCount()  >= 1)
+        Q_UNUSED(newHash)
+        if(result == PasswordHasher::Busy)
         {
-            *error = PermissionDenied;
-            return "";
+            callback("", Busy);
+            return;
         }
 
-        token = QUuid::createUuid().toString();
-
-        if(userObj->sessionExpiration() > 0)
+        if(result != PasswordHasher::Valid)
         {
-           qint64 expires = QDateTime::currentDateTime().addSecs(userObj->sessionExpiration()).toMSecsSinceEpoch();
-           _lock.lockForWrite();
-           _tokenToExpiration.insert(token, expires);
-           _lock.unlock();
+            callback("", IncorrectPassword);
+            return;
         }
 
-        userObj->addToken(token);
-        qInfo()<< userObj->identityID()+" logged in. ("<<userObj->sessionCount()<<" sessions open)";
-        _lock.lockForWrite();
-        _tokenToUserMap.insert(token, userObj);
-        _lock.unlock();
+        ErrorCode error = NoError;
+        QString token = createSession(userObj, &error);
+        callback(token, error);
+    });
+}
+
+QString AuthenticationService::createSession(iUserPtr userObj, ErrorCode *error)
+{
+    if(userObj->isAuthorizedTo(SERVICE) && userObj->sessionCount()  >= 1)
+    {
+        *error = PermissionDenied;
+        return "";
     }
 
+    QString token = insertSession(userObj);
+    userObj->addToken(token);
+    qInfo()<< userObj->identityID()+" logged in. ("<<userObj->sessionCount()<<" sessions open)";
     return token;
 }
 
 QString AuthenticationService::login(iIdentityPtr identity, ErrorCode *error)
 {
-    if(!identity->multipleSessionsAllowed())
+    QString token = QUuid::createUuid().toString();
+
+    // reserve the token in the index, so two concurrent logins can't both pass the check
+    _identityMutex.lock();
+    if(!identity->multipleSessionsAllowed() && !_identityTokens.value(identity.data()).isEmpty())
     {
-        if (_tokenToUserMap.values().contains(identity))
-        {
-            if(error != nullptr)
-                *error = PermissionDenied;
-            return "";
-        }
+        _identityMutex.unlock();
+        if(error != nullptr)
+            *error = PermissionDenied;
+        return "";
     }
+    _identityTokens[identity.data()].insert(token);
+    _identityMutex.unlock();
 
-    QString token = QUuid::createUuid().toString();
+    insertSession(identity, token);
+    qInfo()<< identity->identityID()+" logged in.";
+    return token;
+}
+
+QString AuthenticationService::insertSession(iIdentityPtr identity, QString token)
+{
+    if(token.isEmpty())
+    {
+        token = QUuid::createUuid().toString();
+        _identityMutex.lock();
+        _identityTokens[identity.data()].insert(token);
+        _identityMutex.unlock();
+    }
+
+    sessionPtr session = std::make_shared<Session>();
+    session->identity = identity;
+    session->expiration = 0;
     if(identity->sessionExpiration() > 0)
     {
-        qint64 expires = QDateTime::currentDateTime().addSecs(identity->sessionExpiration()).toMSecsSinceEpoch();
-        _lock.lockForWrite();
-        _tokenToExpiration.insert(token, expires);
-        _lock.unlock();
+        session->expiration = QDateTime::currentMSecsSinceEpoch() + qint64(identity->sessionExpiration()) * 1000;
+        pushDeadline(session->expiration, token);
     }
 
-    qInfo()<< identity->identityID()+" logged in.";
-    _lock.lockForWrite();
-    _tokenToUserMap.insert(token, identity);
-    _lock.unlock();
+    shard(token).update([&](SessionMap& sessions){ sessions.insert(token, session); });
     return token;
 }
 
+AuthenticationService::sessionPtr AuthenticationService::findSession(const QString &token) const
+{
+    return shard(token).load()->value(token);
+}
+
+Snapshot<AuthenticationService::SessionMap> &AuthenticationService::shard(const QString &token)
+{
+    return _shards[qHash(token) % SESSION_SHARDS];
+}
+
+const Snapshot<AuthenticationService::SessionMap> &AuthenticationService::shard(const QString &token) const
+{
+    return _shards[qHash(token) % SESSION_SHARDS];
+}
+
+void AuthenticationService::pushDeadline(qint64 time, const QString &token)
+{
+    QMutexLocker locker(&_deadlineMutex);
+    Deadline deadline;
+    deadline.time = time;
+    deadline.token = token;
+    _deadlines.append(deadline);
+    std::push_heap(_deadlines.begin(), _deadlines.end(), std::greater<Deadline>());
+}
+
 
 bool AuthenticationService::logout(QString token)
 {
-    _lock.lockForRead();
-    iIdentityPtr identity = _tokenToUserMap.value(token, QSharedPointer<IIdentity>());
-    _lock.unlock();
-    if(!identity.isNull())
+    if(!findSession(token))
+        return false;
+
+    sessionPtr session;
+    shard(token).update([&](SessionMap& sessions){ session = sessions.take(token); });
+
+    // logged out concurrently
+    if(!session)
+        return false;
+
+    iIdentityPtr identity = session->identity;
+    _identityMutex.lock();
+    auto it = _identityTokens.find(identity.data());
+    if(it != _identityTokens.end())
     {
-        _lock.lockForWrite();
-        _tokenToUserMap.remove(token);
-        _tokenToExpiration.remove(token);
-        _lock.unlock();
-        identity->removeToken(token);
-
-        qInfo()<< identity->identityID()+" logged out.";
-        Q_EMIT sessionClosed(identity->identityID(), token);
-        return true;
+        it->remove(token);
+        if(it->isEmpty())
+            _identityTokens.erase(it);
     }
-    return false;
+    _identityMutex.unlock();
+    identity->removeToken(token);
+
+    qInfo()<< identity->identityID()+" logged out.";
+    Q_EMIT sessionClosed(identity->identityID(), token);
+    return true;
 }
 
 iUserPtr AuthenticationService::getUserForUserID(QString userID) const
@@ -236,19 +309,37 @@ bool AuthenticationService::alreadyExists(QString userID) const
 
 void AuthenticationService::checkTimeouts()
 {
-    QHashIterator<QString, qint64> it(_tokenToExpiration);
-    while(it.hasNext())
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QStringList expired;
+
+    _deadlineMutex.lock();
+    while(!_deadlines.isEmpty() && _deadlines.first().time < now)
     {
-        it.next();
-        qint64 timeout = it.value();
-        if(timeout > 0 && timeout < QDateTime::currentMSecsSinceEpoch())
-        {
-            qInfo()<< "Token expired. Identity forcibly logged out.";
-            logout(it.key());
-        }
-    }
-}
+        std::pop_heap(_deadlines.begin(), _deadlines.end(), std::greater<Deadline>());
+        Deadline deadline = _deadlines.takeLast();
 
+        // logged out sessions leave their entry, it is dropped when it is due
+        sessionPtr session = findSession(deadline.token);
+        if(!session)
+            continue;
 
+        // validateToken() only renews the expiration of the session, the entry is moved now
+        qint64 expiration = session->expiration.load();
+        if(expiration >= now)
+        {
+            deadline.time = expiration;
+            _deadlines.append(deadline);
+            std::push_heap(_deadlines.begin(), _deadlines.end(), std::greater<Deadline>());
+            continue;
+        }
 
+        expired << deadline.token;
+    }
+    _deadlineMutex.unlock();
 
+    for(int i = 0; i < expired.count(); i++)
+    {
+        qInfo()<< "Token expired. Identity forcibly logged out.";
+        logout(expired.at(i));
+    }
+}
@@ -25,8 +25,18 @@
 #include <QTimer>
 #include <QSharedPointer>
 #include <QReadWriteLock>
+#include <QHash>
+#include <QSet>
+#include <functional>
+#include <atomic>
+#include <memory>
 #include "qhcore_global.h"
 #include "../Resources/ResourceManager/IResource.h"
+#include "../Devices/Snapshot.h"
+
+// number of token maps. A login copies only the map of its shard, and the readers of different shards
+// mostly use different locks of the shared_ptr atomics (see Snapshot)
+#define SESSION_SHARDS 64
 
 class IUser;
 class IAuthenticator;
@@ -63,6 +73,8 @@ public:
                Invalid password.
         \value UserNotExists
                The user for the given userID does not exist.
+        \value Busy
+               Too many logins are verified at the moment, try again later.
     */
 
     enum ErrorCode
@@ -75,7 +87,11 @@ public:
         IncorrectPassword = -5,
         UserNotExists = -6,
         UnknownInternalError = -7,
+        Busy = -8
     };
+
+    typedef std::function<void(QString token, ErrorCode error)> LoginCallback;
+
     /*!
         \fn void AuthenticationService::registerAuthenticator(IAuthenticator* authenticator)
         This function allows to register an external authenticator-object. Subclass IAuthenticator and register its pointer with this function.
@@ -86,6 +102,8 @@ public:
         \fn void AuthenticationService::validateToken(QString token)
         This function checks if the session token exists and returns the apropriate user. The difference to AuthenticationService::getUserForToken(QString token)
         is that \c validateToken() will also renew the expiration timestamp and the last activity timestamp of the user.
+        Neither function waits for logins or logouts: the token maps are sharded immutable snapshots (see Snapshot for the short
+        lock of the pointer copy) and the expiration is renewed with an atomic store.
         If there is no session with the given token, the function will return an invalid null pointer.
         \note Don't forget to check if the returned pointer is valid!
         \sa AuthenticationService::getUserForToken()
@@ -119,6 +137,14 @@ public:
 
     QString login(iIdentityPtr identity, ErrorCode *error = nullptr);
 
+    /*!
+        \fn void loginAsync(QString userID, QString password, QObject* context, LoginCallback callback)
+        Creates a session like login() but verifies the password without blocking the calling thread (see PasswordHasher).
+        \c callback is called in the thread of \c context with the token or the error. If \c context is deleted before
+        the password was verified, no session is created.
+    */
+    void loginAsync(QString userID, QString password, QObject* context, LoginCallback callback);
+
     /*!
         \fn bool logout(QString token)
         Will remove the session and invalidate the token.
@@ -146,10 +172,36 @@ private slots:
     void checkTimeouts();
 
 private:
+    struct Session
+    {
+        iIdentityPtr            identity;
+        std::atomic<qint64>     expiration; // ms since epoch, 0 = never
+    };
+
+    struct Deadline
+    {
+        qint64      time;
+        QString     token;
+        bool operator>(const Deadline& other) const { return time > other.time; }
+    };
+
+    typedef std::shared_ptr<Session> sessionPtr;
+    typedef QHash<QString, sessionPtr> SessionMap;
+
+    QString             createSession(iUserPtr user, ErrorCode *error);
+    QString             insertSession(iIdentityPtr identity, QString token = QString());
+    sessionPtr          findSession(const QString& token) const;
+    Snapshot<SessionMap>& shard(const QString& token);
+    const Snapshot<SessionMap>& shard(const QString& token) const;
+    void                pushDeadline(qint64 time, const QString& token);
+
     QList<IAuthenticator*> _authenticators;
-    mutable QReadWriteLock _lock;
-    QHash<QString, iIdentityPtr> _tokenToUserMap;
-    QHash<QString, qint64> _tokenToExpiration;
+    mutable QReadWriteLock _lock; // guards _authenticators
+    Snapshot<SessionMap> _shards[SESSION_SHARDS]; // token -> session
+    QMutex _identityMutex;
+    QHash<IIdentity*, QSet<QString>> _identityTokens;
+    QMutex _deadlineMutex;
+    QVector<Deadline> _deadlines; // min heap of the session expirations
     QTimer _sessionTimeoutKicker;
 
 };
@@ -7,6 +7,9 @@
 #include "DefaultAuthenticator.h"
 #include "../src/Storage/FileSystemLoader.h"
 
+// user changes without explicit save (e.g. a rehashed password after a login) are written after this delay in ms
+#define USER_DEFERRED_SAVE_DELAY    10000
+
 Q_GLOBAL_STATIC(DefaultAuthenticator, defaultAuthenticator);
 
 
@@ -53,7 +56,11 @@ void DefaultAuthenticator::init(QString userDataPath)
         return;
 
     _loader = new FileSystemLoader(userDataPath, this);
+    _loader->setDurability(PersistenceScheduler::BATCHED);
     _userDataPath = userDataPath;
+    _deferredSave.setSingleShot(true);
+    _deferredSave.setInterval(USER_DEFERRED_SAVE_DELAY);
+    connect(&_deferredSave, &QTimer::timeout, this, &DefaultAuthenticator::save);
     QVariantMap data = _loader->load();
     QVariantList users = data["users"].toList();
     QListIterator<QVariant> it(users);
@@ -120,6 +127,50 @@ userPtr DefaultAuthenticator::addUser(QString userID, QString password, QString
     return userPtr();
 }
 
+void DefaultAuthenticator::addUser(QString userID, QString password, QString token, QObject *context, AddUserCallback callback)
+{
+    if(userID.isEmpty() || password.isEmpty())
+    {
+        callback(userPtr(), AuthenticationService::InvalidData);
+        return;
+    }
+
+    // checked before the expensive hash, addUser() checks again when it is done
+    if(!_everybodyCanAddUsers)
+    {
+        iIdentityPtr identity = AuthenticationService::instance()->validateToken(token);
+        if(identity.isNull() || !identity->isAuthorizedTo(ADD_USERS))
+        {
+            callback(userPtr(), AuthenticationService::PermissionDenied);
+            return;
+        }
+    }
+
+    if (AuthenticationService::instance()->alreadyExists(userID))
+    {
+        callback(userPtr(), AuthenticationService::UserAlreadyExists);
+        return;
+    }
+
+    PasswordHasher::instance()->hash(password, context, [this, userID, token, callback](QString hash)
+    {
+        if(hash.isEmpty())
+        {
+            callback(userPtr(), AuthenticationService::Busy);
+            return;
+        }
+
+        userPtr user(new User());
+        user->setPassHash(hash);
+        user->setUserID(userID);
+        user->setUserName(userID);
+
+        AuthenticationService::ErrorCode error;
+        userPtr added = addUser(user, token, &error);
+        callback(added, error);
+    });
+}
+
 userPtr DefaultAuthenticator::addUser(userPtr user, QString token, AuthenticationService::ErrorCode* error)
 {
     if(!_everybodyCanAddUsers)
@@ -192,41 +243,89 @@ AuthenticationService::ErrorCode DefaultAuthenticator::setPermission(QString tok
 }
 
 
-AuthenticationService::ErrorCode DefaultAuthenticator::changePassword(QString token, QString oldPassword, QString newPassword, QString userID)
+void DefaultAuthenticator::changePassword(QString token, QString oldPassword, QString newPassword, QString userID, QObject *context, ResultCallback callback)
 {
     iIdentityPtr identity = AuthenticationService::instance()->validateToken(token);
 
     if(identity.isNull())
-        return AuthenticationService::PermissionDenied;
+    {
+        callback(AuthenticationService::PermissionDenied);
+        return;
+    }
 
-    iUserPtr userToModify;
     if(!userID.isEmpty()) // Change password of other user
     {
         if(!identity->isAuthorizedTo(IS_ADMIN)) // can only be dony by admins
-            return AuthenticationService::PermissionDenied;
+        {
+            callback(AuthenticationService::PermissionDenied);
+            return;
+        }
 
         _lock.lockForRead();
-        userToModify = _idToUserMap.value(userID, QSharedPointer<User>());
+        iUserPtr userToModify = _idToUserMap.value(userID, QSharedPointer<User>());
         _lock.unlock();
+
+        if (userToModify.isNull() || newPassword.isEmpty())
+        {
+            callback(AuthenticationService::InvalidData);
+            return;
+        }
+
+        storePassword(userToModify, newPassword, context, callback);
+        return;
     }
-    else
+
+    iUserPtr user = qSharedPointerCast<IUser>(identity);
+    if(user.isNull() || newPassword.isEmpty())
     {
-        iUserPtr user = qSharedPointerCast<IUser>(identity);
-        if(user.isNull())
-            return AuthenticationService::InvalidData;
+        callback(AuthenticationService::InvalidData);
+        return;
+    }
+
+    // if you want to change your own password
+    user->checkPasswordAsync(oldPassword, context, [this, user, newPassword, context, callback](PasswordHasher::Result result, QString newHash)
+    {
+        Q_UNUSED(newHash)
+        if(result == PasswordHasher::Busy)
+        {
+            callback(AuthenticationService::Busy);
+            return;
+        }
 
-        if(!user->checkPassword(oldPassword)) // if you want to change your own password
-            return AuthenticationService::IncorrectPassword;
+        if(result != PasswordHasher::Valid)
+        {
+            callback(AuthenticationService::IncorrectPassword);
+            return;
+        }
 
-        userToModify = user;
+        storePassword(user, newPassword, context, callback);
+    });
+}
+
+void DefaultAuthenticator::storePassword(iUserPtr user, QString password, QObject *context, ResultCallback callback)
+{
+    userPtr castedUser = qSharedPointerCast<User>(user);
+    if(castedUser.isNull())
+    {
+        // other IUser implementations hash on their own
+        user->setPassword(password);
+        save();
+        callback(AuthenticationService::NoError);
+        return;
     }
 
-    if (userToModify.isNull() || newPassword.isEmpty())
-        return AuthenticationService::InvalidData;
+    PasswordHasher::instance()->hash(password, context, [this, castedUser, callback](QString hash)
+    {
+        if(hash.isEmpty())
+        {
+            callback(AuthenticationService::Busy);
+            return;
+        }
 
-    userToModify->setPassword(newPassword);
-    save();
-    return AuthenticationService::NoError;
+        castedUser->setPassHash(hash);
+        save();
+        callback(AuthenticationService::NoError);
+    });
 }
 
 const QVariantMap DefaultAuthenticator::getData()
@@ -253,6 +352,13 @@ void DefaultAuthenticator::addUser(userPtr user)
 {
     _users.append(user);
     _idToUserMap.insert(user->identityID(), user);
+
+    // a burst of migrated logins results in a single write of the users file
+    connect(user.data(), &IUser::dataChanged, this, [this]()
+    {
+        if(!_deferredSave.isActive())
+            _deferredSave.start();
+    });
 }
 
 void DefaultAuthenticator::save()
@@ -278,26 +384,51 @@ void DefaultAuthenticator::deleteUser(userPtr user)
 }
 
 
-AuthenticationService::ErrorCode DefaultAuthenticator::deleteUser(QString token, QString password, QString userID)
+void DefaultAuthenticator::deleteUser(QString token, QString password, QString userID, QObject *context, ResultCallback callback)
 {
     iIdentityPtr user = AuthenticationService::instance()->validateToken(token);
     if(user.isNull())
-        return AuthenticationService::PermissionDenied;
+    {
+        callback(AuthenticationService::PermissionDenied);
+        return;
+    }
 
     // check if user wants to delete itself
     if(userID.isEmpty() || userID == user->identityID())
     {
         userPtr castedUser = qSharedPointerCast<User>(user);
         if(castedUser.isNull())
-            return AuthenticationService::InvalidData;
-
-        if(castedUser->checkPassword(password))
         {
-            deleteUser(castedUser);
-            return AuthenticationService::NoError;
+            callback(AuthenticationService::InvalidData);
+            return;
         }
+
+        castedUser->checkPasswordAsync(password, context, [this, user, castedUser, userID, callback](PasswordHasher::Result result, QString newHash)
+        {
+            Q_UNUSED(newHash)
+            if(result == PasswordHasher::Busy)
+            {
+                callback(AuthenticationService::Busy);
+                return;
+            }
+
+            if(result == PasswordHasher::Valid)
+            {
+                deleteUser(castedUser);
+                callback(AuthenticationService::NoError);
+                return;
+            }
+
+            callback(deleteOtherUser(user, userID));
+        });
+        return;
     }
 
+    callback(deleteOtherUser(user, userID));
+}
+
+AuthenticationService::ErrorCode DefaultAuthenticator::deleteOtherUser(iIdentityPtr user, QString userID)
+{
     _lock.lockForRead();
     iUserPtr userToDelete = _idToUserMap.value(userID, QSharedPointer<User>());
     _lock.unlock();
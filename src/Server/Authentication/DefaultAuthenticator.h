@@ -21,6 +21,9 @@ class DefaultAuthenticator : public IAuthenticator
     Q_OBJECT
 
 public:    
+    typedef std::function<void(AuthenticationService::ErrorCode error)> ResultCallback;
+    typedef std::function<void(userPtr user, AuthenticationService::ErrorCode error)> AddUserCallback;
+
     void init(QString userDataPath);
 
     iUserPtr getUser(QString userID) override;
@@ -43,20 +46,28 @@ public:
     userPtr addUser(QString userID, QString password, QString token, AuthenticationService::ErrorCode* error = nullptr);
 
     /*!
-        \fn ErrorCode deleteUser(QString token, QString password = "", QString userID = "")
+        \fn void DefaultAuthenticator::addUser(QString userID, QString password, QString token, QObject* context, AddUserCallback callback)
+        Like addUser() above, but the password is hashed on the worker pool of the PasswordHasher. \c callback is
+        called in the thread of \c context, with AuthenticationService::Busy if the pool is busy.
+    */
+    void addUser(QString userID, QString password, QString token, QObject* context, AddUserCallback callback);
+
+    /*!
+        \fn void deleteUser(QString token, QString password, QString userID, QObject* context, ResultCallback callback)
         Call this function to delete users.
         You can either use this function to delete your own user (You don't need to provide a userID in this case but the correct password for your account) or to delete other users.
         In the second case, you don't need to provide a password when the session user has the permissions to delete users.
-
+        The password is verified on the worker pool of the PasswordHasher, \c callback is called in the thread of \c context.
     */
-    AuthenticationService::ErrorCode deleteUser(QString token, QString password = "", QString userID = "");
+    void deleteUser(QString token, QString password, QString userID, QObject* context, ResultCallback callback);
 
     /*!
-      \fn ErrorCode changePassword(QString token, QString oldPassword, QString newPassword, QString userID = "");
+      \fn void changePassword(QString token, QString oldPassword, QString newPassword, QString userID, QObject* context, ResultCallback callback);
        If you want to change your own password, \c userID can be empty but the given password needs to be correct.
        If you want to change the password of another user, the session owner needs the apropriate permissions. \c oldPassword can be empty in this case.
+       The passwords are verified and hashed on the worker pool of the PasswordHasher, \c callback is called in the thread of \c context.
     */
-    AuthenticationService::ErrorCode changePassword(QString token, QString oldPassword, QString newPassword, QString userID = "");
+    void changePassword(QString token, QString oldPassword, QString newPassword, QString userID, QObject* context, ResultCallback callback);
 
     /*!
         \fn void AuthenticationService::getUsers(QString token ="", AuthenticationService::ErrorCode* error = 0)
@@ -79,6 +90,8 @@ public:
 private:
     iUserPtr getUser(QString userID, bool caseSensitive);
     void deleteUser(userPtr user);
+    AuthenticationService::ErrorCode deleteOtherUser(iIdentityPtr user, QString userID);
+    void storePassword(iUserPtr user, QString password, QObject* context, ResultCallback callback);
     void addUser(userPtr user);
     bool _everybodyCanAddUsers = false;
     QReadWriteLock _timestampLock;
@@ -87,6 +100,7 @@ private:
     QHash<QString, userPtr> _idToUserMap;
     QVector<userPtr> _users;
     QTimer _saveTimer;
+    QTimer _deferredSave; // coalesces the saves of user changes, e.g. rehashed passwords after logins
     FileSystemLoader* _loader = nullptr;
 
 private slots:
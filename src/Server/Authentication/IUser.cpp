@@ -6,7 +6,6 @@
 
 #include "IUser.h"
 #include <QDebug>
-#include <QCryptographicHash>
 
 int IUser::instanceCount = 0;
 void IUser::addToken(QString token)
@@ -44,9 +43,15 @@ void IUser::setSessionExpiration(int timeout)
     _sessionExpiration = timeout;
 }
 
+void IUser::checkPasswordAsync(QString password, QObject *context, PasswordHasher::Callback callback)
+{
+    PasswordHasher::Result result = checkPassword(password) ? PasswordHasher::Valid : PasswordHasher::Invalid;
+    QMetaObject::invokeMethod(context, [callback, result](){ callback(result, QString()); }, Qt::QueuedConnection);
+}
+
 QString IUser::generateHash(QString pass)
 {
-    return QCryptographicHash::hash(pass.toUtf8(), QCryptographicHash::Md5).toHex();
+    return PasswordHasher::instance()->hash(pass);
 }
 
 QSet<QString> IUser::getTokens() const
@@ -13,6 +13,7 @@
 #include <QDebug>
 #include <QProcessEnvironment>
 #include "IIdentitiy.h"
+#include "PasswordHasher.h"
 
 /*!
     \class IUser
@@ -102,6 +103,14 @@ public:
     */
     virtual bool            checkPassword(QString password) = 0;
 
+    /*!
+        \fn void IUser::checkPasswordAsync(QString password, QObject* context, PasswordHasher::Callback callback)
+        Checks the password without blocking the calling thread and calls \c callback in the thread of \c context.
+        The default implementation calls the blocking checkPassword() and is meant for user databases with cheap
+        checks. Reimplement it when the check is expensive.
+    */
+    virtual void            checkPasswordAsync(QString password, QObject* context, PasswordHasher::Callback callback);
+
     /*!
         \fn QSet<QString> IUser::setPassword(QString password) const
         Store the new password (no, not the password - use hashes!). Return false when something went wrong.
@@ -144,6 +153,10 @@ private:
     static int      instanceCount;
 
 protected:
+    /*!
+        \fn QString IUser::generateHash(QString pass)
+        Returns a new salted hash of the password, see PasswordHasher.
+    */
     QString generateHash(QString pass);
 
 signals:
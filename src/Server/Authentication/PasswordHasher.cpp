@@ -0,0 +1,302 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "PasswordHasher.h"
+#include <QCryptographicHash>
+#include <QMessageAuthenticationCode>
+#include <QRandomGenerator>
+#include <QProcessEnvironment>
+#include <QDateTime>
+#include <QPointer>
+#include <QThread>
+#include <QtConcurrent>
+
+#define PASSWORD_HASH_SCHEME        "pbkdf2-sha256"
+#define PASSWORD_HASH_ITERATIONS    100000
+#define PASSWORD_HASH_QUEUE         256
+#define PASSWORD_VERIFY_SHARE       0.75 // share of the queue logins may use, the rest is reserved for new hashes
+#define PASSWORD_VERIFY_PER_ACCOUNT 4    // pending verifications per stored hash
+#define PASSWORD_CACHE_TTL          600
+#define PASSWORD_CACHE_SIZE         4096
+#define PASSWORD_SALT_SIZE          16
+#define PASSWORD_KEY_SIZE           32
+
+Q_GLOBAL_STATIC(PasswordHasher, passwordHasher);
+
+PasswordHasher::PasswordHasher(QObject *parent) : QObject(parent)
+{
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    _iterations = qMax(1, env.value("PASSWORD_HASH_ITERATIONS", QString::number(PASSWORD_HASH_ITERATIONS)).toInt());
+    _queueLimit = qMax(1, env.value("PASSWORD_HASH_QUEUE", QString::number(PASSWORD_HASH_QUEUE)).toInt());
+    _cacheTTL = env.value("PASSWORD_CACHE_TTL", QString::number(PASSWORD_CACHE_TTL)).toLongLong() * 1000;
+
+    // leave the other cores to the device connections
+    int threads = env.value("PASSWORD_HASH_THREADS", QString::number(qMax(1, QThread::idealThreadCount() / 2))).toInt();
+    _pool.setMaxThreadCount(qMax(1, threads));
+
+    _cacheKey.resize(PASSWORD_KEY_SIZE);
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32*>(_cacheKey.data()), PASSWORD_KEY_SIZE / 4);
+}
+
+PasswordHasher::~PasswordHasher()
+{
+    _pool.waitForDone();
+}
+
+PasswordHasher *PasswordHasher::instance()
+{
+    return passwordHasher;
+}
+
+QString PasswordHasher::hash(QString password)
+{
+    QByteArray salt(PASSWORD_SALT_SIZE, 0);
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32*>(salt.data()), PASSWORD_SALT_SIZE / 4);
+    QByteArray key = pbkdf2(password.toUtf8(), salt, _iterations, PASSWORD_KEY_SIZE);
+    return QString(PASSWORD_HASH_SCHEME) + "$" + QString::number(_iterations) + "$" + QString::fromLatin1(salt.toBase64()) + "$" + QString::fromLatin1(key.toBase64());
+}
+
+void PasswordHasher::hash(QString password, QObject *context, HashCallback callback)
+{
+    if(!context)
+    {
+        qWarning()<<"Warning: PasswordHasher::hash called without context, request dropped.";
+        return;
+    }
+
+    QPointer<QObject> guard(context);
+    if(!acquire(QString()))
+    {
+        qWarning()<<"Warning: Too many pending password hashes, request rejected.";
+        QMetaObject::invokeMethod(context, [callback](){ callback(QString()); }, Qt::QueuedConnection);
+        return;
+    }
+
+    QtConcurrent::run(&_pool, [=]()
+    {
+        QString result = hash(password);
+        release(QString());
+
+        if(guard)
+            QMetaObject::invokeMethod(guard.data(), [callback, result](){ callback(result); }, Qt::QueuedConnection);
+    });
+}
+
+PasswordHasher::Result PasswordHasher::verify(QString password, QString storedHash, QString *newHash)
+{
+    bool outdated = isOutdated(storedHash);
+    if(!outdated && isCached(password, storedHash))
+        return Valid;
+
+    if(!compute(password, storedHash))
+        return Invalid;
+
+    if(outdated && newHash)
+        *newHash = hash(password);
+    else
+        cache(password, storedHash);
+
+    return Valid;
+}
+
+void PasswordHasher::verify(QString password, QString storedHash, QObject *context, Callback callback)
+{
+    if(!context)
+    {
+        qWarning()<<"Warning: PasswordHasher::verify called without context, request dropped.";
+        return;
+    }
+
+    QPointer<QObject> guard(context);
+    bool outdated = isOutdated(storedHash);
+    if(!outdated && isCached(password, storedHash))
+    {
+        QMetaObject::invokeMethod(context, [callback](){ callback(Valid, QString()); }, Qt::QueuedConnection);
+        return;
+    }
+
+    if(!acquire(storedHash))
+    {
+        qWarning()<<"Warning: Too many pending password verifications, login rejected.";
+        QMetaObject::invokeMethod(context, [callback](){ callback(Busy, QString()); }, Qt::QueuedConnection);
+        return;
+    }
+
+    QtConcurrent::run(&_pool, [=]()
+    {
+        QString newHash;
+        Result result = verify(password, storedHash, outdated ? &newHash : nullptr);
+        release(storedHash);
+
+        if(guard)
+            QMetaObject::invokeMethod(guard.data(), [callback, result, newHash](){ callback(result, newHash); }, Qt::QueuedConnection);
+    });
+}
+
+bool PasswordHasher::isOutdated(QString storedHash) const
+{
+    QStringList parts = storedHash.split('$');
+    if(parts.count() != 4 || parts.at(0) != PASSWORD_HASH_SCHEME)
+        return true;
+
+    return parts.at(1).toInt() < _iterations;
+}
+
+QByteArray PasswordHasher::pbkdf2(const QByteArray &password, const QByteArray &salt, int iterations, int length)
+{
+    QMessageAuthenticationCode hmac(QCryptographicHash::Sha256, password);
+    QByteArray key;
+
+    for(quint32 block = 1; key.size() < length; block++)
+    {
+        QByteArray index(4, 0);
+        index[0] = char(block >> 24);
+        index[1] = char(block >> 16);
+        index[2] = char(block >> 8);
+        index[3] = char(block);
+
+        hmac.reset();
+        hmac.addData(salt);
+        hmac.addData(index);
+        QByteArray u = hmac.result();
+        QByteArray t = u;
+
+        for(int i = 1; i < iterations; i++)
+        {
+            hmac.reset();
+            hmac.addData(u);
+            u = hmac.result();
+            for(int j = 0; j < t.size(); j++)
+                t[j] = char(t.at(j) ^ u.at(j));
+        }
+        key.append(t);
+    }
+
+    return key.left(length);
+}
+
+bool PasswordHasher::acquire(const QString &storedHash)
+{
+    // verifications (storedHash set) can't take the whole queue or pile up for a single account,
+    // so wrong passwords sent in a loop neither block other accounts nor new hashes
+    QMutexLocker locker(&_queueMutex);
+    if(storedHash.isEmpty())
+    {
+        if(_queued >= _queueLimit)
+            return false;
+    }
+    else
+    {
+        if(_verifications >= qMax(1, int(_queueLimit * PASSWORD_VERIFY_SHARE)) || _pendingPerHash.value(storedHash) >= PASSWORD_VERIFY_PER_ACCOUNT)
+            return false;
+
+        _verifications++;
+        _pendingPerHash[storedHash]++;
+    }
+
+    _queued++;
+    return true;
+}
+
+void PasswordHasher::release(const QString &storedHash)
+{
+    QMutexLocker locker(&_queueMutex);
+    _queued--;
+    if(storedHash.isEmpty())
+        return;
+
+    _verifications--;
+    if(--_pendingPerHash[storedHash] <= 0)
+        _pendingPerHash.remove(storedHash);
+}
+
+bool PasswordHasher::equals(const QByteArray &a, const QByteArray &b)
+{
+    // constant time, the duration must not reveal how many bytes matched
+    if(a.size() != b.size())
+        return false;
+
+    char diff = 0;
+    for(int i = 0; i < a.size(); i++)
+        diff |= a.at(i) ^ b.at(i);
+
+    return diff == 0;
+}
+
+bool PasswordHasher::compute(const QString &password, const QString &storedHash) const
+{
+    QStringList parts = storedHash.split('$');
+    if(parts.count() == 1)
+    {
+        // legacy unsalted MD5
+        QByteArray legacy = QCryptographicHash::hash(password.toUtf8(), QCryptographicHash::Md5).toHex();
+        return equals(legacy, storedHash.toLatin1());
+    }
+
+    if(parts.count() != 4 || parts.at(0) != PASSWORD_HASH_SCHEME)
+        return false;
+
+    int iterations = parts.at(1).toInt();
+    QByteArray salt = QByteArray::fromBase64(parts.at(2).toLatin1());
+    QByteArray expected = QByteArray::fromBase64(parts.at(3).toLatin1());
+    if(iterations < 1 || expected.isEmpty())
+        return false;
+
+    return equals(pbkdf2(password.toUtf8(), salt, iterations, expected.size()), expected);
+}
+
+QByteArray PasswordHasher::cacheDigest(const QString &password) const
+{
+    return QMessageAuthenticationCode::hash(password.toUtf8(), _cacheKey, QCryptographicHash::Sha256);
+}
+
+bool PasswordHasher::isCached(const QString &password, const QString &storedHash)
+{
+    if(_cacheTTL <= 0)
+        return false;
+
+    QByteArray digest = cacheDigest(password);
+    QMutexLocker locker(&_cacheMutex);
+    auto it = _cache.find(storedHash);
+    if(it == _cache.end())
+        return false;
+
+    if(it->expires < QDateTime::currentMSecsSinceEpoch())
+    {
+        _cache.erase(it);
+        return false;
+    }
+
+    return equals(it->digest, digest);
+}
+
+void PasswordHasher::cache(const QString &password, const QString &storedHash)
+{
+    if(_cacheTTL <= 0)
+        return;
+
+    CacheEntry entry;
+    entry.digest = cacheDigest(password);
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    entry.expires = now + _cacheTTL;
+
+    QMutexLocker locker(&_cacheMutex);
+    if(_cache.count() >= PASSWORD_CACHE_SIZE)
+    {
+        auto it = _cache.begin();
+        while(it != _cache.end())
+        {
+            if(it->expires < now)
+                it = _cache.erase(it);
+            else
+                ++it;
+        }
+
+        if(_cache.count() >= PASSWORD_CACHE_SIZE)
+            _cache.clear();
+    }
+    _cache.insert(storedHash, entry);
+}
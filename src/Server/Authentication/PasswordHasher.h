@@ -0,0 +1,131 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef PASSWORDHASHER_H
+#define PASSWORDHASHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QThreadPool>
+#include <functional>
+
+/*!
+    \class PasswordHasher
+    \brief Salted, cost tunable password hashes which are verified on a bounded worker pool.
+    \ingroup authentication
+
+    New hashes are PBKDF2-HMAC-SHA256 with a random 16 byte salt, stored as
+    <code>pbkdf2-sha256$iterations$salt$hash</code> (salt and hash base64 encoded). The number of iterations is
+    taken from the environment variable PASSWORD_HASH_ITERATIONS (default 100000) and stored with every hash, so it
+    can be raised at any time. Unsalted MD5 hashes of older versions are still accepted. They and hashes with fewer
+    iterations are reported as outdated and replaced on the next successful login.
+
+    verify() and hash() run the key derivation on a pool of PASSWORD_HASH_THREADS threads (default: half of the
+    cores) so a login spike never blocks the event loops which serve the devices. At most PASSWORD_HASH_QUEUE
+    requests wait for the pool, further requests are rejected instead of piling up. Verifications may only use
+    PASSWORD_VERIFY_SHARE of the queue and PASSWORD_VERIFY_PER_ACCOUNT requests per stored hash, so wrong passwords
+    sent in a loop neither make the logins of other accounts Busy nor block new hashes.
+
+    Successful verifications are cached for PASSWORD_CACHE_TTL seconds. The cache stores a keyed digest of the
+    password, never the password itself; a reconnecting client does not pay for the key derivation again.
+
+    \sa IUser, AuthenticationService
+*/
+
+class PasswordHasher : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Result
+    {
+        Valid,
+        Invalid,
+        Busy
+    };
+
+    /*!
+        \typedef PasswordHasher::Callback
+        Receives the result of a verification and, if the stored hash is outdated and the password was valid,
+        a new hash of the password. \c newHash is empty otherwise.
+    */
+    typedef std::function<void(Result result, QString newHash)> Callback;
+
+    /*!
+        \typedef PasswordHasher::HashCallback
+        Receives the new hash of the password, an empty string if the request was rejected because the pool is busy.
+    */
+    typedef std::function<void(QString hash)> HashCallback;
+
+    explicit PasswordHasher(QObject *parent = nullptr);
+    ~PasswordHasher();
+    static PasswordHasher* instance();
+
+    /*!
+        \fn QString PasswordHasher::hash(QString password)
+        Returns a new salted hash of the password. Blocks for the time of the key derivation.
+    */
+    QString     hash(QString password);
+
+    /*!
+        \fn void PasswordHasher::hash(QString password, QObject* context, HashCallback callback)
+        Hashes the password on the worker pool and calls \c callback in the thread of \c context.
+        The callback is dropped if \c context is null or was deleted in the meantime.
+    */
+    void        hash(QString password, QObject* context, HashCallback callback);
+
+    /*!
+        \fn PasswordHasher::Result PasswordHasher::verify(QString password, QString storedHash, QString* newHash = nullptr)
+        Verifies the password synchronously. Never returns Busy.
+    */
+    Result      verify(QString password, QString storedHash, QString* newHash = nullptr);
+
+    /*!
+        \fn void PasswordHasher::verify(QString password, QString storedHash, QObject* context, Callback callback)
+        Verifies the password on the worker pool and calls \c callback in the thread of \c context.
+        The callback is dropped if \c context is null or was deleted in the meantime.
+    */
+    void        verify(QString password, QString storedHash, QObject* context, Callback callback);
+
+    /*!
+        \fn bool PasswordHasher::isOutdated(QString storedHash) const
+        Returns true if the hash is a legacy MD5 hash or uses fewer iterations than configured.
+    */
+    bool        isOutdated(QString storedHash) const;
+
+private:
+    struct CacheEntry
+    {
+        QByteArray  digest;
+        qint64      expires = 0;
+    };
+
+    static QByteArray   pbkdf2(const QByteArray& password, const QByteArray& salt, int iterations, int length);
+    static bool         equals(const QByteArray& a, const QByteArray& b);
+    bool                compute(const QString& password, const QString& storedHash) const;
+    QByteArray          cacheDigest(const QString& password) const;
+    bool                isCached(const QString& password, const QString& storedHash);
+    void                cache(const QString& password, const QString& storedHash);
+    bool                acquire(const QString& storedHash);
+    void                release(const QString& storedHash);
+
+    int                 _iterations;
+    int                 _queueLimit;
+    qint64              _cacheTTL;
+    QByteArray          _cacheKey;
+    QThreadPool         _pool;
+
+    QMutex                          _queueMutex;
+    int                             _queued = 0;
+    int                             _verifications = 0;
+    QHash<QString, int>             _pendingPerHash; // stored hash -> pending verifications
+
+    QMutex                          _cacheMutex;
+    QHash<QString, CacheEntry>      _cache; // stored hash -> digest of the verified password
+};
+
+#endif // PASSWORDHASHER_H
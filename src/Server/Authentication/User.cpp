@@ -7,6 +7,7 @@
 #include "User.h"
 #include <QVariant>
 #include <QDebug>
+#include <QPointer>
 
 
 User::User(QObject *parent) : IUser(parent)
@@ -180,7 +181,36 @@ QVariantMap User::getUserData() const
 
 bool User::checkPassword(QString password)
 {
-    return generateHash(password) == _passHash;
+    QString oldHash = _passHash;
+    QString newHash;
+    if(PasswordHasher::instance()->verify(password, oldHash, &newHash) != PasswordHasher::Valid)
+        return false;
+
+    updatePassHash(oldHash, newHash);
+    return true;
+}
+
+void User::checkPasswordAsync(QString password, QObject *context, PasswordHasher::Callback callback)
+{
+    QPointer<User> self(this);
+    QString oldHash = _passHash;
+    PasswordHasher::instance()->verify(password, oldHash, context, [self, oldHash, callback](PasswordHasher::Result result, QString newHash)
+    {
+        if(self && result == PasswordHasher::Valid)
+            QMetaObject::invokeMethod(self.data(), [self, oldHash, newHash](){ if(self) self->updatePassHash(oldHash, newHash); });
+
+        callback(result, newHash);
+    });
+}
+
+void User::updatePassHash(const QString &oldHash, const QString &newHash)
+{
+    // rehash of a legacy or outdated hash after a successful login, unless the password was changed meanwhile
+    if(newHash.isEmpty() || _passHash != oldHash)
+        return;
+
+    setPassHash(newHash);
+    Q_EMIT dataChanged();
 }
 
 bool User::setPassword(QString password, bool isTemporary)
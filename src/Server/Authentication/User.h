@@ -34,6 +34,7 @@ public:
     QSet<QString> getSteadyTokens() const override;
 
     bool checkPassword(QString password) override;
+    void checkPasswordAsync(QString password, QObject* context, PasswordHasher::Callback callback) override;
     void setUserData(const QVariantMap &userData);
     bool setEMail(const QString &getEMail) override;
     bool isAuthorizedTo(QString permission) override;
@@ -47,6 +48,7 @@ protected:
     explicit User(QVariantMap variant, QObject* parent = nullptr);
     void setUserID(const QString &identityID);
     void setPassHash(const QString &passHash);
+    void updatePassHash(const QString &oldHash, const QString &newHash);
 
     void setGroup(const QString &group);
 
@@ -0,0 +1,101 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "AutomationEngine.h"
+#include "AutomationWorker.h"
+#include <QThread>
+#include <QDateTime>
+#include <QQmlEngine>
+#include <QDebug>
+#include "QmlComponents/AutomationRule.h"
+#include "QmlComponents/DeviceQmlAdapter.h"
+
+#define AUTOMATION_WATCHDOG_INTERVAL    250
+#define AUTOMATION_WATCHDOG_TIMEOUT     2000
+
+AutomationEngine::AutomationEngine(int workers, QObject *parent) : QObject(parent)
+{
+    qmlRegisterType<AutomationRule>("QuickHub.Automation", 1, 0, "AutomationRule");
+    qmlRegisterType<DeviceQmlAdapter>("QuickHub.Automation", 1, 0, "Device");
+
+    if(workers <= 0)
+        workers = qMax(1, QThread::idealThreadCount() - 1);
+
+    for(int i = 0; i < workers; i++)
+    {
+        QThread* thread = new QThread(this);
+        AutomationWorker* worker = new AutomationWorker();
+        worker->moveToThread(thread);
+        connect(thread, &QThread::started, worker, &AutomationWorker::start);
+        connect(thread, &QThread::finished, worker, &QObject::deleteLater);
+        thread->setObjectName("Automation " + QString::number(i));
+        thread->start();
+
+        _threads << thread;
+        _workers << worker;
+    }
+
+    _watchdog.setInterval(AUTOMATION_WATCHDOG_INTERVAL);
+    connect(&_watchdog, &QTimer::timeout, this, &AutomationEngine::checkWorkers);
+    _watchdog.start();
+}
+
+AutomationEngine::~AutomationEngine()
+{
+    for(int i = 0; i < _workers.count(); i++)
+        _workers.at(i)->interrupt();
+
+    for(int i = 0; i < _threads.count(); i++)
+    {
+        _threads.at(i)->quit();
+        _threads.at(i)->wait();
+    }
+}
+
+void AutomationEngine::addRule(QString id, QString qmlCode)
+{
+    AutomationWorker* worker = _rules.value(id, nullptr);
+    if(!worker)
+    {
+        worker = _workers.first();
+        for(int i = 1; i < _workers.count(); i++)
+        {
+            if(_workers.at(i)->ruleCount() < worker->ruleCount())
+                worker = _workers.at(i);
+        }
+        _rules.insert(id, worker);
+    }
+
+    QMetaObject::invokeMethod(worker, "loadRule", Qt::QueuedConnection, Q_ARG(QString, id), Q_ARG(QString, qmlCode));
+}
+
+void AutomationEngine::removeRule(QString id)
+{
+    AutomationWorker* worker = _rules.take(id);
+    if(worker)
+        QMetaObject::invokeMethod(worker, "unloadRule", Qt::QueuedConnection, Q_ARG(QString, id));
+}
+
+void AutomationEngine::checkWorkers()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for(int i = 0; i < _workers.count(); i++)
+    {
+        AutomationWorker* worker = _workers.at(i);
+        qint64 busySince = worker->busySince();
+        if(busySince == 0 || now - busySince < AUTOMATION_WATCHDOG_TIMEOUT || _interrupted.value(worker) == busySince)
+            continue;
+
+        QString rule = worker->busyRule();
+        if(rule.isEmpty())
+            qWarning()<<"Warning: Automation code in"<<_threads.at(i)->objectName()<<"is running for"<<now - busySince<<"ms, interrupting it.";
+        else
+            qWarning()<<"Warning: Automation rule"<<rule<<"is running for"<<now - busySince<<"ms, interrupting it.";
+
+        _interrupted.insert(worker, busySince);
+        worker->interrupt(busySince);
+    }
+}
@@ -8,26 +8,57 @@
 #define QUICKENGINE_H
 
 #include <QObject>
-#include <QQmlComponent>
-#include <QQmlEngine>
 #include <QHash>
+#include <QVector>
+#include <QTimer>
 
-class AutomationRule;
+class QThread;
+class AutomationWorker;
+
+/*!
+    \class AutomationEngine
+    \brief Runs QML automation rules in a pool of worker threads.
+    \ingroup automation
+
+    Each worker thread has its own QQmlEngine (see AutomationWorker). A new rule is assigned to the worker with the
+    fewest rules and stays there, so slow rules never block the socket I/O of the main thread and only compete with
+    the rules of their own worker.
+
+    A watchdog checks the workers every AUTOMATION_WATCHDOG_INTERVAL ms. A rule which runs longer than
+    AUTOMATION_WATCHDOG_TIMEOUT ms without returning to the event loop is interrupted and unloaded. This includes
+    the device signal and Timer handlers of the rule; other long running code of a worker is interrupted only.
+
+    \sa AutomationWorker, AutomationRule, DeviceQmlAdapter
+*/
 class AutomationEngine : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit AutomationEngine(QObject *parent = 0);
-    QObject* instanciateRule(QString qmlCode);
+    /*!
+        \fn AutomationEngine::AutomationEngine(int workers, QObject *parent)
+        Starts the worker threads. If workers is 0, QThread::idealThreadCount() - 1 (at least one) threads are used.
+    */
+    explicit AutomationEngine(int workers = 0, QObject *parent = 0);
+    ~AutomationEngine();
 
-private:
-    QQmlEngine*                     _engine;
-    QHash<QString, AutomationRule*> _rules;
+    /*!
+        \fn void AutomationEngine::addRule(QString id, QString qmlCode)
+        Loads (or replaces) a rule. The root object of the QML code must be an AutomationRule.
+        This function is asynchronous, errors are logged by the worker.
+    */
+    void addRule(QString id, QString qmlCode);
+    void removeRule(QString id);
 
-signals:
+private:
+    QVector<QThread*>                   _threads;
+    QVector<AutomationWorker*>          _workers;
+    QHash<QString, AutomationWorker*>   _rules;
+    QHash<AutomationWorker*, qint64>    _interrupted; // worker -> busySince() of the interrupted run
+    QTimer                              _watchdog;
 
-public slots:
+private slots:
+    void checkWorkers();
 };
 
 #endif // QUICKENGINE_H
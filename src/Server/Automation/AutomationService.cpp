@@ -0,0 +1,61 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "AutomationService.h"
+#include "RuleEngine.h"
+#include "Server/Authentication/AuthentificationService.h"
+#include "Server/Authentication/IUser.h"
+
+AutomationService::AutomationService(QObject* parent) : IService(parent)
+{
+}
+
+QString AutomationService::getServiceName() const
+{
+    return "automation";
+}
+
+QStringList AutomationService::getServiceCalls() const
+{
+    QStringList calls;
+    calls << "addRule" << "removeRule" << "getRules";
+    return calls;
+}
+
+bool AutomationService::call(QString call, QString token, QString cbID, QVariant argument)
+{
+    QVariantMap answer;
+    iIdentityPtr user = AuthenticationService::instance()->validateToken(token);
+    if(user.isNull() || !user->isAuthorizedTo(IS_ADMIN))
+    {
+        answer["errorstring"] = "Permission denied";
+        answer["errorcode"] = Err::PERMISSION_DENIED;
+        Q_EMIT response(cbID, answer);
+        return true;
+    }
+
+    if(call == "addRule")
+    {
+        answer["errorcode"] = RuleEngine::instance()->addRule(argument.toMap());
+        if(answer["errorcode"].toInt() != Err::NO_ERROR)
+            answer["errorstring"] = "Invalid rule";
+    }
+    else if(call == "removeRule")
+    {
+        bool removed = RuleEngine::instance()->removeRule(argument.toMap()["id"].toString());
+        answer["errorcode"] = removed ? Err::NO_ERROR : Err::INVALID_DATA;
+    }
+    else if(call == "getRules")
+    {
+        answer["errorcode"] = Err::NO_ERROR;
+        answer["rules"] = RuleEngine::instance()->rules();
+    }
+    else
+        return false;
+
+    Q_EMIT response(cbID, answer);
+    return true;
+}
@@ -0,0 +1,38 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef AUTOMATIONSERVICE_H
+#define AUTOMATIONSERVICE_H
+
+#include <QObject>
+#include "Server/Services/IService.h"
+
+/*!
+    \class AutomationService
+    \brief This class implements a service to manage the rules of the RuleEngine.
+    \ingroup automation
+    \inherits IService
+
+    All calls require a user with admin permissions.
+
+    addRule             - adds or replaces a rule, the argument is the rule definition (see RuleEngine)
+    removeRule          - removes a rule ({id})
+    getRules            - returns all rule definitions with their current state ("active")
+
+    \sa RuleEngine
+*/
+class AutomationService : public IService
+{
+    Q_OBJECT
+
+public:
+    AutomationService(QObject* parent = nullptr);
+    virtual QString         getServiceName() const override;
+    virtual QStringList     getServiceCalls() const override;
+    virtual bool            call(QString call, QString token, QString cbID, QVariant argument = QVariant()) override;
+};
+
+#endif // AUTOMATIONSERVICE_H
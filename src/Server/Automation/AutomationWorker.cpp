@@ -0,0 +1,382 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "AutomationWorker.h"
+#include <QQmlEngine>
+#include <QQmlComponent>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QTimer>
+#include <QAbstractEventDispatcher>
+#include <QDebug>
+#include "QmlComponents/AutomationRule.h"
+#include "QmlComponents/DeviceQmlAdapter.h"
+#include "Server/Devices/DeviceManager.h"
+
+// processing time of a rule per budget window in ms
+#define AUTOMATION_RULE_BUDGET      100
+#define AUTOMATION_BUDGET_WINDOW    1000
+
+AutomationWorker::AutomationWorker(QObject *parent) : QObject(parent),
+    _busySince(0),
+    _ruleCount(0)
+{
+}
+
+AutomationWorker::~AutomationWorker()
+{
+    QHashIterator<QString, RuleSlot> it(_rules);
+    while(it.hasNext())
+        delete it.next().value().rule;
+}
+
+AutomationWorker *AutomationWorker::forObject(QObject *object)
+{
+    QQmlEngine* engine = qmlEngine(object);
+    return engine ? qobject_cast<AutomationWorker*>(engine->parent()) : nullptr;
+}
+
+void AutomationWorker::subscribe(DeviceQmlAdapter *adapter, deviceHandlePtr handle)
+{
+    unsubscribe(adapter);
+    if(handle.isNull())
+        return;
+
+    // keyed by the handle, temporary handles have no uuid and the uuid of a handle may change
+    DeviceHandle* key = handle.data();
+    _adapters.insert(key, adapter);
+    _adapterRules.insert(adapter, _currentRule);
+
+    Subscription& subscription = _subscriptions[key];
+    if(subscription.count++ > 0)
+        return;
+
+    // direct connection, the changes are merged in the thread of the device and delivered in batches
+    subscription.handle = handle;
+    subscription.connection = connect(key, &DeviceHandle::propertiesChanged, this, [this, key](QString uuid, QVariantMap changes)
+    {
+        Q_UNUSED(uuid)
+        propertiesChanged(key, changes);
+    }, Qt::DirectConnection);
+}
+
+void AutomationWorker::run(DeviceQmlAdapter *adapter, std::function<void()> handler)
+{
+    QString ruleId = _adapterRules.value(adapter);
+
+    QElapsedTimer timer;
+    timer.start();
+    enter(ruleId);
+    handler();
+    leave();
+    account(ruleId, timer.elapsed());
+
+    if(_faulted.contains(ruleId))
+        scheduleFlush(0);
+}
+
+void AutomationWorker::unsubscribe(DeviceQmlAdapter *adapter)
+{
+    if(!_adapterRules.contains(adapter))
+        return;
+
+    _adapterRules.remove(adapter);
+    DeviceHandle* key = _adapters.key(adapter);
+    _adapters.remove(key, adapter);
+
+    if(--_subscriptions[key].count > 0)
+        return;
+
+    disconnect(_subscriptions.take(key).connection);
+}
+
+qint64 AutomationWorker::busySince() const
+{
+    return _busySince;
+}
+
+QString AutomationWorker::busyRule() const
+{
+    QMutexLocker locker(&_mutex);
+    return _busyRule;
+}
+
+void AutomationWorker::interrupt(qint64 busySince)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    // mark() ends a run under the same mutex, so the flag can not hit the code which runs next
+    QMutexLocker locker(&_mutex);
+    if(busySince != 0 && _busySince != busySince)
+        return;
+
+    // thread safe, aborts the running JavaScript code
+    if(_engine)
+        _engine->setInterrupted(true);
+#else
+    Q_UNUSED(busySince)
+#endif
+}
+
+int AutomationWorker::ruleCount() const
+{
+    return _ruleCount;
+}
+
+void AutomationWorker::start()
+{
+    _engine = new QQmlEngine(this);
+
+    // times everything the worker thread runs, not only the rule code between enter() and leave()
+    QAbstractEventDispatcher* dispatcher = QAbstractEventDispatcher::instance(thread());
+    connect(dispatcher, &QAbstractEventDispatcher::awake, this, &AutomationWorker::awake, Qt::DirectConnection);
+    connect(dispatcher, &QAbstractEventDispatcher::aboutToBlock, this, &AutomationWorker::aboutToBlock, Qt::DirectConnection);
+}
+
+void AutomationWorker::loadRule(QString id, QString qmlCode)
+{
+    unloadRule(id);
+
+    QQmlComponent component(_engine);
+    component.setData(qmlCode.toUtf8(), QUrl());
+
+    enter(id);
+    QObject* object = component.create();
+    leave();
+
+    AutomationRule* rule = qobject_cast<AutomationRule*>(object);
+    if(!rule || _faulted.removeAll(id) > 0)
+    {
+        qWarning()<<"Warning: Could not load automation rule"<<id<<component.errorString();
+        unloadRule(id);
+        delete object;
+        return;
+    }
+
+    _rules[id].rule = rule;
+    _ruleCount = _rules.count();
+
+    // the handler of a Timer runs before the regular connections of triggered(), so timerTriggered() accounts it
+    QList<QObject*> objects = rule->findChildren<QObject*>();
+    for(int i = 0; i < objects.count(); i++)
+    {
+        if(objects.at(i)->metaObject()->indexOfSignal("triggered()") < 0)
+            continue;
+
+        _timers.insert(objects.at(i), id);
+        connect(objects.at(i), SIGNAL(triggered()), this, SLOT(timerTriggered()), Qt::DirectConnection);
+    }
+}
+
+void AutomationWorker::unloadRule(QString id)
+{
+    QList<DeviceQmlAdapter*> adapters = _adapterRules.keys(id);
+    for(int i = 0; i < adapters.count(); i++)
+        unsubscribe(adapters.at(i));
+
+    auto it = _timers.begin();
+    while(it != _timers.end())
+    {
+        if(it.value() == id)
+            it = _timers.erase(it);
+        else
+            ++it;
+    }
+
+    delete _rules.take(id).rule;
+    _ruleCount = _rules.count();
+}
+
+void AutomationWorker::propertiesChanged(DeviceHandle *handle, QVariantMap changes)
+{
+    QMutexLocker locker(&_mutex);
+    bool first = _pending.isEmpty();
+    merge(_pending[handle], changes);
+    locker.unlock();
+
+    if(first)
+        QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
+}
+
+void AutomationWorker::merge(QVariantMap &changes, const QVariantMap &update)
+{
+    QMapIterator<QString, QVariant> it(update);
+    while(it.hasNext())
+    {
+        it.next();
+        QVariantMap change = changes.value(it.key()).toMap();
+        QVariantMap next = it.value().toMap();
+        QMapIterator<QString, QVariant> field(next);
+        while(field.hasNext())
+        {
+            field.next();
+            change.insert(field.key(), field.value());
+        }
+        changes.insert(it.key(), change);
+    }
+}
+
+void AutomationWorker::deliver(const QString &ruleId, DeviceHandle *handle, const QVariantMap &changes)
+{
+    RuleSlot& slot = _rules[ruleId];
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if(now - slot.windowStart >= AUTOMATION_BUDGET_WINDOW)
+    {
+        slot.windowStart = now;
+        slot.used = 0;
+    }
+
+    if(slot.used >= AUTOMATION_RULE_BUDGET)
+    {
+        merge(slot.deferred[handle], changes);
+        scheduleFlush(int(slot.windowStart + AUTOMATION_BUDGET_WINDOW - now));
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    enter(ruleId);
+
+    QList<DeviceQmlAdapter*> adapters = _adapters.values(handle);
+    for(int i = 0; i < adapters.count(); i++)
+    {
+        if(_adapterRules.value(adapters.at(i)) == ruleId)
+            adapters.at(i)->applyChanges(changes);
+    }
+
+    leave();
+    account(ruleId, timer.elapsed());
+}
+
+void AutomationWorker::account(const QString &ruleId, qint64 used)
+{
+    if(!_rules.contains(ruleId))
+        return;
+
+    RuleSlot& slot = _rules[ruleId];
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if(now - slot.windowStart >= AUTOMATION_BUDGET_WINDOW)
+    {
+        slot.windowStart = now;
+        slot.used = 0;
+    }
+    slot.used += used;
+}
+
+void AutomationWorker::enter(const QString &ruleId)
+{
+    _currentRule = ruleId;
+    if(mark(ruleId, QDateTime::currentMSecsSinceEpoch()))
+        qWarning()<<"Warning: Interrupted automation code which could not be assigned to a rule.";
+}
+
+void AutomationWorker::leave()
+{
+    // the rest of the event loop iteration is timed without a rule
+    if(mark(QString(), QDateTime::currentMSecsSinceEpoch()))
+        _faulted << _currentRule;
+}
+
+bool AutomationWorker::mark(const QString &ruleId, qint64 since)
+{
+    // ends the current run and returns true if it was interrupted
+    QMutexLocker locker(&_mutex);
+    _busyRule = ruleId;
+    _busySince = since;
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    if(_engine && _engine->isInterrupted())
+    {
+        _engine->setInterrupted(false);
+        return true;
+    }
+#endif
+    return false;
+}
+
+void AutomationWorker::awake()
+{
+    if(mark(QString(), QDateTime::currentMSecsSinceEpoch()))
+        qWarning()<<"Warning: Interrupted automation code which could not be assigned to a rule.";
+}
+
+void AutomationWorker::aboutToBlock()
+{
+    if(mark(QString(), 0))
+        qWarning()<<"Warning: Interrupted automation code which could not be assigned to a rule.";
+}
+
+void AutomationWorker::timerTriggered()
+{
+    // everything since the last mark() belongs to the handler of this timer
+    QString ruleId = _timers.value(sender());
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    qint64 started = _busySince;
+    if(started > 0)
+        account(ruleId, now - started);
+
+    if(mark(QString(), now) && !ruleId.isEmpty())
+    {
+        _faulted << ruleId;
+        scheduleFlush(0);
+    }
+}
+
+void AutomationWorker::scheduleFlush(int delay)
+{
+    if(_flushScheduled)
+        return;
+
+    _flushScheduled = true;
+    QTimer::singleShot(qMax(0, delay), this, &AutomationWorker::flush);
+}
+
+void AutomationWorker::flush()
+{
+    _flushScheduled = false;
+
+    QMutexLocker locker(&_mutex);
+    QHash<DeviceHandle*, QVariantMap> pending = _pending;
+    _pending.clear();
+    locker.unlock();
+
+    // changes which exceeded the budget of their rule in the last window
+    QStringList ruleIds = _rules.keys();
+    for(int i = 0; i < ruleIds.count(); i++)
+    {
+        QHash<DeviceHandle*, QVariantMap> deferred = _rules[ruleIds.at(i)].deferred;
+        _rules[ruleIds.at(i)].deferred.clear();
+        QHashIterator<DeviceHandle*, QVariantMap> it(deferred);
+        while(it.hasNext())
+        {
+            it.next();
+            deliver(ruleIds.at(i), it.key(), it.value());
+        }
+    }
+
+    QHashIterator<DeviceHandle*, QVariantMap> it(pending);
+    while(it.hasNext())
+    {
+        it.next();
+        QStringList rules;
+        QList<DeviceQmlAdapter*> adapters = _adapters.values(it.key());
+        for(int i = 0; i < adapters.count(); i++)
+        {
+            QString ruleId = _adapterRules.value(adapters.at(i));
+            if(!rules.contains(ruleId))
+                rules << ruleId;
+        }
+
+        for(int i = 0; i < rules.count(); i++)
+            deliver(rules.at(i), it.key(), it.value());
+    }
+
+    for(int i = 0; i < _faulted.count(); i++)
+    {
+        qWarning()<<"Warning: Automation rule"<<_faulted.at(i)<<"exceeded the watchdog timeout and was unloaded.";
+        unloadRule(_faulted.at(i));
+    }
+    _faulted.clear();
+}
@@ -0,0 +1,152 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef AUTOMATIONWORKER_H
+#define AUTOMATIONWORKER_H
+
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QVariant>
+#include <atomic>
+#include <functional>
+#include "Server/Devices/DeviceManager.h"
+
+class QQmlEngine;
+class QThread;
+class AutomationRule;
+class DeviceQmlAdapter;
+
+/*!
+    \class AutomationWorker
+    \brief Runs a partition of the QML automation rules in its own thread with its own QQmlEngine.
+    \ingroup automation
+
+    The worker lives in its thread, all rule and adapter objects are created there. Property changes of the
+    devices are not delivered as one queued signal per change: DeviceHandle::propertiesChanged() is connected
+    directly, the changes are merged per device (the latest value wins) and delivered to the DeviceQmlAdapters
+    in one batch per event loop iteration of the worker.
+
+    Every rule has a time budget of AUTOMATION_RULE_BUDGET ms per AUTOMATION_BUDGET_WINDOW ms for the processing of
+    its changes. The worker thread only runs rules, so the elapsed time is used as CPU time. When a rule has
+    exhausted its budget, its changes are kept (merged) and delivered in the next window.
+
+    The device signals (deviceStateChanged(), dataReceived()) are dispatched with run() and count against the
+    budget of their rule as well, but they are never deferred. Timers of a rule are accounted after their handler
+    returned. All other code of the worker thread (e.g. Connections handlers) is timed per event loop iteration
+    and covered by the watchdog, but can not be assigned to a rule.
+
+    The watchdog of the AutomationEngine interrupts the JavaScript execution of a rule which runs longer than the
+    watchdog timeout (Qt >= 5.14). The rule is unloaded afterwards, if it could be identified.
+
+    \sa AutomationEngine, DeviceQmlAdapter
+*/
+
+class AutomationWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AutomationWorker(QObject *parent = nullptr);
+    ~AutomationWorker();
+
+    /*!
+        \fn static AutomationWorker* AutomationWorker::forObject(QObject* object)
+        Returns the worker of the engine which created the QML object, or nullptr.
+    */
+    static AutomationWorker* forObject(QObject* object);
+
+    /*!
+        \fn void AutomationWorker::subscribe(DeviceQmlAdapter* adapter, deviceHandlePtr handle)
+        Delivers the changes of the handle to the adapter. Must be called in the worker thread.
+    */
+    void        subscribe(DeviceQmlAdapter* adapter, deviceHandlePtr handle);
+    void        unsubscribe(DeviceQmlAdapter* adapter);
+
+    /*!
+        \fn void AutomationWorker::run(DeviceQmlAdapter* adapter, std::function<void()> handler)
+        Runs the handler as code of the rule of the adapter: it is timed, counted against the budget of the rule
+        and covered by the watchdog. Must be called in the worker thread.
+    */
+    void        run(DeviceQmlAdapter* adapter, std::function<void()> handler);
+
+    /*!
+        \fn qint64 AutomationWorker::busySince() const
+        Returns the time (ms since epoch) when the current rule or event loop iteration started to run,
+        0 if the worker is idle. Thread safe.
+    */
+    qint64      busySince() const;
+
+    /*!
+        \fn QString AutomationWorker::busyRule() const
+        Returns the id of the running rule, an empty string if the running code can not be assigned to a rule.
+    */
+    QString     busyRule() const;
+
+    /*!
+        \fn void AutomationWorker::interrupt(qint64 busySince)
+        Interrupts the JavaScript execution if the worker is still in the run which started at \c busySince.
+        Code started later is never hit. 0 interrupts whatever is running. Thread safe.
+    */
+    void        interrupt(qint64 busySince = 0);
+    int         ruleCount() const;
+
+public slots:
+    void        start();
+    void        loadRule(QString id, QString qmlCode);
+    void        unloadRule(QString id);
+
+private:
+    struct RuleSlot
+    {
+        AutomationRule*     rule = nullptr;
+        qint64              windowStart = 0;
+        qint64              used = 0;
+        QHash<DeviceHandle*, QVariantMap> deferred; // handle -> changes which exceeded the budget
+    };
+
+    struct Subscription
+    {
+        deviceHandlePtr             handle;
+        QMetaObject::Connection     connection;
+        int                         count = 0; // number of adapters
+    };
+
+    // called by the DeviceHandles in their thread
+    void        propertiesChanged(DeviceHandle* handle, QVariantMap changes);
+
+    static void merge(QVariantMap& changes, const QVariantMap& update);
+    void        deliver(const QString& ruleId, DeviceHandle* handle, const QVariantMap& changes);
+    void        account(const QString& ruleId, qint64 used);
+    void        enter(const QString& ruleId);
+    void        leave();
+    bool        mark(const QString& ruleId, qint64 since);
+    void        scheduleFlush(int delay);
+
+    QQmlEngine*                         _engine = nullptr;
+    QHash<QString, RuleSlot>            _rules;
+    QMultiHash<DeviceHandle*, DeviceQmlAdapter*> _adapters; // handle -> adapters
+    QHash<DeviceQmlAdapter*, QString>   _adapterRules; // adapter -> rule id
+    QString                             _currentRule;
+    QStringList                         _faulted;
+    QHash<DeviceHandle*, Subscription>  _subscriptions;
+    QHash<QObject*, QString>            _timers; // timer -> rule id
+    std::atomic<qint64>                 _busySince;
+    std::atomic<int>                    _ruleCount;
+    bool                                _flushScheduled = false;
+
+    mutable QMutex                      _mutex; // guards _pending, _busyRule and changes of _busySince
+    QHash<DeviceHandle*, QVariantMap>   _pending; // handle -> merged changes
+    QString                             _busyRule;
+
+private slots:
+    void        flush();
+    void        awake();
+    void        aboutToBlock();
+    void        timerTriggered();
+};
+
+#endif // AUTOMATIONWORKER_H
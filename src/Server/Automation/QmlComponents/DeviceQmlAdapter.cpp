@@ -4,12 +4,19 @@
  * Written by Friedemann Metzger <friedemann.metzger@gmx.de>, 2017
 */
 #include "DeviceQmlAdapter.h"
+#include "../AutomationWorker.h"
 
 DeviceQmlAdapter::DeviceQmlAdapter(QObject *parent) : QQmlPropertyMap(this, parent)
 {
 
 }
 
+DeviceQmlAdapter::~DeviceQmlAdapter()
+{
+    if(_worker)
+        _worker->unsubscribe(this);
+}
+
 QString DeviceQmlAdapter::mapping() const
 {
     return _mapping;
@@ -24,7 +31,15 @@ void DeviceQmlAdapter::setMapping(const QString &mapping)
 
 void DeviceQmlAdapter::call(QString function, QVariant parameters)
 {
-    _deviceHandle->triggerFunction(function, parameters);
+    // the adapter may run in an automation thread, the device is called in the thread of its handle
+    deviceHandlePtr handle = _deviceHandle;
+    if(handle.isNull())
+        return;
+
+    QMetaObject::invokeMethod(handle.data(), [handle, function, parameters]()
+    {
+        handle->triggerFunction(function, parameters);
+    });
 }
 
 QQmlListProperty<QObject> DeviceQmlAdapter::children()
@@ -34,13 +49,33 @@ QQmlListProperty<QObject> DeviceQmlAdapter::children()
 
 bool DeviceQmlAdapter::registerDevice(QString deviceMapping)
 {
+    if(!_deviceHandle.isNull())
+        disconnect(_deviceHandle.data(), nullptr, this, nullptr);
+
     _deviceHandle = DeviceManager::instance()->getHandleByMapping(deviceMapping);
     if(!_deviceHandle.isNull())
     {
+        // inside of an AutomationWorker the property changes are delivered in batches
+        _worker = AutomationWorker::forObject(this);
+        if(_worker)
+        {
+            _worker->subscribe(this, _deviceHandle);
+        }
+        else
+        {
+            connect(_deviceHandle.data(), &DeviceHandle::propertyChanged, this, &DeviceQmlAdapter::propertyChangedSlot);
+            connect(_deviceHandle.data(), &DeviceHandle::propertiesChanged, this, &DeviceQmlAdapter::propertiesChangedSlot);
+        }
+
         connect(_deviceHandle.data(), &DeviceHandle::deviceStateChanged, this, &DeviceQmlAdapter::deviceStateChangedSlot);
-        connect(_deviceHandle.data(), &DeviceHandle::propertyChanged, this, &DeviceQmlAdapter::propertyChangedSlot);
-        connect(_deviceHandle.data(), &DeviceHandle::init, this, &DeviceQmlAdapter::initHandle);
-        connect(_deviceHandle.data(), &DeviceHandle::dataReceived, this, &DeviceQmlAdapter::dataReceived);
+        connect(_deviceHandle.data(), &DeviceHandle::init, this, [this]()
+        {
+            if(_worker)
+                _worker->run(this, [this](){ initHandle(); });
+            else
+                initHandle();
+        });
+        connect(_deviceHandle.data(), &DeviceHandle::dataReceived, this, &DeviceQmlAdapter::dataReceivedSlot);
         initHandle();
         return true;
     }
@@ -54,9 +89,30 @@ bool DeviceQmlAdapter::online() const
 }
 
 
+void DeviceQmlAdapter::applyChanges(const QVariantMap &changes)
+{
+    QMapIterator<QString, QVariant> it(changes);
+    while(it.hasNext())
+    {
+        it.next();
+        QVariantMap change = it.value().toMap();
+        if(change.contains("real"))
+            this->insert(it.key(), change.value("real"));
+        else if(change.contains("set"))
+            this->insert(it.key(), change.value("set"));
+    }
+}
+
 QVariant DeviceQmlAdapter::updateValue(const QString &key, const QVariant &input)
 {
-    _deviceHandle->setDeviceProperty(key, input);
+    deviceHandlePtr handle = _deviceHandle;
+    if(!handle.isNull())
+    {
+        QMetaObject::invokeMethod(handle.data(), [handle, key, input]()
+        {
+            handle->setDeviceProperty(key, input);
+        });
+    }
     return this->value(key);
 }
 
@@ -67,22 +123,51 @@ void DeviceQmlAdapter::propertyChangedSlot(QString uuid, QString property, QVari
     this->insert(property, value);
 }
 
+void DeviceQmlAdapter::propertiesChangedSlot(QString uuid, QVariantMap changes)
+{
+    Q_UNUSED (uuid)
+    QMapIterator<QString, QVariant> it(changes);
+    while(it.hasNext())
+    {
+        it.next();
+        // requested values are already inserted by propertyChangedSlot()
+        QVariantMap change = it.value().toMap();
+        if(change.contains("real"))
+            this->insert(it.key(), change.value("real"));
+    }
+}
+
 void DeviceQmlAdapter::deviceStateChangedSlot(QString uuid, IDevice::DeviceState state)
 {
     Q_UNUSED (uuid)
     Q_UNUSED (state)
-    Q_EMIT onlineChanged();
+
+    // the handlers of the rule are timed and covered by the watchdog of the worker
+    if(_worker)
+        _worker->run(this, [this](){ Q_EMIT onlineChanged(); });
+    else
+        Q_EMIT onlineChanged();
+}
+
+void DeviceQmlAdapter::dataReceivedSlot(QString uuid, QString subject, QVariantMap data)
+{
+    if(_worker)
+        _worker->run(this, [&](){ Q_EMIT dataReceived(uuid, subject, data); });
+    else
+        Q_EMIT dataReceived(uuid, subject, data);
 }
 
 void DeviceQmlAdapter::initHandle()
 {
-    //*TODO*
-    QVariantMap properties; /* = _deviceHandle->getConfirmedProperties();*/
-    QMapIterator<QString, QVariant> it(properties);
-    while(it.hasNext())
+    deviceHandlePtr handle = _deviceHandle;
+    if(handle.isNull())
+        return;
+
+    QVariantList properties = handle->properties();
+    for(int i = 0; i < properties.count(); i++)
     {
-        it.next();
-        this->insert(it.key(), it.value());
+        QVariantMap property = properties.at(i).toMap();
+        this->insert(property["name"].toString(), property["val"]);
     }
     Q_EMIT onlineChanged();
 }
@@ -13,6 +13,7 @@
 #include "../../Devices/DeviceManager.h"
 #include "qhcore_global.h"
 
+class AutomationWorker;
 class COREPLUGINSHARED_EXPORT DeviceQmlAdapter : public QQmlPropertyMap
 {
     Q_OBJECT
@@ -24,6 +25,7 @@ class COREPLUGINSHARED_EXPORT DeviceQmlAdapter : public QQmlPropertyMap
 
 public:
     explicit DeviceQmlAdapter(QObject *parent = 0);
+    ~DeviceQmlAdapter();
 
     QString mapping() const;
     void setMapping(const QString &mapping);
@@ -31,6 +33,9 @@ public:
     QQmlListProperty<QObject> children();
     bool online() const;
 
+    // Applies a batch of DeviceHandle::propertiesChanged() changes, used by the AutomationWorker
+    void applyChanges(const QVariantMap& changes);
+
 private:
     QString         _mapping;
     deviceHandlePtr _deviceHandle;
@@ -38,6 +43,7 @@ private:
     bool            registerDevice(QString deviceMapping);
     bool            _online;
     QList<QObject*> _children;
+    AutomationWorker* _worker = nullptr;
 
 protected:
     QVariant updateValue(const QString &key, const QVariant &input) override;
@@ -49,7 +55,9 @@ signals:
 
 private slots:
     void propertyChangedSlot(QString uuid, QString property, QVariant value, bool dirty);
+    void propertiesChangedSlot(QString uuid, QVariantMap changes);
     void deviceStateChangedSlot(QString uuid, IDevice::DeviceState state);
+    void dataReceivedSlot(QString uuid, QString subject, QVariantMap data);
     void initHandle();
 
 };
@@ -0,0 +1,506 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "RuleEngine.h"
+#include <QFile>
+#include <QJsonDocument>
+#include <QDateTime>
+#include <QTime>
+#include <QDebug>
+#include "Server/Devices/DeviceManager.h"
+#include "Storage/PersistenceScheduler.h"
+
+Q_GLOBAL_STATIC(RuleEngine, ruleEngine);
+
+RuleEngine::RuleEngine(QObject *parent) : QObject(parent)
+{
+    _debounceTimer.setSingleShot(true);
+    connect(&_debounceTimer, &QTimer::timeout, this, &RuleEngine::debounceTimeout);
+
+    // the index is keyed by the devices, so it has to follow the mappings
+    connect(DeviceManager::instance(), &DeviceManager::newDeviceMapping, this, &RuleEngine::mappingChanged);
+    connect(DeviceManager::instance(), &DeviceManager::deviceMappingRemoved, this, &RuleEngine::mappingChanged);
+}
+
+RuleEngine::~RuleEngine()
+{
+    qDeleteAll(_rules);
+}
+
+RuleEngine *RuleEngine::instance()
+{
+    return ruleEngine;
+}
+
+void RuleEngine::init(QString storagePath)
+{
+    _storagePath = storagePath;
+    PersistenceScheduler::waitForWritten(_storagePath+"/rules");
+    QFile file(_storagePath+"/rules");
+    if(!file.open(QFile::ReadOnly))
+        return;
+
+    QVariantList rules = QJsonDocument::fromJson(file.readAll()).toVariant().toMap()["rules"].toList();
+    file.close();
+
+    for(int i = 0; i < rules.count(); i++)
+    {
+        Rule* rule = compile(rules.at(i).toMap());
+        if(!rule)
+        {
+            qWarning()<<"Warning: Ignoring invalid automation rule"<<rules.at(i).toMap()["id"].toString();
+            continue;
+        }
+
+        delete _rules.take(rule->id);
+        _rules.insert(rule->id, rule);
+    }
+
+    // all mappings are loaded now, the index is built once
+    _initialized = true;
+    QHashIterator<QString, Rule*> it(_rules);
+    while(it.hasNext())
+        indexRule(it.next().value());
+}
+
+Err::CloudError RuleEngine::addRule(QVariantMap definition)
+{
+    Rule* rule = compile(definition);
+    if(!rule)
+        return Err::INVALID_DATA;
+
+    Rule* previous = _rules.take(rule->id);
+    if(previous)
+    {
+        unindexRule(previous);
+        _deadlines.remove(previous->deadline, previous);
+        delete previous;
+    }
+
+    _rules.insert(rule->id, rule);
+    if(_initialized)
+        indexRule(rule);
+
+    save();
+    return Err::NO_ERROR;
+}
+
+bool RuleEngine::removeRule(QString id)
+{
+    Rule* rule = _rules.take(id);
+    if(!rule)
+        return false;
+
+    unindexRule(rule);
+    _deadlines.remove(rule->deadline, rule);
+    delete rule;
+    save();
+    return true;
+}
+
+QVariantList RuleEngine::rules() const
+{
+    QVariantList rules;
+    QHashIterator<QString, Rule*> it(_rules);
+    while(it.hasNext())
+    {
+        it.next();
+        QVariantMap definition = it.value()->definition;
+        definition["active"] = it.value()->condition;
+        rules << definition;
+    }
+    return rules;
+}
+
+RuleEngine::Rule *RuleEngine::compile(const QVariantMap &definition)
+{
+    QScopedPointer<Rule> rule(new Rule);
+    rule->id = definition["id"].toString();
+    rule->definition = definition;
+    rule->any = definition["mode"].toString() == "any";
+    rule->debounce = qMax(0, definition["debounce"].toInt());
+
+    if(rule->id.isEmpty())
+        return nullptr;
+
+    static const QStringList operators = QStringList() << "eq" << "ne" << "lt" << "le" << "gt" << "ge";
+    QVariantList triggers = definition["triggers"].toList();
+    for(int i = 0; i < triggers.count(); i++)
+    {
+        QVariantMap data = triggers.at(i).toMap();
+        Trigger trigger;
+        trigger.mapping = data["mapping"].toString();
+        trigger.property = data["property"].toString();
+        trigger.value = data["value"];
+        trigger.hysteresis = qAbs(data["hysteresis"].toDouble());
+
+        int op = operators.indexOf(data.value("op", "eq").toString());
+        if(trigger.mapping.isEmpty() || trigger.property.isEmpty() || op < 0)
+            return nullptr;
+
+        trigger.op = Operator(op);
+        if(trigger.op != EQ && trigger.op != NE)
+        {
+            bool numeric = false;
+            trigger.threshold = trigger.value.toDouble(&numeric);
+            if(!numeric)
+                return nullptr;
+        }
+
+        rule->triggers << trigger;
+    }
+
+    if(rule->triggers.isEmpty())
+        return nullptr;
+
+    if(!compileActions(definition["actions"].toList(), &rule->actions) || !compileActions(definition["resetActions"].toList(), &rule->resetActions))
+        return nullptr;
+
+    if(rule->actions.isEmpty() && rule->resetActions.isEmpty())
+        return nullptr;
+
+    if(definition.contains("window"))
+    {
+        QVariantMap window = definition["window"].toMap();
+        QTime from = QTime::fromString(window["from"].toString(), "HH:mm");
+        QTime to = QTime::fromString(window["to"].toString(), "HH:mm");
+        if(!from.isValid() || !to.isValid())
+            return nullptr;
+
+        rule->windowFrom = from.hour() * 60 + from.minute();
+        rule->windowTo = to.hour() * 60 + to.minute();
+
+        QVariantList days = window["days"].toList();
+        if(!days.isEmpty())
+        {
+            rule->days = 0;
+            for(int i = 0; i < days.count(); i++)
+            {
+                int day = days.at(i).toInt();
+                if(day < 1 || day > 7)
+                    return nullptr;
+
+                rule->days |= 1 << (day - 1);
+            }
+        }
+    }
+
+    return rule.take();
+}
+
+bool RuleEngine::compileActions(const QVariantList &list, QVector<Action> *actions)
+{
+    for(int i = 0; i < list.count(); i++)
+    {
+        QVariantMap data = list.at(i).toMap();
+        Action action;
+        action.mapping = data["mapping"].toString();
+        action.property = data["property"].toString();
+        action.function = data["function"].toString();
+        action.value = action.function.isEmpty() ? data["value"] : data["params"];
+
+        if(action.mapping.isEmpty() || action.property.isEmpty() == action.function.isEmpty())
+            return false;
+
+        actions->append(action);
+    }
+    return true;
+}
+
+bool RuleEngine::evaluate(const Trigger &trigger, const QVariant &value)
+{
+    if(trigger.op == EQ)
+        return value == trigger.value;
+
+    if(trigger.op == NE)
+        return value != trigger.value;
+
+    bool numeric = false;
+    double number = value.toDouble(&numeric);
+    if(!numeric)
+        return false;
+
+    // an active trigger is released only after the value has crossed the threshold by the hysteresis
+    double threshold = trigger.threshold;
+    if(trigger.active)
+        threshold += (trigger.op == LT || trigger.op == LE) ? trigger.hysteresis : -trigger.hysteresis;
+
+    switch(trigger.op)
+    {
+        case LT:
+            return number < threshold;
+        case LE:
+            return number <= threshold;
+        case GT:
+            return number > threshold;
+        case GE:
+            return number >= threshold;
+        default:
+            return false;
+    }
+}
+
+bool RuleEngine::isInWindow(const Rule *rule)
+{
+    QDateTime now = QDateTime::currentDateTime();
+    if(!(rule->days & (1 << (now.date().dayOfWeek() - 1))))
+        return false;
+
+    if(rule->windowFrom < 0)
+        return true;
+
+    int minute = now.time().hour() * 60 + now.time().minute();
+    if(rule->windowFrom <= rule->windowTo)
+        return minute >= rule->windowFrom && minute < rule->windowTo;
+
+    // the window spans midnight
+    return minute >= rule->windowFrom || minute < rule->windowTo;
+}
+
+void RuleEngine::indexRule(Rule *rule)
+{
+    for(int i = 0; i < rule->triggers.count(); i++)
+    {
+        TriggerRef ref;
+        ref.rule = rule;
+        ref.trigger = i;
+        _mappingTriggers[rule->triggers.at(i).mapping].append(ref);
+        resolveTrigger(rule, i);
+    }
+
+    updateCondition(rule, false);
+}
+
+void RuleEngine::unindexRule(Rule *rule)
+{
+    for(int i = 0; i < rule->triggers.count(); i++)
+    {
+        unresolveTrigger(rule, i);
+
+        const QString& mapping = rule->triggers.at(i).mapping;
+        QVector<TriggerRef>& refs = _mappingTriggers[mapping];
+        for(int j = refs.count() - 1; j >= 0; j--)
+        {
+            if(refs.at(j).rule == rule)
+                refs.remove(j);
+        }
+
+        if(refs.isEmpty())
+            _mappingTriggers.remove(mapping);
+    }
+}
+
+void RuleEngine::resolveTrigger(Rule *rule, int index)
+{
+    Trigger& trigger = rule->triggers[index];
+    QString uuid = DeviceManager::instance()->getDeviceByMapping(trigger.mapping);
+    deviceHandlePtr handle = uuid.isEmpty() ? deviceHandlePtr() : DeviceManager::instance()->getHandle(uuid);
+
+    // a trigger which refers to another device starts with the current value of this device
+    if(uuid != trigger.uuid)
+    {
+        trigger.uuid = uuid;
+        trigger.active = false;
+        trigger.active = !handle.isNull() && evaluate(trigger, handle->getPropertyValue(trigger.property));
+    }
+
+    if(handle.isNull())
+        return;
+
+    TriggerRef ref;
+    ref.rule = rule;
+    ref.trigger = index;
+    _index[uuid][trigger.property].append(ref);
+
+    if(_connected.value(uuid) != handle.data())
+    {
+        _connected.insert(uuid, handle.data());
+        connect(handle.data(), &DeviceHandle::propertiesChanged, this, &RuleEngine::propertiesChanged);
+    }
+}
+
+void RuleEngine::unresolveTrigger(Rule *rule, int index)
+{
+    const Trigger& trigger = rule->triggers.at(index);
+    QHash<QString, PropertyIndex>::iterator device = _index.find(trigger.uuid);
+    if(device == _index.end())
+        return;
+
+    PropertyIndex::iterator refs = device->find(trigger.property);
+    if(refs == device->end())
+        return;
+
+    for(int i = refs->count() - 1; i >= 0; i--)
+    {
+        if(refs->at(i).rule == rule && refs->at(i).trigger == index)
+            refs->remove(i);
+    }
+
+    if(refs->isEmpty())
+        device->erase(refs);
+
+    if(device->isEmpty())
+        _index.erase(device);
+}
+
+void RuleEngine::mappingChanged(QString uuid, QString mapping)
+{
+    Q_UNUSED(uuid)
+    if(!_initialized || !_mappingTriggers.contains(mapping))
+        return;
+
+    QVector<TriggerRef> refs = _mappingTriggers.value(mapping);
+    for(int i = 0; i < refs.count(); i++)
+    {
+        unresolveTrigger(refs.at(i).rule, refs.at(i).trigger);
+        resolveTrigger(refs.at(i).rule, refs.at(i).trigger);
+    }
+
+    for(int i = 0; i < refs.count(); i++)
+        updateCondition(refs.at(i).rule, false);
+}
+
+void RuleEngine::updateCondition(Rule *rule, bool dispatchActions)
+{
+    int activeCount = 0;
+    for(int i = 0; i < rule->triggers.count(); i++)
+    {
+        if(rule->triggers.at(i).active)
+            activeCount++;
+    }
+
+    bool condition = rule->any ? activeCount > 0 : activeCount == rule->triggers.count();
+    if(condition == rule->condition)
+        return;
+
+    rule->condition = condition;
+    if(condition)
+    {
+        if(!dispatchActions)
+            return;
+
+        if(rule->debounce > 0)
+            schedule(rule);
+        else
+            fire(rule);
+
+        return;
+    }
+
+    if(rule->deadline != 0)
+    {
+        _deadlines.remove(rule->deadline, rule);
+        rule->deadline = 0;
+    }
+
+    if(rule->fired)
+    {
+        rule->fired = false;
+        if(dispatchActions)
+            dispatch(rule, rule->resetActions);
+    }
+}
+
+void RuleEngine::fire(Rule *rule)
+{
+    if(!isInWindow(rule))
+        return;
+
+    rule->fired = true;
+    dispatch(rule, rule->actions);
+}
+
+void RuleEngine::dispatch(const Rule *rule, const QVector<Action> &actions)
+{
+    for(int i = 0; i < actions.count(); i++)
+    {
+        const Action& action = actions.at(i);
+        deviceHandlePtr handle = DeviceManager::instance()->getHandleByMapping(action.mapping);
+        if(handle.isNull())
+        {
+            qWarning()<<"Warning: Automation rule"<<rule->id<<"- no device at"<<action.mapping;
+            continue;
+        }
+
+        IDevice::DeviceError error;
+        if(action.function.isEmpty())
+            error = handle->setDeviceProperty(action.property, action.value);
+        else
+            error = handle->triggerFunction(action.function, action.value);
+
+        if(error != IDevice::NO_ERROR)
+            qWarning()<<"Warning: Automation rule"<<rule->id<<"- action on"<<action.mapping<<"failed:"<<error;
+    }
+}
+
+void RuleEngine::schedule(Rule *rule)
+{
+    rule->deadline = QDateTime::currentMSecsSinceEpoch() + rule->debounce;
+    _deadlines.insert(rule->deadline, rule);
+
+    if(!_debounceTimer.isActive() || _deadlines.firstKey() == rule->deadline)
+        _debounceTimer.start(int(_deadlines.firstKey() - QDateTime::currentMSecsSinceEpoch()));
+}
+
+void RuleEngine::save()
+{
+    QVariantList rules;
+    QHashIterator<QString, Rule*> it(_rules);
+    while(it.hasNext())
+        rules << it.next().value()->definition;
+
+    QVariantMap data;
+    data["rules"] = rules;
+    PersistenceScheduler::save(_storagePath+"/rules", data);
+}
+
+void RuleEngine::propertiesChanged(QString uuid, QVariantMap changes)
+{
+    QHash<QString, PropertyIndex>::const_iterator device = _index.constFind(uuid);
+    if(device == _index.constEnd())
+        return;
+
+    QMapIterator<QString, QVariant> it(changes);
+    while(it.hasNext())
+    {
+        it.next();
+        PropertyIndex::const_iterator refs = device->constFind(it.key());
+        if(refs == device->constEnd())
+            continue;
+
+        QVariantMap change = it.value().toMap();
+        QVariantMap::const_iterator real = change.constFind("real");
+        if(real == change.constEnd())
+            continue;
+
+        for(int i = 0; i < refs->count(); i++)
+        {
+            const TriggerRef& ref = refs->at(i);
+            Trigger& trigger = ref.rule->triggers[ref.trigger];
+            bool active = evaluate(trigger, real.value());
+            if(active == trigger.active)
+                continue;
+
+            trigger.active = active;
+            updateCondition(ref.rule, true);
+        }
+    }
+}
+
+void RuleEngine::debounceTimeout()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    while(!_deadlines.isEmpty() && _deadlines.firstKey() <= now)
+    {
+        Rule* rule = _deadlines.take(_deadlines.firstKey());
+        rule->deadline = 0;
+        if(rule->condition)
+            fire(rule);
+    }
+
+    if(!_deadlines.isEmpty())
+        _debounceTimer.start(int(_deadlines.firstKey() - now));
+}
@@ -0,0 +1,164 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef RULEENGINE_H
+#define RULEENGINE_H
+
+#include <QObject>
+#include <QVariant>
+#include <QHash>
+#include <QPointer>
+#include <QVector>
+#include <QTimer>
+#include "Server/Defines/ErrDef.h"
+
+class DeviceHandle;
+
+/*!
+    \class RuleEngine
+    \brief Native automation rules which react to device property changes.
+    \ingroup automation
+
+    A rule is a QVariantMap (JSON) definition:
+
+    <code><pre>
+    {
+        "id": "heating",
+        "mode": "all",                  // "all" or "any" of the triggers
+        "triggers": [{"mapping": "home/living/thermostat", "property": "temperature", "op": "lt", "value": 19, "hysteresis": 0.5}],
+        "debounce": 5000,               // ms the condition has to hold before the actions are dispatched
+        "window": {"from": "06:00", "to": "22:00", "days": [1, 2, 3, 4, 5]},
+        "actions": [{"mapping": "home/living/heater", "property": "on", "value": true}],
+        "resetActions": [{"mapping": "home/living/heater", "function": "off", "params": {}}]
+    }
+    </pre></code>
+
+    Operators are eq, ne, lt, le, gt and ge. A trigger with hysteresis stays active until the value has crossed the
+    threshold by the hysteresis, e.g. "lt 19" with hysteresis 0.5 stays active until the value is >= 19.5.
+
+    Rules are edge triggered: the actions are dispatched when the condition becomes true (after the debounce time,
+    inside the time window), the reset actions when it becomes false again after the actions were dispatched.
+    A rule which is added while its condition is already true waits for the next transition.
+
+    The triggers are compiled into an index by device uuid and property, a property change evaluates only the
+    triggers of this property. The index is built once by init(), afterwards adding a rule indexes only its triggers
+    and a changed device mapping re-resolves only the triggers which refer to this mapping. Actions are resolved by
+    mapping when they are dispatched and run without a user token.
+
+    The rules are stored in the "automation" directory of the server (see SocketServer).
+
+    \sa AutomationService, DeviceHandle
+*/
+
+class RuleEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RuleEngine(QObject *parent = nullptr);
+    ~RuleEngine();
+    static RuleEngine* instance();
+
+    /*!
+        \fn void RuleEngine::init(QString storagePath)
+        Loads the stored rules. Must be called after the DeviceManager was initialized.
+    */
+    void                init(QString storagePath);
+
+    /*!
+        \fn Err::CloudError RuleEngine::addRule(QVariantMap definition)
+        Adds a rule or replaces the rule with the same id. Returns Err::INVALID_DATA if the definition is invalid.
+    */
+    Err::CloudError     addRule(QVariantMap definition);
+    bool                removeRule(QString id);
+    QVariantList        rules() const;
+
+private:
+    enum Operator
+    {
+        EQ,
+        NE,
+        LT,
+        LE,
+        GT,
+        GE
+    };
+
+    struct Trigger
+    {
+        QString     mapping;
+        QString     property;
+        QString     uuid;       // resolved device of the mapping
+        Operator    op = EQ;
+        QVariant    value;
+        double      threshold = 0;
+        double      hysteresis = 0;
+        bool        active = false;
+    };
+
+    struct Action
+    {
+        QString     mapping;
+        QString     property;
+        QString     function;
+        QVariant    value;
+    };
+
+    struct Rule
+    {
+        QString             id;
+        QVariantMap         definition;
+        bool                any = false;
+        QVector<Trigger>    triggers;
+        QVector<Action>     actions;
+        QVector<Action>     resetActions;
+        int                 debounce = 0;
+        int                 windowFrom = -1; // minutes of the day
+        int                 windowTo = -1;
+        int                 days = 0x7f;     // bit 0 = monday
+        bool                condition = false;
+        bool                fired = false;
+        qint64              deadline = 0;
+    };
+
+    struct TriggerRef
+    {
+        Rule*   rule;
+        int     trigger;
+    };
+
+    typedef QHash<QString, QVector<TriggerRef>> PropertyIndex; // property -> triggers
+
+    static Rule*            compile(const QVariantMap& definition);
+    static bool             compileActions(const QVariantList& list, QVector<Action>* actions);
+    static bool             evaluate(const Trigger& trigger, const QVariant& value);
+    static bool             isInWindow(const Rule* rule);
+    void                    indexRule(Rule* rule);
+    void                    unindexRule(Rule* rule);
+    void                    resolveTrigger(Rule* rule, int trigger);
+    void                    unresolveTrigger(Rule* rule, int trigger);
+    void                    updateCondition(Rule* rule, bool dispatchActions);
+    void                    fire(Rule* rule);
+    void                    dispatch(const Rule* rule, const QVector<Action>& actions);
+    void                    schedule(Rule* rule);
+    void                    save();
+
+    QString                         _storagePath;
+    QHash<QString, Rule*>           _rules;
+    bool                            _initialized = false;
+    QHash<QString, PropertyIndex>   _index; // device uuid -> property index
+    QHash<QString, QVector<TriggerRef>> _mappingTriggers; // mapping -> triggers which refer to it
+    QHash<QString, QPointer<DeviceHandle>> _connected; // uuid -> handle whose changes are received
+    QMultiMap<qint64, Rule*>        _deadlines;
+    QTimer                          _debounceTimer;
+
+private slots:
+    void propertiesChanged(QString uuid, QVariantMap changes);
+    void mappingChanged(QString uuid, QString mapping);
+    void debounceTimeout();
+};
+
+#endif // RULEENGINE_H
@@ -0,0 +1,276 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "DeviceBulkCommand.h"
+#include "DeviceHandle.h"
+#include "Server/Defines/ErrDef.h"
+#include <QTimer>
+#include <QSet>
+#include <QAtomicInteger>
+
+// number of devices which are addressed per event loop iteration
+#define DEVICE_BULK_SLICE           100
+
+// maximum number of function calls waiting for an answer at the same time
+#define DEVICE_BULK_PARALLELISM     32
+
+namespace
+{
+    QAtomicInteger<quint64> bulkSequence(0);
+}
+
+DeviceBulkCommand::DeviceBulkCommand(Command command, QString name, QVariant argument, QString token, QString cbID, QObject *parent) : QObject(parent),
+    _command(command),
+    _name(name),
+    _argument(argument),
+    _token(token),
+    _cbID(cbID)
+{
+    // the cbIDs of two bulk commands or of a client must never collide
+    _callPrefix = QString(DEVICE_BULK_CBID_PREFIX) + QString::number(++bulkSequence) + ":";
+}
+
+bool DeviceBulkCommand::isValidSelector(const QVariantMap &selector)
+{
+    // an empty selector would address every device, this has to be requested explicitly
+    if(selector["all"].toBool())
+        return true;
+
+    return !selector["type"].toString().isEmpty() || !selector["mapping"].toString().isEmpty()
+            || !selector["property"].toMap()["name"].toString().isEmpty();
+}
+
+QMap<QString, deviceHandlePtr> DeviceBulkCommand::select(QVariantMap selector)
+{
+    if(!isValidSelector(selector))
+    {
+        qWarning()<<"Warning: Device selector without criteria, set \"all\": true to address all devices.";
+        return QMap<QString, deviceHandlePtr>();
+    }
+
+    QString type = selector["type"].toString();
+    QString prefix = selector["mapping"].toString();
+    QVariantMap predicate = selector["property"].toMap();
+    QString propertyName = predicate["name"].toString();
+    QString op = predicate.value("op", "eq").toString();
+
+    // first mapping of every device with the prefix, the handles are evaluated outside of the lock of the manager
+    QSet<QString> uuids;
+    QVector<QPair<QString, QString>> candidates;
+    DeviceManager::instance()->forEachMapping(prefix, [&](const QString& mapping, const QString& uuid)
+    {
+        if(uuids.contains(uuid))
+            return;
+
+        uuids.insert(uuid);
+        candidates.append(qMakePair(mapping, uuid));
+    });
+
+    QMap<QString, deviceHandlePtr> result;
+    for(int i = 0; i < candidates.count(); i++)
+    {
+        deviceHandlePtr handle = DeviceManager::instance()->getHandle(candidates.at(i).second);
+        if(handle.isNull())
+            continue;
+
+        if(!type.isEmpty() && handle->type() != type)
+            continue;
+
+        if(!propertyName.isEmpty() && !matches(handle->getPropertyValue(propertyName), op, predicate["value"]))
+            continue;
+
+        result.insert(candidates.at(i).first, handle);
+    }
+
+    return result;
+}
+
+void DeviceBulkCommand::start(QMap<QString, deviceHandlePtr> targets, bool wait, int timeout)
+{
+    _wait = wait && _command == CALL;
+    _timeout = timeout;
+
+    QMapIterator<QString, deviceHandlePtr> it(targets);
+    while(it.hasNext())
+    {
+        it.next();
+        Target target;
+        target.mapping = it.key();
+        target.handle = it.value();
+        _targets.append(target);
+    }
+
+    if(_targets.isEmpty())
+    {
+        finish();
+        return;
+    }
+
+    dispatchNext();
+}
+
+bool DeviceBulkCommand::matches(const QVariant &value, const QString &op, const QVariant &reference)
+{
+    if(op == "exists")
+        return value.isValid();
+
+    if(!value.isValid())
+        return false;
+
+    if(op == "eq")
+        return value == reference;
+
+    if(op == "ne")
+        return value != reference;
+
+    bool numeric = false;
+    bool referenceNumeric = false;
+    double number = value.toDouble(&numeric);
+    double referenceNumber = reference.toDouble(&referenceNumeric);
+    int comparison;
+    if(numeric && referenceNumeric)
+        comparison = number < referenceNumber ? -1 : (number > referenceNumber ? 1 : 0);
+    else
+        comparison = QString::compare(value.toString(), reference.toString());
+
+    if(op == "lt")
+        return comparison < 0;
+
+    if(op == "le")
+        return comparison <= 0;
+
+    if(op == "gt")
+        return comparison > 0;
+
+    if(op == "ge")
+        return comparison >= 0;
+
+    qWarning()<<"Warning: Unknown operator in device selector -"<<op;
+    return false;
+}
+
+void DeviceBulkCommand::dispatchNext()
+{
+    if(_finished)
+        return;
+
+    int dispatched = 0;
+    while(_next < _targets.count() && dispatched < DEVICE_BULK_SLICE)
+    {
+        if(_wait && _pending.count() >= DEVICE_BULK_PARALLELISM)
+            return;
+
+        dispatch(_next++);
+        dispatched++;
+    }
+
+    if(_completed == _targets.count())
+    {
+        finish();
+        return;
+    }
+
+    // don't block the event loop with thousands of devices, continue in the next iteration
+    if(_next < _targets.count() && (!_wait || _pending.count() < DEVICE_BULK_PARALLELISM))
+        QTimer::singleShot(0, this, &DeviceBulkCommand::dispatchNext);
+}
+
+void DeviceBulkCommand::dispatch(int index)
+{
+    deviceHandlePtr handle = _targets.at(index).handle;
+
+    if(_command == SET_PROPERTY)
+    {
+        complete(index, handle->setDeviceProperty(_name, _argument, _token));
+        return;
+    }
+
+    if(!_wait)
+    {
+        complete(index, handle->triggerFunction(_name, _argument, _token));
+        return;
+    }
+
+    QString cbID = _callPrefix + QString::number(index);
+    connect(handle.data(), &DeviceHandle::functionAnswered, this, &DeviceBulkCommand::functionAnswered);
+    connect(handle.data(), &DeviceHandle::functionCallFailed, this, &DeviceBulkCommand::functionCallFailed);
+    _pending.insert(cbID, index);
+
+    IDevice::DeviceError error = handle->triggerFunction(_name, _argument, _token, cbID, _timeout);
+    if(error != IDevice::NO_ERROR)
+    {
+        _pending.remove(cbID);
+        disconnect(handle.data(), nullptr, this, nullptr);
+        complete(index, error);
+    }
+}
+
+void DeviceBulkCommand::complete(int index, int error, QVariantMap data)
+{
+    _targets[index].error = error;
+    _targets[index].data = data;
+    _completed++;
+}
+
+void DeviceBulkCommand::functionAnswered(QString uuid, QString cbID, QVariantMap data)
+{
+    Q_UNUSED(uuid)
+    int index = _pending.value(cbID, -1);
+    if(index < 0)
+        return;
+
+    _pending.remove(cbID);
+    disconnect(_targets.at(index).handle.data(), nullptr, this, nullptr);
+    complete(index, IDevice::NO_ERROR, data);
+    dispatchNext();
+}
+
+void DeviceBulkCommand::functionCallFailed(QString uuid, QString cbID, IDevice::DeviceError error)
+{
+    Q_UNUSED(uuid)
+    int index = _pending.value(cbID, -1);
+    if(index < 0)
+        return;
+
+    _pending.remove(cbID);
+    disconnect(_targets.at(index).handle.data(), nullptr, this, nullptr);
+    complete(index, error);
+    dispatchNext();
+}
+
+void DeviceBulkCommand::finish()
+{
+    if(_finished)
+        return;
+
+    _finished = true;
+    QVariantList results;
+    int failed = 0;
+    for(int i = 0; i < _targets.count(); i++)
+    {
+        const Target& target = _targets.at(i);
+        QVariantMap entry;
+        entry["mapping"] = target.mapping;
+        entry["uuid"] = target.handle->uuid();
+        entry["errorcode"] = target.error;
+        if(!target.data.isEmpty())
+            entry["data"] = target.data;
+
+        if(target.error != IDevice::NO_ERROR)
+            failed++;
+
+        results << entry;
+    }
+
+    QVariantMap result;
+    result["errorcode"] = Err::NO_ERROR;
+    result["count"] = _targets.count();
+    result["failed"] = failed;
+    result["results"] = results;
+
+    Q_EMIT finished(_cbID, result);
+    deleteLater();
+}
@@ -0,0 +1,113 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef DEVICEBULKCOMMAND_H
+#define DEVICEBULKCOMMAND_H
+
+#include <QObject>
+#include <QVariant>
+#include <QHash>
+#include <QVector>
+#include "DeviceManager.h"
+
+// prefix of the cbIDs of bulk calls, DeviceHandleHandler rejects client cbIDs with this prefix
+#define DEVICE_BULK_CBID_PREFIX     "bulk:"
+
+/*!
+    \class DeviceBulkCommand
+    \brief Sets a property or calls a function on all devices matching a selector.
+    \ingroup devices
+
+    The selector is a QVariantMap with the optional entries
+    - "type": the device type,
+    - "mapping": a mapping prefix, e.g. "building1/floor2/",
+    - "property": {"name": ..., "op": "eq|ne|lt|le|gt|ge|exists", "value": ...} - a predicate on the current property value,
+    - "all": true - required if none of the other entries is given, an empty selector matches no device.
+
+    Bulk commands need the MANAGE_DEVICES permission, see DeviceService.
+
+    Every matching device is addressed once, even if it has several mappings. Property changes are applied in
+    slices of DEVICE_BULK_SLICE devices per event loop iteration. Function calls which wait for the answers of the
+    devices are dispatched with at most DEVICE_BULK_PARALLELISM calls in flight.
+
+    finished() delivers one aggregated result:
+    {"errorcode": 0, "count": n, "failed": m, "results": [{"mapping", "uuid", "errorcode", "data"}, ...]}
+
+    The instance deletes itself after finished() was emitted.
+
+    \sa DeviceService
+*/
+
+class DeviceBulkCommand : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Command
+    {
+        SET_PROPERTY,
+        CALL
+    };
+
+    DeviceBulkCommand(Command command, QString name, QVariant argument, QString token, QString cbID, QObject* parent = nullptr);
+
+    /*!
+        \fn static bool DeviceBulkCommand::isValidSelector(const QVariantMap& selector)
+        Returns false if the selector has no criteria and doesn't request all devices explicitly.
+    */
+    static bool isValidSelector(const QVariantMap& selector);
+
+    /*!
+        \fn static QMap<QString, deviceHandlePtr> DeviceBulkCommand::select(QVariantMap selector)
+        Returns the matching handles by one of their mappings, no handles for an invalid selector.
+    */
+    static QMap<QString, deviceHandlePtr> select(QVariantMap selector);
+
+    /*!
+        \fn void DeviceBulkCommand::start(QMap<QString, deviceHandlePtr> targets, bool wait, int timeout)
+        Starts the command. If wait is true, function calls are finished by the answers of the devices (or
+        after timeout ms, < 0 for the default deadline), otherwise as soon as they were sent.
+    */
+    void start(QMap<QString, deviceHandlePtr> targets, bool wait = false, int timeout = -1);
+
+signals:
+    void finished(QString cbID, QVariant result);
+
+private:
+    struct Target
+    {
+        QString         mapping;
+        deviceHandlePtr handle;
+        int             error = IDevice::NO_ERROR;
+        QVariantMap     data;
+    };
+
+    static bool             matches(const QVariant& value, const QString& op, const QVariant& reference);
+    void                    dispatch(int index);
+    void                    complete(int index, int error, QVariantMap data = QVariantMap());
+    void                    finish();
+
+    Command                 _command;
+    QString                 _name;
+    QVariant                _argument;
+    QString                 _token;
+    QString                 _cbID;
+    QString                 _callPrefix; // prefix of the cbIDs of the calls to the devices
+    bool                    _wait = false;
+    int                     _timeout = -1;
+    QVector<Target>         _targets;
+    QHash<QString, int>     _pending; // cbID of a running call -> target index
+    int                     _next = 0;
+    int                     _completed = 0;
+    bool                    _finished = false;
+
+private slots:
+    void dispatchNext();
+    void functionAnswered(QString uuid, QString cbID, QVariantMap data);
+    void functionCallFailed(QString uuid, QString cbID, IDevice::DeviceError error);
+};
+
+#endif // DEVICEBULKCOMMAND_H
@@ -8,8 +8,10 @@
 #include "DeviceHandle.h"
 #include "DeviceManager.h"
 #include "DeviceProperty.h"
+#include "DeviceRpcQueue.h"
 #include <QtDebug>
 #include <QDateTime>
+#include <QThread>
 #include "DevicePermissionManager.h"
 #include <QWriteLocker>
 #include <QReadLocker>
@@ -17,12 +19,17 @@
 #include "../Authentication/IIdentitiy.h"
 
 DeviceHandle::DeviceHandle(QString uuid, QString path, QObject *parent) : IResource(path, parent),
-    _uuid(uuid),
-    _lock(QReadWriteLock::Recursive)
-{
+    _table(path),
+    _lock(QReadWriteLock::Recursive),
+    _rpc(new DeviceRpcQueue(this))
+{
+    _state.update([&](State& next) { next.uuid = uuid; });
+    _table.setHistoryKey(uuid);
+    _table.setChangeCallback([this](const QVector<PropertyTable::Change>& changes) { propertyTableChanged(changes); });
+    connect(_rpc, &DeviceRpcQueue::callFailed, this, &DeviceHandle::rpcFailed);
     connect(DeviceManager::instance(), &DeviceManager::deviceRegistered, this, &DeviceHandle::deviceRegistered);
     connect(DeviceManager::instance(), &DeviceManager::deviceDeregistered, this, &DeviceHandle::deviceDeregistered);
-    iDevicePtr device = DeviceManager::instance()->getDeviceByUuid(_uuid);
+    iDevicePtr device = DeviceManager::instance()->getDeviceByUuid(uuid);
     // will be only the case in "set mapping" process in all other cases the device handle is
     // created at application startup
     if(device)
@@ -35,37 +42,35 @@ DeviceHandle::DeviceHandle(QString uuid, QString path, QObject *parent) : IResou
 }
 
 DeviceHandle::DeviceHandle(QString path, QObject *parent): IResource(path, parent),
-    _temporary(true),
-    _lock()
+    _table(path),
+    _lock(),
+    _rpc(new DeviceRpcQueue(this))
 {
+    _state.update([](State& next) { next.temporary = true; });
+    _table.setChangeCallback([this](const QVector<PropertyTable::Change>& changes) { propertyTableChanged(changes); });
+    connect(_rpc, &DeviceRpcQueue::callFailed, this, &DeviceHandle::rpcFailed);
     connect(DeviceManager::instance(), &DeviceManager::deviceRegistered, this, &DeviceHandle::deviceRegistered);
     connect(DeviceManager::instance(), &DeviceManager::deviceDeregistered, this, &DeviceHandle::deviceDeregistered);
 }
 
 DeviceHandle::~DeviceHandle()
 {
-    qDebug()<< "Device-Handle Destroyed for: " + getResourcePath() + ( !_uuid.isEmpty() ? "/"+ _uuid : "") ;
-    QReadLocker locker(&_lock);
-    if(!_temporary)
-    {
-       locker.unlock();
+    std::shared_ptr<const State> state = _state.load();
+    qDebug()<< "Device-Handle Destroyed for: " + getResourcePath() + ( !state->uuid.isEmpty() ? "/"+ state->uuid : "") ;
+    if(!state->temporary)
        save();
-    }
+
+    // the wrappers have no parent, see property()
+    qDeleteAll(_wrappers);
 }
 
 const QVariantMap DeviceHandle::getData()
 {
     QVariantMap data;
-    QVariantMap properties;
+    QVariantMap properties = _table.toMap();
+    std::shared_ptr<const State> state = _state.load();
 
     _lock.lockForRead();
-    QMapIterator<QString, DeviceProperty*> propIt(_properties);
-    while(propIt.hasNext())
-    {
-        propIt.next();
-        properties.insert(propIt.key(), propIt.value()->toMap());
-    }
-
     QMapIterator<QString, bool> permIt(_permissions);
     QVariantMap permissions;
     while(permIt.hasNext())
@@ -75,13 +80,13 @@ const QVariantMap DeviceHandle::getData()
     }
 
     data["properties"] = properties;
-    data["functions"] = _functions;
-    data["type"] = _type;
+    data["functions"] = state->functions;
+    data["type"] = state->type;
     data["lastOnline"] = _lastOnline;
-    data["description"] = _description;
+    data["description"] = state->description;
     data["authkey"] = _authentificationKey;
     data["enableauthkey"] = _enableSecureCheck;
-    data["shortID"] = _shortID;
+    data["shortID"] = state->shortID;
     data["permissions"] = permissions;
     _lock.unlock();
     return data;
@@ -89,12 +94,20 @@ const QVariantMap DeviceHandle::getData()
 
 void DeviceHandle::setUuid(QString uuid)
 {
-    if(uuid == _uuid)
+    bool changed = false;
+    _state.update([&](State& next)
+    {
+        changed = next.uuid != uuid;
+        next.uuid = uuid;
+    });
+
+    if(!changed)
         return;
 
+    // the history belongs to the device, not to the mapping
+    _table.setHistoryKey(uuid);
     _lock.lockForWrite();
     _initialized = false;
-    _uuid = uuid;
     _lock.unlock();
     Q_EMIT uuidChanged(uuid);
 }
@@ -102,11 +115,9 @@ void DeviceHandle::setUuid(QString uuid)
 void DeviceHandle::setDescription(QString description, QString token)
 {
     Q_UNUSED(token)
-    _lock.lockForWrite();
-    _description = description;
-    _lock.unlock();
+    std::shared_ptr<const State> state = _state.update([&](State& next) { next.description = description; });
     save();
-    Q_EMIT descriptionChanged(_uuid, description);
+    Q_EMIT descriptionChanged(state->uuid, description);
 }
 
 qint64 DeviceHandle::lastAccess() const
@@ -122,14 +133,12 @@ const QString DeviceHandle::getResourceType() const
 
 IDevice::DeviceState DeviceHandle::getDeviceState() const
 {
-    QReadLocker locker(&_lock);
-    return _deviceSate;
+    return _state.load()->deviceState;
 }
 
 QString DeviceHandle::getDescription() const
 {
-    QReadLocker locker(&_lock);
-    return _description;
+    return _state.load()->description;
 }
 
 bool DeviceHandle::setDevice(QSharedPointer<IDevice> device)
@@ -148,31 +157,40 @@ bool DeviceHandle::setDevice(QSharedPointer<IDevice> device)
 
     setUuid(device->uuid());
     connect(device.data(), &IDevice::propertyChanged, this, &DeviceHandle::propertyChangedSlot);
-    connect(device.data(), &IDevice::dataReceived, this, &DeviceHandle::dataReceived);
+    connect(device.data(), &IDevice::dataReceived, this, &DeviceHandle::dataReceivedSlot);
     connect(device.data(), &IDevice::deviceStateChanged, this, &DeviceHandle::deviceStateChangedSlot);
     connect(device.data(), &IDevice::forcePropertySync, this, &DeviceHandle::syncDevice);
+    _rpc->setDevice(device);
 
+    IDevice::DeviceState deviceState = device->getDeviceState();
+    int firmwareVersion = device->getFirmwareVersion();
     _lock.lockForWrite();
     _device = device;
-    _deviceSate = device->getDeviceState();
-    _firmwareVersion = device->getFirmwareVersion();
-    _temporary = false;
-    if(!_permissions.isEmpty())
-    {
-        _token = AuthenticationService::instance()->login(device);
-    }
-    else
-        _token = "";
+    _firmwareVersion = firmwareVersion;
+    bool hasPermissions = !_permissions.isEmpty();
+    QMap<QString, bool> permissions = _permissions;
+    _lock.unlock();
+
+    // the login is done outside of the lock, AuthenticationService may call back
+    QString token = hasPermissions ? AuthenticationService::instance()->login(device) : "";
+    _lock.lockForWrite();
+    _token = token;
     _lock.unlock();
 
-    if(!_permissions.isEmpty())
+    std::shared_ptr<const State> state = _state.update([&](State& next)
     {
-        device->setGrantedPermissions(_permissions);
-        device->setToken(_token);
+        next.deviceState = deviceState;
+        next.temporary = false;
+    });
+
+    if(hasPermissions)
+    {
+        device->setGrantedPermissions(permissions);
+        device->setToken(token);
     }
 
-    Q_EMIT deviceStateChanged(_uuid, _deviceSate);
-    Q_EMIT temporaryChanged(_uuid, _temporary);
+    Q_EMIT deviceStateChanged(state->uuid, state->deviceState);
+    Q_EMIT temporaryChanged(state->uuid, state->temporary);
     syncDevice();
 
     bool emitInit = false;
@@ -194,195 +212,198 @@ bool DeviceHandle::setDevice(QSharedPointer<IDevice> device)
 bool DeviceHandle::removeDevice()
 {
     QReadLocker locker(&_lock);
-    if(_device == nullptr)
-        return false;
+    iDevicePtr device = _device;
     locker.unlock();
+    if(device == nullptr)
+        return false;
 
     setUuid("");
-    disconnect(_device.data(), &IDevice::propertyChanged, this, &DeviceHandle::propertyChangedSlot);
-    disconnect(_device.data(), &IDevice::dataReceived, this, &DeviceHandle::dataReceived);
-    disconnect(_device.data(), &IDevice::deviceStateChanged, this, &DeviceHandle::deviceStateChangedSlot);
-    disconnect(_device.data(), &IDevice::forcePropertySync, this, &DeviceHandle::syncDevice);
+    disconnect(device.data(), &IDevice::propertyChanged, this, &DeviceHandle::propertyChangedSlot);
+    disconnect(device.data(), &IDevice::dataReceived, this, &DeviceHandle::dataReceivedSlot);
+    disconnect(device.data(), &IDevice::deviceStateChanged, this, &DeviceHandle::deviceStateChangedSlot);
+    disconnect(device.data(), &IDevice::forcePropertySync, this, &DeviceHandle::syncDevice);
+    _rpc->setDevice(nullptr);
+    _rpc->abort(IDevice::DEVICE_NOT_AVAILABLE);
     _lock.lockForWrite();
-    _deviceSate = IDevice::OFFLINE;
-    _temporary = true;
     _device = nullptr;
     _lock.unlock();
-    Q_EMIT deviceStateChanged(_uuid, _deviceSate);
-    Q_EMIT temporaryChanged(_uuid,true);
+
+    std::shared_ptr<const State> state = _state.update([](State& next)
+    {
+        next.deviceState = IDevice::OFFLINE;
+        next.temporary = true;
+    });
+
+    Q_EMIT deviceStateChanged(state->uuid, state->deviceState);
+    Q_EMIT temporaryChanged(state->uuid, state->temporary);
     save();
     return true;
 }
 
 bool DeviceHandle::temporary() const
 {
-    QReadLocker locker(&_lock);
-    return _temporary;
+    return _state.load()->temporary;
 }
 
 
 QVariantList DeviceHandle::getFunctions() const
 {
-    QReadLocker locker(&_lock);
-    return _functions;
+    return _state.load()->functions;
 }
 
 IDevice::DeviceError DeviceHandle::setDeviceProperty(QString property, QVariant value, QString token)
 {
+    std::shared_ptr<const State> state = _state.load();
     IDevicePermissionChecker::PropertyPermission permission;
-    _lock.lockForRead();
-    if(!_permissionChecker.isNull())
-        permission = _permissionChecker-> checkPropertyPermission(token, this, property);
-    _lock.unlock();
+    if(!state->permissionChecker.isNull())
+        permission = state->permissionChecker->checkPropertyPermission(token, this, property);
 
     if(!permission.canWrite)
         return IDevice::PERMISSION_DENIED;
 
-    _lock.lockForRead();
-    DeviceProperty* prop = _properties.value(property, nullptr);
-    _lock.unlock();
-
-    if(!prop)
+    if(!_table.setValue(property, value))
         return IDevice::PROPERTY_NOT_EXISTS;
 
-    prop->setValue(value);
     return IDevice::NO_ERROR;
 }
 
 QString DeviceHandle::type() const
 {
-    QReadLocker locker(&_lock);
-    return _type;
+    return _state.load()->type;
 }
 
 QString DeviceHandle::uuid() const
 {
-    QReadLocker locker(&_lock);
-    return _uuid;
+    return _state.load()->uuid;
 }
 
 QString DeviceHandle::shortUid() const
 {
-    QReadLocker locker(&_lock);
-    return _shortID;
+    return _state.load()->shortID;
 }
 
-IDevice::DeviceError DeviceHandle::triggerFunction(QString name, QVariant parameters, QString token, QString cbID)
+IDevice::DeviceError DeviceHandle::triggerFunction(QString name, QVariant parameters, QString token, QString cbID, int timeout, bool idempotent)
 {
+    std::shared_ptr<const State> state = _state.load();
     bool canCall = true;
-    _lock.lockForRead();
-    if(!_permissionChecker.isNull())
-        canCall = _permissionChecker->checkRPCPermission(token, this, name);
-    _lock.unlock();
+    if(!state->permissionChecker.isNull())
+        canCall = state->permissionChecker->checkRPCPermission(token, this, name);
 
     if(!canCall)
         return IDevice::PERMISSION_DENIED;
 
-    QReadLocker locker(&_lock);
-    if(_deviceSate != IDevice::ONLINE)
+    _lock.lockForRead();
+    iDevicePtr device = _device;
+    _lock.unlock();
+
+    if(state->deviceState != IDevice::ONLINE || device == nullptr)
         return IDevice::DEVICE_NOT_AVAILABLE;
+
     QVariantMap paramMap = parameters.toMap();
     iIdentityPtr identity  = AuthenticationService::instance()->validateToken(token);
     if(!identity.isNull())
         paramMap["caller"] = identity.data()->identityID();
 
-    return _device->triggerFunction(name, paramMap, cbID);
+    if(cbID.isEmpty())
+        return device->triggerFunction(name, paramMap, cbID);
+
+    // the queue starts timers, it can't be used from other threads
+    if(QThread::currentThread() != thread())
+    {
+        qWarning()<<"Warning: DeviceHandle::triggerFunction with a cbID called outside of the thread of the handle -"<<name;
+        return IDevice::DEVICE_NOT_AVAILABLE;
+    }
+    return _rpc->call(name, paramMap, cbID, timeout, idempotent);
 }
 
 QMap<QString, DeviceProperty *> DeviceHandle::propertyObjects()
 {
-    QReadLocker locker(&_lock);
-    return _properties;
+    QMap<QString, DeviceProperty*> properties;
+    QStringList names = _table.names();
+    for(int i = 0; i < names.count(); i++)
+        properties.insert(names.at(i), property(names.at(i)));
+
+    return properties;
 }
 
 QVariantList DeviceHandle::properties() const
 {
-    QVariantList properties;
-    QReadLocker locker(&_lock);
-    QMapIterator<QString, DeviceProperty*> propIt(_properties);
-    while(propIt.hasNext())
+    return _table.toList();
+}
+
+DeviceProperty *DeviceHandle::property(QString name)
+{
+    if(!_table.contains(name))
+        return nullptr;
+
+    QMutexLocker locker(&_wrapperMutex);
+    DeviceProperty* prop = _wrappers.value(name, nullptr);
+    if(!prop)
     {
-        properties <<  propIt.next().value()->toMap();
+        // may be called from automation threads: the object is created without parent and lives in the
+        // thread of the handle, which emits its signals
+        prop = new DeviceProperty(name, &_table, nullptr);
+        prop->moveToThread(thread());
+        _wrappers.insert(name, prop);
     }
-    return properties;
+    return prop;
 }
 
-DeviceProperty *DeviceHandle::property(QString name)
+QVariant DeviceHandle::getPropertyValue(QString name) const
 {
-    QReadLocker locker(&_lock);
-    return _properties.value(name, nullptr);
+    return _table.getValue(name); // invalid if the property doesn't exist
 }
 
-DeviceProperty* DeviceHandle::createDevicePropertyObject(QString name, DeviceHandle *parent, QVariantMap metadata)
+IDevice::DeviceError DeviceHandle::setPropertyMetadata(QString name, QString key, QVariant value)
 {
-    DeviceProperty* prop = new DeviceProperty(name, parent, metadata);
-    connect(prop, &DeviceProperty::metadataChanged, this, &DeviceHandle::save);
-    return prop;
+    return _table.setMetadata(name, key, value) ? IDevice::NO_ERROR : IDevice::PROPERTY_NOT_EXISTS;
 }
 
-QVariant DeviceHandle::getPropertyValue(QString name) const
+IDevice::DeviceError DeviceHandle::getPropertyHistory(QString name, qint64 from, qint64 to, int buckets, QString token, QVariantList *history)
 {
-    QReadLocker locker(&_lock);
-    DeviceProperty* prop = _properties.value(name, nullptr);
-    if(prop == nullptr)
-        return QVariant(); //invalid
+    std::shared_ptr<const State> state = _state.load();
+    IDevicePermissionChecker::PropertyPermission permission;
+    if(!state->permissionChecker.isNull())
+        permission = state->permissionChecker->checkPropertyPermission(token, this, name);
+
+    if(!permission.canRead)
+        return IDevice::PERMISSION_DENIED;
+
+    if(!_table.contains(name))
+        return IDevice::PROPERTY_NOT_EXISTS;
 
-    return prop->getValue();
+    *history = _table.history(name, from, to, buckets);
+    return IDevice::NO_ERROR;
 }
 
 void DeviceHandle::syncDevice()
 {
-    QReadLocker locker(&_lock);
-    if(_device == nullptr)
+    _lock.lockForRead();
+    iDevicePtr device = _device;
+    _lock.unlock();
+    if(device == nullptr)
         return;
 
-    QVariantMap newProperties = _device->getProperties();
-    locker.unlock();
+    // a handle without properties needs the full set, otherwise the changes are sufficient
+    QVariantMap newProperties = _table.count() == 0 ? device->getProperties() : device->getPropertyChanges();
 
-    QMapIterator<QString,QVariant> receivedPropertiesIt(newProperties);
+    // These values come directly from the sensor after reattach. If there are shadowed values,
+    // then let the dirty flag as it is! The snapshot is applied and announced at once.
+    _table.setRealValues(newProperties, true);
+    QVariantMap unconfirmedProperties = _table.unconfirmedValues();
 
-    QVariantMap _unconfirmedProperties;
-    while (receivedPropertiesIt.hasNext())
+    QVariantList functions = device->getFunctions();
+    QString type = device->type();
+    QString shortID = device->shortId();
+    QSharedPointer<IDevicePermissionChecker> permissionChecker = DevicePermissionManager::instance()->getDevicePermissionChecker(type);
+    _state.update([&](State& next)
     {
-        receivedPropertiesIt.next();
-        QString key = receivedPropertiesIt.key();
-        QVariant val = receivedPropertiesIt.value();
-        _lock.lockForRead();
-        DeviceProperty* property = _properties.value(key, nullptr);
-        _lock.unlock();
-        if(property)
-        {
-            // These values come directly from the sensor after reattach. If there are shadowed values,
-            // then let the dirty flag as it is!
-            property->setRealValue(val, true);
-        }
-        else
-        {
-             property = createDevicePropertyObject(key, this);// new DeviceProperty(key, this);
-             property->setRealValue(val);
-             registerPropertyObject(key, property);
-        }
-
-        _lock.lockForRead();
-        QMapIterator<QString, DeviceProperty*> it = _properties;
-
-        while(it.hasNext())
-        {
-            if(it.next().value()->isDirty())
-            {
-                _unconfirmedProperties.insert(it.key(), it.value()->getSetValue());
-            }
-        }
-        _lock.unlock();
-        Q_EMIT propertyChanged(_uuid, key, val, false);
-    }
-    _lock.lockForWrite();
-    _functions = _device->getFunctions();
-    _type = _device->type();
-    _permissionChecker = DevicePermissionManager::instance()->getDevicePermissionChecker(_type);
-    _shortID = _device->shortId();
-    _device->initDevice(_unconfirmedProperties);
-    _lock.unlock();
+        next.functions = functions;
+        next.type = type;
+        next.shortID = shortID;
+        next.permissionChecker = permissionChecker;
+    });
+    device->initDevice(unconfirmedProperties);
     save();
 }
 
@@ -403,41 +424,90 @@ void DeviceHandle::loadLastData()
      }
 
     _lock.lockForWrite();
-    _type = data["type"].toString();
-    _permissionChecker = DevicePermissionManager::instance()->getDevicePermissionChecker(_type);
-    _functions = data["functions"].toList();
-    _shortID = data["shortID"].toString();
-    _description = data["description"].toString();
     _authentificationKey = data["authkey"].toUInt();
     _enableSecureCheck = data["enableauthkey"].toBool();
     _lastOnline = data["lastOnline"].toLongLong();
     _permissions = permissionMap;
     _lock.unlock();
 
-    QVariantMap properties = data["properties"].toMap();
-    QMapIterator<QString, QVariant> propIt(properties);
-
-    while (propIt.hasNext())
+    QString type = data["type"].toString();
+    QSharedPointer<IDevicePermissionChecker> permissionChecker = DevicePermissionManager::instance()->getDevicePermissionChecker(type);
+    _state.update([&](State& next)
     {
-        propIt.next();
-        DeviceProperty* prop = createDevicePropertyObject(propIt.key(), this,  propIt.value().toMap());//new DeviceProperty(propIt.key(), this,  propIt.value().toMap());
-        registerPropertyObject(propIt.key(), prop);
-    }
+        next.type = type;
+        next.permissionChecker = permissionChecker;
+        next.functions = data["functions"].toList();
+        next.shortID = data["shortID"].toString();
+        next.description = data["description"].toString();
+    });
 
+    _table.restore(data["properties"].toMap());
 }
 
-void DeviceHandle::registerPropertyObject(QString name, DeviceProperty *prop)
+void DeviceHandle::propertyTableChanged(const QVector<PropertyTable::Change> &changes)
 {
-    _lock.lockForWrite();
-    _properties.insert(name, prop);
-    _lock.unlock();
-    connect(prop, &DeviceProperty::setValueChanged, this, &DeviceHandle::sendPropertyToDevice);
-    Q_EMIT newPropertyObject(prop);
+    QString uuid = this->uuid();
+    QVariantMap aggregated;
+    bool metadataModified = false;
+
+    for(int i = 0; i < changes.count(); i++)
+    {
+        const PropertyTable::Change& change = changes.at(i);
+        if(change.flags & (PropertyTable::REAL_VALUE | PropertyTable::SET_VALUE))
+        {
+            QVariantMap entry = aggregated.value(change.name).toMap();
+            if(change.flags & PropertyTable::REAL_VALUE)
+            {
+                entry["real"] = change.value;
+                entry["timestamp"] = change.timestamp;
+            }
+            else
+            {
+                entry["set"] = change.value;
+            }
+            entry["dirty"] = change.dirty;
+            aggregated.insert(change.name, entry);
+        }
+
+        // requested values are delivered to the device, or when it is offline with the next sync
+        if(change.flags & PropertyTable::SET_VALUE)
+        {
+            _lock.lockForRead();
+            iDevicePtr device = _device;
+            _lock.unlock();
+            if(device != nullptr)
+                device->setDeviceProperty(change.name, change.value);
+            else
+                save();
+
+            Q_EMIT propertyChanged(uuid, change.name, change.value, true);
+        }
+
+        if(change.flags & PropertyTable::METADATA)
+        {
+            metadataModified = true;
+            Q_EMIT metadataChanged(uuid, change.name, change.key, change.value);
+        }
+
+        _wrapperMutex.lock();
+        DeviceProperty* wrapper = _wrappers.value(change.name, nullptr);
+        _wrapperMutex.unlock();
+        if(wrapper)
+            wrapper->notify(change);
+    }
+
+    if(!aggregated.isEmpty())
+        Q_EMIT propertiesChanged(uuid, aggregated);
+
+    if(metadataModified)
+        save();
 }
 
 void DeviceHandle::setPermissions(const QMap<QString, bool> &permissions)
 {
+    _lock.lockForWrite();
     _permissions = permissions;
+    _lock.unlock();
     save();
 }
 
@@ -449,20 +519,25 @@ bool DeviceHandle::getEnableSecureCheck() const
 
 IDevice::DeviceError DeviceHandle::startFirmwareUpdate(QVariant args)
 {
-    if(_device == nullptr)
+    _lock.lockForRead();
+    iDevicePtr device = _device;
+    _lock.unlock();
+    if(device == nullptr)
         return IDevice::DEVICE_NOT_AVAILABLE;
 
-    return _device->startFirmwareUpdate(args);
+    return device->startFirmwareUpdate(args);
 }
 
 int DeviceHandle::getFirmwareVersion()
 {
+    QReadLocker locker(&_lock);
     return _firmwareVersion;
 }
 
 QVariantMap DeviceHandle::getPermissions()
 {
     QVariantMap map;
+    QReadLocker locker(&_lock);
     QMapIterator<QString, bool> it(_permissions);
     while(it.hasNext()){
         it.next();
@@ -487,32 +562,9 @@ void DeviceHandle::setAuthentificationKey(const quint32 &securekey)
 }
 
 
-void DeviceHandle::sendPropertyToDevice(QString name, QVariant value)
-{
-    DeviceProperty* senderProp = qobject_cast<DeviceProperty*>(sender());
-    if(!senderProp)
-        return;
-
-    _lock.lockForRead();
-    iDevicePtr device = _device;
-    _lock.unlock();
-    if(device != nullptr)
-    {
-        device->setDeviceProperty(name, value);
-    }
-    else
-    {
-        save();
-    }
-
-    Q_EMIT propertyChanged(_uuid, name, value, true);
-}
-
 void DeviceHandle::deviceStateChangedSlot(QString uuid, IDevice::DeviceState state)
 {
-    _lock.lockForWrite();
-    _deviceSate = state;
-    _lock.unlock();
+    _state.update([&](State& next) { next.deviceState = state; });
     if(state == IDevice::ONLINE)
         syncDevice();
 
@@ -522,22 +574,27 @@ void DeviceHandle::deviceStateChangedSlot(QString uuid, IDevice::DeviceState sta
 void DeviceHandle::deviceDeregistered(QString uuid)
 {
     QReadLocker locker(&_lock);
-    if(uuid != _uuid || _device == nullptr)
+    iDevicePtr device = _device;
+    locker.unlock();
+    if(uuid != this->uuid() || device == nullptr)
         return;
 
-    disconnect(_device.data(), &IDevice::propertyChanged, this, &DeviceHandle::propertyChangedSlot);
-    disconnect(_device.data(), &IDevice::dataReceived, this, &DeviceHandle::dataReceived);
-    disconnect(_device.data(), &IDevice::deviceStateChanged, this, &DeviceHandle::deviceStateChangedSlot);
-    locker.unlock();
+    disconnect(device.data(), &IDevice::propertyChanged, this, &DeviceHandle::propertyChangedSlot);
+    disconnect(device.data(), &IDevice::dataReceived, this, &DeviceHandle::dataReceivedSlot);
+    disconnect(device.data(), &IDevice::deviceStateChanged, this, &DeviceHandle::deviceStateChangedSlot);
+    _rpc->setDevice(nullptr);
+    _rpc->abort(IDevice::DEVICE_NOT_AVAILABLE);
     save();
 
     _lock.lockForWrite();
     _lastOnline = QDateTime::currentMSecsSinceEpoch();
-    _deviceSate = IDevice::OFFLINE;
-    AuthenticationService::instance()->logout(_token);
+    QString token = _token;
     _device = nullptr;
     _lock.unlock();
-    Q_EMIT deviceStateChanged(_uuid, IDevice::OFFLINE);
+    AuthenticationService::instance()->logout(token);
+
+    std::shared_ptr<const State> state = _state.update([](State& next) { next.deviceState = IDevice::OFFLINE; });
+    Q_EMIT deviceStateChanged(state->uuid, state->deviceState);
 }
 
 void DeviceHandle::deviceRegistered(QString uuid)
@@ -546,7 +603,7 @@ void DeviceHandle::deviceRegistered(QString uuid)
     if(_device)
         return;
 
-    if(uuid == _uuid)
+    if(uuid == this->uuid())
     {
         locker.unlock();
 
@@ -559,7 +616,7 @@ void DeviceHandle::deviceRegistered(QString uuid)
         {
             if(_authentificationKey != device->getAuthentificationKey())
             {
-                qWarning()<<"Wrong authentification key: "+_uuid+"! - Device rejected.";
+                qWarning()<<"Wrong authentification key: "+uuid+"! - Device rejected.";
                 qDebug()<< "IS:     "+QString::number(device->getAuthentificationKey());
                 qDebug()<< "SHOULD: "+QString::number(_authentificationKey);
                 return;
@@ -567,7 +624,7 @@ void DeviceHandle::deviceRegistered(QString uuid)
 
             if(_permissions != device->getRequestedPermissions())
             {
-                qWarning()<<"Unconfirmed permission request! "+_uuid+"! - Device rejected.";
+                qWarning()<<"Unconfirmed permission request! "+uuid+"! - Device rejected.";
                 return;
             }
 
@@ -582,20 +639,26 @@ void DeviceHandle::deviceRegistered(QString uuid)
 void DeviceHandle::propertyChangedSlot(QString uuid, QString property, QVariant value)
 {
     Q_UNUSED(uuid)
-    _lock.lockForRead();
-    DeviceProperty* prop = _properties.value(property, nullptr);
-    _lock.unlock();
+    _table.setRealValue(property, value);
+    Q_EMIT propertyChanged(this->uuid(), property, value, false);
+}
 
-    if(prop)
-    {
-        prop->setRealValue(value);
-    }
-    else
+void DeviceHandle::dataReceivedSlot(QString uuid, QString subject, QVariantMap data)
+{
+    QStringList callers;
+    if(!_rpc->finish(subject, &callers))
     {
-         prop = createDevicePropertyObject(property, this);// new DeviceProperty(property, this);
-         prop->setRealValue(value);
-         registerPropertyObject(property, prop);
+        Q_EMIT dataReceived(uuid, subject, data);
+        return;
     }
 
-    Q_EMIT propertyChanged(_uuid, property, value, false);
+    // answers of timed out calls are dropped, coalesced calls get the same answer
+    QListIterator<QString> it(callers);
+    while(it.hasNext())
+        Q_EMIT functionAnswered(uuid, it.next(), data);
+}
+
+void DeviceHandle::rpcFailed(QString cbID, IDevice::DeviceError error)
+{
+    Q_EMIT functionCallFailed(uuid(), cbID, error);
 }
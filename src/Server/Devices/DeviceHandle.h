@@ -18,6 +18,12 @@
 
     \note Use this class to communicate with- or get infos from a specific device.
 
+    The metadata read by dashboards and automation (uuid, type, state, functions...) is kept in an immutable
+    Snapshot, its getters only wait for the short lock of the pointer copy (see Snapshot). The property values
+    are stored in a PropertyTable and updated in place under its QReadWriteLock, so property getters wait
+    while a writer holds the lock. Property changes are announced per device with propertiesChanged(),
+    DeviceProperty objects are only created on demand. Signals are emitted after a new snapshot is published.
+
     \sa DeviceHandleHandler DeviceManager
 */
 
@@ -29,8 +35,12 @@
 #include <QSharedPointer>
 #include "../Resources/ResourceManager/IResource.h"
 #include "QReadWriteLock"
+#include "Snapshot.h"
+#include "PropertyTable.h"
+#include <QMutex>
 
 class DeviceProperty;
+class DeviceRpcQueue;
 class IDevicePermissionChecker;
 class DeviceHandle : public IResource
 {
@@ -128,13 +138,20 @@ public:
         Will invoke the appropriate RPC with the given parameteres.
         If there is a permission checker installed for this device, the
         implementation will check whether the appropriate user has permission to modify the device.
-        \sa IDevice::DeviceError
+
+        Calls with a cbID are answered by the device (functionAnswered() with the cbID). They have a deadline
+        of timeout ms (< 0 for the default) and are limited per device. If the call fails later on, e.g. because
+        the device hasn't answered in time, functionCallFailed() is emitted. Identical calls of idempotent functions
+        are only sent once. Calls with a cbID must be made in the thread of the handle (the main thread),
+        from other threads they fail with DEVICE_NOT_AVAILABLE.
+        \sa IDevice::DeviceError, DeviceRpcQueue
     */
-    IDevice::DeviceError triggerFunction(QString name, QVariant parameters, QString token = "", QString cbID ="");
+    IDevice::DeviceError triggerFunction(QString name, QVariant parameters, QString token = "", QString cbID ="", int timeout = -1, bool idempotent = false);
 
     /*!
         \fn void DeviceHandle::propertyObjects()
-        Returns a list with all property objects.
+        Returns a list with all property objects. The objects are created on demand, use getPropertyValue()
+        and propertiesChanged() if you don't need QObjects.
 
         \sa DeviceProperty
     */
@@ -148,7 +165,8 @@ public:
 
     /*!
         \fn void DeviceHandle::property(QString name)
-        Returns a pointer to the DeviceProperty Object instance for the given property name.
+        Returns a pointer to the DeviceProperty Object instance for the given property name. The object is
+        created on demand, lives in the thread of the handle and as long as the handle. Thread safe.
         Returns a nullptr, when the property doesn't exist.
     */
     DeviceProperty*                 property(QString name);
@@ -159,6 +177,15 @@ public:
         \sa QVariant::isValid()
     */
     QVariant                        getPropertyValue(QString name) const;
+    IDevice::DeviceError            setPropertyMetadata(QString name, QString key, QVariant value);
+
+    /*!
+        \fn DeviceHandle::getPropertyHistory(QString name, qint64 from, qint64 to, int buckets, QString token, QVariantList* history)
+        Fills history with the recorded values of the property between from and to. If buckets is > 0, the values are
+        downsampled to at most buckets [timestamp, min, max, avg] entries.
+        \sa DeviceProperty::history()
+    */
+    IDevice::DeviceError            getPropertyHistory(QString name, qint64 from, qint64 to, int buckets, QString token, QVariantList* history);
 
     /*!
         \fn DeviceHandle::getAuthentificationKey() const
@@ -211,35 +238,56 @@ private:
     */
     void                            setUuid(QString uuid);
 
-    DeviceProperty*                 createDevicePropertyObject(QString name, DeviceHandle *parent, QVariantMap metadata = QVariantMap());
     void                            loadLastData();
-    void                            registerPropertyObject(QString name,DeviceProperty* prop);
-    QMap<QString, DeviceProperty*>  _properties;
+    void                            propertyTableChanged(const QVector<PropertyTable::Change>& changes);
+
+    struct State
+    {
+        QString                                     uuid;
+        QString                                     shortID;
+        QString                                     type;
+        QString                                     description;
+        QVariantList                                functions;
+        IDevice::DeviceState                        deviceState = IDevice::OFFLINE;
+        bool                                        temporary = false;
+        QSharedPointer<IDevicePermissionChecker>    permissionChecker;
+    };
+
+    // read by everyone, see Snapshot
+    Snapshot<State>                 _state;
+    PropertyTable                   _table;
+
+    // created on demand by property()
+    QMutex                          _wrapperMutex;
+    QHash<QString, DeviceProperty*> _wrappers;
+
+    // guarded by _lock
     QMap<QString, bool>             _permissions;
-    bool                            _temporary = false;
     bool                            _initialized = false;
     QStringList                     _mappings;
     qint64                          _lastAccess = 0;
     qint64                          _lastOnline = 0;
-    QString                         _uuid;
-    QString                         _shortID;
-    QVariantList                    _functions;
     QSharedPointer<IDevice>         _device;
-    IDevice::DeviceState            _deviceSate = IDevice::OFFLINE;
-    QString                         _type;
-    QString                         _description;
     quint32                         _authentificationKey = 0;
     QString                         _token;
-    int                             _firmwareVersion;
+    int                             _firmwareVersion = -1;
     bool                            _enableSecureCheck = false;
     mutable QReadWriteLock          _lock;
-  QSharedPointer<IDevicePermissionChecker>      _permissionChecker;
+    DeviceRpcQueue*                 _rpc;
 
 signals:
     void deviceStateChanged(QString uuid, IDevice::DeviceState state);
-    void newPropertyObject(DeviceProperty* property);
     void dataReceived(QString uuid, QString subject, QVariantMap data);
+
+    // the answer of a call with a cbID, only for the caller - unlike dataReceived() it must not be broadcast
+    void functionAnswered(QString uuid, QString cbID, QVariantMap data);
+    void functionCallFailed(QString uuid, QString cbID, IDevice::DeviceError error);
     void propertyChanged(QString uuid, QString property, QVariant value, bool dirty);
+
+    // Sent for every change of the property table, e.g. once after the properties of a (re)attached device
+    // were synchronized. Contains only the changed properties: name -> {real, timestamp, dirty} and/or {set, dirty}
+    void propertiesChanged(QString uuid, QVariantMap changes);
+    void metadataChanged(QString uuid, QString property, QString key, QVariant value);
     void uuidChanged(QString uuid);
     void descriptionChanged(QString uuid, QString description);
     void temporaryChanged(QString uuid, bool temporary);
@@ -247,11 +295,12 @@ signals:
 
 private slots:
     void syncDevice();
-    void sendPropertyToDevice(QString name, QVariant value);
     void deviceStateChangedSlot(QString uuid, IDevice::DeviceState state);
     void deviceDeregistered(QString uuid);
     void deviceRegistered(QString uuid);
     void propertyChangedSlot(QString uuid, QString property, QVariant value);
+    void dataReceivedSlot(QString uuid, QString subject, QVariantMap data);
+    void rpcFailed(QString cbID, IDevice::DeviceError error);
 };
 
 #endif // DEVICEHANDLE_H
@@ -13,8 +13,12 @@
 #include <QDebug>
 #include <QCoreApplication>
 #include <QRandomGenerator>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QThread>
 #include "../Authentication/AuthentificationService.h"
 #include "../Authentication/User.h"
+#include "Storage/PersistenceScheduler.h"
 
 Q_GLOBAL_STATIC(DeviceManager, deviceManager);
 
@@ -88,18 +92,45 @@ void DeviceManager::init(QString storagePath)
 
 QMap<QString, QString> DeviceManager::getMappings() const
 {
+    QReadLocker locker(&_mappingLock);
     return _deviceMappings;
 }
 
+void DeviceManager::forEachMapping(QString prefix, std::function<void (const QString &, const QString &)> visitor) const
+{
+    QReadLocker locker(&_mappingLock);
+
+    // the mappings are sorted, so all mappings with the prefix follow each other
+    QMap<QString, QString>::const_iterator it = _deviceMappings.lowerBound(prefix);
+    for(; it != _deviceMappings.constEnd() && it.key().startsWith(prefix); ++it)
+        visitor(it.key(), it.value());
+}
+
+QStringList DeviceManager::getMappingsForDevice(QString uuid) const
+{
+    QReadLocker locker(&_mappingLock);
+    return _mappingsByUuid.values(uuid);
+}
+
+bool DeviceManager::isMapped(QString uuid) const
+{
+    QReadLocker locker(&_mappingLock);
+    return _mappingsByUuid.contains(uuid);
+}
+
 deviceHandlePtr DeviceManager::getHandle(QString uuid) const
 {
+    QReadLocker locker(&_handleLock);
     return _handles.value(uuid, deviceHandlePtr());
 }
 
 deviceHandlePtr DeviceManager::getHandleByMapping(QString mapping)
 {
     deviceHandlePtr handle;
-    QString uuid = _deviceMappings.value(mapping);
+    QString uuid = getDeviceByMapping(mapping);
+
+    // also called by the automation workers in their threads
+    QWriteLocker locker(&_handleLock);
     if(!uuid.isEmpty())
     {
          handle = _handles.value(uuid);
@@ -109,12 +140,14 @@ deviceHandlePtr DeviceManager::getHandleByMapping(QString mapping)
 
     if(_handleByMappings.contains(mapping))
     {
-        weakDeviceHandlePtr weakhandle = _handleByMappings.value(mapping);
-        if(!weakhandle.isNull())
-            return weakhandle.toStrongRef();
+        handle = _handleByMappings.value(mapping).toStrongRef();
+        if(!handle.isNull())
+            return handle;
     }
 
     handle.reset(new DeviceHandle(""));
+    if(handle->thread() != thread())
+        handle->moveToThread(thread());
     _handleByMappings.insert(mapping, handle);
 
     return handle;
@@ -123,6 +156,7 @@ deviceHandlePtr DeviceManager::getHandleByMapping(QString mapping)
 
 QList<deviceHandlePtr> DeviceManager::getHandles()
 {
+    QReadLocker locker(&_handleLock);
     return _handles.values();
 }
 
@@ -138,8 +172,8 @@ iDevicePtr DeviceManager::getDeviceByUuid(QString uuid) const
 
 QString DeviceManager::getDeviceByMapping(QString mapping) const
 {
-    QString uuid = _deviceMappings.value(mapping,"");
-    return uuid;
+    QReadLocker locker(&_mappingLock);
+    return _deviceMappings.value(mapping,"");
 }
 
 QString DeviceManager::getTypeForUuid(QString uuid) const
@@ -165,12 +199,16 @@ DeviceManager::~DeviceManager()
 
 deviceHandlePtr DeviceManager::addDeviceHandle(QString uuid)
 {
-    if(_handles.contains(uuid))
-        return _handles.value(uuid);
+    deviceHandlePtr deviceHandle = getHandle(uuid);
+    if(!deviceHandle.isNull())
+        return deviceHandle;
 
+    // the handles are only added in this thread, no one else can insert the uuid in the meantime
     QString path = _storagePath +"/handles/"+uuid;
-    deviceHandlePtr deviceHandle(new DeviceHandle(uuid, path));
+    deviceHandle.reset(new DeviceHandle(uuid, path));
+    _handleLock.lockForWrite();
     _handles.insert(uuid, deviceHandle);
+    _handleLock.unlock();
     Q_EMIT newDeviceHandle(uuid);
     return deviceHandle;
 }
@@ -189,13 +227,17 @@ Err::CloudError DeviceManager::unhook(QString mapping)
     if(deviceUUID.isEmpty())
         return Err::INVALID_DATA;
 
-    _deviceMappings.remove(mapping);
+    removeMapping(mapping);
     Q_EMIT deviceMappingRemoved(deviceUUID, mapping);
 
-    weakDeviceHandlePtr weakPtr = _handles.value(deviceUUID).toWeakRef();
-
-    _handles.remove(deviceUUID);
+    _handleLock.lockForWrite();
+    weakDeviceHandlePtr weakPtr = _handles.take(deviceUUID).toWeakRef();
     if(!weakPtr.isNull())
+        _handleByMappings.insert(mapping, weakPtr);
+    _handleLock.unlock();
+
+    deviceHandlePtr handle = weakPtr.toStrongRef();
+    if(!handle.isNull())
     {
         /* Someone still has a smart pointer to this DeviceHandle instance.
          * The DeviceHandle instance is only deleted when there are no more
@@ -203,8 +245,7 @@ Err::CloudError DeviceManager::unhook(QString mapping)
          * It may even happen that the handle is reused if a new mapping with
          * this address is created in the meantime. */
 
-        weakPtr.toStrongRef()->removeDevice();
-        _handleByMappings.insert(mapping, weakPtr);
+        handle->removeDevice();
     }
     Q_EMIT deviceHandleRemoved(deviceUUID);
 
@@ -220,15 +261,16 @@ Err::CloudError DeviceManager::hook(QString mapping, QString uuid, bool force)
         return Err::PERMISSION_DENIED; // Device needs to be online
     }
 
-    if(_deviceMappings.contains(mapping))
+    if(!getDeviceByMapping(mapping).isEmpty())
     {
         unhook(mapping);
     }
 
-    if(_deviceMappings.values().contains(uuid))
+    QStringList existingMappings = getMappingsForDevice(uuid);
+    if(!existingMappings.isEmpty())
     {
         if(force)
-             unhook(_deviceMappings.key(uuid));
+             unhook(existingMappings.first());
         else
             return Err::ALREADY_EXISTS;
     }
@@ -240,11 +282,13 @@ Err::CloudError DeviceManager::hook(QString mapping, QString uuid, bool force)
         device->setAuthentificationKey(value);
     }
 
-    _deviceMappings.insert(mapping, uuid);
+    insertMapping(mapping, uuid);
 
     // dummy handle already exists - This is the case when someone instanciates
     // a handler to an Device which hasn't already a hook
-    deviceHandlePtr handle = _handleByMappings.value(mapping);
+    _handleLock.lockForRead();
+    deviceHandlePtr handle = _handleByMappings.value(mapping).toStrongRef();
+    _handleLock.unlock();
     if(!handle.isNull())
     {
         QString path = _storagePath +"/handles/"+uuid;
@@ -254,7 +298,9 @@ Err::CloudError DeviceManager::hook(QString mapping, QString uuid, bool force)
         if(value != 0)
             handle->setAuthentificationKey(value);
 
+        _handleLock.lockForWrite();
         _handles.insert(uuid, handle);
+        _handleLock.unlock();
         Q_EMIT newDeviceHandle(uuid);
 
     }
@@ -269,16 +315,37 @@ Err::CloudError DeviceManager::hook(QString mapping, QString uuid, bool force)
     handle->setPermissions(device->getRequestedPermissions());
     Q_EMIT newDeviceMapping(uuid, mapping);
 
+    _handleLock.lockForWrite();
     _handleByMappings.remove(mapping);
+    _handleLock.unlock();
     saveMappings();
     return Err::NO_ERROR;
 }
 
+void DeviceManager::insertMapping(QString mapping, QString uuid)
+{
+    QWriteLocker locker(&_mappingLock);
+    QString previous = _deviceMappings.value(mapping);
+    if(!previous.isEmpty())
+        _mappingsByUuid.remove(previous, mapping);
+
+    _deviceMappings.insert(mapping, uuid);
+    _mappingsByUuid.insert(uuid, mapping);
+}
+
+void DeviceManager::removeMapping(QString mapping)
+{
+    QWriteLocker locker(&_mappingLock);
+    QString uuid = _deviceMappings.take(mapping);
+    if(!uuid.isEmpty())
+        _mappingsByUuid.remove(uuid, mapping);
+}
+
 void DeviceManager::saveMappings()
 {
     QVariantMap mappings;
     qInfo()<<"Save mapping:"+_storagePath+"/mappings";
-    QMapIterator<QString, QString> it(_deviceMappings);
+    QMapIterator<QString, QString> it(getMappings());
 
     while(it.hasNext())
     {
@@ -289,42 +356,32 @@ void DeviceManager::saveMappings()
     QVariantMap data;
     data["mappings"] = mappings;
 
-
-    QFile file(_storagePath+"/mappings");
-    QFileInfo info(file);
-    QDir dir(info.absolutePath());
-    if(!dir.exists())
-    {
-        dir.mkpath(info.absolutePath());
-    }
-
-    if(file.open(QFile::WriteOnly))
-    {
-        file.write(QJsonDocument::fromVariant(data).toJson());
-        file.close();
-    }
-    else
-    {
-        qDebug()<<"Warning: Could not open file -"<<file.errorString();
-    }
+    // written with the next batch instead of a blocking fsync on the event loop
+    if(!PersistenceScheduler::save(_storagePath+"/mappings", data, PersistenceScheduler::BATCHED))
+        qWarning()<<"Warning: Could not save device mappings";
 }
 
 void DeviceManager::loadMappings()
 {
+    PersistenceScheduler::waitForWritten(_storagePath+"/mappings");
     QFile file(_storagePath+"/mappings");
     if( file.open(QFile::ReadOnly))
     {
         QVariantMap data =  QJsonDocument::fromJson(file.readAll()).toVariant().toMap();
         QVariantMap mappings = data["mappings"].toMap();
         file.close();
+        _mappingLock.lockForWrite();
         _deviceMappings.clear();
+        _mappingsByUuid.clear();
+        _mappingLock.unlock();
+
         QMapIterator<QString, QVariant> it(mappings);
         while(it.hasNext())
         {
             it.next();
             QString mapping = it.key();
             QString uuid = it.value().toString();
-            _deviceMappings.insert(mapping, uuid);
+            insertMapping(mapping, uuid);
             Q_EMIT newDeviceMapping(uuid, mapping);
         }
     }
@@ -337,8 +394,11 @@ void DeviceManager::loadMappings()
 void DeviceManager::loadHandles()
 {
     // load only handles for Devices which have a mapping
-    QSet<QString> registeredDeviceUuids = _deviceMappings.values().toSet();
-    QSetIterator<QString> it(registeredDeviceUuids);
+    _mappingLock.lockForRead();
+    QStringList registeredDeviceUuids = _mappingsByUuid.uniqueKeys();
+    _mappingLock.unlock();
+
+    QListIterator<QString> it(registeredDeviceUuids);
     while(it.hasNext())
     {
         QString uuid = it.next();
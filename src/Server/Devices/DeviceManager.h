@@ -29,6 +29,9 @@
 #include "DeviceHandle.h"
 #include <QSharedPointer>
 #include <QWeakPointer>
+#include <QMultiHash>
+#include <QReadWriteLock>
+#include <functional>
 
 typedef QSharedPointer<IDevice> iDevicePtr;
 typedef QSharedPointer<DeviceHandle> deviceHandlePtr;
@@ -96,9 +99,30 @@ public:
         \fn QMap<QString, QString>  getMappings() const
         Returns a list with all registered mappings from the internal address to the device uuid.
         The key specifies the address string, value the device id string.
+        The map is implicitly shared, so this is cheap as long as the result is not modified.
+        Use getMappingsForDevice() or isMapped() to look up the mappings of a device.
     */
     QMap<QString, QString>    getMappings() const;
 
+    /*!
+        \fn void forEachMapping(QString prefix, std::function<void(const QString& mapping, const QString& uuid)> visitor) const
+        Calls \c visitor for every mapping which starts with \c prefix, in the order of the mappings.
+        The mappings are locked for reading meanwhile, so \c visitor must not call into the DeviceManager.
+    */
+    void                      forEachMapping(QString prefix, std::function<void(const QString& mapping, const QString& uuid)> visitor) const;
+
+    /*!
+        \fn QStringList getMappingsForDevice(QString uuid) const
+        Returns all addresses which are mapped to the device with the given uuid.
+    */
+    QStringList               getMappingsForDevice(QString uuid) const;
+
+    /*!
+        \fn bool isMapped(QString uuid) const
+        Returns true if the device with the given uuid is mapped to at least one address.
+    */
+    bool                      isMapped(QString uuid) const;
+
     /*!
         \fn deviceHandlePtr getHandle(QString uuid) const
         Returns a handle to the device with the given uuid. The hanle will be null if there is no device with this uuid.
@@ -108,6 +132,7 @@ public:
     /*!
         \fn deviceHandlePtr getHandleByMapping(QString mapping)
         Returns a handle to the device with the given mapping. The hanle will be null if there is no device with this uuid.
+        getHandle(), getHandleByMapping() and getHandles() are thread safe, the automation workers use them in their threads.
     */
     deviceHandlePtr           getHandleByMapping(QString mapping);
 
@@ -152,6 +177,9 @@ private:
     QMap<QString, weakDeviceHandlePtr>  _handleByMappings; // mapping -> handle
     QMap<QString, iDevicePtr>           _deviceMap; // uuid -> device
     QMap<QString, QString>              _deviceMappings; // mapping -> uuid
+    QMultiHash<QString, QString>        _mappingsByUuid; // uuid -> mappings
+    mutable QReadWriteLock              _mappingLock; // guards _deviceMappings and _mappingsByUuid
+    mutable QReadWriteLock              _handleLock; // guards _handles and _handleByMappings
     QMap<QString, QString>              _shortIDtoUid; // shortID -> uuid
     QMap<QString, QString>              _preparedHooks; // hooks that will be set when device comes online
     QString                             _storagePath;
@@ -161,6 +189,9 @@ private:
     Err::CloudError hook(QString mapping, QString uuid, bool force = true);
 
 
+    void insertMapping(QString mapping, QString uuid);
+    void removeMapping(QString mapping);
+
     deviceHandlePtr addDeviceHandle(QString uuid);
     void saveMappings();
     void loadMappings();
@@ -5,135 +5,79 @@
  * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
 
 #include "DeviceProperty.h"
-#include <QDateTime>
 #include <QDebug>
-#include <QReadLocker>
-#include <QWriteLocker>
 
 
-DeviceProperty::DeviceProperty(QString name, DeviceHandle *parent, QVariantMap metadata) : QObject(parent),
-    _name(name)
+DeviceProperty::DeviceProperty(QString name, PropertyTable *table, DeviceHandle *parent) : QObject(parent),
+    _name(name),
+    _table(table)
 {
-    if(!metadata.isEmpty())
-    {
-        _mutex.lockForWrite();
-        _realValue              = metadata["val"];
-        _setValue               = metadata["setVal"];
-        _timestamp              = metadata["timestamp"].toLongLong();
-        _dirty                  = metadata["dirty"].toBool();
-        _metadata               = metadata["metadata"].toMap();
-        _mutex.unlock();
-        _mutex.lockForRead();
-        Q_EMIT setValueChanged(_name, _setValue, _dirty);
-        Q_EMIT realValueChanged(_name, _realValue, _dirty, _timestamp);
-        _mutex.unlock();
-    }
 }
 
 QVariant DeviceProperty::getValue() const
 {
-     QReadLocker locker(&_mutex);
-        return _dirty ? _setValue : _realValue;
+    return _table->getValue(_name);
 }
 
 QVariant DeviceProperty::getRealValue() const
 {
-    QReadLocker locker(&_mutex);
-    return _realValue;
+    return _table->getRealValue(_name);
 }
 
-void DeviceProperty::setRealValue(const QVariant &realValue,  bool keepDirtyFlag)
+void DeviceProperty::notify(const PropertyTable::Change &change)
 {
-    if(!keepDirtyFlag)
-        setDirty(false, realValue == _setValue);
-
-    _mutex.lockForWrite();
-    _realValue = realValue;
-    _timestamp = QDateTime::currentMSecsSinceEpoch();
-    _mutex.unlock();
-    _mutex.lockForRead();
-    Q_EMIT realValueChanged(_name, realValue, _dirty, _timestamp);
-    _mutex.unlock();
-}
+    if(change.flags & PropertyTable::DIRTY)
+        Q_EMIT dirtyChanged(_name, change.dirty);
 
-void DeviceProperty::setDirty(bool dirty, bool accepted)
-{
-    _mutex.lockForWrite();
-    _dirty = dirty;
-    _mutex.unlock();
-    _mutex.lockForRead();
-    Q_EMIT dirtyChanged(_name, dirty);
-    _mutex.unlock();
-
-    if(!dirty)
-    {
-        _mutex.lockForRead();
-        Q_EMIT confirmed(_name,_timestamp, accepted);
-        _mutex.unlock();
-    }
-}
+    if(change.flags & PropertyTable::CONFIRMED)
+        Q_EMIT confirmed(_name, change.timestamp, change.accepted);
 
-DeviceProperty::~DeviceProperty()
-{
-}
+    if(change.flags & PropertyTable::SET_VALUE)
+        Q_EMIT setValueChanged(_name, change.value, change.dirty);
 
+    if(change.flags & PropertyTable::REAL_VALUE)
+        Q_EMIT realValueChanged(_name, change.value, change.dirty, change.timestamp);
+
+    if(change.flags & PropertyTable::METADATA)
+        Q_EMIT metadataChanged(_name, change.key, change.value);
+}
 
 QVariantMap DeviceProperty::toMap() const
 {
-    QVariantMap metadata;
-    _mutex.lockForRead();
-    metadata["name"]     = _name;
-    metadata["val"]      = _realValue;
-    metadata["setVal"]   = _setValue;
-    metadata["timestamp"]  = _timestamp;
-    metadata["dirty"]    = _dirty;
-    metadata["metadata"] = _metadata;
-    _mutex.unlock();
-    return metadata;
+    return _table->toMap(_name);
 }
 
 QVariant DeviceProperty::getSetValue() const
 {
-    QReadLocker locker(&_mutex);
-    return _setValue;
+    return _table->getSetValue(_name);
 }
 
 QString DeviceProperty::getName() const
 {
-    QReadLocker locker(&_mutex);
     return _name;
 }
 
 void DeviceProperty::setValue(const QVariant &setValue)
 {
-    setDirty(true, false);
-    _mutex.lockForWrite();
-    _setValue = setValue;
-    _mutex.unlock();
-    _mutex.lockForRead();
-    Q_EMIT setValueChanged(_name, setValue, true);
-    _mutex.unlock();
+    _table->setValue(_name, setValue);
 }
 
 void DeviceProperty::setMetadata(QString key, QVariant value)
 {
-    _mutex.lockForWrite();
-    _metadata[key] = value;
-    _mutex.unlock();
-    _mutex.lockForRead();
-    Q_EMIT metadataChanged(_name, key, value);
-    _mutex.unlock();
+    _table->setMetadata(_name, key, value);
 }
 
 bool DeviceProperty::isDirty() const
 {
-    QReadLocker locker(&_mutex);
-    return _dirty;
+    return _table->isDirty(_name);
 }
 
-qlonglong DeviceProperty::confirmedTimestamp() const
+QVariantList DeviceProperty::history(qint64 from, qint64 to, int buckets) const
 {
-    QReadLocker locker(&_mutex);
-    return _timestamp;
+    return _table->history(_name, from, to, buckets);
 }
 
+qlonglong DeviceProperty::confirmedTimestamp() const
+{
+    return _table->confirmedTimestamp(_name);
+}
@@ -9,7 +9,7 @@
 
 #include <QObject>
 #include "DeviceHandle.h"
-#include <QReadWriteLock>
+#include "PropertyTable.h"
 
 /*!
     \class DeviceProperty
@@ -21,6 +21,10 @@
     currently offline.
     This interface can be used if you want to read or change the property of a Device with a DeviceHandle.
 
+    The state of the properties is stored in the PropertyTable of the DeviceHandle. DeviceProperty objects are
+    only wrappers for consumers which need a QObject (QML, automation). They are created on demand with
+    DeviceHandle::property() and emit their signals after the table has published a change.
+
     \sa DeviceHandle
 */
 class DeviceProperty : public QObject
@@ -93,6 +97,13 @@ public:
     */
     QVariantMap toMap() const;
 
+    /*!
+        \fn QVariantList history(qint64 from, qint64 to, int buckets = 0) const
+        Returns the recorded real values between from and to (ms since epoch). Only numeric values are recorded.
+        \sa PropertyHistory::query()
+    */
+    QVariantList history(qint64 from, qint64 to, int buckets = 0) const;
+
 public slots:
     /*!
         \fn  void setValue(const QVariant &setValue);
@@ -119,19 +130,11 @@ signals:
     void metadataChanged(QString name, QString key, QVariant value);
 
 private:
-    void setRealValue(const QVariant &getRealValue, bool keepDirtyFlag = false);
-    void setDirty(bool isDirty, bool accepted);
-    explicit DeviceProperty(QString name, DeviceHandle *parent, QVariantMap metadata = QVariantMap());
-    ~DeviceProperty();
+    explicit DeviceProperty(QString name, PropertyTable* table, DeviceHandle *parent);
+    void notify(const PropertyTable::Change& change);
 
-private:
-    QString         _name;
-    QVariantMap     _metadata;
-    QVariant        _realValue;
-    QVariant        _setValue;
-    bool            _dirty;
-    qlonglong       _timestamp;
-    mutable QReadWriteLock  _mutex;
+    const QString           _name;
+    PropertyTable*          _table;
 
 
 
@@ -0,0 +1,218 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "DeviceRpcQueue.h"
+#include <QDateTime>
+
+// maximum number of unanswered calls per device
+#define DEVICE_RPC_WINDOW       4
+
+// maximum number of calls waiting for a free slot
+#define DEVICE_RPC_MAX_QUEUED   64
+
+// default deadline of a call in ms
+#define DEVICE_RPC_TIMEOUT      10000
+
+// time in ms for which late answers of timed out calls are recognized and dropped
+#define DEVICE_RPC_EXPIRED_TTL  60000
+
+DeviceRpcQueue::DeviceRpcQueue(QObject *parent) : QObject(parent)
+{
+    _timer.setSingleShot(true);
+    connect(&_timer, &QTimer::timeout, this, &DeviceRpcQueue::timeout);
+}
+
+void DeviceRpcQueue::setDevice(QSharedPointer<IDevice> device)
+{
+    _device = device;
+}
+
+IDevice::DeviceError DeviceRpcQueue::call(QString name, QVariantMap parameters, QString cbID, int timeout, bool idempotent)
+{
+    if(_device.isNull())
+        return IDevice::DEVICE_NOT_AVAILABLE;
+
+    if(idempotent)
+    {
+        QMutableHashIterator<QString, Call> it(_inFlight);
+        while(it.hasNext())
+        {
+            Call& running = it.next().value();
+            if(matches(running, name, parameters))
+            {
+                running.callers << cbID;
+                return IDevice::NO_ERROR;
+            }
+        }
+
+        for(int i = 0; i < _queue.count(); i++)
+        {
+            if(matches(_queue.at(i), name, parameters))
+            {
+                _queue[i].callers << cbID;
+                return IDevice::NO_ERROR;
+            }
+        }
+    }
+
+    Call call;
+    call.name = name;
+    call.parameters = parameters;
+    call.callers << cbID;
+    call.idempotent = idempotent;
+    call.deadline = QDateTime::currentMSecsSinceEpoch() + (timeout < 0 ? DEVICE_RPC_TIMEOUT : timeout);
+
+    if(_inFlight.count() < DEVICE_RPC_WINDOW)
+    {
+        IDevice::DeviceError error = send(call);
+        if(error != IDevice::NO_ERROR)
+            return error;
+    }
+    else
+    {
+        if(_queue.count() >= DEVICE_RPC_MAX_QUEUED)
+            return IDevice::TOO_MANY_REQUESTS;
+
+        _queue.append(call);
+    }
+
+    schedule();
+    return IDevice::NO_ERROR;
+}
+
+bool DeviceRpcQueue::finish(QString id, QStringList *callers)
+{
+    if(_expired.remove(id) > 0)
+    {
+        callers->clear();
+        return true;
+    }
+
+    if(!_inFlight.contains(id))
+        return false;
+
+    *callers = _inFlight.take(id).callers;
+    sendNext();
+    schedule();
+    return true;
+}
+
+void DeviceRpcQueue::abort(IDevice::DeviceError error)
+{
+    QList<Call> calls = _inFlight.values() + _queue;
+    _inFlight.clear();
+    _queue.clear();
+    _timer.stop();
+
+    for(int i = 0; i < calls.count(); i++)
+        fail(calls.at(i), error);
+}
+
+bool DeviceRpcQueue::matches(const Call &call, const QString &name, const QVariantMap &parameters)
+{
+    return call.idempotent && call.name == name && call.parameters == parameters;
+}
+
+void DeviceRpcQueue::fail(const Call &call, IDevice::DeviceError error)
+{
+    QListIterator<QString> it(call.callers);
+    while(it.hasNext())
+        Q_EMIT callFailed(it.next(), error);
+}
+
+IDevice::DeviceError DeviceRpcQueue::send(Call &call)
+{
+    if(_device.isNull())
+        return IDevice::DEVICE_NOT_AVAILABLE;
+
+    call.id = "rpc:" + QString::number(++_sequence);
+    IDevice::DeviceError error = _device->triggerFunction(call.name, call.parameters, call.id);
+    if(error == IDevice::NO_ERROR)
+        _inFlight.insert(call.id, call);
+
+    return error;
+}
+
+void DeviceRpcQueue::sendNext()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    while(_inFlight.count() < DEVICE_RPC_WINDOW && !_queue.isEmpty())
+    {
+        Call call = _queue.takeFirst();
+        if(call.deadline <= now)
+        {
+            fail(call, IDevice::TIMEOUT);
+            continue;
+        }
+
+        IDevice::DeviceError error = send(call);
+        if(error != IDevice::NO_ERROR)
+            fail(call, error);
+    }
+}
+
+void DeviceRpcQueue::schedule()
+{
+    qint64 next = -1;
+    QHashIterator<QString, Call> it(_inFlight);
+    while(it.hasNext())
+    {
+        qint64 deadline = it.next().value().deadline;
+        if(next < 0 || deadline < next)
+            next = deadline;
+    }
+
+    for(int i = 0; i < _queue.count(); i++)
+    {
+        if(next < 0 || _queue.at(i).deadline < next)
+            next = _queue.at(i).deadline;
+    }
+
+    if(next < 0)
+    {
+        _timer.stop();
+        return;
+    }
+
+    _timer.start(int(qMax(qint64(0), next - QDateTime::currentMSecsSinceEpoch())));
+}
+
+void DeviceRpcQueue::timeout()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QList<Call> failed;
+
+    QMutableHashIterator<QString, Call> it(_inFlight);
+    while(it.hasNext())
+    {
+        it.next();
+        if(it.value().deadline <= now)
+        {
+            _expired.insert(it.key(), now);
+            failed << it.value();
+            it.remove();
+        }
+    }
+
+    for(int i = _queue.count() - 1; i >= 0; i--)
+    {
+        if(_queue.at(i).deadline <= now)
+            failed.prepend(_queue.takeAt(i));
+    }
+
+    QMutableHashIterator<QString, qint64> expiredIt(_expired);
+    while(expiredIt.hasNext())
+    {
+        if(expiredIt.next().value() < now - DEVICE_RPC_EXPIRED_TTL)
+            expiredIt.remove();
+    }
+
+    sendNext();
+    schedule();
+
+    for(int i = 0; i < failed.count(); i++)
+        fail(failed.at(i), IDevice::TIMEOUT);
+}
@@ -0,0 +1,94 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef DEVICERPCQUEUE_H
+#define DEVICERPCQUEUE_H
+
+#include <QObject>
+#include <QTimer>
+#include <QHash>
+#include <QSharedPointer>
+#include "IDevice.h"
+
+/*!
+    \class DeviceRpcQueue
+    \brief Flow control for the remote procedure calls of a single device.
+    \ingroup devices
+
+    Only calls with a callback id (cbID) are answered by the device, so only those are managed here:
+    - At most DEVICE_RPC_WINDOW calls are sent to the device at the same time, further calls wait in a
+      queue of at most DEVICE_RPC_MAX_QUEUED calls (TOO_MANY_REQUESTS otherwise).
+    - Every call has a deadline. Calls which are not answered in time fail with TIMEOUT, late answers are dropped.
+    - Identical calls of idempotent functions are sent once, the answer is delivered to all callers.
+
+    The device gets an id of the queue ("rpc:<sequence number>") as callback id, never the cbID of a client,
+    so calls of different clients with the same cbID don't collide. finish() maps the answer back to the cbIDs
+    of the callers. The queue uses timers and must only be used from the thread it lives in.
+
+    \sa DeviceHandle::triggerFunction()
+*/
+
+class DeviceRpcQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DeviceRpcQueue(QObject* parent = nullptr);
+
+    void                    setDevice(QSharedPointer<IDevice> device);
+
+    /*!
+        \fn IDevice::DeviceError DeviceRpcQueue::call(QString name, QVariantMap parameters, QString cbID, int timeout, bool idempotent)
+        Sends or queues the call. timeout is the deadline in ms (< 0 for the default), counted from now on.
+    */
+    IDevice::DeviceError    call(QString name, QVariantMap parameters, QString cbID, int timeout = -1, bool idempotent = false);
+
+    /*!
+        \fn bool DeviceRpcQueue::finish(QString id, QStringList* callers)
+        Has to be called for every answer of the device with the callback id of the answer. Returns false if the answer
+        doesn't belong to a managed call. Otherwise callers contains the cbIDs of all callers, which is empty if the
+        call has timed out.
+    */
+    bool                    finish(QString id, QStringList* callers);
+
+    /*!
+        \fn void DeviceRpcQueue::abort(IDevice::DeviceError error)
+        Fails all waiting and running calls with the given error, e.g. when the device went offline.
+    */
+    void                    abort(IDevice::DeviceError error);
+
+signals:
+    void callFailed(QString cbID, IDevice::DeviceError error);
+
+private:
+    struct Call
+    {
+        QString     id;         // callback id sent to the device
+        QString     name;
+        QVariantMap parameters;
+        QStringList callers;
+        qint64      deadline = 0;
+        bool        idempotent = false;
+    };
+
+    static bool             matches(const Call& call, const QString& name, const QVariantMap& parameters);
+    void                    fail(const Call& call, IDevice::DeviceError error);
+    IDevice::DeviceError    send(Call& call);
+    void                    sendNext();
+    void                    schedule();
+
+    QSharedPointer<IDevice> _device;
+    QList<Call>             _queue;
+    quint64                 _sequence = 0;
+    QHash<QString, Call>    _inFlight; // id of the sent call -> call
+    QHash<QString, qint64>  _expired; // id -> time of the timeout
+    QTimer                  _timer;
+
+private slots:
+    void timeout();
+};
+
+#endif // DEVICERPCQUEUE_H
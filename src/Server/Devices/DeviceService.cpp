@@ -7,6 +7,7 @@
 #include "DeviceService.h"
 #include "Server/Authentication/AuthentificationService.h"
 #include "DeviceManager.h"
+#include "DeviceBulkCommand.h"
 #include <QDebug>
 
 DeviceService::DeviceService(QObject* parent) : IService(parent),
@@ -23,7 +24,8 @@ QString DeviceService::getServiceName() const
 QStringList DeviceService::getServiceCalls() const
 {
     QStringList calls;
-    calls << "hookWithShortID" << "unhookWithShortID" << "checkForUpdates" << "startUpdate";
+    calls << "hookWithShortID" << "unhookWithShortID" << "checkForUpdates" << "startUpdate" << "setPropertyBulk" << "callBulk"
+          << "startRollout" << "rolloutStatus" << "cancelRollout";
     return calls;
 }
 
@@ -45,11 +47,71 @@ bool DeviceService::call(QString call, QString token, QString cbID, QVariant arg
         return true;
     }
 
+    if (call == "startRollout")
+    {
+        _updateLogic->startRollout(token, argument.toMap(), cbID);
+        return true;
+    }
+
+    if (call == "rolloutStatus")
+    {
+        Q_EMIT response(cbID, _updateLogic->rolloutStatus(token, argument.toMap()));
+        return true;
+    }
+
+    if (call == "cancelRollout")
+    {
+        Q_EMIT response(cbID, _updateLogic->cancelRollout(token, argument.toMap()));
+        return true;
+    }
+
+    if (call == "setPropertyBulk" || call == "callBulk")
+        return startBulkCommand(call, token, cbID, argument.toMap());
+
     QVariantMap answer = syncCalls(call, token, argument);
     Q_EMIT response(cbID, answer);
     return true;
 }
 
+bool DeviceService::startBulkCommand(QString call, QString token, QString cbID, QVariantMap argument)
+{
+    QVariantMap answer;
+    iIdentityPtr user = AuthenticationService::instance()->validateToken(token);
+    if(user.isNull())
+    {
+        answer["errorstring"] = "Invalid token";
+        answer["errorcode"] = Err::INVALID_TOKEN;
+        Q_EMIT response(cbID, answer);
+        return true;
+    }
+
+    // devices without a permission checker accept writes of every user, a fan out needs a fleet-level permission
+    if(!user->isAuthorizedTo(MANAGE_DEVICES))
+    {
+        answer["errorstring"] = "Permission denied";
+        answer["errorcode"] = Err::PERMISSION_DENIED;
+        Q_EMIT response(cbID, answer);
+        return true;
+    }
+
+    bool setProperty = call == "setPropertyBulk";
+    QString name = setProperty ? argument["property"].toString() : argument["function"].toString();
+    if(name.isEmpty() || !DeviceBulkCommand::isValidSelector(argument["selector"].toMap()))
+    {
+        answer["errorstring"] = "Invalid arguments";
+        answer["errorcode"] = Err::INVALID_DATA;
+        Q_EMIT response(cbID, answer);
+        return true;
+    }
+
+    // permissions of the single devices are checked by the DeviceHandles
+    DeviceBulkCommand* command = new DeviceBulkCommand(setProperty ? DeviceBulkCommand::SET_PROPERTY : DeviceBulkCommand::CALL,
+                                                       name, setProperty ? argument["value"] : argument["params"], token, cbID, this);
+    connect(command, &DeviceBulkCommand::finished, this, &DeviceService::response);
+    command->start(DeviceBulkCommand::select(argument["selector"].toMap()), argument["wait"].toBool(), argument.value("timeout", -1).toInt());
+    return true;
+}
+
 QVariantMap DeviceService::syncCalls(QString call, QString token, QVariant argument)
 {
     QVariantMap argMap = argument.toMap();
@@ -85,7 +147,7 @@ QVariantMap DeviceService::syncCalls(QString call, QString token, QVariant argum
         }
 
         QString uuid = DeviceManager::instance()->getUuidForShortId(shortID);
-        QString existingMapping = DeviceManager::instance()->getMappings().key(uuid);
+        QString existingMapping = DeviceManager::instance()->getMappingsForDevice(uuid).value(0);
 
         answer["errorcode"] = DeviceManager::instance()->setDeviceMapping(token, existingMapping, "", true);
         return answer;
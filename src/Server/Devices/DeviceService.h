@@ -27,6 +27,13 @@
     unhookWithShortID   - removes a device mapping via its shortID
     checkForUpdates     - checks for available plugins for a given shortID
     startUpdate         - starts an update for a specific device with a download URL
+    setPropertyBulk     - sets a property on all devices matching a selector ({selector, property, value})
+    callBulk            - calls a function on all devices matching a selector ({selector, function, params, wait, timeout})
+    startRollout        - updates the firmware of all devices of a type in waves ({type, selector, options}), see FirmwareRollout
+    rolloutStatus       - returns the status of a rollout ({id}) or of all rollouts
+    cancelRollout       - stops a rollout ({id})
+
+    See DeviceBulkCommand for the selector and the aggregated result of the bulk calls.
 
 
     \sa DeviceHandleHandler DeviceManager
@@ -43,6 +50,7 @@ public:
     QVariantMap             syncCalls(QString call, QString token, QVariant argument);
 
 private:
+    bool                    startBulkCommand(QString call, QString token, QString cbID, QVariantMap argument);
     DeviceUpdateLogic* _updateLogic = nullptr;
 };
 
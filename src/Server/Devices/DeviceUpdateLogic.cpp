@@ -7,16 +7,30 @@
 #include "DeviceUpdateLogic.h"
 #include "QProcessEnvironment"
 #include "DeviceManager.h"
+#include "DeviceBulkCommand.h"
+#include "FirmwareRollout.h"
+#include "FirmwareStore.h"
 #include <QNetworkReply>
 #include <QJsonDocument>
+#include <QDateTime>
+#include <QUuid>
 #include "Server/Authentication/AuthentificationService.h"
 #include "Server/Authentication/IUser.h"
 
+// seconds a version.json is cached
+#define FIRMWARE_MANIFEST_TTL           300
+#define FIRMWARE_MANIFEST_ERROR_TTL     30
+
+// number of finished rollouts which are kept for status requests
+#define FIRMWARE_ROLLOUT_HISTORY        20
 
 DeviceUpdateLogic::DeviceUpdateLogic(QObject *parent) : QObject(parent),
     _nam(new QNetworkAccessManager(this))
 {
-    _firmwareLookup = QProcessEnvironment::systemEnvironment().value("FIRMWARE_UPDATE_LOOKUP", "");
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    _firmwareLookup = environment.value("FIRMWARE_UPDATE_LOOKUP", "");
+    _manifestTtl = environment.value("FIRMWARE_MANIFEST_TTL", QString::number(FIRMWARE_MANIFEST_TTL)).toLongLong() * 1000;
+    _manifestErrorTtl = environment.value("FIRMWARE_MANIFEST_ERROR_TTL", QString::number(FIRMWARE_MANIFEST_ERROR_TTL)).toLongLong() * 1000;
 }
 
 bool DeviceUpdateLogic::checkForUpdates(QString mapping, QString cbID)
@@ -32,21 +46,17 @@ bool DeviceUpdateLogic::checkForUpdates(QString mapping, QString cbID)
         return false;
     }
 
-    QString deviceType = handle->type();
-    QUrl url(_firmwareLookup+handle->type()+"/version.json");
-
-    QNetworkReply* reply =  _nam->get(QNetworkRequest(url));
-    reply->setProperty("cbID", cbID);
-    reply->setProperty("mapping", mapping);
-    connect(reply, &QNetworkReply::finished, this, &DeviceUpdateLogic::lookupFinished);
+    lookup(handle->type(), [this, mapping, cbID](QVariantMap manifest, QString error)
+    {
+        checkVersion(mapping, manifest, error, cbID);
+    });
     return true;
 }
 
 bool DeviceUpdateLogic::startUpdate(QString token, QString mapping, QString url,  QString cbID)
 {
     QVariantMap answer;
-    iIdentityPtr user = AuthenticationService::instance()->validateToken(token);
-    if (user.isNull() || !user->isAuthorizedTo(IS_ADMIN))
+    if (!isAdmin(token))
     {
         answer["status"] = PERMISSION_DENIED;
         answer["error"] = "Permission denied!";
@@ -70,31 +80,211 @@ bool DeviceUpdateLogic::startUpdate(QString token, QString mapping, QString url,
     return true;
 }
 
-void DeviceUpdateLogic::lookupFinished()
+bool DeviceUpdateLogic::startRollout(QString token, QVariantMap argument, QString cbID)
 {
-    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
-    if(!reply)
-        return;
+    QVariantMap answer;
+    if (!isAdmin(token))
+    {
+        answer["status"] = PERMISSION_DENIED;
+        answer["error"] = "Permission denied!";
+        Q_EMIT sendResult(cbID, answer);
+        return false;
+    }
+
+    QString type = argument["type"].toString();
+    if(type.isEmpty())
+    {
+        answer["status"] = CHECK_FAILED;
+        answer["error"] = "Missing device type.";
+        Q_EMIT sendResult(cbID, answer);
+        return false;
+    }
 
-    QString cbID = reply->property("cbID").toString();
-    QString mapping = reply->property("mapping").toString();
+    lookup(type, [this, type, argument, cbID](QVariantMap manifest, QString error)
+    {
+        if(!error.isEmpty())
+        {
+            QVariantMap answer;
+            answer["status"] = CHECK_FAILED;
+            answer["error"] = error;
+            Q_EMIT sendResult(cbID, answer);
+            return;
+        }
+
+        mirrorImage(type, manifest, [this, type, manifest, argument, cbID](QString file)
+        {
+            startRollout(type, manifest, file, argument, cbID);
+        });
+    });
+    return true;
+}
 
+QVariantMap DeviceUpdateLogic::rolloutStatus(QString token, QVariantMap argument)
+{
     QVariantMap answer;
-    answer["status"] = CHECK_FAILED;
+    if (!isAdmin(token))
+    {
+        answer["status"] = PERMISSION_DENIED;
+        answer["error"] = "Permission denied!";
+        return answer;
+    }
 
+    QString id = argument["id"].toString();
+    if(id.isEmpty())
+    {
+        QVariantList rollouts;
+        QMapIterator<QString, FirmwareRollout*> it(_rollouts);
+        while(it.hasNext())
+            rollouts << it.next().value()->status();
 
-    if(reply->error() != QNetworkReply::NoError)
+        answer["rollouts"] = rollouts;
+        return answer;
+    }
+
+    FirmwareRollout* rollout = _rollouts.value(id, nullptr);
+    if(!rollout)
+    {
+        answer["status"] = ROLLOUT_NOT_FOUND;
+        return answer;
+    }
+
+    answer["rollout"] = rollout->status();
+    return answer;
+}
+
+QVariantMap DeviceUpdateLogic::cancelRollout(QString token, QVariantMap argument)
+{
+    QVariantMap answer;
+    if (!isAdmin(token))
+    {
+        answer["status"] = PERMISSION_DENIED;
+        answer["error"] = "Permission denied!";
+        return answer;
+    }
+
+    FirmwareRollout* rollout = _rollouts.value(argument["id"].toString(), nullptr);
+    if(!rollout)
     {
-        answer["error"] = reply->errorString();
-        delete reply;
-        reply = nullptr;
+        answer["status"] = ROLLOUT_NOT_FOUND;
+        return answer;
+    }
+
+    rollout->cancel();
+    answer["rollout"] = rollout->status();
+    return answer;
+}
+
+bool DeviceUpdateLogic::isAdmin(QString token) const
+{
+    iIdentityPtr user = AuthenticationService::instance()->validateToken(token);
+    return !user.isNull() && user->isAuthorizedTo(IS_ADMIN);
+}
+
+void DeviceUpdateLogic::lookup(QString type, ManifestCallback callback)
+{
+    Manifest& manifest = _manifests[type];
+    qint64 ttl = manifest.error.isEmpty() ? _manifestTtl : _manifestErrorTtl;
+    if(manifest.fetched > 0 && QDateTime::currentMSecsSinceEpoch() - manifest.fetched < ttl)
+    {
+        callback(manifest.info, manifest.error);
+        return;
+    }
+
+    // a lookup of this type is already running
+    manifest.waiting << callback;
+    if(manifest.waiting.count() > 1)
+        return;
+
+    QUrl url(_firmwareLookup+type+"/version.json");
+    QNetworkReply* reply =  _nam->get(QNetworkRequest(url));
+    reply->setProperty("type", type);
+    connect(reply, &QNetworkReply::finished, this, &DeviceUpdateLogic::lookupFinished);
+}
+
+void DeviceUpdateLogic::mirrorImage(QString type, QVariantMap manifest, std::function<void (QString)> callback)
+{
+    QString file = manifest["file"].toString();
+    if(!file.isEmpty())
+    {
+        if(!FirmwareStore::instance()->contains(file))
+        {
+            qWarning()<<"Warning: Firmware image"<<file<<"is not in the firmware store.";
+            file.clear();
+        }
+        callback(file);
+        return;
+    }
+
+    QUrl url(manifest["url"].toString());
+    file = type + "-" + manifest["version"].toString() + ".bin";
+    if(url.isEmpty() || FirmwareStore::instance()->contains(file))
+    {
+        callback(FirmwareStore::instance()->contains(file) ? file : QString());
+        return;
+    }
+
+    QNetworkReply* reply = _nam->get(QNetworkRequest(url));
+    connect(reply, &QNetworkReply::finished, this, [reply, file, callback]()
+    {
+        reply->deleteLater();
+
+        // without a local copy the devices download the image from the url
+        if(reply->error() != QNetworkReply::NoError)
+        {
+            qWarning()<<"Warning: Could not mirror firmware image"<<reply->url()<<"-"<<reply->errorString();
+            callback(QString());
+            return;
+        }
+
+        callback(FirmwareStore::instance()->store(file, reply->readAll()) ? file : QString());
+    });
+}
+
+void DeviceUpdateLogic::startRollout(QString type, QVariantMap manifest, QString file, QVariantMap argument, QString cbID)
+{
+    QVariantMap answer;
+    QVariantMap updateArgs;
+    updateArgs["val"] = manifest["url"];
+    if(!file.isEmpty())
+    {
+        updateArgs["file"] = file;
+        updateArgs["size"] = FirmwareStore::instance()->size(file);
+        updateArgs["sha1"] = FirmwareStore::instance()->sha1(file);
+        updateArgs["chunk"] = FIRMWARE_CHUNK_SIZE;
+    }
+    else if(manifest["url"].toString().isEmpty())
+    {
+        answer["status"] = CHECK_FAILED;
+        answer["error"] = "No firmware image available.";
         Q_EMIT sendResult(cbID, answer);
         return;
     }
 
-    QVariantMap versionInfo = QJsonDocument::fromJson(reply->readAll()).toVariant().toMap();
-    delete reply;
-    reply = nullptr;
+    QVariantMap selector = argument["selector"].toMap();
+    selector["type"] = type;
+
+    QString id = QUuid::createUuid().toString();
+    FirmwareRollout* rollout = new FirmwareRollout(id, type, toVersion(manifest["version"].toString()), updateArgs, this);
+    connect(rollout, &FirmwareRollout::finished, this, &DeviceUpdateLogic::rolloutFinished);
+    _rollouts.insert(id, rollout);
+    rollout->start(DeviceBulkCommand::select(selector), argument["options"].toMap());
+
+    answer["status"] = ROLLOUT_STARTED;
+    answer["rollout"] = rollout->status();
+    Q_EMIT sendResult(cbID, answer);
+}
+
+void DeviceUpdateLogic::checkVersion(QString mapping, QVariantMap versionInfo, QString error, QString cbID)
+{
+    QVariantMap answer;
+    answer["status"] = CHECK_FAILED;
+
+    if(!error.isEmpty())
+    {
+        answer["error"] = error;
+        Q_EMIT sendResult(cbID, answer);
+        return;
+    }
 
     deviceHandlePtr handle = DeviceManager::instance()->getHandleByMapping(mapping);
     if(handle.isNull() || handle->getFirmwareVersion() < 0)
@@ -104,10 +294,25 @@ void DeviceUpdateLogic::lookupFinished()
         return;
     }
 
+    int versionInt = toVersion(versionInfo["version"].toString());
+    answer["info"] = versionInfo;
+    if(handle->getFirmwareVersion() < versionInt)
+    {
+        answer["status"] = UPDATE_AVAILABLE;
+        Q_EMIT sendResult(cbID, answer);
+    }
+    else
+    {
+        answer["status"] = UP_TO_DATE;
+        Q_EMIT sendResult(cbID, answer);
+    }
+}
+
+int DeviceUpdateLogic::toVersion(QString version)
+{
     int major = 0;
     int minor = 0;
 
-    QString version =  versionInfo["version"].toString();
     QStringList split = version.split(".");
     if(split.count() > 1)
     {
@@ -115,16 +320,53 @@ void DeviceUpdateLogic::lookupFinished()
         minor = split[1].toInt();
     }
 
-    int versionInt = major * 1000 + minor;
-    answer["info"] = versionInfo;
-    if(handle->getFirmwareVersion() < versionInt)
+    return major * 1000 + minor;
+}
+
+void DeviceUpdateLogic::lookupFinished()
+{
+    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
+    if(!reply)
+        return;
+
+    QString type = reply->property("type").toString();
+    Manifest& manifest = _manifests[type];
+    manifest.info.clear();
+    manifest.error.clear();
+
+    if(reply->error() != QNetworkReply::NoError)
     {
-        answer["status"] = UPDATE_AVAILABLE;
-        Q_EMIT sendResult(cbID, answer);
+        manifest.error = reply->errorString();
     }
     else
     {
-        answer["status"] = UP_TO_DATE;
-        Q_EMIT sendResult(cbID, answer);
+        manifest.info = QJsonDocument::fromJson(reply->readAll()).toVariant().toMap();
+        if(manifest.info.isEmpty())
+            manifest.error = "Invalid version.json";
+    }
+    reply->deleteLater();
+    reply = nullptr;
+
+    manifest.fetched = QDateTime::currentMSecsSinceEpoch();
+    QList<ManifestCallback> waiting = manifest.waiting;
+    manifest.waiting.clear();
+
+    QVariantMap info = manifest.info;
+    QString error = manifest.error;
+    for(int i = 0; i < waiting.count(); i++)
+        waiting.at(i)(info, error);
+}
+
+void DeviceUpdateLogic::rolloutFinished(QString id, QVariantMap status)
+{
+    qInfo()<<"Firmware rollout"<<id<<"finished:"<<status["state"].toString()<<"- done:"<<status["done"].toInt()
+          <<"failed:"<<status["failed"].toInt()<<"skipped:"<<status["skipped"].toInt();
+
+    _finishedRollouts << id;
+    while(_finishedRollouts.count() > FIRMWARE_ROLLOUT_HISTORY)
+    {
+        FirmwareRollout* rollout = _rollouts.take(_finishedRollouts.takeFirst());
+        if(rollout)
+            rollout->deleteLater();
     }
 }
@@ -9,6 +9,10 @@
 
 #include <QObject>
 #include <QNetworkAccessManager>
+#include <QHash>
+#include <functional>
+
+class FirmwareRollout;
 
 class DeviceUpdateLogic : public QObject
 {
@@ -42,6 +46,15 @@ class DeviceUpdateLogic : public QObject
         new firmware version is available.
         This class is primarily used by DeviceService and separates the functionality from the service interface.
 
+        The version.json files are cached per device type for FIRMWARE_MANIFEST_TTL seconds (default 300),
+        failed lookups for FIRMWARE_MANIFEST_ERROR_TTL seconds. Concurrent lookups of the same type share one
+        request. The base URL may also be a file:// URL.
+
+        Updates of many devices are started with startRollout(), see FirmwareRollout. Before a rollout starts, the
+        firmware image is mirrored to the FirmwareStore (once per type and version), so the devices can fetch
+        it in chunks over their connection instead of downloading it from the firmware host. The version.json may
+        contain a "file" field instead of an "url" to refer to an image which was put into the store manually.
+
         \sa DeviceHandleHandler DeviceManager
     */
 public:
@@ -53,6 +66,8 @@ public:
         UP_TO_DATE=0,
         UPDATE_AVAILABLE=1,
         CMD_UPDATE_SENT=2,
+        ROLLOUT_STARTED=3,
+        ROLLOUT_NOT_FOUND=-4
     };
 
     explicit    DeviceUpdateLogic(QObject *parent = nullptr);
@@ -75,13 +90,54 @@ public:
     */
     bool        startUpdate(QString token, QString mapping, QString url, QString cbID);
 
+    /*!
+        Starts a firmware rollout to all devices of a type which have an older firmware version.
+        This function is asynchronous, the answer contains the id and the status of the rollout.
+        - token must be the token of a logged in user with admin permissions
+        - argument: {"type": ..., "selector": {...}, "options": {...}}, see DeviceBulkCommand for the selector and
+          FirmwareRollout for the options.
+    */
+    bool        startRollout(QString token, QVariantMap argument, QString cbID);
+
+    /*!
+        Returns the status of a rollout ({"id": ...}), or of all rollouts if no id is given.
+    */
+    QVariantMap rolloutStatus(QString token, QVariantMap argument);
+
+    /*!
+        Stops a rollout ({"id": ...}). Updates which were already sent are not aborted.
+    */
+    QVariantMap cancelRollout(QString token, QVariantMap argument);
+
 private:
-    QNetworkReply *startLookup(QString mapping);
+    typedef std::function<void(QVariantMap manifest, QString error)> ManifestCallback;
+
+    struct Manifest
+    {
+        QVariantMap             info;
+        QString                 error;
+        qint64                  fetched = 0;
+        QList<ManifestCallback> waiting;
+    };
+
+    bool                    isAdmin(QString token) const;
+    void                    lookup(QString type, ManifestCallback callback);
+    void                    mirrorImage(QString type, QVariantMap manifest, std::function<void(QString file)> callback);
+    void                    startRollout(QString type, QVariantMap manifest, QString file, QVariantMap argument, QString cbID);
+    void                    checkVersion(QString mapping, QVariantMap versionInfo, QString error, QString cbID);
+    static int              toVersion(QString version);
+
     QNetworkAccessManager*  _nam = nullptr;
     QString                 _firmwareLookup;
+    qint64                  _manifestTtl;
+    qint64                  _manifestErrorTtl;
+    QHash<QString, Manifest> _manifests;
+    QMap<QString, FirmwareRollout*> _rollouts;
+    QStringList             _finishedRollouts;
 
 private slots:
     void lookupFinished();
+    void rolloutFinished(QString id, QVariantMap status);
 
 signals:
     void sendResult(QString cbID, QVariant result);
@@ -0,0 +1,265 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "FirmwareRollout.h"
+#include "DeviceHandle.h"
+#include <QDateTime>
+#include <QtMath>
+
+#define FIRMWARE_ROLLOUT_CONCURRENCY        20
+#define FIRMWARE_ROLLOUT_FAILURE_RATE       0.1
+#define FIRMWARE_ROLLOUT_DEVICE_TIMEOUT     600000
+
+// interval to check running updates for timeouts
+#define FIRMWARE_ROLLOUT_CHECK_INTERVAL     5000
+
+FirmwareRollout::FirmwareRollout(QString id, QString type, int version, QVariantMap updateArgs, QObject *parent) : QObject(parent),
+    _id(id),
+    _type(type),
+    _version(version),
+    _updateArgs(updateArgs)
+{
+    _checkTimer.setInterval(FIRMWARE_ROLLOUT_CHECK_INTERVAL);
+    connect(&_checkTimer, &QTimer::timeout, this, &FirmwareRollout::checkUpdates);
+}
+
+void FirmwareRollout::start(QMap<QString, deviceHandlePtr> targets, QVariantMap options)
+{
+    _maxConcurrent = qMax(1, options.value("maxConcurrent", FIRMWARE_ROLLOUT_CONCURRENCY).toInt());
+    _maxFailureRate = options.value("maxFailureRate", FIRMWARE_ROLLOUT_FAILURE_RATE).toDouble();
+    _deviceTimeout = options.value("deviceTimeout", FIRMWARE_ROLLOUT_DEVICE_TIMEOUT).toLongLong();
+    _wavePause = options.value("wavePause", 0).toInt();
+
+    QMapIterator<QString, deviceHandlePtr> it(targets);
+    while(it.hasNext())
+    {
+        it.next();
+
+        // devices without firmware information can't be updated, up to date devices don't need to
+        int firmwareVersion = it.value()->getFirmwareVersion();
+        if(firmwareVersion < 0 || firmwareVersion >= _version)
+            continue;
+
+        Target target;
+        target.mapping = it.key();
+        target.handle = it.value();
+        _targets.append(target);
+    }
+
+    QVariantList waves = options.value("waves", QVariantList() << 1 << 10 << 100).toList();
+    for(int i = 0; i < waves.count(); i++)
+    {
+        int end = qBound(1, qCeil(_targets.count() * waves.at(i).toDouble() / 100.0), _targets.count());
+        if(_waveEnds.isEmpty() || end > _waveEnds.last())
+            _waveEnds.append(end);
+    }
+
+    if(_waveEnds.isEmpty() || _waveEnds.last() < _targets.count())
+        _waveEnds.append(_targets.count());
+
+    if(_targets.isEmpty())
+    {
+        finish(COMPLETED);
+        return;
+    }
+
+    _checkTimer.start();
+    startWave();
+}
+
+void FirmwareRollout::cancel()
+{
+    if(isFinished())
+        return;
+
+    finish(CANCELED);
+}
+
+bool FirmwareRollout::isFinished() const
+{
+    return _state != RUNNING;
+}
+
+QVariantMap FirmwareRollout::status() const
+{
+    int count[SKIPPED + 1] = {0, 0, 0, 0, 0};
+    QVariantList failures;
+    for(int i = 0; i < _targets.count(); i++)
+    {
+        const Target& target = _targets.at(i);
+        count[target.state]++;
+        if(target.state == FAILED)
+        {
+            QVariantMap failure;
+            failure["mapping"] = target.mapping;
+            failure["error"] = target.error;
+            failures << failure;
+        }
+    }
+
+    QVariantMap status;
+    status["id"] = _id;
+    status["type"] = _type;
+    status["version"] = _version;
+    status["state"] = stateName(_state);
+    status["wave"] = _wave + 1;
+    status["waves"] = _waveEnds.count();
+    status["total"] = _targets.count();
+    status["pending"] = count[PENDING];
+    status["running"] = count[UPDATING];
+    status["done"] = count[DONE];
+    status["failed"] = count[FAILED];
+    status["skipped"] = count[SKIPPED];
+    status["failures"] = failures;
+    return status;
+}
+
+QString FirmwareRollout::stateName(State state)
+{
+    switch(state)
+    {
+        case RUNNING:
+            return "running";
+        case HALTED:
+            return "halted";
+        case COMPLETED:
+            return "completed";
+        case CANCELED:
+            return "canceled";
+    }
+    return QString();
+}
+
+void FirmwareRollout::startWave()
+{
+    if(isFinished())
+        return;
+
+    qInfo()<<"Firmware rollout"<<_id<<"- starting wave"<<_wave + 1<<"of"<<_waveEnds.count();
+    dispatchNext();
+}
+
+void FirmwareRollout::dispatchNext()
+{
+    if(isFinished())
+        return;
+
+    int waveEnd = _waveEnds.at(_wave);
+    while(_next < waveEnd && _updating.count() < _maxConcurrent)
+        dispatch(_next++);
+
+    if(_next == waveEnd && _updating.isEmpty())
+        waveFinished();
+}
+
+void FirmwareRollout::dispatch(int index)
+{
+    Target& target = _targets[index];
+    if(target.handle->getDeviceState() != IDevice::ONLINE)
+    {
+        target.state = SKIPPED;
+        return;
+    }
+
+    target.state = UPDATING;
+    target.started = QDateTime::currentMSecsSinceEpoch();
+    _updating.insert(target.handle.data(), index);
+    connect(target.handle.data(), &DeviceHandle::deviceStateChanged, this, &FirmwareRollout::deviceStateChanged);
+
+    IDevice::DeviceError error = target.handle->startFirmwareUpdate(_updateArgs);
+    if(error != IDevice::NO_ERROR)
+        complete(index, FAILED, "Update rejected: " + QString::number(error));
+}
+
+void FirmwareRollout::complete(int index, TargetState state, QString error)
+{
+    Target& target = _targets[index];
+    _updating.remove(target.handle.data());
+    disconnect(target.handle.data(), nullptr, this, nullptr);
+    target.state = state;
+    target.error = error;
+}
+
+void FirmwareRollout::waveFinished()
+{
+    int done = 0;
+    int failed = 0;
+    for(int i = 0; i < _next; i++)
+    {
+        if(_targets.at(i).state == DONE)
+            done++;
+        else if(_targets.at(i).state == FAILED)
+            failed++;
+    }
+
+    if(failed > 0 && double(failed) / (done + failed) > _maxFailureRate)
+    {
+        qWarning()<<"Warning: Firmware rollout"<<_id<<"halted after wave"<<_wave + 1<<"-"<<failed<<"of"<<done + failed<<"updates failed.";
+        finish(HALTED);
+        return;
+    }
+
+    if(_wave + 1 >= _waveEnds.count())
+    {
+        finish(COMPLETED);
+        return;
+    }
+
+    _wave++;
+    QTimer::singleShot(_wavePause, this, &FirmwareRollout::startWave);
+}
+
+void FirmwareRollout::finish(State state)
+{
+    _state = state;
+    _checkTimer.stop();
+
+    // running updates are not aborted by the devices, but no longer tracked
+    QHashIterator<DeviceHandle*, int> it(_updating);
+    while(it.hasNext())
+        disconnect(it.next().key(), nullptr, this, nullptr);
+    _updating.clear();
+
+    Q_EMIT finished(_id, status());
+}
+
+void FirmwareRollout::deviceStateChanged(QString uuid, IDevice::DeviceState state)
+{
+    Q_UNUSED(uuid)
+    DeviceHandle* handle = qobject_cast<DeviceHandle*>(sender());
+    int index = _updating.value(handle, -1);
+
+    // the device reconnects after the update, it may reconnect before with the old firmware if the download was interrupted
+    if(index < 0 || state != IDevice::ONLINE || handle->getFirmwareVersion() < _version)
+        return;
+
+    complete(index, DONE);
+    dispatchNext();
+}
+
+void FirmwareRollout::checkUpdates()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QList<int> indexes = _updating.values();
+    bool completed = false;
+    for(int i = 0; i < indexes.count(); i++)
+    {
+        const Target& target = _targets.at(indexes.at(i));
+        if(target.handle->getFirmwareVersion() >= _version)
+        {
+            complete(indexes.at(i), DONE);
+            completed = true;
+        }
+        else if(now - target.started > _deviceTimeout)
+        {
+            complete(indexes.at(i), FAILED, "Timeout");
+            completed = true;
+        }
+    }
+
+    if(completed)
+        dispatchNext();
+}
@@ -0,0 +1,115 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef FIRMWAREROLLOUT_H
+#define FIRMWAREROLLOUT_H
+
+#include <QObject>
+#include <QVariant>
+#include <QHash>
+#include <QVector>
+#include <QTimer>
+#include "DeviceManager.h"
+
+/*!
+    \class FirmwareRollout
+    \brief Updates the firmware of a fleet of devices in canary waves with a limited number of parallel updates.
+    \ingroup devices
+
+    The targets are divided into waves, given as cumulative percentages of all targets (default: 1, 10, 100).
+    Within a wave at most "maxConcurrent" devices are updating at the same time. An update is done when the device
+    registers again with the new firmware version, it fails if the device rejects the command or doesn't come back
+    within "deviceTimeout" ms. Devices which are offline when it is their turn are skipped.
+
+    After each wave the failure rate of all finished updates is checked. If it exceeds "maxFailureRate", the
+    rollout is halted before the next wave is started.
+
+    Options (all optional):
+    {"maxConcurrent": 20, "waves": [1, 10, 100], "maxFailureRate": 0.1, "deviceTimeout": 600000, "wavePause": 0}
+
+    status() returns {"id", "type", "version", "state": "running|halted|completed|canceled", "wave", "waves",
+    "total", "pending", "running", "done", "failed", "skipped", "failures": [{"mapping", "error"}, ...]}
+
+    \sa DeviceUpdateLogic, FirmwareStore
+*/
+
+class FirmwareRollout : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum State
+    {
+        RUNNING,
+        HALTED,
+        COMPLETED,
+        CANCELED
+    };
+
+    /*!
+        \fn FirmwareRollout::FirmwareRollout(QString id, QString type, int version, QVariantMap updateArgs, QObject* parent)
+        version is the target version as returned by DeviceHandle::getFirmwareVersion(), updateArgs are passed
+        to DeviceHandle::startFirmwareUpdate().
+    */
+    FirmwareRollout(QString id, QString type, int version, QVariantMap updateArgs, QObject* parent = nullptr);
+
+    void        start(QMap<QString, deviceHandlePtr> targets, QVariantMap options);
+    void        cancel();
+    bool        isFinished() const;
+    QVariantMap status() const;
+
+signals:
+    void finished(QString id, QVariantMap status);
+
+private:
+    enum TargetState
+    {
+        PENDING,
+        UPDATING,
+        DONE,
+        FAILED,
+        SKIPPED
+    };
+
+    struct Target
+    {
+        QString         mapping;
+        deviceHandlePtr handle;
+        TargetState     state = PENDING;
+        qint64          started = 0;
+        QString         error;
+    };
+
+    static QString  stateName(State state);
+    void            startWave();
+    void            dispatchNext();
+    void            dispatch(int index);
+    void            complete(int index, TargetState state, QString error = QString());
+    void            waveFinished();
+    void            finish(State state);
+
+    QString                 _id;
+    QString                 _type;
+    int                     _version;
+    QVariantMap             _updateArgs;
+    State                   _state = RUNNING;
+    QVector<Target>         _targets;
+    QVector<int>            _waveEnds;
+    QHash<DeviceHandle*, int> _updating; // handle -> target index
+    QTimer                  _checkTimer;
+    int                     _wave = 0;
+    int                     _next = 0;
+    int                     _maxConcurrent;
+    double                  _maxFailureRate;
+    qint64                  _deviceTimeout;
+    int                     _wavePause;
+
+private slots:
+    void deviceStateChanged(QString uuid, IDevice::DeviceState state);
+    void checkUpdates();
+};
+
+#endif // FIRMWAREROLLOUT_H
@@ -0,0 +1,117 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "FirmwareStore.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QCryptographicHash>
+#include <QDebug>
+#include "Storage/FileSystemPaths.h"
+
+Q_GLOBAL_STATIC(FirmwareStore, firmwareStore);
+
+FirmwareStore::FirmwareStore(QObject *parent) : QObject(parent)
+{
+}
+
+FirmwareStore *FirmwareStore::instance()
+{
+    return firmwareStore;
+}
+
+bool FirmwareStore::contains(QString name) const
+{
+    return isValidName(name) && QFileInfo::exists(path(name));
+}
+
+bool FirmwareStore::store(QString name, QByteArray data)
+{
+    if(!isValidName(name))
+        return false;
+
+    QString file = path(name);
+    QDir().mkpath(QFileInfo(file).absolutePath());
+
+    // write to a temporary file first, devices may be reading the current image
+    QFile tmp(file + ".tmp");
+    if(!tmp.open(QFile::WriteOnly) || tmp.write(data) != data.size())
+    {
+        qWarning()<<"Warning: Could not write firmware image"<<file;
+        return false;
+    }
+    tmp.close();
+
+    QFile::remove(file);
+    if(!tmp.rename(file))
+    {
+        qWarning()<<"Warning: Could not write firmware image"<<file;
+        return false;
+    }
+
+    QMutexLocker locker(&_mutex);
+    _images.remove(name);
+    return true;
+}
+
+qint64 FirmwareStore::size(QString name)
+{
+    Image image;
+    return load(name, &image) ? image.data.size() : -1;
+}
+
+QString FirmwareStore::sha1(QString name)
+{
+    Image image;
+    return load(name, &image) ? image.sha1 : QString();
+}
+
+bool FirmwareStore::readChunk(QString name, qint64 offset, int size, QByteArray *data, qint64 *total)
+{
+    Image image;
+    if(!load(name, &image))
+        return false;
+
+    *total = image.data.size();
+    if(offset < 0 || offset > image.data.size())
+        return false;
+
+    size = qBound(0, size, FIRMWARE_CHUNK_SIZE);
+    *data = image.data.mid(int(offset), size);
+    return true;
+}
+
+bool FirmwareStore::isValidName(const QString &name)
+{
+    return !name.isEmpty() && !name.startsWith(".") && QFileInfo(name).fileName() == name;
+}
+
+QString FirmwareStore::path(const QString &name) const
+{
+    return FileSystemPaths::instance()->getStoragePath() + "firmware/" + name;
+}
+
+bool FirmwareStore::load(const QString &name, Image *image)
+{
+    if(!isValidName(name))
+        return false;
+
+    QMutexLocker locker(&_mutex);
+    if(_images.contains(name))
+    {
+        *image = _images.value(name);
+        return true;
+    }
+
+    QFile file(path(name));
+    if(!file.open(QFile::ReadOnly))
+        return false;
+
+    image->data = file.readAll();
+    image->sha1 = QCryptographicHash::hash(image->data, QCryptographicHash::Sha1).toHex();
+    _images.insert(name, *image);
+    return true;
+}
@@ -0,0 +1,71 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef FIRMWARESTORE_H
+#define FIRMWARESTORE_H
+
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+
+// maximum size of a firmware chunk sent to a device
+#define FIRMWARE_CHUNK_SIZE 4096
+
+/*!
+    \class FirmwareStore
+    \brief Local storage of firmware images which are delivered to the devices over their connection.
+    \ingroup devices
+
+    The images are stored in <storage path>/firmware/. An image is loaded into memory when it is requested
+    the first time, all devices share the same copy.
+
+    Devices fetch an image in chunks of at most FIRMWARE_CHUNK_SIZE bytes by offset, so an interrupted download
+    can be resumed at the last received offset (see SocketDevice).
+
+    \sa FirmwareRollout, DeviceUpdateLogic
+*/
+
+class FirmwareStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FirmwareStore(QObject *parent = nullptr);
+    static FirmwareStore* instance();
+
+    bool        contains(QString name) const;
+
+    /*!
+        \fn bool FirmwareStore::store(QString name, QByteArray data)
+        Writes an image to the store. Returns false if the name is invalid or the file can't be written.
+    */
+    bool        store(QString name, QByteArray data);
+    qint64      size(QString name);
+    QString     sha1(QString name);
+
+    /*!
+        \fn bool FirmwareStore::readChunk(QString name, qint64 offset, int size, QByteArray* data, qint64* total)
+        Reads up to size bytes (at most FIRMWARE_CHUNK_SIZE) at offset. data is empty if offset is at the end of the image.
+        Returns false if the image doesn't exist or offset is out of range.
+    */
+    bool        readChunk(QString name, qint64 offset, int size, QByteArray* data, qint64* total);
+
+private:
+    struct Image
+    {
+        QByteArray  data;
+        QString     sha1;
+    };
+
+    static bool isValidName(const QString& name);
+    QString     path(const QString& name) const;
+    bool        load(const QString& name, Image* image);
+
+    QMutex                  _mutex;
+    QHash<QString, Image>   _images;
+};
+
+#endif // FIRMWARESTORE_H
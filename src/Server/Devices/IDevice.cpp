@@ -32,6 +32,11 @@ void IDevice::setGrantedPermissions(const QMap<QString, bool> &grantedPermission
     _grantedPermissions = grantedPermissions;
 }
 
+QVariantMap IDevice::getPropertyChanges() const
+{
+    return getProperties();
+}
+
 QVariantList IDevice::getSkills() const
 {
     return QVariantList();
@@ -42,7 +42,9 @@ public:
         FUNCTION_NOT_EXIST = -1, /*! The function does not exist */
         DEVICE_NOT_AVAILABLE = -2, /*! The requested device does not exist */
         PROPERTY_NOT_EXISTS = -3, /*! The requested property does not exist on this device */
-        PERMISSION_DENIED = -4 /*! You don't have the required permissions */
+        PERMISSION_DENIED = -4, /*! You don't have the required permissions */
+        TIMEOUT = -5, /*! The device has not answered in time */
+        TOO_MANY_REQUESTS = -6 /*! Too many calls are waiting for the device */
     };
 
     enum DeviceState
@@ -123,6 +125,14 @@ public:
     */
     virtual QVariantMap getProperties() const = 0;
 
+    /*!
+        \fn virtual QVariantMap getPropertyChanges() const
+        Returns the properties which may have changed since the device was synchronized the last time,
+        e.g. when a device has resumed its session after a reconnect. Used by DeviceHandle::syncDevice().
+        The default implementation returns getProperties().
+    */
+    virtual QVariantMap getPropertyChanges() const;
+
 
     /*!
         \fn DeviceError triggerFunction(QString name, QVariant parameters = QVariant()) = 0
@@ -0,0 +1,510 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "PropertyHistory.h"
+#include <QDataStream>
+#include <QJsonDocument>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QDir>
+#include <QAtomicInteger>
+#include <QtAlgorithms>
+#include <QDebug>
+#include <cstring>
+#include "Storage/PersistenceScheduler.h"
+
+// number of samples which are compressed into one chunk
+#define HISTORY_CHUNK_SAMPLES   1024
+
+// default retention period in ms (7 days)
+#define HISTORY_RETENTION       7LL * 24 * 60 * 60 * 1000
+
+// default maximum number of compressed bytes per property
+#define HISTORY_MEMORY_LIMIT    64 * 1024
+
+// default maximum number of compressed bytes of all properties together
+#define HISTORY_GLOBAL_MEMORY_LIMIT 64 * 1024 * 1024
+
+namespace
+{
+    QAtomicInteger<qint64>  retention(HISTORY_RETENTION);
+    QAtomicInt              memoryLimit(HISTORY_MEMORY_LIMIT);
+    QAtomicInt              globalMemoryLimit(HISTORY_GLOBAL_MEMORY_LIMIT);
+    QAtomicInt              instances(0);
+
+    class BitReader
+    {
+    public:
+        explicit BitReader(const QByteArray& data) : _data(data) {}
+
+        quint64 read(int count)
+        {
+            quint64 value = 0;
+            for(int i = 0; i < count; i++)
+            {
+                value <<= 1;
+                if(_position / 8 < _data.size() && (uchar(_data.at(int(_position / 8))) & (0x80 >> (_position % 8))))
+                    value |= 1;
+                _position++;
+            }
+            return value;
+        }
+
+    private:
+        const QByteArray&   _data;
+        qint64              _position = 0;
+    };
+
+    qint64 signExtend(quint64 value, int bits)
+    {
+        qint64 result = qint64(value);
+        if(result > (1LL << (bits - 1)))
+            result -= 1LL << bits;
+
+        return result;
+    }
+
+    quint64 toBits(double value)
+    {
+        quint64 bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    double fromBits(quint64 bits)
+    {
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+}
+
+PropertyHistory::PropertyHistory(QString path) :
+    _file(path),
+    _openPath(path + ".open")
+{
+    instances.ref();
+    load();
+    flush();
+}
+
+PropertyHistory::~PropertyHistory()
+{
+    _mutex.lock();
+    closeChunk();
+    _mutex.unlock();
+    flush();
+    instances.deref();
+}
+
+void PropertyHistory::append(qint64 timestamp, double value)
+{
+    QMutexLocker locker(&_mutex);
+    if(_open.chunk.count > 0 && timestamp < _open.chunk.last)
+        timestamp = _open.chunk.last;
+
+    _open.append(timestamp, value);
+    if(_open.chunk.count < HISTORY_CHUNK_SAMPLES)
+    {
+        // the open chunk is written periodically, a crash loses at most one periodic interval
+        QVariantMap chunk;
+        chunk["first"] = _open.chunk.first;
+        chunk["last"] = _open.chunk.last;
+        chunk["count"] = _open.chunk.count;
+        chunk["data"] = QString::fromLatin1(_open.chunk.data.toBase64());
+        PersistenceScheduler::save(_openPath, chunk, PersistenceScheduler::PERIODIC);
+        return;
+    }
+
+    closeChunk();
+    locker.unlock();
+    flush();
+}
+
+QVector<PropertyHistory::Sample> PropertyHistory::samples(qint64 from, qint64 to)
+{
+    QMutexLocker locker(&_mutex);
+    QVector<Sample> result;
+    for(int i = 0; i < _chunks.count(); i++)
+        decode(_chunks.at(i), from, to, &result);
+
+    decode(_open.chunk, from, to, &result);
+    return result;
+}
+
+QVariantList PropertyHistory::query(qint64 from, qint64 to, int buckets)
+{
+    QVector<Sample> data = samples(from, to);
+    QVariantList result;
+
+    if(buckets <= 0 || data.count() <= buckets)
+    {
+        for(int i = 0; i < data.count(); i++)
+            result << QVariant(QVariantList() << data.at(i).timestamp << data.at(i).value);
+
+        return result;
+    }
+
+    qint64 start = data.first().timestamp;
+    double width = double(data.last().timestamp - start + 1) / buckets;
+    int current = -1;
+    double min = 0, max = 0, sum = 0;
+    int count = 0;
+
+    for(int i = 0; i <= data.count(); i++)
+    {
+        int bucket = i < data.count() ? qMin(buckets - 1, int((data.at(i).timestamp - start) / width)) : -1;
+        if(bucket != current && count > 0)
+        {
+            result << QVariant(QVariantList() << qint64(start + current * width) << min << max << sum / count);
+            count = 0;
+        }
+
+        if(bucket < 0)
+            break;
+
+        double value = data.at(i).value;
+        if(count == 0)
+        {
+            min = max = sum = value;
+        }
+        else
+        {
+            min = qMin(min, value);
+            max = qMax(max, value);
+            sum += value;
+        }
+        current = bucket;
+        count++;
+    }
+
+    return result;
+}
+
+int PropertyHistory::memoryUsage()
+{
+    QMutexLocker locker(&_mutex);
+    return _size + _open.chunk.data.size();
+}
+
+bool PropertyHistory::toSample(const QVariant &value, double *sample)
+{
+    switch(int(value.type()))
+    {
+        case QMetaType::Bool:
+        case QMetaType::Int:
+        case QMetaType::UInt:
+        case QMetaType::LongLong:
+        case QMetaType::ULongLong:
+        case QMetaType::Double:
+        case QMetaType::Float:
+            *sample = value.toDouble();
+            return true;
+        default:
+            return false;
+    }
+}
+
+void PropertyHistory::setRetention(qint64 msecs)
+{
+    retention.store(msecs);
+}
+
+void PropertyHistory::setMemoryLimit(int bytes)
+{
+    memoryLimit.store(bytes);
+}
+
+void PropertyHistory::setGlobalMemoryLimit(int bytes)
+{
+    globalMemoryLimit.store(bytes);
+}
+
+void PropertyHistory::Encoder::writeBits(quint64 value, int count)
+{
+    for(int i = count - 1; i >= 0; i--)
+    {
+        if(bits % 8 == 0)
+            chunk.data.append(char(0));
+
+        if((value >> i) & 1)
+        {
+            int index = int(bits / 8);
+            chunk.data[index] = char(uchar(chunk.data.at(index)) | (0x80 >> (bits % 8)));
+        }
+        bits++;
+    }
+}
+
+void PropertyHistory::Encoder::append(qint64 timestamp, double value)
+{
+    quint64 valueBits = toBits(value);
+
+    if(chunk.count == 0)
+    {
+        writeBits(quint64(timestamp), 64);
+        writeBits(valueBits, 64);
+        chunk.first = timestamp;
+        chunk.last = timestamp;
+        chunk.count = 1;
+        previousDelta = 0;
+        previousValue = valueBits;
+        leading = -1;
+        return;
+    }
+
+    // timestamp: delta of deltas, regular intervals need a single bit
+    qint64 delta = timestamp - chunk.last;
+    qint64 deltaOfDelta = delta - previousDelta;
+    previousDelta = delta;
+
+    if(deltaOfDelta == 0)
+    {
+        writeBits(0, 1);
+    }
+    else if(deltaOfDelta >= -63 && deltaOfDelta <= 64)
+    {
+        writeBits(0x2, 2);
+        writeBits(quint64(deltaOfDelta) & 0x7F, 7);
+    }
+    else if(deltaOfDelta >= -255 && deltaOfDelta <= 256)
+    {
+        writeBits(0x6, 3);
+        writeBits(quint64(deltaOfDelta) & 0x1FF, 9);
+    }
+    else if(deltaOfDelta >= -2047 && deltaOfDelta <= 2048)
+    {
+        writeBits(0xE, 4);
+        writeBits(quint64(deltaOfDelta) & 0xFFF, 12);
+    }
+    else
+    {
+        writeBits(0xF, 4);
+        writeBits(quint64(deltaOfDelta), 64);
+    }
+
+    // value: XOR to the previous value, only the meaningful bits are stored
+    quint64 xorValue = valueBits ^ previousValue;
+    previousValue = valueBits;
+
+    if(xorValue == 0)
+    {
+        writeBits(0, 1);
+    }
+    else
+    {
+        int leadingZeros = qMin(31, int(qCountLeadingZeroBits(xorValue)));
+        int trailingZeros = int(qCountTrailingZeroBits(xorValue));
+
+        if(leading >= 0 && leadingZeros >= leading && trailingZeros >= trailing)
+        {
+            writeBits(0x2, 2);
+            writeBits(xorValue >> trailing, 64 - leading - trailing);
+        }
+        else
+        {
+            leading = leadingZeros;
+            trailing = trailingZeros;
+            int significant = 64 - leading - trailing;
+            writeBits(0x3, 2);
+            writeBits(quint64(leading), 5);
+            writeBits(quint64(significant == 64 ? 0 : significant), 6);
+            writeBits(xorValue >> trailing, significant);
+        }
+    }
+
+    chunk.last = timestamp;
+    chunk.count++;
+}
+
+void PropertyHistory::decode(const Chunk &chunk, qint64 from, qint64 to, QVector<Sample> *samples)
+{
+    if(chunk.count == 0 || chunk.last < from || chunk.first > to)
+        return;
+
+    BitReader reader(chunk.data);
+    qint64 timestamp = qint64(reader.read(64));
+    quint64 value = reader.read(64);
+    qint64 delta = 0;
+    int leading = 0;
+    int trailing = 0;
+
+    for(int i = 0; i < chunk.count; i++)
+    {
+        if(i > 0)
+        {
+            qint64 deltaOfDelta;
+            if(reader.read(1) == 0)
+                deltaOfDelta = 0;
+            else if(reader.read(1) == 0)
+                deltaOfDelta = signExtend(reader.read(7), 7);
+            else if(reader.read(1) == 0)
+                deltaOfDelta = signExtend(reader.read(9), 9);
+            else if(reader.read(1) == 0)
+                deltaOfDelta = signExtend(reader.read(12), 12);
+            else
+                deltaOfDelta = qint64(reader.read(64));
+
+            delta += deltaOfDelta;
+            timestamp += delta;
+
+            if(reader.read(1) == 1)
+            {
+                if(reader.read(1) == 1)
+                {
+                    leading = int(reader.read(5));
+                    int significant = int(reader.read(6));
+                    if(significant == 0)
+                        significant = 64;
+
+                    trailing = 64 - leading - significant;
+                }
+                value ^= reader.read(64 - leading - trailing) << trailing;
+            }
+        }
+
+        if(timestamp > to)
+            break;
+
+        if(timestamp >= from)
+        {
+            Sample sample;
+            sample.timestamp = timestamp;
+            sample.value = fromBits(value);
+            samples->append(sample);
+        }
+    }
+}
+
+void PropertyHistory::closeChunk()
+{
+    if(_open.chunk.count == 0)
+        return;
+
+    Chunk chunk = _open.chunk;
+    _open = Encoder();
+    _chunks.append(chunk);
+    _size += chunk.data.size();
+
+    // closed chunks are only appended, the file is rewritten when old chunks are dropped
+    if(!dropExpiredChunks())
+        _unwritten.append(chunk);
+}
+
+bool PropertyHistory::dropExpiredChunks()
+{
+    if(_chunks.isEmpty())
+        return false;
+
+    // every history gets an equal share of the global budget
+    int bytes = qMin(memoryLimit.load(), globalMemoryLimit.load() / qMax(1, instances.load()));
+    qint64 limit = qMax(_chunks.last().last, _open.chunk.last) - retention.load();
+    bool dropped = false;
+    while(!_chunks.isEmpty() && (_chunks.first().last < limit || _size + _open.chunk.data.size() > bytes))
+    {
+        _size -= _chunks.takeFirst().data.size();
+        dropped = true;
+    }
+
+    if(dropped)
+        _rewrite = true;
+
+    return dropped;
+}
+
+void PropertyHistory::load()
+{
+    if(!_file.open(QFile::ReadOnly))
+        return;
+
+    QDataStream stream(&_file);
+    while(!stream.atEnd())
+    {
+        Chunk chunk;
+        qint32 count;
+        stream >> chunk.first >> chunk.last >> count >> chunk.data;
+
+        // a torn chunk at the end of the file is ignored
+        if(stream.status() != QDataStream::Ok)
+            break;
+
+        chunk.count = count;
+        _chunks.append(chunk);
+        _size += chunk.data.size();
+    }
+    _file.close();
+
+    // the open chunk of the last run is taken over as closed chunk, unless it was closed before the crash
+    PersistenceScheduler::waitForWritten(_openPath);
+    QFile open(_openPath);
+    if(open.open(QFile::ReadOnly))
+    {
+        QVariantMap data = QJsonDocument::fromJson(open.readAll()).toVariant().toMap();
+        open.close();
+
+        Chunk chunk;
+        chunk.first = data["first"].toLongLong();
+        chunk.last = data["last"].toLongLong();
+        chunk.count = data["count"].toInt();
+        chunk.data = QByteArray::fromBase64(data["data"].toString().toLatin1());
+        if(chunk.count > 0 && (_chunks.isEmpty() || chunk.first > _chunks.last().last))
+        {
+            _chunks.append(chunk);
+            _size += chunk.data.size();
+            _rewrite = true;
+        }
+    }
+
+    dropExpiredChunks();
+}
+
+bool PropertyHistory::writeChunk(QIODevice *device, const Chunk &chunk)
+{
+    QDataStream stream(device);
+    stream << chunk.first << chunk.last << qint32(chunk.count) << chunk.data;
+    return stream.status() == QDataStream::Ok;
+}
+
+void PropertyHistory::flush()
+{
+    // whoever gets the file first writes all pending chunks, so they reach the file in order
+    QMutexLocker fileLocker(&_fileMutex);
+    _mutex.lock();
+    bool truncate = _rewrite;
+    QVector<Chunk> chunks = truncate ? _chunks : _unwritten;
+    _rewrite = false;
+    _unwritten.clear();
+    _mutex.unlock();
+
+    if(truncate || !chunks.isEmpty())
+        write(chunks, truncate);
+
+    // the closed chunk is in the file now. A new open chunk has already replaced the pending copy.
+    QMutexLocker locker(&_mutex);
+    if(!chunks.isEmpty() && _open.chunk.count == 0)
+        PersistenceScheduler::remove(_openPath);
+}
+
+void PropertyHistory::write(const QVector<Chunk> &chunks, bool truncate)
+{
+    QDir().mkpath(QFileInfo(_file).absolutePath());
+    if(!_file.open(QFile::WriteOnly | (truncate ? QFile::Truncate : QFile::Append)))
+    {
+        qWarning()<<"Warning: Could not write property history -"<<_file.fileName()<<_file.errorString();
+        return;
+    }
+
+    for(int i = 0; i < chunks.count(); i++)
+    {
+        if(!writeChunk(&_file, chunks.at(i)))
+        {
+            qWarning()<<"Warning: Could not write property history -"<<_file.fileName()<<_file.errorString();
+            break;
+        }
+    }
+
+    _file.close();
+}
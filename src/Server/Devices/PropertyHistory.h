@@ -0,0 +1,109 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef PROPERTYHISTORY_H
+#define PROPERTYHISTORY_H
+
+#include <QVariant>
+#include <QVector>
+#include <QMutex>
+#include <QFile>
+
+/*!
+    \class PropertyHistory
+    \brief Compressed time series of the numeric values of a DeviceProperty.
+    \ingroup devices
+
+    Samples are compressed like in Facebook's Gorilla: timestamps are stored as delta of deltas,
+    values as XOR to the previous value. A regular sensor needs one to two bytes per sample.
+
+    The samples are collected in chunks of HISTORY_CHUNK_SAMPLES samples. Closed chunks are appended to
+    the history file (<storage path>/history/<first two hex digits>/<sha1 of device uuid and property>.hist)
+    and loaded again on startup. The open chunk is saved next to it (.hist.open) with PersistenceScheduler::PERIODIC
+    and taken over on startup, so a crash loses at most one periodic interval.
+    Chunks older than the retention period, or the oldest chunks if the history exceeds its memory
+    limit, are dropped. The limit of a history is the per property limit or its share of the global limit,
+    whichever is smaller. The file is written after the samples are released, appending a sample
+    never waits for the disk.
+
+    \sa DeviceProperty::history()
+*/
+
+class PropertyHistory
+{
+public:
+    struct Sample
+    {
+        qint64  timestamp = 0;
+        double  value = 0;
+    };
+
+    explicit PropertyHistory(QString path);
+    ~PropertyHistory();
+
+    void            append(qint64 timestamp, double value);
+    QVector<Sample> samples(qint64 from, qint64 to);
+
+    /*!
+        \fn QVariantList PropertyHistory::query(qint64 from, qint64 to, int buckets)
+        Returns the samples between from and to as [timestamp, value] pairs. If there are more samples
+        than buckets (and buckets > 0), the range is divided into buckets and every non empty bucket
+        is returned as [start timestamp, min, max, avg].
+    */
+    QVariantList    query(qint64 from, qint64 to, int buckets);
+    int             memoryUsage();
+
+    /*!
+        \fn static bool PropertyHistory::toSample(const QVariant& value, double* sample)
+        Returns false if value is not numeric (or boolean) and therefore not recorded.
+    */
+    static bool     toSample(const QVariant& value, double* sample);
+    static void     setRetention(qint64 msecs);
+    static void     setMemoryLimit(int bytes);
+    static void     setGlobalMemoryLimit(int bytes);
+
+private:
+    struct Chunk
+    {
+        qint64      first = 0;
+        qint64      last = 0;
+        int         count = 0;
+        QByteArray  data;
+    };
+
+    struct Encoder
+    {
+        Chunk       chunk;
+        qint64      bits = 0;
+        qint64      previousDelta = 0;
+        quint64     previousValue = 0;
+        int         leading = -1;
+        int         trailing = 0;
+
+        void        writeBits(quint64 value, int count);
+        void        append(qint64 timestamp, double value);
+    };
+
+    static void     decode(const Chunk& chunk, qint64 from, qint64 to, QVector<Sample>* samples);
+    void            closeChunk();
+    bool            dropExpiredChunks();
+    void            load();
+    void            flush();
+    bool            writeChunk(QIODevice* device, const Chunk& chunk);
+    void            write(const QVector<Chunk>& chunks, bool truncate);
+
+    QMutex          _mutex;
+    QMutex          _fileMutex; // guards _file, taken before _mutex
+    QFile           _file;
+    QString         _openPath;
+    QVector<Chunk>  _chunks;
+    QVector<Chunk>  _unwritten; // closed chunks which are not in the file yet
+    bool            _rewrite = false;
+    Encoder         _open;
+    int             _size = 0;
+};
+
+#endif // PROPERTYHISTORY_H
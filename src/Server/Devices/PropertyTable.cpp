@@ -0,0 +1,504 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "PropertyTable.h"
+#include "PropertyHistory.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include "Storage/FileSystemPaths.h"
+
+PropertyTable::PropertyTable(QString legacyHistoryKey) :
+    _legacyHistoryKey(legacyHistoryKey)
+{
+}
+
+PropertyTable::~PropertyTable()
+{
+}
+
+void PropertyTable::setHistoryKey(QString key)
+{
+    // closing writes the open chunks, the histories are closed outside of the lock when the last user releases them
+    QHash<QString, QSharedPointer<PropertyHistory>> closed;
+    _historyMutex.lock();
+    if(key != _historyKey)
+    {
+        closed.swap(_histories);
+        _historyKey = key;
+    }
+    _historyMutex.unlock();
+}
+
+void PropertyTable::setChangeCallback(ChangeCallback callback)
+{
+    _callback = callback;
+}
+
+int PropertyTable::count() const
+{
+    return _layout.load()->names.count();
+}
+
+QStringList PropertyTable::names() const
+{
+    return _layout.load()->names.toList();
+}
+
+bool PropertyTable::contains(const QString &name) const
+{
+    return _layout.load()->index.contains(name);
+}
+
+QVariant PropertyTable::getValue(const QString &name) const
+{
+    int index = indexOf(name);
+    if(index < 0)
+        return QVariant();
+
+    QReadLocker locker(&_lock);
+    if(_columns.dirty.testBit(index))
+        return decode(index, _columns.target, _columns.targetVariants);
+
+    return decode(index, _columns.real, _columns.realVariants);
+}
+
+QVariant PropertyTable::getRealValue(const QString &name) const
+{
+    int index = indexOf(name);
+    if(index < 0)
+        return QVariant();
+
+    QReadLocker locker(&_lock);
+    return decode(index, _columns.real, _columns.realVariants);
+}
+
+QVariant PropertyTable::getSetValue(const QString &name) const
+{
+    int index = indexOf(name);
+    if(index < 0)
+        return QVariant();
+
+    QReadLocker locker(&_lock);
+    return decode(index, _columns.target, _columns.targetVariants);
+}
+
+bool PropertyTable::isDirty(const QString &name) const
+{
+    int index = indexOf(name);
+    if(index < 0)
+        return false;
+
+    QReadLocker locker(&_lock);
+    return _columns.dirty.testBit(index);
+}
+
+qlonglong PropertyTable::confirmedTimestamp(const QString &name) const
+{
+    int index = indexOf(name);
+    if(index < 0)
+        return 0;
+
+    QReadLocker locker(&_lock);
+    return _columns.timestamps.at(index);
+}
+
+QVariantMap PropertyTable::toMap(const QString &name) const
+{
+    int index = indexOf(name);
+    if(index < 0)
+        return QVariantMap();
+
+    QReadLocker locker(&_lock);
+    return toMap(name, index);
+}
+
+QVariantMap PropertyTable::toMap() const
+{
+    std::shared_ptr<const Layout> layout = _layout.load();
+    QVariantMap properties;
+    QReadLocker locker(&_lock);
+    for(int i = 0; i < layout->names.count(); i++)
+        properties.insert(layout->names.at(i), toMap(layout->names.at(i), i));
+
+    return properties;
+}
+
+QVariantList PropertyTable::toList() const
+{
+    std::shared_ptr<const Layout> layout = _layout.load();
+    QVariantList properties;
+    QReadLocker locker(&_lock);
+    for(int i = 0; i < layout->names.count(); i++)
+        properties << toMap(layout->names.at(i), i);
+
+    return properties;
+}
+
+QVariantMap PropertyTable::unconfirmedValues() const
+{
+    std::shared_ptr<const Layout> layout = _layout.load();
+    QVariantMap values;
+    QReadLocker locker(&_lock);
+    for(int i = 0; i < layout->names.count(); i++)
+    {
+        if(_columns.dirty.testBit(i))
+            values.insert(layout->names.at(i), decode(i, _columns.target, _columns.targetVariants));
+    }
+    return values;
+}
+
+QVariantList PropertyTable::history(const QString &name, qint64 from, qint64 to, int buckets)
+{
+    QSharedPointer<PropertyHistory> history = historyFor(name);
+    return history ? history->query(from, to, buckets) : QVariantList();
+}
+
+void PropertyTable::setRealValues(const QVariantMap &values, bool keepDirtyFlag)
+{
+    if(values.isEmpty())
+        return;
+
+    QVector<Change> changes;
+    _lock.lockForWrite();
+    QMapIterator<QString, QVariant> it(values);
+    while(it.hasNext())
+    {
+        it.next();
+        applyRealValue(it.key(), it.value(), keepDirtyFlag, false, &changes);
+    }
+    _lock.unlock();
+
+    record(changes);
+    notify(changes);
+}
+
+void PropertyTable::setRealValue(const QString &name, const QVariant &value)
+{
+    QVector<Change> changes;
+    _lock.lockForWrite();
+    applyRealValue(name, value, false, true, &changes);
+    _lock.unlock();
+
+    record(changes);
+    notify(changes);
+}
+
+bool PropertyTable::setValue(const QString &name, const QVariant &value)
+{
+    int index = indexOf(name);
+    if(index < 0)
+        return false;
+
+    Change change;
+    change.name = name;
+    change.flags = SET_VALUE | DIRTY;
+    change.value = value;
+    change.dirty = true;
+
+    _lock.lockForWrite();
+    encode(value, index, _columns.target, _columns.targetVariants);
+    _columns.dirty.setBit(index);
+    change.timestamp = _columns.timestamps.at(index);
+    _lock.unlock();
+
+    notify(QVector<Change>() << change);
+    return true;
+}
+
+bool PropertyTable::setMetadata(const QString &name, const QString &key, const QVariant &value)
+{
+    int index = indexOf(name);
+    if(index < 0)
+        return false;
+
+    Change change;
+    change.name = name;
+    change.flags = METADATA;
+    change.key = key;
+    change.value = value;
+
+    _lock.lockForWrite();
+    _columns.metadata[index][key] = value;
+    change.dirty = _columns.dirty.testBit(index);
+    _lock.unlock();
+
+    notify(QVector<Change>() << change);
+    return true;
+}
+
+void PropertyTable::restore(const QVariantMap &properties)
+{
+    QWriteLocker locker(&_lock);
+    QMapIterator<QString, QVariant> it(properties);
+    while(it.hasNext())
+    {
+        it.next();
+        QVariantMap data = it.value().toMap();
+        int index = indexOf(it.key());
+        if(index < 0)
+            index = add(it.key());
+
+        encode(data["val"], index, _columns.real, _columns.realVariants);
+        encode(data["setVal"], index, _columns.target, _columns.targetVariants);
+        _columns.timestamps[index] = data["timestamp"].toLongLong();
+        _columns.dirty.setBit(index, data["dirty"].toBool());
+
+        QVariantMap metadata = data["metadata"].toMap();
+        if(metadata.isEmpty())
+            _columns.metadata.remove(index);
+        else
+            _columns.metadata.insert(index, metadata);
+    }
+}
+
+int PropertyTable::indexOf(const QString &name) const
+{
+    return _layout.load()->index.value(name, -1);
+}
+
+int PropertyTable::add(const QString &name)
+{
+    // the slots exist before the name is published, readers never see an index without slots
+    int index = _columns.real.count();
+    _columns.real.append(Value());
+    _columns.target.append(Value());
+    _columns.timestamps.append(0);
+    _columns.dirty.resize(index + 1);
+
+    _layout.update([&](Layout& next)
+    {
+        next.index.insert(name, index);
+        next.names.append(name);
+    });
+    return index;
+}
+
+void PropertyTable::encode(const QVariant &value, int index, QVector<Value> &values, QHash<int, QVariant> &variants)
+{
+    Value slot;
+    switch(int(value.type()))
+    {
+        case QMetaType::UnknownType:
+            break;
+        case QMetaType::Bool:
+            slot.type = BOOL;
+            slot.integer = value.toBool() ? 1 : 0;
+            break;
+        case QMetaType::Int:
+            slot.type = INT;
+            slot.integer = value.toInt();
+            break;
+        case QMetaType::UInt:
+            slot.type = UINT;
+            slot.integer = value.toUInt();
+            break;
+        case QMetaType::LongLong:
+            slot.type = LONGLONG;
+            slot.integer = value.toLongLong();
+            break;
+        case QMetaType::ULongLong:
+            slot.type = ULONGLONG;
+            slot.integer = qint64(value.toULongLong());
+            break;
+        case QMetaType::Double:
+            slot.type = DOUBLE;
+            slot.number = value.toDouble();
+            break;
+        case QMetaType::Float:
+            slot.type = FLOAT;
+            slot.number = value.toDouble();
+            break;
+        case QMetaType::QString:
+            slot.type = STRING;
+            slot.text = value.toString();
+            break;
+        default:
+            slot.type = VARIANT;
+            break;
+    }
+
+    if(slot.type == VARIANT)
+        variants.insert(index, value);
+    else if(values.at(index).type == VARIANT)
+        variants.remove(index);
+
+    values[index] = slot;
+}
+
+QVariant PropertyTable::decode(int index, const QVector<Value> &values, const QHash<int, QVariant> &variants)
+{
+    // the value is returned with the type it was stored with
+    const Value& slot = values.at(index);
+    switch(slot.type)
+    {
+        case BOOL:
+            return QVariant(slot.integer != 0);
+        case INT:
+            return QVariant(int(slot.integer));
+        case UINT:
+            return QVariant(uint(slot.integer));
+        case LONGLONG:
+            return QVariant(qlonglong(slot.integer));
+        case ULONGLONG:
+            return QVariant(qulonglong(slot.integer));
+        case DOUBLE:
+            return QVariant(slot.number);
+        case FLOAT:
+            return QVariant(float(slot.number));
+        case STRING:
+            return QVariant(slot.text);
+        case VARIANT:
+            return variants.value(index);
+        default:
+            return QVariant();
+    }
+}
+
+QVariantMap PropertyTable::toMap(const QString &name, int index) const
+{
+    QVariantMap data;
+    data["name"]        = name;
+    data["val"]         = decode(index, _columns.real, _columns.realVariants);
+    data["setVal"]      = decode(index, _columns.target, _columns.targetVariants);
+    data["timestamp"]   = _columns.timestamps.at(index);
+    data["dirty"]       = _columns.dirty.testBit(index);
+    data["metadata"]    = _columns.metadata.value(index);
+    return data;
+}
+
+void PropertyTable::applyRealValue(const QString &name, const QVariant &value, bool keepDirtyFlag, bool announceUnchanged, QVector<Change> *changes)
+{
+    int index = indexOf(name);
+    bool added = index < 0;
+    if(added)
+        index = add(name);
+
+    bool wasDirty = _columns.dirty.testBit(index);
+    bool changed = added || decode(index, _columns.real, _columns.realVariants) != value || (!keepDirtyFlag && wasDirty);
+
+    encode(value, index, _columns.real, _columns.realVariants);
+    _columns.timestamps[index] = QDateTime::currentMSecsSinceEpoch();
+
+    Change change;
+    change.name = name;
+    change.flags = REAL_VALUE;
+    change.value = value;
+    if(!keepDirtyFlag)
+    {
+        _columns.dirty.clearBit(index);
+        change.flags |= DIRTY | CONFIRMED;
+        change.accepted = value == decode(index, _columns.target, _columns.targetVariants);
+    }
+    change.dirty = _columns.dirty.testBit(index);
+    change.timestamp = _columns.timestamps.at(index);
+
+    // the history records every reported value, the notification only the changed ones
+    if(!changed && !announceUnchanged)
+        change.flags = 0;
+
+    changes->append(change);
+}
+
+void PropertyTable::record(const QVector<Change> &changes)
+{
+    for(int i = 0; i < changes.count(); i++)
+    {
+        double sample;
+        if(!PropertyHistory::toSample(changes.at(i).value, &sample))
+            continue;
+
+        QSharedPointer<PropertyHistory> history = historyFor(changes.at(i).name);
+        if(history)
+            history->append(changes.at(i).timestamp, sample);
+    }
+}
+
+QSharedPointer<PropertyHistory> PropertyTable::historyFor(const QString &name)
+{
+    _historyMutex.lock();
+    QSharedPointer<PropertyHistory> history = _histories.value(name);
+    _historyMutex.unlock();
+
+    if(history)
+        return history;
+
+    // the file is loaded without holding _historyMutex, so the other properties keep recording meanwhile.
+    // Only one history is opened at a time, two instances must never share a file.
+    QMutexLocker openLocker(&_historyOpenMutex);
+    _historyMutex.lock();
+    history = _histories.value(name);
+    QString key = _historyKey;
+    _historyMutex.unlock();
+
+    if(history || key.isEmpty())
+        return history;
+
+    // older versions stored the histories in a flat directory and under the legacy key
+    QString path = historyPath(key, name);
+    if(!QFile::exists(path))
+    {
+        QStringList candidates = QStringList() << historyPath(key, name, false);
+        if(!_legacyHistoryKey.isEmpty())
+            candidates << historyPath(_legacyHistoryKey, name) << historyPath(_legacyHistoryKey, name, false);
+
+        for(int i = 0; i < candidates.count(); i++)
+        {
+            if(!QFile::exists(candidates.at(i)))
+                continue;
+
+            QDir().mkpath(QFileInfo(path).absolutePath());
+            QFile::rename(candidates.at(i), path);
+            break;
+        }
+    }
+
+    history = QSharedPointer<PropertyHistory>(new PropertyHistory(path));
+
+    QMutexLocker locker(&_historyMutex);
+    if(key != _historyKey)
+    {
+        locker.unlock();
+        return QSharedPointer<PropertyHistory>();
+    }
+
+    _histories.insert(name, history);
+    return history;
+}
+
+QString PropertyTable::historyPath(const QString &key, const QString &name, bool sharded) const
+{
+    QString id = key + "/" + name;
+    QString hash = QCryptographicHash::hash(id.toUtf8(), QCryptographicHash::Sha1).toHex();
+
+    // sharded by the first byte of the hash, so no directory has to hold the histories of all devices
+    QString directory = FileSystemPaths::instance()->getStoragePath() + "history/";
+    if(sharded)
+        directory += hash.left(2) + "/";
+
+    return directory + hash + ".hist";
+}
+
+void PropertyTable::notify(const QVector<Change> &changes)
+{
+    if(!_callback)
+        return;
+
+    QVector<Change> announced;
+    announced.reserve(changes.count());
+    for(int i = 0; i < changes.count(); i++)
+    {
+        if(changes.at(i).flags != 0)
+            announced << changes.at(i);
+    }
+
+    if(!announced.isEmpty())
+        _callback(announced);
+}
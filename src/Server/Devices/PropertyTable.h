@@ -0,0 +1,212 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef PROPERTYTABLE_H
+#define PROPERTYTABLE_H
+
+#include <QVariant>
+#include <QVector>
+#include <QHash>
+#include <QBitArray>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QSharedPointer>
+#include <functional>
+#include "Snapshot.h"
+
+class PropertyHistory;
+
+/*!
+    \class PropertyTable
+    \brief Packed storage of all properties of a device.
+    \ingroup devices
+
+    Each property is a slot in contiguous columns: real value, set value (the value requested by a client),
+    timestamp and dirty bit. Values are stored typed (bool, integer, double, string), only other values
+    (maps, lists...) are kept as QVariant. Metadata is stored sparsely.
+
+    The names and their slot indexes are an immutable Snapshot, only adding a property publishes a new
+    version. The values are updated in place under a read/write lock of the table, so an update costs
+    the same no matter how many properties a device has. Getters hold the lock only while they copy a value.
+    Writers notify the ChangeCallback of the device after releasing the lock. A batch of values
+    (setRealValues()) is applied and announced at once. Values are returned with the type they were set with.
+
+    The history of the numeric real values is recorded per property (see PropertyHistory), the histories
+    are created when they are needed first. They belong to the device, not to the mapping: the files are
+    named after the device uuid (setHistoryKey()), a table without uuid records no history. A history which is
+    replaced by setHistoryKey() is closed when the last running record() or history() call has released it.
+
+    \sa DeviceHandle, DeviceProperty
+*/
+
+class PropertyTable
+{
+public:
+    enum ChangeFlag
+    {
+        REAL_VALUE  = 0x01,
+        SET_VALUE   = 0x02,
+        DIRTY       = 0x04,
+        CONFIRMED   = 0x08,
+        METADATA    = 0x10
+    };
+
+    struct Change
+    {
+        QString     name;
+        int         flags = 0;
+        QVariant    value;      // the new real value (REAL_VALUE), set value (SET_VALUE) or metadata value (METADATA)
+        bool        dirty = false;
+        qlonglong   timestamp = 0;
+        bool        accepted = false; // CONFIRMED: the real value equals the set value
+        QString     key;        // METADATA
+    };
+
+    typedef std::function<void(const QVector<Change>& changes)> ChangeCallback;
+
+    /*!
+        \fn PropertyTable::PropertyTable(QString legacyHistoryKey)
+        legacyHistoryKey is the resource path of the handle, older versions named the history files after it.
+        Such files are taken over by the device once its history is opened.
+    */
+    explicit PropertyTable(QString legacyHistoryKey = QString());
+    ~PropertyTable();
+
+    /*!
+        \fn void PropertyTable::setHistoryKey(QString key)
+        Sets the key (the device uuid) which identifies the history files. Histories of the previous key are closed.
+    */
+    void            setHistoryKey(QString key);
+
+    void            setChangeCallback(ChangeCallback callback);
+
+    int             count() const;
+    QStringList     names() const;
+    bool            contains(const QString& name) const;
+    QVariant        getValue(const QString& name) const;
+    QVariant        getRealValue(const QString& name) const;
+    QVariant        getSetValue(const QString& name) const;
+    bool            isDirty(const QString& name) const;
+    qlonglong       confirmedTimestamp(const QString& name) const;
+
+    /*!
+        \fn QVariantMap PropertyTable::toMap(const QString& name) const
+        Returns the property as {name, val, setVal, timestamp, dirty, metadata} - the persistence and
+        the client format of a property.
+    */
+    QVariantMap     toMap(const QString& name) const;
+
+    /*!
+        \fn QVariantMap PropertyTable::toMap() const
+        Returns all properties: name -> toMap(name).
+    */
+    QVariantMap     toMap() const;
+    QVariantList    toList() const;
+
+    /*!
+        \fn QVariantMap PropertyTable::unconfirmedValues() const
+        Returns the set values of all dirty properties.
+    */
+    QVariantMap     unconfirmedValues() const;
+    QVariantList    history(const QString& name, qint64 from, qint64 to, int buckets);
+
+    /*!
+        \fn void PropertyTable::setRealValues(const QVariantMap& values, bool keepDirtyFlag)
+        Applies values reported by the device. Unknown properties are added. Only values which
+        have changed are announced. If keepDirtyFlag is true, unconfirmed set values stay dirty.
+    */
+    void            setRealValues(const QVariantMap& values, bool keepDirtyFlag);
+
+    /*!
+        \fn void PropertyTable::setRealValue(const QString& name, const QVariant& value)
+        Applies a value change reported by the device. The property is confirmed and no longer dirty.
+    */
+    void            setRealValue(const QString& name, const QVariant& value);
+
+    /*!
+        \fn bool PropertyTable::setValue(const QString& name, const QVariant& value)
+        Requests a value change, the property is dirty until the device reports a value.
+        Returns false if the property doesn't exist.
+    */
+    bool            setValue(const QString& name, const QVariant& value);
+    bool            setMetadata(const QString& name, const QString& key, const QVariant& value);
+
+    /*!
+        \fn void PropertyTable::restore(const QVariantMap& properties)
+        Loads persisted properties (see toMap()) without any notification.
+    */
+    void            restore(const QVariantMap& properties);
+
+private:
+    enum ValueType
+    {
+        NONE,
+        BOOL,
+        INT,
+        UINT,
+        LONGLONG,
+        ULONGLONG,
+        DOUBLE,
+        FLOAT,
+        STRING,
+        VARIANT
+    };
+
+    struct Value
+    {
+        Value() : integer(0) {}
+
+        quint8      type = NONE;
+        union
+        {
+            qint64  integer;
+            double  number;
+        };
+        QString     text;
+    };
+
+    struct Layout
+    {
+        QHash<QString, int>     index;
+        QVector<QString>        names;
+    };
+
+    struct Columns
+    {
+        QVector<Value>          real;
+        QVector<Value>          target;
+        QVector<qlonglong>      timestamps;
+        QBitArray               dirty;
+        QHash<int, QVariant>    realVariants;
+        QHash<int, QVariant>    targetVariants;
+        QHash<int, QVariantMap> metadata;
+    };
+
+    // add(), toMap(name, index) and applyRealValue() expect the caller to hold _lock
+    int             indexOf(const QString& name) const;
+    int             add(const QString& name);
+    static void     encode(const QVariant& value, int index, QVector<Value>& values, QHash<int, QVariant>& variants);
+    static QVariant decode(int index, const QVector<Value>& values, const QHash<int, QVariant>& variants);
+    QVariantMap     toMap(const QString& name, int index) const;
+    void            applyRealValue(const QString& name, const QVariant& value, bool keepDirtyFlag, bool announceUnchanged, QVector<Change>* changes);
+    void            record(const QVector<Change>& changes);
+    QSharedPointer<PropertyHistory> historyFor(const QString& name);
+    void            notify(const QVector<Change>& changes);
+
+    QString         historyPath(const QString& key, const QString& name, bool sharded = true) const;
+
+    const QString                       _legacyHistoryKey;
+    QString                             _historyKey;
+    Snapshot<Layout>                    _layout;
+    mutable QReadWriteLock              _lock; // guards _columns
+    Columns                             _columns;
+    ChangeCallback                      _callback;
+    QMutex                              _historyMutex;
+    QMutex                              _historyOpenMutex;
+    QHash<QString, QSharedPointer<PropertyHistory>> _histories; // shared with running record()/history() calls
+};
+
+#endif // PROPERTYTABLE_H
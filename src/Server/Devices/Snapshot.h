@@ -0,0 +1,66 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <QMutex>
+#include <memory>
+
+/*!
+    \class Snapshot
+    \brief Holds an immutable version of a state, which is replaced as a whole (read-copy-update).
+    \ingroup devices
+
+    Readers get the current version with load() and can use it as long as they want without holding a lock.
+    Writers copy the current version, modify the copy and publish it with update(). Writers are serialized,
+    so no update gets lost, but they never make readers wait for the copy.
+
+    load() and the publication use std::atomic_load/std::atomic_store on the shared_ptr. These are not lock
+    free in common standard libraries (libstdc++ guards them with a small pool of mutexes selected by address),
+    so load() may briefly wait for another load() or publication. The lock is only held while the pointer and
+    its reference count are copied, never while a state is copied or modified.
+
+    Signals which announce a change should be emitted after update() has returned, with the values of the
+    published version.
+
+    \sa DeviceHandle, DeviceProperty
+*/
+
+template<typename T>
+class Snapshot
+{
+public:
+    Snapshot() : _current(std::make_shared<const T>()) {}
+
+    std::shared_ptr<const T> load() const
+    {
+        return std::atomic_load(&_current);
+    }
+
+    /*!
+        \fn std::shared_ptr<const T> Snapshot::update(F modify)
+        Calls modify(T&) with a copy of the current version and publishes the copy. Returns the published version.
+        modify must not call functions which may update the same snapshot.
+    */
+    template<typename F>
+    std::shared_ptr<const T> update(F modify)
+    {
+        QMutexLocker locker(&_writeMutex);
+        std::shared_ptr<T> next = std::make_shared<T>(*load());
+        modify(*next);
+        std::shared_ptr<const T> published = next;
+        std::atomic_store(&_current, published);
+        return published;
+    }
+
+private:
+    Q_DISABLE_COPY(Snapshot)
+    std::shared_ptr<const T>    _current;
+    QMutex                      _writeMutex;
+};
+
+#endif // SNAPSHOT_H
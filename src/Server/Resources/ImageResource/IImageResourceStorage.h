@@ -8,6 +8,9 @@
 #define IIMAGERESOURCESTORAGE_H
 
 #include <QObject>
+#include <QImage>
+#include <QBuffer>
+#include <QVariant>
 
 class IImageResourceStorage : public QObject
 {
@@ -24,6 +27,68 @@ public:
     virtual QImage      getImage(QString uid) = 0;
     virtual QVariant    getMetadata(QString uid) = 0;
     virtual QVariantMap getAllMetadata() = 0;
+
+    /*!
+        \fn bool IImageResourceStorage::insertImageData(QByteArray data, QVariantMap metadata, QString uid)
+        Stores the encoded image as it is. The default implementation decodes the image and calls insertImage().
+        Override this function to store the original bytes without decoding and re-encoding them.
+    */
+    virtual bool insertImageData(QByteArray data, QVariantMap metadata, QString uid)
+    {
+        return insertImage(QImage::fromData(data), metadata, uid);
+    }
+
+    /*!
+        \fn bool IImageResourceStorage::insertImageReference(QString hash, QVariantMap metadata, QString uid)
+        Adds an image whose data is already known to the storage by its SHA-256 hash (see ImageBlobStore),
+        so the data doesn't have to be transferred again. Only data which the identity in metadata["userid"]
+        already stored may be referenced. Returns false if the hash is unknown to this identity or the
+        storage doesn't deduplicate images (default).
+    */
+    virtual bool insertImageReference(QString hash, QVariantMap metadata, QString uid)
+    {
+        Q_UNUSED(hash);
+        Q_UNUSED(metadata);
+        Q_UNUSED(uid);
+        return false;
+    }
+
+    /*!
+        \fn QByteArray IImageResourceStorage::getImageData(QString uid)
+        Returns the encoded image. The default implementation encodes getImage() as PNG.
+    */
+    virtual QByteArray getImageData(QString uid)
+    {
+        QByteArray data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        getImage(uid).save(&buffer, "PNG");
+        return data;
+    }
+
+    /*!
+        \fn bool IImageResourceStorage::insertThumbnail(QString uid, int size, QByteArray data)
+        Stores a downscaled variant of the image next to the original. The default implementation
+        doesn't store thumbnails, they are generated again on every request.
+    */
+    virtual bool insertThumbnail(QString uid, int size, QByteArray data)
+    {
+        Q_UNUSED(uid);
+        Q_UNUSED(size);
+        Q_UNUSED(data);
+        return false;
+    }
+
+    /*!
+        \fn QByteArray IImageResourceStorage::getThumbnail(QString uid, int size)
+        Returns the encoded thumbnail or an empty byte array if it doesn't exist (yet).
+    */
+    virtual QByteArray getThumbnail(QString uid, int size)
+    {
+        Q_UNUSED(uid);
+        Q_UNUSED(size);
+        return QByteArray();
+    }
 };
 
 #endif // IIMAGERESOURCESTORAGE_H
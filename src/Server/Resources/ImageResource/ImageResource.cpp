@@ -8,10 +8,41 @@
 #include "IImageResourceStorage.h"
 #include <QDateTime>
 #include <QUuid>
+#include <QDebug>
+#include <QBuffer>
+#include <QImageReader>
+#include <QtConcurrent>
+
+#define IMAGE_THUMBNAIL_QUALITY 85
+
+namespace
+{
+    QFuture<QByteArray> finishedFuture(const QByteArray& data)
+    {
+        QFutureInterface<QByteArray> future;
+        future.reportStarted();
+        future.reportResult(data);
+        future.reportFinished();
+        return future.future();
+    }
+}
 
 ImageResource::ImageResource(IImageResourceStorage* storage, QObject* parent): IResource("", parent),
 _listStorage(storage)
 {
+    _thumbnailSizes<<64<<256<<1024;
+}
+
+ImageResource::~ImageResource()
+{
+    // running jobs access the storage - wait for them
+    _thumbnailMutex.lock();
+    QList<QFuture<QByteArray>> jobs = _thumbnailJobs.values();
+    _thumbnailMutex.unlock();
+
+    QListIterator<QFuture<QByteArray>> it(jobs);
+    while(it.hasNext())
+        it.next().waitForFinished();
 }
 
 qint64 ImageResource::lastAccess() const
@@ -25,6 +56,15 @@ const QString ImageResource::getResourceType() const
 }
 
 IResource::ModificationResult ImageResource::insert(QImage image, QVariant data, QString id, QString token)
+{
+    QByteArray encoded;
+    QBuffer buffer(&encoded);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, "PNG");
+    return insertData(encoded, data, id, token);
+}
+
+IResource::ModificationResult ImageResource::insertData(QByteArray image, QVariant data, QString id, QString token)
 {
     ModificationResult result;
     iIdentityPtr user = AuthenticationService::instance()->validateToken(token);
@@ -35,19 +75,69 @@ IResource::ModificationResult ImageResource::insert(QImage image, QVariant data,
         return result;
     }
 
+    QByteArray format = imageFormat(image);
+    if(format.isEmpty())
+    {
+        result.error = INVALID_PARAMETERS;
+        return result;
+    }
+
     QVariantMap item = prepareTemplate(user);
     item["data"] = data;
+    item["format"] = QString(format);
+    item["size"] = image.size();
     result.data = item;
 
     _lock.lockForWrite();
-    bool success = _listStorage->insertImage(image, item, id);
+    bool success = _listStorage->insertImageData(image, item, id);
     _lock.unlock();
 
     if(!success)
+    {
         result.error = STORAGE_ERROR;
-    else
-        Q_EMIT imageAdded(id);
+        return result;
+    }
+
+    // thumbnails are generated in parallel right away, so that the first gallery view doesn't have to wait
+    QListIterator<int> it(thumbnailSizes());
+    while(it.hasNext())
+        requestThumbnail(id, it.next());
 
+    Q_EMIT imageAdded(id);
+    return result;
+}
+
+IResource::ModificationResult ImageResource::insertReference(QString hash, QVariant data, QString id, QString token)
+{
+    ModificationResult result;
+    iIdentityPtr user = AuthenticationService::instance()->validateToken(token);
+
+    if(user.isNull())
+    {
+        result.error = PERMISSION_DENIED;
+        return result;
+    }
+
+    QVariantMap item = prepareTemplate(user);
+    item["data"] = data;
+
+    _lock.lockForWrite();
+    bool success = _listStorage->insertImageReference(hash, item, id);
+    if(success)
+        result.data = _listStorage->getMetadata(id);
+    _lock.unlock();
+
+    if(!success)
+    {
+        result.error = UNKNOWN_ITEM;
+        return result;
+    }
+
+    QListIterator<int> it(thumbnailSizes());
+    while(it.hasNext())
+        requestThumbnail(id, it.next());
+
+    Q_EMIT imageAdded(id);
     return result;
 }
 
@@ -100,6 +190,67 @@ QImage ImageResource::getImage(QString id, QString token)
     return _listStorage->getImage(id);
 }
 
+QByteArray ImageResource::getImageData(QString id, QString token)
+{
+    iIdentityPtr user = AuthenticationService::instance()->validateToken(token);
+
+    if(user.isNull())
+        return QByteArray();
+
+    QReadLocker locker(&_lock);
+    return _listStorage->getImageData(id);
+}
+
+QFuture<QByteArray> ImageResource::getThumbnail(QString id, int size, QString token)
+{
+    iIdentityPtr user = AuthenticationService::instance()->validateToken(token);
+
+    if(user.isNull())
+        return finishedFuture(QByteArray());
+
+    int thumbnailSize = -1;
+    QListIterator<int> it(thumbnailSizes());
+    while(it.hasNext())
+    {
+        int current = it.next();
+        if(current >= size && (thumbnailSize < 0 || current < thumbnailSize))
+            thumbnailSize = current;
+    }
+
+    QReadLocker locker(&_lock);
+    if(thumbnailSize < 0)
+        return finishedFuture(_listStorage->getImageData(id));
+
+    QByteArray thumbnail = _listStorage->getThumbnail(id, thumbnailSize);
+    locker.unlock();
+
+    if(!thumbnail.isEmpty())
+        return finishedFuture(thumbnail);
+
+    return requestThumbnail(id, thumbnailSize);
+}
+
+void ImageResource::setThumbnailSizes(QList<int> sizes)
+{
+    QMutexLocker locker(&_thumbnailMutex);
+    _thumbnailSizes = sizes;
+}
+
+QList<int> ImageResource::thumbnailSizes() const
+{
+    QMutexLocker locker(&_thumbnailMutex);
+    return _thumbnailSizes;
+}
+
+QByteArray ImageResource::imageFormat(const QByteArray &image)
+{
+    // only the header is read to detect the format
+    QBuffer buffer;
+    buffer.setData(image);
+    buffer.open(QIODevice::ReadOnly);
+    return QImageReader::imageFormat(&buffer);
+}
+
 QVariant ImageResource::getMetaData(QString id)
 {
     QReadLocker locker(&_lock);
@@ -112,6 +263,76 @@ QVariantMap ImageResource::getAllMetadata()
     return _listStorage->getAllMetadata();
 }
 
+QFuture<QByteArray> ImageResource::requestThumbnail(QString id, int size)
+{
+    QString key = id + "_" + QString::number(size);
+    QMutexLocker locker(&_thumbnailMutex);
+    if(_thumbnailJobs.contains(key))
+        return _thumbnailJobs.value(key);
+
+    QFuture<QByteArray> job = QtConcurrent::run([=](){ return createThumbnail(id, size); });
+    _thumbnailJobs.insert(key, job);
+    return job;
+}
+
+QByteArray ImageResource::createThumbnail(QString id, int size)
+{
+    QByteArray thumbnail;
+    QByteArray original;
+
+    _lock.lockForRead();
+    thumbnail = _listStorage->getThumbnail(id, size);
+    if(thumbnail.isEmpty())
+        original = _listStorage->getImageData(id);
+    _lock.unlock();
+
+    if(thumbnail.isEmpty() && !original.isEmpty())
+    {
+        QBuffer buffer(&original);
+        buffer.open(QIODevice::ReadOnly);
+        QImageReader reader(&buffer);
+        QByteArray format = reader.format();
+        QSize imageSize = reader.size();
+
+        if(imageSize.isValid() && imageSize.width() <= size && imageSize.height() <= size)
+        {
+            // small images are not scaled up
+            thumbnail = original;
+        }
+        else
+        {
+            // most readers (e.g. JPEG) can decode directly to the scaled size
+            if(imageSize.isValid())
+                reader.setScaledSize(imageSize.scaled(size, size, Qt::KeepAspectRatio));
+
+            QImage image = reader.read();
+            if(!imageSize.isValid() && !image.isNull())
+                image = image.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+            bool jpeg = format == "jpeg" || format == "jpg";
+            QBuffer output(&thumbnail);
+            output.open(QIODevice::WriteOnly);
+            if(image.isNull() || !image.save(&output, jpeg ? "JPEG" : "PNG", jpeg ? IMAGE_THUMBNAIL_QUALITY : -1))
+            {
+                qWarning()<<"Warning: Could not create thumbnail for image"<<id;
+                thumbnail.clear();
+            }
+            else
+            {
+                _lock.lockForWrite();
+                _listStorage->insertThumbnail(id, size, thumbnail);
+                _lock.unlock();
+            }
+        }
+    }
+
+    // the thumbnail is stored before the job is removed, so no request can miss both
+    _thumbnailMutex.lock();
+    _thumbnailJobs.remove(id + "_" + QString::number(size));
+    _thumbnailMutex.unlock();
+    return thumbnail;
+}
+
 QVariantMap ImageResource::prepareTemplate(iIdentityPtr user) const
 {
     QVariantMap item;
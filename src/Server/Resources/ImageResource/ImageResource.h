@@ -11,6 +11,8 @@
 #include "../../Authentication/User.h"
 #include "ImageResourceFactory.h"
 #include <QReadWriteLock>
+#include <QMutex>
+#include <QFuture>
 
 class IImageResourceStorage;
 class ResourceManager;
@@ -21,18 +23,56 @@ class ImageResource : public IResource
 public:
 
     explicit ImageResource(IImageResourceStorage* storage, QObject* parent = nullptr);
+    ~ImageResource() override;
 
     qint64              lastAccess() const override;
     QString const       getResourceType() const override;
     ModificationResult  insert(QImage image, QVariant data, QString id, QString token);
+
+    /*!
+        \fn ModificationResult ImageResource::insertData(QByteArray image, QVariant data, QString id, QString token)
+        Inserts an encoded image (PNG, JPEG, ...) without decoding it. The format is detected from the content,
+        data which is not a supported image format is rejected with INVALID_PARAMETERS.
+    */
+    ModificationResult  insertData(QByteArray image, QVariant data, QString id, QString token);
+
+    /*!
+        \fn ModificationResult ImageResource::insertReference(QString hash, QVariant data, QString id, QString token)
+        Inserts an image whose data the same user already stored, identified by its SHA-256 hash. Fails with
+        UNKNOWN_ITEM if the user has no image with this hash, the data has to be inserted with insertData() then.
+    */
+    ModificationResult  insertReference(QString hash, QVariant data, QString id, QString token);
     ModificationResult  deleteImage(QString uid, QString token);
 
     QStringList         getAllImageIds(QString token);
     QImage              getImage(QString id,  QString token);
+    QByteArray          getImageData(QString id, QString token);
     QVariant            getMetaData(QString id);
     QVariantMap         getAllMetadata();
 
+    /*!
+        \fn QFuture<QByteArray> ImageResource::getThumbnail(QString id, int size, QString token)
+        Returns the smallest thumbnail whose bounding box is at least size x size pixels. If the requested size
+        is larger than all thumbnail sizes, the original image is returned. Missing thumbnails are generated on
+        the thread pool, concurrent requests for the same thumbnail share a single job.
+    */
+    QFuture<QByteArray> getThumbnail(QString id, int size, QString token);
+
+    /*!
+        \fn void ImageResource::setThumbnailSizes(QList<int> sizes)
+        Sets the edge lengths of the thumbnails which are generated for every inserted image. Default is 64, 256 and 1024 px.
+    */
+    void                setThumbnailSizes(QList<int> sizes);
+    QList<int>          thumbnailSizes() const;
+
+    static QByteArray   imageFormat(const QByteArray& image);
+
 private:
+    QFuture<QByteArray>      requestThumbnail(QString id, int size);
+    QByteArray               createThumbnail(QString id, int size);
+    mutable QMutex           _thumbnailMutex;
+    QHash<QString, QFuture<QByteArray>> _thumbnailJobs;
+    QList<int>               _thumbnailSizes;
     QReadWriteLock           _lock;
     qint64                   _lastAccess;
     IImageResourceStorage*   _listStorage;
@@ -0,0 +1,128 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "CappedListResource.h"
+#include <QDateTime>
+#include <QJsonDocument>
+#include "../ResourceManager/IResourceFactory.h"
+
+// When a limit is exceeded, the list is trimmed to (1 - CAPPED_LIST_EVICTION_BATCH) of the limit.
+// This way, items are evicted in batches instead of one by one with every append.
+#define CAPPED_LIST_EVICTION_BATCH  0.1
+
+CappedListResource::CappedListResource(IListResourceStorage *storage, RetentionPolicy policy, QObject *parent) : ListResource(storage, parent),
+    _policy(policy)
+{
+    if(_policy.maxBytes > 0)
+    {
+        QListIterator<QVariant> it(getListData());
+        while(it.hasNext())
+            _bytes += itemSize(it.next());
+    }
+
+    // without appends, aged items are evicted periodically
+    if(_policy.maxAge > 0)
+    {
+        _ageTimer.setInterval(int(qBound<qint64>(1000, _policy.maxAge / 10, 1000 * 60)));
+        connect(&_ageTimer, &QTimer::timeout, this, &CappedListResource::applyRetention);
+        _ageTimer.start();
+    }
+}
+
+CappedListResource::RetentionPolicy CappedListResource::parseRetentionPolicy(QString descriptor)
+{
+    QVariantMap parameters = IResourceFactory::parseParameters(descriptor);
+    RetentionPolicy policy;
+    policy.maxCount = qMax(0, parameters.value("maxcount").toInt());
+    policy.maxAge = qMax<qint64>(0, parameters.value("maxage").toLongLong() * 1000);
+    policy.maxBytes = qMax<qint64>(0, parameters.value("maxbytes").toLongLong());
+    return policy;
+}
+
+QString CappedListResource::policyName(RetentionPolicy policy)
+{
+    return "capped-c" + QString::number(policy.maxCount) + "-a" + QString::number(policy.maxAge / 1000) + "-b" + QString::number(policy.maxBytes);
+}
+
+CappedListResource::RetentionPolicy CappedListResource::retentionPolicy() const
+{
+    return _policy;
+}
+
+void CappedListResource::itemsAdded(const QVariantList &items)
+{
+    // called for the token and the identity overloads of appendItem(), insertAt() and appendList()
+    if(_policy.maxBytes > 0)
+    {
+        for(int i = 0; i < items.count(); i++)
+            _bytes += itemSize(items.at(i));
+    }
+    applyRetention();
+}
+
+qint64 CappedListResource::itemSize(const QVariant &item)
+{
+    return QJsonDocument::fromVariant(item).toJson(QJsonDocument::Compact).size();
+}
+
+int CappedListResource::evictionsForCount(int count) const
+{
+    if(_policy.maxCount <= 0 || count <= _policy.maxCount)
+        return 0;
+
+    int keep = qMax(1, int(_policy.maxCount * (1.0 - CAPPED_LIST_EVICTION_BATCH)));
+    return count - keep;
+}
+
+int CappedListResource::evictionsForAge(int count) const
+{
+    if(_policy.maxAge <= 0)
+        return 0;
+
+    // items are appended in chronological order - the first young item ends the search
+    qint64 limit = QDateTime::currentMSecsSinceEpoch() - _policy.maxAge;
+    int evictions = 0;
+    while(evictions < count && getItem(evictions).toMap()["timestamp"].toLongLong() < limit)
+        evictions++;
+
+    return evictions;
+}
+
+int CappedListResource::evictionsForBytes(int count)
+{
+    // _bytes is an upper bound, removed or modified items are not subtracted.
+    // The exact size is only calculated when the bound exceeds the limit.
+    if(_policy.maxBytes <= 0 || _bytes <= _policy.maxBytes)
+        return 0;
+
+    qint64 keepBytes = qint64(_policy.maxBytes * (1.0 - CAPPED_LIST_EVICTION_BATCH));
+    qint64 bytes = 0;
+    int index = count - 1;
+    while(index >= 0)
+    {
+        qint64 size = itemSize(getItem(index));
+        if(bytes + size > keepBytes)
+            break;
+        bytes += size;
+        index--;
+    }
+
+    _bytes = bytes;
+    return index + 1;
+}
+
+void CappedListResource::applyRetention()
+{
+    int count = getCount();
+    if(count <= 0)
+        return;
+
+    int evictions = qMax(evictionsForCount(count), evictionsForAge(count));
+    evictions = qMax(evictions, evictionsForBytes(count));
+
+    if(evictions > 0)
+        removeItems(0, qMin(evictions, count));
+}
@@ -0,0 +1,81 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef CAPPEDLISTRESOURCE_H
+#define CAPPEDLISTRESOURCE_H
+
+#include <QTimer>
+#include "ListResource.h"
+
+/*!
+    \class CappedListResource
+    \brief A ListResource with a retention policy, e.g. for event logs.
+
+    The oldest items at the beginning of the list are evicted as soon as the list exceeds one of its limits
+    (number of items, age of the items or size in bytes). This is not a ring buffer: an eviction removes a batch of
+    CAPPED_LIST_EVICTION_BATCH of the limit from the front of the list, which moves the remaining items and is
+    written to the storage like any other removal. Batching only makes these evictions rare.
+    The batch is sent to the clients as a single "synclist:remove" range.
+
+    A capped list is requested by adding the retention parameters to the descriptor, e.g.
+    \code
+    logs/events?maxcount=10000&maxage=604800&maxbytes=1048576
+    \endcode
+    maxage is given in seconds. The parameters are part of the resource name: every policy is a list of its own,
+    so a client can never shorten a list by opening it with other parameters.
+
+    \sa ListResourceFactory
+*/
+
+class CappedListResource : public ListResource
+{
+    Q_OBJECT
+
+    friend class ListResourceFactory;
+
+public:
+    /*!
+        \struct CappedListResource::RetentionPolicy
+        Limits of a capped list. A value of 0 means unlimited.
+    */
+    struct RetentionPolicy
+    {
+        int     maxCount = 0;
+        qint64  maxAge = 0; // msecs
+        qint64  maxBytes = 0;
+
+        bool isCapped() const {return maxCount > 0 || maxAge > 0 || maxBytes > 0;}
+    };
+
+    static RetentionPolicy parseRetentionPolicy(QString descriptor);
+
+    /*!
+        \fn static QString CappedListResource::policyName(RetentionPolicy policy)
+        Returns a name for the policy which is added to the resource name, e.g. "capped-c10000-a604800-b0".
+    */
+    static QString policyName(RetentionPolicy policy);
+
+    RetentionPolicy             retentionPolicy() const;
+
+protected:
+    explicit CappedListResource(IListResourceStorage* storage, RetentionPolicy policy, QObject *parent = nullptr);
+    void                        itemsAdded(const QVariantList& items) override;
+
+private:
+    static qint64               itemSize(const QVariant& item);
+    int                         evictionsForCount(int count) const;
+    int                         evictionsForAge(int count) const;
+    int                         evictionsForBytes(int count);
+
+    RetentionPolicy             _policy;
+    qint64                      _bytes = 0;
+    QTimer                      _ageTimer;
+
+private slots:
+    void                        applyRetention();
+};
+
+#endif // CAPPEDLISTRESOURCE_H
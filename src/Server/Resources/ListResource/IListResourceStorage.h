@@ -80,6 +80,23 @@ public:
      */
     virtual bool removeItem(ItemUID item) = 0;
 
+    /*!
+          \fn bool IListResourceStorage::removeItems(int index, int count)
+          Removes count items starting at the given position. The default implementation calls removeItem() for
+          every single item. Override this function if the storage is able to remove a range at once.
+     */
+    virtual bool removeItems(int index, int count)
+    {
+        bool success = true;
+        for(int i = index + count - 1; i >= index; i--)
+        {
+            ItemUID uid;
+            uid.index = i;
+            success = removeItem(uid) && success;
+        }
+        return success;
+    }
+
     /*!
           \fn bool IListResourceStorage::deleteList()
           Deletes the list. (Should also delete its storage representation [file, database entry,...]).
@@ -108,6 +108,9 @@ IResource::ModificationResult ListResource::appendItem(QVariant data, iIdentityP
         result.error = STORAGE_ERROR;
     }
     _mutex.unlock();
+
+    if(result.error == NO_ERROR)
+        itemsAdded(QVariantList() << item);
     return result;
 
 }
@@ -147,6 +150,9 @@ IResource::ModificationResult ListResource::insertAt(QVariant data, int index, i
         result.error = STORAGE_ERROR;
 
     _mutex.unlock();
+
+    if(result.error == NO_ERROR)
+        itemsAdded(QVariantList() << item);
     return result;
 }
 
@@ -185,6 +191,9 @@ ListResource::ModificationResult ListResource::appendList(QVariantList data, iId
     else
         result.error = STORAGE_ERROR;
     _mutex.unlock();
+
+    if(result.error == NO_ERROR)
+        itemsAdded(itemsToAppend);
     return result;
 }
 
@@ -240,6 +249,25 @@ IResource::ModificationResult ListResource::removeItem(int index, iIdentityPtr u
     return result;
 }
 
+IResource::ModificationResult ListResource::removeItems(int index, int count, iIdentityPtr user)
+{
+    ModificationResult result;
+    if(index < 0 || count <= 0)
+    {
+        result.error = INVALID_PARAMETERS;
+        return result;
+    }
+
+    _mutex.lockForWrite();
+    _lastAccess = QDateTime::currentMSecsSinceEpoch();
+    if(_listStorage && _listStorage->removeItems(index, count))
+        Q_EMIT itemsRemoved(index, count, user);
+    else
+        result.error = STORAGE_ERROR;
+    _mutex.unlock();
+    return result;
+}
+
 
 ListResource::ModificationResult ListResource::deleteList(QString token)
 {
@@ -429,6 +457,11 @@ void ListResource::setStorage(IListResourceStorage *storage)
    // Q_EMIT reset();  not sure if this is a good idea
 }
 
+void ListResource::itemsAdded(const QVariantList &items)
+{
+    Q_UNUSED(items)
+}
+
 void ListResource::setAllowUserAccess(bool enabled)
 {
     _allowUserAccess = enabled;
@@ -194,6 +194,7 @@ signals:
     void itemInserted(QVariant data, int index, iIdentityPtr user);
     void listAppended(QVariantList data, iIdentityPtr user);
     void itemRemoved(int index, QString uuid, iIdentityPtr user);
+    void itemsRemoved(int index, int count, iIdentityPtr user);
     void listDeleted(iIdentityPtr user);
     void listCleared(iIdentityPtr user);
     void itemSet(QVariant data, int index, QString uuid, iIdentityPtr user);
@@ -215,6 +216,7 @@ protected:
     ModificationResult appendList(QVariantList data, iIdentityPtr user = iIdentityPtr(nullptr));
     void resetData(QVariantList data, iIdentityPtr user = iIdentityPtr(nullptr));
     ModificationResult removeItem(int index, iIdentityPtr user = iIdentityPtr(nullptr), QString uuid = "");
+    ModificationResult removeItems(int index, int count, iIdentityPtr user = iIdentityPtr(nullptr));
     ModificationResult deleteList(iIdentityPtr user = iIdentityPtr(nullptr));
     ModificationResult clearList(iIdentityPtr user = iIdentityPtr(nullptr));
     ModificationResult set(QVariant data, int index, iIdentityPtr user = iIdentityPtr(nullptr),  QString uuid = "");
@@ -223,6 +225,13 @@ protected:
     void setStorage(IListResourceStorage* storage);
     void setAllowUserAccess(bool enabled);
 
+    /*!
+        \fn void ListResource::itemsAdded(const QVariantList& items)
+        Called after appendItem(), insertAt() or appendList() added items, no matter which overload was used.
+        The lock of the list is released. The default implementation does nothing.
+    */
+    virtual void itemsAdded(const QVariantList& items);
+
 public slots:
 };
 
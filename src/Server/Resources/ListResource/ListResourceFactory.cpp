@@ -7,6 +7,7 @@
 #include <QDebug>
 #include "ListResourceFactory.h"
 #include "ListResource.h"
+#include "CappedListResource.h"
 #include "Storage/ListResourceFileSystemStorage.h"
 
 ListResourceFactory::ListResourceFactory(IListResourceStorageFactory* storageFactory, QObject *parent) : IResourceFactory(parent),
@@ -23,6 +24,21 @@ QString ListResourceFactory::getResourceType() const
     return "synclist";
 }
 
+QString ListResourceFactory::getResourceID(QString descriptor, QString token) const
+{
+    return generateQualifiedResourceName(retentionDescriptor(descriptor), token);
+}
+
+QString ListResourceFactory::retentionDescriptor(QString descriptor)
+{
+    // every retention policy is a list of its own, opening a list with other parameters must not evict its items
+    CappedListResource::RetentionPolicy policy = CappedListResource::parseRetentionPolicy(descriptor);
+    if(!policy.isCapped())
+        return descriptor;
+
+    return descriptor.split("?").first().split(":").first() + "_" + CappedListResource::policyName(policy);
+}
+
 resourcePtr ListResourceFactory::createResource(QString token, QString descriptor, QObject *parent)
 {
     Q_UNUSED(parent)
@@ -31,7 +47,7 @@ resourcePtr ListResourceFactory::createResource(QString token, QString descripto
     if(user.isNull())
         return resourcePtr();
 
-    QString resourceName = generateQualifiedResourceName(descriptor, token);
+    QString resourceName = getResourceID(descriptor, token);
 
     IListResourceStorage* storage = nullptr;
 
@@ -47,6 +63,10 @@ resourcePtr ListResourceFactory::createResource(QString token, QString descripto
         qInfo()<<"Create ListResource with FS Resource Handler"<<resourceName;
     }
 
+    CappedListResource::RetentionPolicy policy = CappedListResource::parseRetentionPolicy(descriptor);
+    if(policy.isCapped())
+        return resourcePtr(new CappedListResource(storage, policy));
+
     return resourcePtr(new ListResource(storage));
 }
 
@@ -19,10 +19,12 @@ public:
     ListResourceFactory(IListResourceStorageFactory* storageFactory, QObject* parent = nullptr);
     ListResourceFactory(QObject* parent = nullptr);
     QString getResourceType() const override;
+    QString getResourceID(QString descriptor, QString token = "") const override;
 
     void setAlternativeStorageFactory(IListResourceStorageFactory *newAlternativeStorageFactory);
 
 private:
+    static QString retentionDescriptor(QString descriptor);
     resourcePtr createResource(QString token, QString descriptor, QObject *parent) override;
     IListResourceStorageFactory* _alternativeStorageFactory = nullptr;
 };
@@ -9,7 +9,6 @@
 #include <QJsonDocument>
 
 #include <QDebug>
-#include <QDir>
 #include <QCoreApplication>
 
 
@@ -31,22 +30,10 @@ IResource::~IResource()
 
 void IResource::save()
 {
-    QFileInfo info(_file);
-    QDir dir(info.absolutePath());
-    if(!dir.exists())
-    {
-        dir.mkpath(info.absolutePath());
-    }
+    if(_resourcePath.isEmpty())
+        return;
 
-    if(_file.open(QFile::WriteOnly))
-    {
-        _file.write(QJsonDocument::fromVariant(getData()).toJson());
-        _file.close();
-    }
-    else
-    {
-        qDebug()<<"Warning: Could not open file -"<<_file.errorString();
-    }
+    PersistenceScheduler::save(_resourcePath, getData(), _durability);
 }
 
 void IResource::setDynamicContent(bool enabled)
@@ -56,6 +43,7 @@ void IResource::setDynamicContent(bool enabled)
 
 QVariantMap IResource::load()
 {
+    PersistenceScheduler::waitForWritten(_resourcePath);
     if( _file.open(QFile::ReadOnly))
     {
         QVariantMap file =  QJsonDocument::fromJson(_file.readAll()).toVariant().toMap();
@@ -86,6 +74,11 @@ const QVariantMap IResource::getData()
     return QVariantMap();
 }
 
+void IResource::setDurability(PersistenceScheduler::Durability durability)
+{
+    _durability = durability;
+}
+
 bool IResource::dynamicContent() const
 {
     return _dynamicContent;
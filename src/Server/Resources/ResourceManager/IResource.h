@@ -13,6 +13,7 @@
 #include <QFileInfo>
 #include <QVariant>
 #include "qhcore_global.h"
+#include "Storage/PersistenceScheduler.h"
 
 class ResourceManager;
 class COREPLUGINSHARED_EXPORT IResource : public QObject
@@ -29,7 +30,8 @@ public:
         INVALID_PARAMETERS = -3,
         STORAGE_ERROR = -4,
         UNKNOWN_ERROR = -5,
-        NOT_SUPPORTED = -6
+        NOT_SUPPORTED = -6,
+        BUSY = -7
     };
 
     Q_ENUM (ResourceError)
@@ -65,6 +67,7 @@ public:
         \fn virtual bool IResource::getData()
         Returns a dump of the whole resource.
         The base class will use this data to store the content on disk.
+        \sa IResource::save()
     */
     virtual const QVariantMap   getData();
 
@@ -83,10 +86,22 @@ public:
 
 
 public slots:
+    /*!
+        \fn void IResource::save()
+        Hands a dump of the resource (getData()) to the PersistenceScheduler. The file is written in the background
+        according to the durability mode of this resource.
+        \sa IResource::setDurability(PersistenceScheduler::Durability durability)
+    */
     void                        save();
 
 protected:
     QFile                       _file;
+
+    /*!
+        \fn IResource::setDurability(PersistenceScheduler::Durability durability)
+        Sets the durability mode which is used when the resource is saved. Default is PersistenceScheduler::BATCHED.
+    */
+    void                        setDurability(PersistenceScheduler::Durability durability);
     /*!
         \fn IResource::setDynamicContent(bool enabled)
         Set dynamic content to true, to implement a resource which
@@ -98,6 +113,7 @@ protected:
 private:
     QString                     _resourcePath;
     bool                        _dynamicContent = false;
+    PersistenceScheduler::Durability _durability = PersistenceScheduler::BATCHED;
 
     //                          this property is set from friend class ResourceManager and will be sent with the destroyed signal
     //                          It is used for internal bookkeeping in ResourceManager.cpp. This is for threadsafetyness.
@@ -0,0 +1,115 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+
+#ifndef KEYEDLIST_H
+#define KEYEDLIST_H
+
+#include <QVector>
+#include <QList>
+#include <algorithm>
+
+/*!
+    \class KeyedList
+    \brief Ordered container for IList implementations, whose items are addressed by a unique key.
+
+    The items are kept sorted by their key in contiguous arrays. The index of a key is
+    found with a binary search, so looking up or updating an item costs O(log n) without any
+    allocation. Inserting and removing moves the following items (a single memmove).
+
+    \sa IList
+*/
+
+template<typename Key, typename T>
+class KeyedList
+{
+public:
+    /*!
+        \fn int KeyedList::indexOf(const Key& key) const
+        Returns the index of the item with the given key or -1.
+    */
+    int indexOf(const Key& key) const
+    {
+        int idx = lowerBound(key);
+        return idx < _keys.count() && _keys.at(idx) == key ? idx : -1;
+    }
+
+    bool contains(const Key& key) const
+    {
+        return indexOf(key) >= 0;
+    }
+
+    /*!
+        \fn int KeyedList::insert(const Key& key, const T& value)
+        Inserts the item at its sorted position or replaces an existing item with the same key.
+        Returns the index of the item.
+    */
+    int insert(const Key& key, const T& value)
+    {
+        int idx = lowerBound(key);
+        if(idx < _keys.count() && _keys.at(idx) == key)
+        {
+            _values[idx] = value;
+            return idx;
+        }
+
+        _keys.insert(idx, key);
+        _values.insert(idx, value);
+        return idx;
+    }
+
+    /*!
+        \fn int KeyedList::remove(const Key& key)
+        Removes the item and returns the index it had, or -1 if there is no item with the given key.
+    */
+    int remove(const Key& key)
+    {
+        int idx = indexOf(key);
+        if(idx < 0)
+            return -1;
+
+        _keys.remove(idx);
+        _values.remove(idx);
+        return idx;
+    }
+
+    T value(const Key& key, const T& defaultValue = T()) const
+    {
+        int idx = indexOf(key);
+        return idx < 0 ? defaultValue : _values.at(idx);
+    }
+
+    const T& at(int index) const
+    {
+        return _values.at(index);
+    }
+
+    void replace(int index, const T& value)
+    {
+        _values[index] = value;
+    }
+
+    int count() const
+    {
+        return _keys.count();
+    }
+
+    QList<T> values() const
+    {
+        return _values.toList();
+    }
+
+private:
+    int lowerBound(const Key& key) const
+    {
+        return int(std::lower_bound(_keys.constBegin(), _keys.constEnd(), key) - _keys.constBegin());
+    }
+
+    QVector<Key>    _keys;
+    QVector<T>      _values;
+};
+
+#endif // KEYEDLIST_H
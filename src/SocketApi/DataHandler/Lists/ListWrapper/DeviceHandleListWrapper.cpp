@@ -32,36 +32,29 @@ void DeviceHandleListWrapper::newHandle(QString uuid)
 
 void DeviceHandleListWrapper::handleRemoved(QString uuid)
 {
-    int idx = getIndex(uuid);
+    int idx = _devices.remove(uuid);
     if(idx < 0)
         return;
 
-    _devices.remove(uuid);
     Q_EMIT itemRemoved(idx);
 }
 
 void DeviceHandleListWrapper::deviceStateChangedSlot(QString uuid, IDevice::DeviceState state)
 {
-    if(!_devices.contains(uuid))
+    bool online = (state == IDevice::ONLINE);
+    int idx = setItemProperty(uuid, "online", online);
+    if(idx < 0)
         return;
 
-    bool online = (state == IDevice::ONLINE);
-    QVariantMap item = _devices[uuid].toMap();
-    item["online"] = online;
-    _devices.insert(uuid, item);
-    int idx = getIndex(uuid);
     Q_EMIT IList::propertyChanged("online", online, idx);
 }
 
 void DeviceHandleListWrapper::deviceDescriptionChangedSlot(QString uuid, QString description)
 {
-    if(!_devices.contains(uuid))
+    int idx = setItemProperty(uuid, "description", description);
+    if(idx < 0)
         return;
 
-    QVariantMap item = _devices[uuid].toMap();
-    item["description"] = description;
-    _devices.insert(uuid, item);
-    int idx = getIndex(uuid);
     Q_EMIT IList::propertyChanged("description", description, idx);
 }
 
@@ -71,14 +64,23 @@ void DeviceHandleListWrapper::newMapping(QString uuid, QString mapping)
     if(!_devices.contains(uuid))
         return;
 
-    QVariantMap item = _devices[uuid].toMap();
-    QStringList mappings = DeviceManager::instance()->getMappings().keys(uuid);
-    item["mappings"] = mappings;
-    _devices.insert(uuid, item);
-    int idx = getIndex(uuid);
+    QStringList mappings = DeviceManager::instance()->getMappingsForDevice(uuid);
+    int idx = setItemProperty(uuid, "mappings", mappings);
     Q_EMIT propertyChanged("mappings", mappings, idx);
 }
 
+int DeviceHandleListWrapper::setItemProperty(QString uuid, QString property, QVariant value)
+{
+    int idx = _devices.indexOf(uuid);
+    if(idx < 0)
+        return -1;
+
+    QVariantMap item = _devices.at(idx).toMap();
+    item[property] = value;
+    _devices.replace(idx, item);
+    return idx;
+}
+
 void DeviceHandleListWrapper::addHandle(deviceHandlePtr handle)
 {
     if(handle.isNull())
@@ -86,8 +88,7 @@ void DeviceHandleListWrapper::addHandle(deviceHandlePtr handle)
 
     QString uuid = handle->uuid();
     QVariant handleData = toVariant(handle);
-    _devices.insert(uuid, handleData);
-    int idx = getIndex(uuid);
+    int idx = _devices.insert(uuid, handleData);
 
     connect(handle.data(), &DeviceHandle::deviceStateChanged, this, &DeviceHandleListWrapper::deviceStateChangedSlot);
     connect(handle.data(), &DeviceHandle::descriptionChanged, this, &DeviceHandleListWrapper::deviceDescriptionChangedSlot);
@@ -97,7 +98,7 @@ void DeviceHandleListWrapper::addHandle(deviceHandlePtr handle)
 QVariant DeviceHandleListWrapper::toVariant(deviceHandlePtr handle)
 {
     QVariantMap data;
-    QStringList deviceMappings = DeviceManager::instance()->getMappings().keys(handle->uuid());
+    QStringList deviceMappings = DeviceManager::instance()->getMappingsForDevice(handle->uuid());
     data["mappings"] = deviceMappings;
     data["online"] = handle->getDeviceState() == IDevice::ONLINE;
     data["uuid"] = handle->uuid();
@@ -106,13 +107,3 @@ QVariant DeviceHandleListWrapper::toVariant(deviceHandlePtr handle)
     data["shortID"] = handle->shortUid();
     return data;
 }
-
-int DeviceHandleListWrapper::getIndex(QString uuid) const
-{
-    if(!_devices.contains(uuid))
-        return -1;
-
-    QList<QString> keys = _devices.keys();
-    auto i = qBinaryFind(keys.begin(), keys.end(), uuid);
-    return i - keys.begin();
-}
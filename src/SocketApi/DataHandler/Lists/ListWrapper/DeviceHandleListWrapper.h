@@ -10,6 +10,7 @@
 
 #include <QObject>
 #include "../IList.h"
+#include "../KeyedList.h"
 #include "Server/Devices/DeviceManager.h"
 
 class DeviceHandleListWrapper : public IList
@@ -31,10 +32,8 @@ private slots:
 private:
     void addHandle(deviceHandlePtr handle);
     QVariant toVariant(deviceHandlePtr handle);
-    QMap<QString, QVariant> _devices;
-
-
-    int getIndex(QString uuid) const;
+    int setItemProperty(QString uuid, QString property, QVariant value);
+    KeyedList<QString, QVariant> _devices; // uuid -> handle data
 };
 
 #endif // DEVICEHANDLELISTWRAPPER_H
@@ -30,7 +30,7 @@ DeviceListWrapper::DeviceListWrapper(QObject* parent) : IList(parent)
 
 QVariantMap DeviceListWrapper::toMap(QSharedPointer<IDevice> device) const
 {
-    bool isRegistered = !DeviceManager::instance()->getMappings().keys(device->uuid()).isEmpty();
+    bool isRegistered = DeviceManager::instance()->isMapped(device->uuid());
     QVariantMap deviceData;
     deviceData["online"] = device->getDeviceState() == IDevice::ONLINE;
     deviceData["isRegistered"] = isRegistered;
@@ -49,30 +49,27 @@ QVariantMap DeviceListWrapper::toMap(QSharedPointer<IDevice> device) const
     return deviceData;
 }
 
-bool DeviceListWrapper::addDevice(QString uuid)
+int DeviceListWrapper::addDevice(QString uuid)
 {
     iDevicePtr device = DeviceManager::instance()->getDeviceByUuid(uuid);
     if(device)
     {
-        connect(device.data(), &IDevice::deviceStateChanged, this, &DeviceListWrapper::deviceStateChanged);
-        _list.append(toMap(device));
-        return true;
+        connect(device.data(), &IDevice::deviceStateChanged, this, &DeviceListWrapper::deviceStateChanged, Qt::UniqueConnection);
+        return _list.insert(uuid, toMap(device));
     }
-    return false;
+    return -1;
 }
 
-int DeviceListWrapper::getIndex(QString uuid) const
+int DeviceListWrapper::setItemProperty(QString uuid, QString property, QVariant value)
 {
+    int idx = _list.indexOf(uuid);
+    if(idx < 0)
+        return -1;
 
-    QListIterator<QVariant>it(_list);
-    int idx = 0;
-    while(it.hasNext())
-    {
-        if(it.next().toMap()["uuid"] == uuid)
-            return idx;
-        idx++;
-    }
-    return -1;
+    QVariantMap item = _list.at(idx).toMap();
+    item[property] = value;
+    _list.replace(idx, item);
+    return idx;
 }
 
 void DeviceListWrapper::handleMessage(QVariant msg, ISocket *handle)
@@ -107,24 +104,19 @@ void DeviceListWrapper::handleMessage(QVariant msg, ISocket *handle)
 
 void DeviceListWrapper::newDevice(QString uuid)
 {
-    if(addDevice(uuid))
-    {
-        int idx = getIndex(uuid);
-        if(idx < 0)
-            return;
+    int idx = addDevice(uuid);
+    if(idx < 0)
+        return;
 
-        qDebug()<<uuid<<"  "<<idx;
-        Q_EMIT itemAdded(_list[idx], idx);
-    }
+    Q_EMIT itemAdded(_list.at(idx), idx);
 }
 
 void DeviceListWrapper::deviceRemoved(QString uuid)
 {
-    int index = getIndex(uuid);
+    int index = _list.remove(uuid);
     if(index < 0)
         return;
 
-    _list.removeAt(index);
     Q_EMIT itemRemoved(index);
 }
 
@@ -143,15 +135,11 @@ void DeviceListWrapper::newMapping(QString uuid, QString mapping)
     }
 
 
-    bool isRegistered = !DeviceManager::instance()->getMappings().keys(deviceUUID).isEmpty();
-    int idx = getIndex(deviceUUID);
-
+    bool isRegistered = DeviceManager::instance()->isMapped(deviceUUID);
+    int idx = setItemProperty(deviceUUID, "isRegistered", isRegistered);
     if(idx < 0)
         return;
 
-    QVariantMap item = _list[idx].toMap();
-    item["isRegistered"] = isRegistered;
-    _list.replace(idx, item);
     Q_EMIT propertyChanged("isRegistered", isRegistered, idx);
 }
 
@@ -162,18 +150,15 @@ void DeviceListWrapper::mappingRemoved(QString uuid, QString mapping)
 
 void DeviceListWrapper::deviceStateChanged(QString uuid, IDevice::DeviceState state)
 {
-    int idx = getIndex(uuid);
+    bool online = IDevice::ONLINE == state;
+    int idx = setItemProperty(uuid, "online", online);
     if(idx < 0)
         return;
 
-    QVariantMap item = _list[idx].toMap();
-    bool online = IDevice::ONLINE == state;
-    item["online"] = online;
-    _list.replace(idx, item);
     Q_EMIT propertyChanged("online", online, idx);
 }
 
 QVariantList DeviceListWrapper::getListData() const
 {
-    return _list;
+    return _list.values();
 }
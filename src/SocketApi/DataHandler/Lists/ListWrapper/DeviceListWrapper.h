@@ -10,6 +10,7 @@
 
 #include <QObject>
 #include "../IList.h"
+#include "../KeyedList.h"
 #include "Server/Devices/IDevice.h"
 
 class DeviceListWrapper : public IList
@@ -21,10 +22,10 @@ public:
     virtual QVariantList getListData() const override;
 
 private:
-    QVariantList _list;
+    KeyedList<QString, QVariant> _list; // uuid -> device data
     QVariantMap toMap(QSharedPointer<IDevice> device) const;
-    bool addDevice(QString uuid);
-    int getIndex(QString uuid) const;
+    int addDevice(QString uuid);
+    int setItemProperty(QString uuid, QString property, QVariant value);
     void handleMessage(QVariant msg, ISocket *handle) override;
 
 private slots:
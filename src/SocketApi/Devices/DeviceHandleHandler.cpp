@@ -6,25 +6,35 @@
 
 
 #include "DeviceHandleHandler.h"
-#include "Server/Devices/DeviceProperty.h"
+#include "Server/Devices/DeviceBulkCommand.h"
+#include <QAtomicInt>
+#include <QDateTime>
+
+// default interval in ms in which property changes are collected before they are sent to the clients
+#define DEVICE_TELEMETRY_INTERVAL   50
+
+namespace
+{
+    QAtomicInt telemetryInterval(DEVICE_TELEMETRY_INTERVAL);
+}
 
 DeviceHandleHandler::DeviceHandleHandler(QSharedPointer<DeviceHandle> deviceHandle, QObject* parent):IResourceHandler("device", parent),
     _deviceHandle(deviceHandle)
 {
+    _telemetryTimer.setSingleShot(true);
+    _telemetryTimer.setInterval(telemetryInterval.load());
+    connect(&_telemetryTimer, &QTimer::timeout, this, &DeviceHandleHandler::sendPropertyChanges);
+
     //connect(deviceHandle.data(), &DeviceHandle::propertyChanged, this, &DeviceHandleHandler::propertyChanged);
+    connect(deviceHandle.data(), &DeviceHandle::propertiesChanged, this, &DeviceHandleHandler::propertiesChanged);
     connect(deviceHandle.data(), &DeviceHandle::temporaryChanged, this, &DeviceHandleHandler::temporaryChanged);
     connect(deviceHandle.data(), &DeviceHandle::deviceStateChanged, this, &DeviceHandleHandler::deviceStateChangedSlot);
     connect(deviceHandle.data(), &DeviceHandle::dataReceived, this, &DeviceHandleHandler::dataReceived);
+    connect(deviceHandle.data(), &DeviceHandle::functionAnswered, this, &DeviceHandleHandler::functionAnswered);
+    connect(deviceHandle.data(), &DeviceHandle::functionCallFailed, this, &DeviceHandleHandler::functionCallFailed);
     connect(deviceHandle.data(), &DeviceHandle::init, this, &DeviceHandleHandler::reinit);
-    connect(deviceHandle.data(), &DeviceHandle::newPropertyObject, this, &DeviceHandleHandler::registerProperty);
+    connect(deviceHandle.data(), &DeviceHandle::metadataChanged, this, &DeviceHandleHandler::metadataChanged);
     connect(deviceHandle.data(), &DeviceHandle::descriptionChanged, this, &DeviceHandleHandler::deviceDescriptionChanged);
-
-    auto tmpProperties = _deviceHandle->propertyObjects();
-    QMapIterator<QString, DeviceProperty*> it(tmpProperties);
-    while(it.hasNext())
-    {
-        registerProperty(it.next().value());
-    }
 }
 
 void DeviceHandleHandler::initHandle(ISocket *handle)
@@ -33,6 +43,11 @@ void DeviceHandleHandler::initHandle(ISocket *handle)
 }
 
 
+void DeviceHandleHandler::setTelemetryInterval(int msecs)
+{
+    telemetryInterval.store(qMax(0, msecs));
+}
+
 void DeviceHandleHandler::handleMessage(QVariant message, ISocket *handle)
 {
     QVariantMap msg         = message.toMap();
@@ -48,7 +63,17 @@ void DeviceHandleHandler::handleMessage(QVariant message, ISocket *handle)
         QString functionName = parameters["funcname"].toString();
         QVariantMap functionParameters = parameters["funcparams"].toMap();
         QString cbID  = parameters["cbID"].toString();
-        auto returnVal = _deviceHandle->triggerFunction(functionName, functionParameters, token, cbID);
+        int timeout = parameters.value("timeout", -1).toInt();
+        bool idempotent = parameters["idempotent"].toBool();
+
+        // reserved for the calls of bulk commands, their answers must not reach this client
+        if(cbID.startsWith(DEVICE_BULK_CBID_PREFIX))
+        {
+            handleError(command, IDevice::PERMISSION_DENIED, handle);
+            return;
+        }
+
+        auto returnVal = _deviceHandle->triggerFunction(functionName, functionParameters, token, cbID, timeout, idempotent);
         QVariantMap msg;
         if(returnVal == IDevice::NO_ERROR)
         {
@@ -71,6 +96,36 @@ void DeviceHandleHandler::handleMessage(QVariant message, ISocket *handle)
         return;
     }
 
+    if(command == "device:history")
+    {
+        QString property = parameters["property"].toString();
+        qint64 from = parameters.value("from", 0).toLongLong();
+        qint64 to = parameters.value("to", QDateTime::currentMSecsSinceEpoch()).toLongLong();
+        int buckets = parameters["buckets"].toInt();
+        QVariantList history;
+        auto err = _deviceHandle->getPropertyHistory(property, from, to, buckets, token, &history);
+        if(err != IDevice::NO_ERROR)
+        {
+            handleError(command, err, handle);
+            return;
+        }
+
+        QVariantMap answer;
+        answer["property"] = property;
+        answer["from"] = from;
+        answer["to"] = to;
+        answer["buckets"] = buckets;
+        answer["values"] = history;
+        if(parameters.contains("cbID"))
+            answer["cbID"] = parameters["cbID"];
+
+        QVariantMap msg;
+        msg["command"] = "device:history";
+        msg["parameters"] = answer;
+        handle->sendVariant(msg);
+        return;
+    }
+
     if(command == "device:description")
     {
         QString description = parameters["desc"].toString();
@@ -81,21 +136,17 @@ void DeviceHandleHandler::handleMessage(QVariant message, ISocket *handle)
     if(command == "device:meta:set")
     {
         QString propName = parameters.firstKey();
-        DeviceProperty* prop = _deviceHandle->property(propName);
-        if(prop != nullptr)
+        QVariantMap values = parameters.first().toMap();
+        QMapIterator<QString, QVariant> it(values);
+        while (it.hasNext())
         {
-            QVariantMap values = parameters.first().toMap();
-            QMapIterator<QString, QVariant> it(values);
-            while (it.hasNext())
+            it.next();
+            if(_deviceHandle->setPropertyMetadata(propName, it.key(), it.value()) != IDevice::NO_ERROR)
             {
-                it.next();
-                prop->setMetadata(it.key(), it.value());
+                handleError(command, IDevice::PROPERTY_NOT_EXISTS, handle);
+                return;
             }
         }
-        else
-        {
-           handleError(command, IDevice::PROPERTY_NOT_EXISTS, handle);
-        }
     }
 }
 
@@ -112,22 +163,29 @@ void DeviceHandleHandler::handleError(QString command, IDevice::DeviceError erro
     }
 
     msg["command"] = command + ":failed";
+    msg["errorstring"] = errorString(error);
+    socket->sendVariant(msg);
+}
+
+QString DeviceHandleHandler::errorString(IDevice::DeviceError error)
+{
     switch(error)
     {
         case IDevice::FUNCTION_NOT_EXIST:
-            msg["errorstring"] = "Unknown function."; break;
-
+            return "Unknown function.";
         case IDevice::DEVICE_NOT_AVAILABLE:
-            msg["errorstring"] = "Device is offline.";break;
-
+            return "Device is offline.";
         case IDevice::PERMISSION_DENIED:
-            msg["errorstring"] = "Permission Denied.";break;
+            return "Permission Denied.";
         case IDevice::PROPERTY_NOT_EXISTS:
-             msg["errorstring"] = "The property does not exist.";break;
+            return "The property does not exist.";
+        case IDevice::TIMEOUT:
+            return "The device has not answered in time.";
+        case IDevice::TOO_MANY_REQUESTS:
+            return "Too many requests.";
         default:
-             msg["errorstring"] = "Unknown internal error"; break;
+            return "Unknown internal error";
     }
-    socket->sendVariant(msg);
 }
 
 QVariantMap DeviceHandleHandler::getDumpMessage()
@@ -150,14 +208,6 @@ QVariantMap DeviceHandleHandler::getDumpMessage()
     return msg;
 }
 
-void DeviceHandleHandler::registerProperty(DeviceProperty *property)
-{
-    // The queued connection ensures that the property broadcast is sent AFTER the status message (success / failed)
-    connect(property, &DeviceProperty::setValueChanged, this, &DeviceHandleHandler::setValueChanged, Qt::QueuedConnection);
-    connect(property, &DeviceProperty::realValueChanged, this, &DeviceHandleHandler::realValueChanged);
-    connect(property, &DeviceProperty::metadataChanged, this, &DeviceHandleHandler::metadataChanged);
-}
-
 void DeviceHandleHandler::dataReceived(QString uuid, QString subject, QVariantMap data)
 {
     Q_UNUSED(uuid)
@@ -191,6 +241,17 @@ void DeviceHandleHandler::propertyChanged(QString uuid, QString property, QVaria
     deployToAll(msg);
 }
 
+void DeviceHandleHandler::propertiesChanged(QString uuid, QVariantMap changes)
+{
+    Q_UNUSED(uuid)
+    QMapIterator<QString, QVariant> it(changes);
+    while(it.hasNext())
+    {
+        it.next();
+        queuePropertyChange(it.key(), it.value().toMap());
+    }
+}
+
 void DeviceHandleHandler::deviceStateChangedSlot(QString uuid, IDevice::DeviceState state)
 {
     Q_UNUSED(uuid)
@@ -224,8 +285,9 @@ void DeviceHandleHandler::temporaryChanged(QString uuid, bool temporary)
     deployToAll(msg);
 }
 
-void DeviceHandleHandler::metadataChanged(QString name, QString key, QVariant value)
+void DeviceHandleHandler::metadataChanged(QString uuid, QString name, QString key, QVariant value)
 {
+    Q_UNUSED(uuid)
     QVariantMap msg;
     msg["command"] = "device:meta:set";
     QVariantMap parameters;
@@ -236,32 +298,71 @@ void DeviceHandleHandler::metadataChanged(QString name, QString key, QVariant va
     deployToAll(msg);
 }
 
-void DeviceHandleHandler::setValueChanged(QString name, QVariant setValue,  bool dirty)
+void DeviceHandleHandler::queuePropertyChange(QString name, QVariantMap data)
+{
+    // newer values of the same property replace the pending ones
+    QVariantMap pending = _pendingChanges.value(name).toMap();
+    QMapIterator<QString, QVariant> it(data);
+    while(it.hasNext())
+    {
+        it.next();
+        pending[it.key()] = it.value();
+    }
+    _pendingChanges[name] = pending;
+
+    // even without a telemetry interval the changes are sent from the event loop,
+    // so the broadcast follows the status message (success / failed) of a request
+    if(!_telemetryTimer.isActive())
+        _telemetryTimer.start();
+}
+
+void DeviceHandleHandler::sendPropertyChanges()
 {
+    if(_pendingChanges.isEmpty())
+        return;
+
     QVariantMap msg;
     msg["command"] = "device:prop:set";
-    QVariantMap data;
-    data["set"] = setValue;
-    data["dirty"] = dirty;
-    QVariantMap parameters;
-    parameters[name] = data;
-    msg["parameters"] = parameters;
+    msg["parameters"] = _pendingChanges;
+    _pendingChanges.clear();
     deployToAll(msg);
 }
 
-
-void DeviceHandleHandler::realValueChanged(QString name, QVariant realValue, bool dirty,  qlonglong timestamp)
+void DeviceHandleHandler::functionAnswered(QString uuid, QString cbID, QVariantMap data)
 {
+    Q_UNUSED(uuid)
+
+    // answers of calls made by other handlers (e.g. bulk commands) are not for these clients
+    ISocket* socket = _cbMap.take(cbID);
+    if(!socket)
+        return;
+
     QVariantMap msg;
-    msg["command"] = "device:prop:set";
-    QVariantMap data;
-    data["real"] = realValue;
-    data["dirty"] = dirty;
-    data["timestamp"] = timestamp;
+    msg["command"] = "device:data";
     QVariantMap parameters;
-    parameters[name] = data;
+    parameters["subj"] = cbID;
+    if(!data.isEmpty())
+        parameters["data"] = data;
+
     msg["parameters"] = parameters;
-    deployToAll(msg);
+    socket->sendVariant(msg);
+}
+
+void DeviceHandleHandler::functionCallFailed(QString uuid, QString cbID, IDevice::DeviceError error)
+{
+    Q_UNUSED(uuid)
+    ISocket* socket = _cbMap.take(cbID);
+    if(!socket)
+        return;
+
+    QVariantMap parameters;
+    parameters["cbID"] = cbID;
+    QVariantMap msg;
+    msg["command"] = "device:call:failed";
+    msg["errorcode"] = error;
+    msg["errorstring"] = errorString(error);
+    msg["parameters"] = parameters;
+    socket->sendVariant(msg);
 }
 
 void DeviceHandleHandler::socketDisconnectedSlot()
@@ -270,7 +371,7 @@ void DeviceHandleHandler::socketDisconnectedSlot()
     if(handle)
     {
         QStringList keys = _cbMap.keys(handle);
-        if(keys.isEmpty())
+        if(!keys.isEmpty())
         {
             QListIterator<QString> keyIt(keys);
             while(keyIt.hasNext())
@@ -282,5 +383,8 @@ void DeviceHandleHandler::socketDisconnectedSlot()
 
 void DeviceHandleHandler::reinit()
 {
+    // the dump contains the latest state of all properties
+    _pendingChanges.clear();
+    _telemetryTimer.stop();
     deployToAll(getDumpMessage());
 }
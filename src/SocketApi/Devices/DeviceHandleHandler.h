@@ -9,10 +9,20 @@
 #define DEVICEHANDLEHANDLER_H
 
 #include <QObject>
+#include <QTimer>
 #include "SocketCore/IResourceHandler.h"
 #include "Server/Devices/DeviceHandle.h"
 
 
+/*!
+    \class DeviceHandleHandler
+    \brief Socket API for a single DeviceHandle.
+
+    Property changes of the device are not forwarded one by one. They are collected for the
+    telemetry interval (see setTelemetryInterval()) and sent as one device:prop:set message
+    which contains only the latest state of every changed property.
+*/
+
 class DeviceHandleHandler : public IResourceHandler
 {
     Q_OBJECT
@@ -21,26 +31,39 @@ public:
     DeviceHandleHandler(QSharedPointer<DeviceHandle> deviceHandle, QObject* parent = nullptr);
     void initHandle(ISocket *handle) override;
 
+    /*!
+        \fn static void DeviceHandleHandler::setTelemetryInterval(int msecs)
+        Sets the interval in which property changes are collected for all device handlers.
+        0 forwards every change with the next event loop iteration. Applies to handlers created afterwards.
+    */
+    static void setTelemetryInterval(int msecs);
+
 private:
     virtual void handleMessage(QVariant message, ISocket* handle) override;
     void handleError(QString command, IDevice::DeviceError error, ISocket* socket);
+    static QString errorString(IDevice::DeviceError error);
     QSharedPointer<DeviceHandle> _deviceHandle;
     QVariantMap getDumpMessage();
 
+    void queuePropertyChange(QString name, QVariantMap data);
+
     QMap<QString, ISocket* > _cbMap;
+    QVariantMap _pendingChanges;
+    QTimer      _telemetryTimer;
 
 private slots:
-    void registerProperty(DeviceProperty* property);
     void dataReceived(QString uuid, QString subject, QVariantMap data);
+    void functionAnswered(QString uuid, QString cbID, QVariantMap data);
+    void functionCallFailed(QString uuid, QString cbID, IDevice::DeviceError error);
     void propertyChanged(QString uuid, QString property, QVariant value, bool dirty);
+    void propertiesChanged(QString uuid, QVariantMap changes);
     void deviceStateChangedSlot(QString uuid, IDevice::DeviceState state);
     void deviceDescriptionChanged(QString uuid, QString description);
     void temporaryChanged(QString uuid, bool temporary);
 
-    void metadataChanged(QString name, QString key, QVariant value);
-    void setValueChanged(QString name, QVariant setValue, bool dirty);
-    void realValueChanged(QString name, QVariant realValue, bool dirty, qlonglong timestamp);
+    void metadataChanged(QString uuid, QString name, QString key, QVariant value);
     void socketDisconnectedSlot();
+    void sendPropertyChanges();
     void reinit();
 };
 
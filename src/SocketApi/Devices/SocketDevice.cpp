@@ -8,6 +8,26 @@
 #include "SocketDevice.h"
 #include <QDebug>
 #include <QProcessEnvironment>
+#include <QHash>
+#include <QMutex>
+#include "Server/Devices/FirmwareStore.h"
+
+#define SOCKET_DEVICE_COMPACT_PROTOCOL  2
+
+namespace
+{
+    // state of compact protocol sessions, kept to resume them after a reconnect
+    struct Session
+    {
+        QStringList propertyIds;
+        QVariantMap properties;
+        quint32     lastSeq = 0;
+    };
+
+    typedef QHash<QString, Session> SessionHash;
+    Q_GLOBAL_STATIC(SessionHash, sessions)
+    Q_GLOBAL_STATIC(QMutex, sessionMutex)
+}
 
 SocketDevice::SocketDevice(QObject *parent) : IDevice(parent)
 {
@@ -43,6 +63,12 @@ void SocketDevice::init(QVariantMap data, ISocket *handle)
        _functionParameters[name] = parameters;
     }
 
+    if(_compact)
+        saveSession();
+
+    _compact = data["proto"].toInt() >= SOCKET_DEVICE_COMPACT_PROTOCOL;
+    _resumed = false;
+    _changedProperties.clear();
     _properties = data["properties"].toMap();
     if(_deviceConnection != nullptr)
     {
@@ -58,6 +84,9 @@ void SocketDevice::init(QVariantMap data, ISocket *handle)
     connect(handle, &ISocket::messageReceived, this, &SocketDevice::messageReceived);
     connect(handle, &ISocket::disconnected, this, &SocketDevice::connectionDisconnected);
 
+    if(_compact)
+        initSession(data);
+
     //these uuidChanged and typeChanged properties are still unused - maybe remove it?
 
     Q_EMIT uuidChanged();
@@ -85,6 +114,11 @@ QVariantMap SocketDevice::getProperties() const
     return _properties;
 }
 
+QVariantMap SocketDevice::getPropertyChanges() const
+{
+    return _resumed ? _changedProperties : _properties;
+}
+
 QVariantList SocketDevice::getFunctions() const
 {
     return _functions;
@@ -102,7 +136,25 @@ void SocketDevice::messageReceived(QVariant msg)
     QVariantMap parameters = message["params"].toMap();
 
   //  QString ackDeviceMessages = QProcessEnvironment::systemEnvironment().value("DEVICE_ACK","false");
-    _ackTimer.start();
+    if(_compact)
+    {
+        if(command == "s")
+            applyBatch(message);
+
+        if(_lastSeq != _ackedSeq)
+            _ackTimer.start();
+
+        if(command == "s")
+            return;
+    }
+    else
+        _ackTimer.start();
+
+    if(command == "fw")
+    {
+        sendFirmwareChunk(parameters);
+        return;
+    }
 
     if(command == "msg")
     {
@@ -138,12 +190,26 @@ void SocketDevice::connectionDisconnected()
 		_ackTimer.stop();
 	}
 
+    if(_compact)
+        saveSession();
+
     _deviceConnection = nullptr;
     Q_EMIT deregistered(_uuid);
 }
 
 void SocketDevice::sendAck()
 {
+    if(_compact)
+    {
+        if(_lastSeq == _ackedSeq)
+            return;
+
+        QVariantMap ack;
+        ack["cmd"] = "ack";
+        send(ack);
+        return;
+    }
+
 	if ( _deviceConnection != nullptr )
 	{
 		QVariantMap  ack;
@@ -178,7 +244,7 @@ IDevice::DeviceError SocketDevice::triggerFunction(QString name, QVariant parame
         msg["cbID"] = cbID;
 
     msg["params"] = params;
-    _deviceConnection->sendVariant(msg);
+    send(msg);
     return NO_ERROR;
 }
 
@@ -217,7 +283,7 @@ IDevice::DeviceError SocketDevice::initDevice(QVariantMap properties)
     }
 
     msg["params"] = functions;
-    _deviceConnection->sendVariant(msg);
+    send(msg);
     return NO_ERROR;
 }
 
@@ -231,7 +297,7 @@ void SocketDevice::setAuthentificationKey(quint32 key)
     QVariantMap msg;
     msg["cmd"] = "setkey";
     msg["params"] = key;
-    _deviceConnection->sendVariant(msg);
+    send(msg);
 }
 
 quint32 SocketDevice::getAuthentificationKey()
@@ -279,7 +345,7 @@ bool SocketDevice::setToken(QString token)
     QVariantMap msg;
     msg["cmd"] = "settoken";
     msg["params"] = token;
-    _deviceConnection->sendVariant(msg);
+    send(msg);
     return true;
 }
 
@@ -294,6 +360,129 @@ QString SocketDevice::getPropertySetterFunc(QString propertyName) const
     return "set" + propertyName.replace(0,1,firstChar);
 }
 
+void SocketDevice::initSession(const QVariantMap &data)
+{
+    _propertyIds = data["pids"].toStringList();
+    quint32 since = data["since"].toUInt();
+
+    QMutexLocker locker(sessionMutex());
+    Session session = sessions->value(_uuid);
+    locker.unlock();
+
+    // The session can be resumed if the device refers to a sequence number which was acknowledged
+    // (or at least received) before. Otherwise the device has to send all properties again.
+    bool full = since == 0 || since > session.lastSeq || session.propertyIds != _propertyIds;
+    if(!full)
+    {
+        _resumed = true;
+        _changedProperties = _properties;
+        _properties = session.properties;
+        QMapIterator<QString, QVariant> it(_changedProperties);
+        while(it.hasNext())
+        {
+            it.next();
+            _properties.insert(it.key(), it.value());
+        }
+        _lastSeq = session.lastSeq;
+    }
+    else
+    {
+        _lastSeq = since;
+    }
+    _ackedSeq = _lastSeq;
+
+    QVariantMap params;
+    params["v"] = SOCKET_DEVICE_COMPACT_PROTOCOL;
+    params["ack"] = _lastSeq;
+    params["full"] = full;
+
+    QVariantMap msg;
+    msg["cmd"] = "proto";
+    msg["params"] = params;
+    send(msg);
+}
+
+void SocketDevice::saveSession()
+{
+    Session session;
+    session.propertyIds = _propertyIds;
+    session.properties = _properties;
+    session.lastSeq = _lastSeq;
+
+    QMutexLocker locker(sessionMutex());
+    sessions->insert(_uuid, session);
+}
+
+void SocketDevice::applyBatch(const QVariantMap &message)
+{
+    quint32 seq = message["seq"].toUInt();
+
+    // batches are resent after a reconnect if their ack got lost
+    if(seq != 0 && seq <= _lastSeq)
+        return;
+
+    QVariantList batch = message["p"].toList();
+    for(int i = 0; i + 1 < batch.count(); i += 2)
+    {
+        QString property = _propertyIds.value(batch.at(i).toInt());
+        if(property.isEmpty())
+        {
+            qWarning()<<"Warning: Unknown property id"<<batch.at(i)<<"from device"<<_uuid;
+            continue;
+        }
+
+        QVariant data = batch.at(i + 1);
+        _properties[property] = data;
+        Q_EMIT propertyChanged(_uuid, property, data);
+    }
+
+    if(seq != 0)
+        _lastSeq = seq;
+}
+
+void SocketDevice::sendFirmwareChunk(const QVariantMap &request)
+{
+    QString file = request["file"].toString();
+    qint64 offset = request["offset"].toLongLong();
+
+    QVariantMap params;
+    params["file"] = file;
+    params["offset"] = offset;
+
+    QByteArray data;
+    qint64 total = 0;
+    if(FirmwareStore::instance()->readChunk(file, offset, request.value("size", FIRMWARE_CHUNK_SIZE).toInt(), &data, &total))
+    {
+        params["total"] = total;
+        params["data"] = QString::fromLatin1(data.toBase64());
+    }
+    else
+    {
+        qWarning()<<"Warning: Device"<<_uuid<<"requested an invalid firmware chunk"<<file<<offset;
+        params["error"] = "invalid chunk";
+    }
+
+    QVariantMap msg;
+    msg["cmd"] = "fw";
+    msg["params"] = params;
+    send(msg);
+}
+
+void SocketDevice::send(QVariantMap msg)
+{
+    if(!_deviceConnection)
+        return;
+
+    // cumulative acks are piggybacked on outbound traffic
+    if(_compact && _lastSeq != _ackedSeq)
+    {
+        msg["ack"] = _lastSeq;
+        _ackedSeq = _lastSeq;
+        _ackTimer.stop();
+    }
+    _deviceConnection->sendVariant(msg);
+}
+
 QMap<QString, bool> SocketDevice::getRequestedPermissions() const
 {
     return _permissions;
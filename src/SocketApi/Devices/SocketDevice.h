@@ -14,6 +14,19 @@
     abstract interface definition of IDevice. SocketDeviceHandler will create an instance for each connected device and hand off the pointer
     to the DeviceManager.
 
+    Devices can register with "proto": 2 to use the compact protocol (usually together with CBOR framing, see Connection):
+    - "pids" lists the property names, the index of a name is its numeric id.
+    - Property updates are sent in batches with a sequence number: {"cmd": "s", "seq": 12, "p": [id, value, id, value, ...]}.
+    - The highest received sequence number is acknowledged cumulatively with an "ack" field on the next outbound message,
+      or with {"cmd": "ack", "ack": 12} if there is no outbound traffic.
+    - On reconnect, "since" is the last acknowledged sequence number and "properties" contains only the properties
+      which have changed since then. The registration is answered with {"cmd": "proto", "params": {"v": 2, "ack": 12, "full": false}}.
+      If the server doesn't know the session anymore, "full" is true and the device has to send all properties.
+
+    Firmware images of the FirmwareStore are fetched in chunks: the device requests {"cmd": "fw", "params": {"file", "offset", "size"}}
+    and gets {"cmd": "fw", "params": {"file", "offset", "total", "data"}} with base64 encoded data. A download is resumed by
+    requesting the next missing offset, e.g. after a reconnect.
+
     \sa SocketDeviceHandler, IDevice, DeviceManager
 */
 
@@ -40,6 +53,7 @@ public:
     QString shortId() const override;
     QString type() const override;
     QVariantMap getProperties() const override;
+    QVariantMap getPropertyChanges() const override;
     QVariantList getFunctions() const override;
     IDevice::DeviceError triggerFunction(QString name, QVariant parameters, QString cbID ="") override;
     IDevice::DeviceError setDeviceProperty(QString property, QVariant value) override;
@@ -58,6 +72,11 @@ public:
 
 private:
     QString getPropertySetterFunc(QString propertyName) const;
+    void initSession(const QVariantMap& data);
+    void saveSession();
+    void applyBatch(const QVariantMap& message);
+    void sendFirmwareChunk(const QVariantMap& request);
+    void send(QVariantMap msg);
     QTimer                      _ackTimer;
     ISocket*                    _deviceConnection = nullptr;
     QVariantMap                 _properties;
@@ -73,6 +92,14 @@ private:
     quint32             _authKey;
     quint16             _lastCbID = 0;
 
+    // compact protocol
+    bool                _compact = false;
+    bool                _resumed = false;
+    QStringList         _propertyIds;
+    QVariantMap         _changedProperties;
+    quint32             _lastSeq = 0;
+    quint32             _ackedSeq = 0;
+
 private slots:
     void messageReceived(QVariant msg);
     void connectionDisconnected();
@@ -5,15 +5,43 @@
  * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
 
 #include "ImageCollectionHandler.h"
+#include <QCryptographicHash>
+#include <QFutureWatcher>
+#include <QDateTime>
+#include <QDir>
+#include "Server/Authentication/AuthentificationService.h"
+#include "Storage/FileSystemPaths.h"
+#include "Storage/ImageBlobStore.h"
+
+#define IMGCOLL_CHUNK_SIZE          64 * 1024
+#define IMGCOLL_WINDOW              4                       // unacknowledged chunks per download
+#define IMGCOLL_MAX_TRANSFERS       4                       // concurrent transfers per connection
+#define IMGCOLL_MAX_UPLOAD_SIZE     64 * 1024 * 1024
+#define IMGCOLL_UPLOAD_EXPIRY       24 * 60 * 60            // secs until incomplete uploads are deleted
 
 ImageCollectionHandler::ImageCollectionHandler(QSharedPointer<ImageResource> resource, QObject *parent) : IResourceHandler("imgcoll", parent),
     _resource( resource)
 {
     connect(_resource.data(), &ImageResource::imageAdded, this, &ImageCollectionHandler::imageAddedSlot);
+    _sendTimer.setSingleShot(true);
+    _sendTimer.setInterval(0);
+    connect(&_sendTimer, &QTimer::timeout, this, &ImageCollectionHandler::sendChunks);
+}
+
+ImageCollectionHandler::~ImageCollectionHandler()
+{
+    QList<ISocket*> handles = _transfers.keys();
+    QListIterator<ISocket*> it(handles);
+    while(it.hasNext())
+        handleRemoved(it.next());
 }
 
 void ImageCollectionHandler::initHandle(ISocket *handle)
 {
+    connect(handle, &ISocket::dataReceived, this, &ImageCollectionHandler::dataReceived, Qt::UniqueConnection);
+    connect(handle, &QObject::destroyed, this, &ImageCollectionHandler::handleRemoved, Qt::UniqueConnection);
+    connect(handle, &ISocket::disconnected, this, &ImageCollectionHandler::handleDisconnected, Qt::UniqueConnection);
+
     QVariantMap msg;
     msg["command"] = "imgcoll:dump";
     QVariantMap parameters;
@@ -24,9 +52,375 @@ void ImageCollectionHandler::initHandle(ISocket *handle)
 
 void ImageCollectionHandler::handleMessage(QVariant message, ISocket *handle)
 {
-    Q_UNUSED(message);
-    Q_UNUSED(handle);
+    QVariantMap msg         = message.toMap();
+    QString     command     = msg["command"].toString();
+    QString     token       = msg["token"].toString();
+    QVariantMap parameters  = msg["parameters"].toMap();
+    quint32     transfer    = parameters["transfer"].toUInt();
+
+    if(command == "imgcoll:get")
+    {
+        if(!checkTransfer(command, handle, transfer, parameters))
+            return;
+
+        QString uid = parameters["uid"].toString();
+        qint64 offset = parameters["offset"].toLongLong();
+        int size = parameters["size"].toInt();
+
+        if(size <= 0)
+        {
+            startDownload(handle, transfer, uid, _resource->getImageData(uid, token), offset);
+            return;
+        }
+
+        // the thumbnail might be generated first
+        QFuture<QByteArray> thumbnail = _resource->getThumbnail(uid, size, token);
+        if(thumbnail.isFinished())
+        {
+            startDownload(handle, transfer, uid, thumbnail.result(), offset);
+            return;
+        }
+
+        _transfers[handle].insert(transfer, Transfer());
+        QFutureWatcher<QByteArray>* watcher = new QFutureWatcher<QByteArray>(this);
+        connect(watcher, &QFutureWatcher<QByteArray>::finished, this, [=]()
+        {
+            watcher->deleteLater();
+            if(!_transfers.value(handle).contains(transfer))
+                return; // canceled or disconnected
+
+            _transfers[handle].remove(transfer);
+            startDownload(handle, transfer, uid, watcher->result(), offset);
+        });
+        watcher->setFuture(thumbnail);
+        return;
+    }
+
+    if(command == "imgcoll:upload")
+    {
+        if(!checkTransfer(command, handle, transfer, parameters))
+            return;
+
+        startUpload(handle, transfer, parameters, token);
+        return;
+    }
+
+    if(command == "imgcoll:ack")
+    {
+        if(!_transfers.value(handle).contains(transfer))
+            return;
+
+        Transfer& current = _transfers[handle][transfer];
+        if(current.upload || current.data.isEmpty())
+            return;
+
+        current.acked = qBound(current.acked, parameters["offset"].toLongLong(), current.total);
+        if(current.acked >= current.total)
+        {
+            removeTransfer(handle, transfer);
+            return;
+        }
+
+        _sendTimer.start();
+        return;
+    }
+
+    if(command == "imgcoll:cancel")
+    {
+        removeTransfer(handle, transfer);
+        return;
+    }
+}
+
+int ImageCollectionHandler::transferCount(ISocket *handle) const
+{
+    return _transfers.value(handle).count();
+}
+
+bool ImageCollectionHandler::checkTransfer(QString command, ISocket *handle, quint32 transfer, QVariantMap parameters)
+{
+    if(_transfers.value(handle).contains(transfer))
+    {
+        handleError(command, IResource::INVALID_PARAMETERS, handle, parameters);
+        return false;
+    }
+
+    // the client can retry once one of its transfers is done
+    if(transferCount(handle) >= IMGCOLL_MAX_TRANSFERS)
+    {
+        handleError(command, IResource::BUSY, handle, parameters);
+        return false;
+    }
+
+    return true;
+}
+
+void ImageCollectionHandler::startDownload(ISocket *handle, quint32 transfer, QString uid, QByteArray data, qint64 offset)
+{
+    QVariantMap parameters;
+    parameters["transfer"] = transfer;
+    parameters["uid"] = uid;
+
+    if(!_handles.contains(handle))
+        return;
+
+    if(data.isEmpty() || offset < 0 || offset > data.size())
+    {
+        handleError("imgcoll:get", data.isEmpty() ? IResource::UNKNOWN_ITEM : IResource::INVALID_PARAMETERS, handle, parameters);
+        return;
+    }
+
+    Transfer download;
+    download.uid = uid;
+    download.data = data;
+    download.total = data.size();
+    download.offset = offset;
+    download.acked = offset;
+    _transfers[handle].insert(transfer, download);
+
+    parameters["total"] = download.total;
+    parameters["chunksize"] = IMGCOLL_CHUNK_SIZE;
+    QVariantMap msg;
+    msg["command"] = "imgcoll:get:begin";
+    msg["parameters"] = parameters;
+    handle->sendVariant(msg);
+
+    if(download.acked >= download.total)
+    {
+        removeTransfer(handle, transfer);
+        return;
+    }
+
+    _sendTimer.start();
+}
+
+void ImageCollectionHandler::startUpload(ISocket *handle, quint32 transfer, QVariantMap parameters, QString token)
+{
+    QString uid = parameters["uid"].toString();
+    qint64 total = parameters["total"].toLongLong();
+    iIdentityPtr user = AuthenticationService::instance()->validateToken(token);
+
+    if(user.isNull())
+    {
+        handleError("imgcoll:upload", IResource::PERMISSION_DENIED, handle, parameters);
+        return;
+    }
+
+    if(uid.isEmpty() || total <= 0 || total > IMGCOLL_MAX_UPLOAD_SIZE)
+    {
+        handleError("imgcoll:upload", IResource::INVALID_PARAMETERS, handle, parameters);
+        return;
+    }
+
+    // the data doesn't have to be sent again if the image is already known
+    QString hash = parameters["hash"].toString().toLower();
+    if(!hash.isEmpty() && _resource->insertReference(hash, parameters["data"], uid, token).error == IResource::NO_ERROR)
+    {
+        sendUploadSuccess(handle, transfer, uid, true);
+        return;
+    }
+
+    // get rid of abandoned uploads
+    QString path = uploadPath(token, uid, total);
+    QDir dir(QFileInfo(path).absolutePath());
+    dir.mkpath(dir.absolutePath());
+    QFileInfoList parts = dir.entryInfoList(QStringList()<<"*.part", QDir::Files);
+    QListIterator<QFileInfo> it(parts);
+    while(it.hasNext())
+    {
+        const QFileInfo& part = it.next();
+        if(part.lastModified().secsTo(QDateTime::currentDateTime()) > IMGCOLL_UPLOAD_EXPIRY)
+            QFile::remove(part.absoluteFilePath());
+    }
+
+    Transfer upload;
+    upload.upload = true;
+    upload.uid = uid;
+    upload.token = token;
+    upload.hash = hash;
+    upload.metadata = parameters["data"];
+    upload.total = total;
+    upload.file = new QFile(path);
+    if(!upload.file->open(QFile::ReadWrite | QFile::Append))
+    {
+        delete upload.file;
+        handleError("imgcoll:upload", IResource::STORAGE_ERROR, handle, parameters);
+        return;
+    }
+
+    // an incomplete upload of the same image is resumed
+    upload.offset = qMin(upload.file->size(), total);
+    _transfers[handle].insert(transfer, upload);
+    sendTransferMessage(handle, "imgcoll:upload:ready", transfer, upload.offset);
+
+    if(upload.offset >= upload.total)
+        finishUpload(handle, transfer);
+}
 
+void ImageCollectionHandler::finishUpload(ISocket *handle, quint32 transfer)
+{
+    Transfer& upload = _transfers[handle][transfer];
+    upload.file->seek(0);
+    QByteArray data = upload.file->readAll();
+
+    IResource::ModificationResult result;
+    if(!upload.hash.isEmpty() && upload.hash != ImageBlobStore::hash(data))
+        result.error = IResource::INVALID_PARAMETERS;
+    else
+        result = _resource->insertData(data, upload.metadata, upload.uid, upload.token);
+
+    if(result.error == IResource::NO_ERROR)
+    {
+        sendUploadSuccess(handle, transfer, upload.uid, false);
+    }
+    else
+    {
+        QVariantMap parameters;
+        parameters["transfer"] = transfer;
+        parameters["uid"] = upload.uid;
+        handleError("imgcoll:upload", result.error, handle, parameters);
+    }
+
+    // a failed upload is not resumable - the data is invalid
+    upload.file->remove();
+    removeTransfer(handle, transfer);
+}
+
+void ImageCollectionHandler::sendUploadSuccess(ISocket *handle, quint32 transfer, QString uid, bool deduplicated)
+{
+    QVariantMap parameters;
+    parameters["transfer"] = transfer;
+    parameters["uid"] = uid;
+    if(deduplicated)
+        parameters["deduplicated"] = true;
+
+    QVariantMap msg;
+    msg["command"] = "imgcoll:upload:success";
+    msg["parameters"] = parameters;
+    handle->sendVariant(msg);
+}
+
+void ImageCollectionHandler::removeTransfer(ISocket *handle, quint32 transfer)
+{
+    if(!_transfers.contains(handle))
+        return;
+
+    Transfer removed = _transfers[handle].take(transfer);
+    if(removed.file)
+    {
+        removed.file->close();
+        delete removed.file;
+    }
+
+    if(_transfers.value(handle).isEmpty())
+        _transfers.remove(handle);
+}
+
+void ImageCollectionHandler::sendTransferMessage(ISocket *handle, QString command, quint32 transfer, qint64 offset)
+{
+    QVariantMap parameters;
+    parameters["transfer"] = transfer;
+    parameters["offset"] = offset;
+    QVariantMap msg;
+    msg["command"] = command;
+    msg["parameters"] = parameters;
+    handle->sendVariant(msg);
+}
+
+QString ImageCollectionHandler::uploadPath(QString token, QString uid, qint64 total) const
+{
+    iIdentityPtr user = AuthenticationService::instance()->validateToken(token);
+    QString key = user->identityID() + "/" + uid + "/" + QString::number(total);
+    QString name = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return FileSystemPaths::instance()->getStoragePath() + "uploads/" + name + ".part";
+}
+
+void ImageCollectionHandler::sendChunks()
+{
+    // one chunk per transfer and round, then back to the event loop so that other messages can be sent in between
+    bool pending = false;
+    QList<ISocket*> handles = _transfers.keys();
+    QListIterator<ISocket*> it(handles);
+    while(it.hasNext())
+    {
+        ISocket* handle = it.next();
+        if(!_handles.contains(handle))
+        {
+            handleRemoved(handle);
+            continue;
+        }
+
+        QMutableMapIterator<quint32, Transfer> transferIt(_transfers[handle]);
+        while(transferIt.hasNext())
+        {
+            transferIt.next();
+            Transfer& download = transferIt.value();
+            if(download.upload || download.data.isEmpty())
+                continue;
+
+            if(download.offset >= download.total || download.offset - download.acked >= qint64(IMGCOLL_WINDOW) * IMGCOLL_CHUNK_SIZE)
+                continue;
+
+            int size = int(qMin<qint64>(IMGCOLL_CHUNK_SIZE, download.total - download.offset));
+            handle->sendData(transferIt.key(), download.offset, download.data.mid(int(download.offset), size));
+            download.offset += size;
+
+            if(download.offset < download.total && download.offset - download.acked < qint64(IMGCOLL_WINDOW) * IMGCOLL_CHUNK_SIZE)
+                pending = true;
+        }
+    }
+
+    if(pending)
+        _sendTimer.start();
+}
+
+void ImageCollectionHandler::dataReceived(quint32 transfer, qint64 offset, const QByteArray &data)
+{
+    ISocket* handle = qobject_cast<ISocket*>(sender());
+    if(!handle || !_transfers.value(handle).contains(transfer))
+        return;
+
+    Transfer& upload = _transfers[handle][transfer];
+    if(!upload.upload)
+        return;
+
+    // lost or duplicated chunk - tell the client where to continue
+    if(offset != upload.offset)
+    {
+        sendTransferMessage(handle, "imgcoll:upload:ready", transfer, upload.offset);
+        return;
+    }
+
+    if(upload.offset + data.size() > upload.total || upload.file->write(data) != data.size())
+    {
+        QVariantMap parameters;
+        parameters["transfer"] = transfer;
+        handleError("imgcoll:upload", upload.file->error() != QFile::NoError ? IResource::STORAGE_ERROR : IResource::INVALID_PARAMETERS, handle, parameters);
+        upload.file->remove();
+        removeTransfer(handle, transfer);
+        return;
+    }
+
+    upload.offset += data.size();
+    sendTransferMessage(handle, "imgcoll:ack", transfer, upload.offset);
+
+    if(upload.offset >= upload.total)
+        finishUpload(handle, transfer);
+}
+
+void ImageCollectionHandler::handleRemoved(QObject *handle)
+{
+    // incomplete uploads stay on disk and can be resumed later
+    ISocket* socket = static_cast<ISocket*>(handle);
+    QList<quint32> transfers = _transfers.value(socket).keys();
+    QListIterator<quint32> it(transfers);
+    while(it.hasNext())
+        removeTransfer(socket, it.next());
+}
+
+void ImageCollectionHandler::handleDisconnected()
+{
+    handleRemoved(sender());
 }
 
 void ImageCollectionHandler::imageAddedSlot(QString uuid)
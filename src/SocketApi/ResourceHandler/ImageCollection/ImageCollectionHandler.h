@@ -8,9 +8,46 @@
 #define IMAGECOLLECTIONHANDLER_H
 
 #include <QObject>
+#include <QTimer>
+#include <QFile>
 #include "../../SocketCore/IResourceHandler.h"
 #include "Server/Resources/ImageResource/ImageResource.h"
 
+/*!
+    \class ImageCollectionHandler
+    \brief Socket API for image collections.
+
+    Besides the metadata (imgcoll:dump, imgcoll:new), images are transferred as raw binary frames
+    (see ISocket::sendData()) in chunks of IMGCOLL_CHUNK_SIZE bytes. Every transfer has an id which is chosen by the client.
+
+    Download:
+    \code
+    -> imgcoll:get {uid, transfer, offset, size}        size (optional) selects a thumbnail
+    <- imgcoll:get:begin {transfer, uid, total, chunksize}
+    <- data chunks
+    -> imgcoll:ack {transfer, offset}                   confirms the received bytes
+    \endcode
+
+    Upload:
+    \code
+    -> imgcoll:upload {uid, transfer, total, data, hash} data is the metadata of the image, hash (optional) its SHA-256
+    <- imgcoll:upload:ready {transfer, offset}          offset > 0 if a previous upload is resumed
+    -> data chunks
+    <- imgcoll:ack {transfer, offset}
+    <- imgcoll:upload:success {transfer, uid}
+    \endcode
+
+    If the same user already stored an image with the given hash, the upload succeeds right away
+    (imgcoll:upload:success {transfer, uid, deduplicated: true}) and no data is transferred.
+    Otherwise the received data is checked against the hash.
+
+    Only IMGCOLL_WINDOW chunks of a download are unacknowledged at the same time and chunks of all
+    transfers are sent alternately from the event loop, so a large transfer doesn't block other messages
+    on the same connection. Incomplete uploads are kept on disk and can be resumed with the same uid.
+    Transfers can be aborted with imgcoll:cancel {transfer}. A transfer id which is still in use is rejected
+    with INVALID_PARAMETERS, a transfer beyond IMGCOLL_MAX_TRANSFERS per connection with BUSY.
+*/
+
 class ImageCollectionHandler : public IResourceHandler
 {
 
@@ -18,15 +55,46 @@ class ImageCollectionHandler : public IResourceHandler
 
 public:
     explicit ImageCollectionHandler(QSharedPointer<ImageResource> resource, QObject *parent = nullptr);
+    ~ImageCollectionHandler() override;
      void initHandle(ISocket* handle) override;
      void handleMessage(QVariant message, ISocket* handle) override;
 
 signals:
 private:
+     struct Transfer
+     {
+         bool       upload = false;
+         QString    uid;
+         QString    token;
+         QString    hash;
+         QVariant   metadata;
+         QByteArray data;
+         QFile*     file = nullptr;
+         qint64     total = 0;
+         qint64     offset = 0;
+         qint64     acked = 0;
+     };
+
      QSharedPointer<ImageResource> _resource;
+     QHash<ISocket*, QMap<quint32, Transfer>> _transfers;
+     QTimer         _sendTimer;
+
+     int            transferCount(ISocket* handle) const;
+     bool           checkTransfer(QString command, ISocket* handle, quint32 transfer, QVariantMap parameters);
+     void           startDownload(ISocket* handle, quint32 transfer, QString uid, QByteArray data, qint64 offset);
+     void           startUpload(ISocket* handle, quint32 transfer, QVariantMap parameters, QString token);
+     void           finishUpload(ISocket* handle, quint32 transfer);
+     void           sendUploadSuccess(ISocket* handle, quint32 transfer, QString uid, bool deduplicated);
+     void           removeTransfer(ISocket* handle, quint32 transfer);
+     void           sendTransferMessage(ISocket* handle, QString command, quint32 transfer, qint64 offset);
+     QString        uploadPath(QString token, QString uid, qint64 total) const;
 
 private slots:
      void imageAddedSlot(QString uuid);
+     void sendChunks();
+     void dataReceived(quint32 transfer, qint64 offset, const QByteArray& data);
+     void handleRemoved(QObject* handle);
+     void handleDisconnected();
 
 public slots:
 };
@@ -25,6 +25,7 @@ SynchronizedListHandler::SynchronizedListHandler(QSharedPointer<ListResource> re
     connect(_resource.data(), &ListResource::metadataChanged,  this, &SynchronizedListHandler::metadataChanged);
     connect(_resource.data(), &ListResource::itemSet,      this, &SynchronizedListHandler::itemSet);
     connect(_resource.data(), &ListResource::itemRemoved,  this, &SynchronizedListHandler::itemRemoved);
+    connect(_resource.data(), &ListResource::itemsRemoved, this, &SynchronizedListHandler::itemsRemoved);
     connect(_resource.data(), &ListResource::propertySet,  this, &SynchronizedListHandler::propertySet);
      connect(_resource.data(), &ListResource::reset,  this, &SynchronizedListHandler::listResetted);
 }
@@ -317,6 +318,18 @@ void SynchronizedListHandler::itemRemoved(int index, QString uuid, iIdentityPtr
     deployToAll(msg);
 }
 
+void SynchronizedListHandler::itemsRemoved(int index, int count, iIdentityPtr user)
+{
+    Q_UNUSED(user)
+    QVariantMap msg;
+    msg["command"] = "synclist:remove";
+    QVariantMap parameters;
+    parameters["index"] =  index;
+    parameters["count"] =  count;
+    msg["parameters"] = parameters;
+    deployToAll(msg);
+}
+
 void SynchronizedListHandler::listDeleted(iIdentityPtr user)
 {
     Q_UNUSED(user)
@@ -38,6 +38,7 @@ private slots:
     void itemInserted(QVariant data, int index, iIdentityPtr  user);
     void listAppended(QVariantList data, iIdentityPtr  user);
     void itemRemoved(int index, QString uuid, iIdentityPtr  user);
+    void itemsRemoved(int index, int count, iIdentityPtr  user);
     void listDeleted(iIdentityPtr  user);
     void listCleared(iIdentityPtr  user);
     void itemSet(QVariant data, int index, QString uuid, iIdentityPtr  user);
@@ -37,97 +37,65 @@ bool SessionHandler::handleRequest(QVariantMap message, ISocket *handle)
     {
         QString userId = payload["userID"].toString();
         QString password = payload["password"].toString();
-        AuthenticationService::ErrorCode error;
-        QString token = _authenticationService->login(userId, password, &error);
-        QVariantMap answer;
-
-        if(error == AuthenticationService::NoError)
-        {
-            auto user =  _authenticationService->getUserForToken(token);
-            if(!user.isNull())
-            {
-                qint64 tokenExpiration =  user->sessionExpiration();
-                connect(handle, SIGNAL(destroyed(QObject*)),this,SLOT(sessionConnectionDeleted(QObject*)));
-                _tokenToHandleMap.insert(token, handle);
-                handle->setProperty("token", token);
-                answer["command"] = "user:login:success";
-                QVariantMap payload;
-                payload["token"] = token;
-                payload["tokenExpiration"] = tokenExpiration;
-                payload["user"] =  user->userData().toMap();
-                answer["payload"] = payload;
-                handle->sendVariant(answer);
-                return true;
-            }
-
-            error = AuthenticationService::UnknownInternalError;
-        }
 
-        answer["errrorcode"] = error;
-        answer["command"] = "user:login:failed";
-
-        if(error == AuthenticationService::IncorrectPassword)
-        {
-            answer["errorstring"] = "Wrong password.";
-        }
-        else if(error == AuthenticationService::UserNotExists)
+        // the password is verified on the worker pool of the PasswordHasher, the answer is sent when it is done
+        _authenticationService->loginAsync(userId, password, handle, [this, handle](QString token, AuthenticationService::ErrorCode error)
         {
-            answer["errorstring"] = "Unknown User.";
-        }
-        else
-        {
-            answer["errorstring"] = "Unknown Internal Error.";
-        }
-
-        handle->sendVariant(answer);
+            loginFinished(handle, token, error);
+        });
         return true;
     }
 
 
     if(command == "user:add")
     {
-        QVariantMap answer;
         QString password = payload["password"].toString();
         QString userId = payload["userID"].toString();
         QString eMail = payload["eMail"].toString();
         QString name = payload["name"].toString();
 
-        AuthenticationService::ErrorCode err;
-        iUserPtr user = DefaultAuthenticator::instance()->addUser(userId, password, token, &err);
-
-        QSharedPointer<User> userObjPtr = qSharedPointerCast<User>(user);
-        if(!userObjPtr.isNull())
+        // the password is hashed on the worker pool of the PasswordHasher, the answer is sent when it is done
+        DefaultAuthenticator::instance()->addUser(userId, password, token, handle, [handle, eMail, name](QSharedPointer<User> user, AuthenticationService::ErrorCode err)
         {
-            user->setEMail(eMail);
-            userObjPtr->setUserName(name);
-        }
-
-        if( err  == AuthenticationService::NoError)
-        {
-            answer["command"] = "user:add:success";
-            qInfo()<<"User "+user->identityID()+" added successfully.";
-        }
-        else
-        {
-            answer["command"] = "user:add:failed";
-            answer["errrorcode"] = err;
-            if(err == AuthenticationService::InvalidData)
+            QVariantMap answer;
+            if(!user.isNull())
             {
-                answer["errorstring"] = "Invalid or incomplete user data.";
+                user->setEMail(eMail);
+                user->setUserName(name);
             }
 
-            if(err == AuthenticationService::UserAlreadyExists)
+            if( err  == AuthenticationService::NoError)
             {
-                answer["errorstring"] = "User already exists.";
+                answer["command"] = "user:add:success";
+                qInfo()<<"User "+user->identityID()+" added successfully.";
             }
-
-            if( err == AuthenticationService::PermissionDenied)
+            else
             {
-                answer["errorstring"] = "No permission to add user.";
+                answer["command"] = "user:add:failed";
+                answer["errrorcode"] = err;
+                if(err == AuthenticationService::InvalidData)
+                {
+                    answer["errorstring"] = "Invalid or incomplete user data.";
+                }
+
+                if(err == AuthenticationService::UserAlreadyExists)
+                {
+                    answer["errorstring"] = "User already exists.";
+                }
+
+                if( err == AuthenticationService::PermissionDenied)
+                {
+                    answer["errorstring"] = "No permission to add user.";
+                }
+
+                if(err == AuthenticationService::Busy)
+                {
+                    answer["errorstring"] = "Server busy, please try again later.";
+                }
             }
-        }
 
-        handle->sendVariant(answer);
+            handle->sendVariant(answer);
+        });
         return true;
     }
 
@@ -147,25 +115,31 @@ bool SessionHandler::handleRequest(QVariantMap message, ISocket *handle)
         QString userID = payload["userID"].toString();
         QString oldPassword = payload["oldPassword"].toString();
         QString newPassword = payload["newPassword"].toString();
-        AuthenticationService::ErrorCode err = DefaultAuthenticator::instance()->changePassword(token, oldPassword, newPassword, userID);
-        answer["errrorcode"] = err;
-        if(err == AuthenticationService::NoError)
-        {
-            answer["command"] = "user:changepassword:success";
-        }
-        else
+        DefaultAuthenticator::instance()->changePassword(token, oldPassword, newPassword, userID, handle, [handle](AuthenticationService::ErrorCode err)
         {
-            answer["command"] = "user:changepassword:failed";
-            if(err == AuthenticationService::InvalidData)
-                answer["errorString"] = "New password is empty.";
+            QVariantMap answer;
+            answer["errrorcode"] = err;
+            if(err == AuthenticationService::NoError)
+            {
+                answer["command"] = "user:changepassword:success";
+            }
+            else
+            {
+                answer["command"] = "user:changepassword:failed";
+                if(err == AuthenticationService::InvalidData)
+                    answer["errorString"] = "New password is empty.";
 
-            if(err == AuthenticationService::IncorrectPassword)
-                answer["errorString"] = "Password invalid.";
+                if(err == AuthenticationService::IncorrectPassword)
+                    answer["errorString"] = "Password invalid.";
 
-            if(err == AuthenticationService::UserNotExists)
-                answer["errorString"] = "User not exists.";
-        }
-        handle->sendVariant(answer);
+                if(err == AuthenticationService::UserNotExists)
+                    answer["errorString"] = "User not exists.";
+
+                if(err == AuthenticationService::Busy)
+                    answer["errorString"] = "Server busy, please try again later.";
+            }
+            handle->sendVariant(answer);
+        });
         return true;
     }
 
@@ -208,32 +182,86 @@ bool SessionHandler::handleRequest(QVariantMap message, ISocket *handle)
         QString userID = payload["userID"].toString();
         QString password = payload["password"].toString();
 
-        QVariantMap answer;
-        AuthenticationService::ErrorCode error = DefaultAuthenticator::instance()->deleteUser(token, password, userID);
-        answer["errrorcode"] = error;
-        if(error == AuthenticationService::NoError)
+        DefaultAuthenticator::instance()->deleteUser(token, password, userID, handle, [handle](AuthenticationService::ErrorCode error)
         {
-            answer["command"] = "user:delete:success";
-        }
-        else
-        {
-            answer["command"] = "user:delete:failed";
+            QVariantMap answer;
+            answer["errrorcode"] = error;
+            if(error == AuthenticationService::NoError)
+            {
+                answer["command"] = "user:delete:success";
+            }
+            else
+            {
+                answer["command"] = "user:delete:failed";
 
-            if(error == AuthenticationService::PermissionDenied)
-                answer["errorString"] = "Permission denied.";
+                if(error == AuthenticationService::PermissionDenied)
+                    answer["errorString"] = "Permission denied.";
 
-            if(error == AuthenticationService::IncorrectPassword)
-                answer["errorString"] = "Password invalid.";
+                if(error == AuthenticationService::IncorrectPassword)
+                    answer["errorString"] = "Password invalid.";
 
-            if(error == AuthenticationService::UserNotExists)
-                answer["errorString"] = "User not exists.";
-        }
-        handle->sendVariant(answer);
+                if(error == AuthenticationService::UserNotExists)
+                    answer["errorString"] = "User not exists.";
+
+                if(error == AuthenticationService::Busy)
+                    answer["errorString"] = "Server busy, please try again later.";
+            }
+            handle->sendVariant(answer);
+        });
         return true;
     }
     return false;
 }
 
+void SessionHandler::loginFinished(ISocket *handle, QString token, AuthenticationService::ErrorCode error)
+{
+    QVariantMap answer;
+
+    if(error == AuthenticationService::NoError)
+    {
+        auto user =  _authenticationService->getUserForToken(token);
+        if(!user.isNull())
+        {
+            qint64 tokenExpiration =  user->sessionExpiration();
+            connect(handle, SIGNAL(destroyed(QObject*)),this,SLOT(sessionConnectionDeleted(QObject*)));
+            _tokenToHandleMap.insert(token, handle);
+            handle->setProperty("token", token);
+            answer["command"] = "user:login:success";
+            QVariantMap payload;
+            payload["token"] = token;
+            payload["tokenExpiration"] = tokenExpiration;
+            payload["user"] =  user->userData().toMap();
+            answer["payload"] = payload;
+            handle->sendVariant(answer);
+            return;
+        }
+
+        error = AuthenticationService::UnknownInternalError;
+    }
+
+    answer["errrorcode"] = error;
+    answer["command"] = "user:login:failed";
+
+    if(error == AuthenticationService::IncorrectPassword)
+    {
+        answer["errorstring"] = "Wrong password.";
+    }
+    else if(error == AuthenticationService::UserNotExists)
+    {
+        answer["errorstring"] = "Unknown User.";
+    }
+    else if(error == AuthenticationService::Busy)
+    {
+        answer["errorstring"] = "Server busy, please try again later.";
+    }
+    else
+    {
+        answer["errorstring"] = "Unknown Internal Error.";
+    }
+
+    handle->sendVariant(answer);
+}
+
 QStringList SessionHandler::getSupportedCommands()
 {
     return QStringList();
@@ -25,6 +25,8 @@ public:
     void            init(QString storageDirectory);
 
 private:
+    void            loginFinished(ISocket* handle, QString token, AuthenticationService::ErrorCode error);
+
     QString                                             _dataStoragePath;
     AuthenticationService*                              _authenticationService;
     QMap<QString, ISocket*>                   _tokenToHandleMap;
@@ -42,6 +42,7 @@ HEADERS +=  $$PWD/SocketCore/SocketResourceManager.h \
             $$PWD/ResourceHandler/SynchronizedObject/SynchronizedObjectHandler.h \
             $$PWD/ResourceHandler/SynchronizedObject/SynchronizedObjectHandlerFactory.h \
             $$PWD/DataHandler/Lists/IList.h \
+            $$PWD/DataHandler/Lists/KeyedList.h \
             $$PWD/DataHandler/Lists/ListHandler.h \
             $$PWD/DataHandler/Lists/ListWrapper/DeviceListWrapper.h \
             $$PWD/DataHandler/Lists/ListHandlerFactory.h \
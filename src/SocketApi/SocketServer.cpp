@@ -25,6 +25,7 @@
     #include "Server/Resources/ImageResource/ImageResourceFactory.h"
 #endif
 #include "Server/Devices/DeviceManager.h"
+#include "Server/Automation/RuleEngine.h"
 #include "Server/Resources/ListResource/ListResourceFactory.h"
 #include "Server/Resources/ObjectResource/ObjectResourceFactory.h"
 
@@ -96,6 +97,7 @@ void SocketServer::initServices()
     FileSystemPaths::instance()->setConfigPath(CONFIG_DATA);
 
     DeviceManager::instance()->init(DEVICE_DATA);
+    RuleEngine::instance()->init(AUTOMATION_DATA);
     DefaultAuthenticator::instance()->init(USER_DATA);
     AuthenticationService::instance()->registerAuthenticator(DefaultAuthenticator::instance());
 
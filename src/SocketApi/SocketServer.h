@@ -22,6 +22,7 @@
 #define CONFIG_DATA                 _serverRootPath+"config/"
 #define USER_DATA                   _serverRootPath+"config/users"
 #define DEVICE_DATA                 _serverRootPath+"devices"
+#define AUTOMATION_DATA             _serverRootPath+"automation"
 
 #define SSL_CERTIFICATE             _serverRootPath+"config/certificates/server.crt"
 #define SSL_KEY                     _serverRootPath+"config/certificates/server.key"
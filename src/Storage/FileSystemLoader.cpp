@@ -6,8 +6,6 @@
 
 #include "FileSystemLoader.h"
 #include <QDebug>
-#include <QFileInfo>
-#include <QDir>
 
 FileSystemLoader::FileSystemLoader(QString path, QObject *parent) : QObject(parent),
     _resourcePath(path),
@@ -17,6 +15,7 @@ FileSystemLoader::FileSystemLoader(QString path, QObject *parent) : QObject(pare
 
 QVariantMap FileSystemLoader::load()
 {
+    PersistenceScheduler::waitForWritten(_resourcePath);
     if( _file.open(QFile::ReadOnly))
     {
         QVariantMap file =  QJsonDocument::fromJson(_file.readAll()).toVariant().toMap();
@@ -30,29 +29,18 @@ QVariantMap FileSystemLoader::load()
     }
 }
 
+void FileSystemLoader::setDurability(PersistenceScheduler::Durability durability)
+{
+    _durability = durability;
+}
+
 bool FileSystemLoader::deleteFile()
 {
-    return _file.remove();
+    PersistenceScheduler::remove(_resourcePath);
+    return !_file.exists();
 }
 
 bool FileSystemLoader::save(QVariantMap data)
 {
-    QFileInfo info(_file);
-    QDir dir(info.absolutePath());
-    if(!dir.exists())
-    {
-        dir.mkpath(info.absolutePath());
-    }
-
-    if(_file.open(QFile::WriteOnly))
-    {
-        _file.write(QJsonDocument::fromVariant(data).toJson());
-        _file.close();
-    }
-    else
-    {
-        qDebug()<<"Warning: Could not open file -"<<_file.errorString();
-        return false;
-    }
-    return true;
+    return PersistenceScheduler::save(_resourcePath, data, _durability);
 }
@@ -11,6 +11,7 @@
 #include <QVariant>
 #include <QFile>
 #include <QJsonDocument>
+#include "PersistenceScheduler.h"
 
 class FileSystemLoader : public QObject
 {
@@ -19,6 +20,7 @@ class FileSystemLoader : public QObject
 public:
     explicit        FileSystemLoader(QString path, QObject *parent = nullptr);
     QVariantMap     load();
+    void            setDurability(PersistenceScheduler::Durability durability);
 
 public slots:
     bool            deleteFile();
@@ -27,6 +29,7 @@ public slots:
 private:
     QString         _resourcePath;
     QFile           _file;
+    PersistenceScheduler::Durability _durability = PersistenceScheduler::BATCHED;
 
 signals:
 
@@ -0,0 +1,335 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "ImageBlobStore.h"
+#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDebug>
+#include "FileSystemPaths.h"
+#include "PersistenceScheduler.h"
+
+// number of journal records after which a new snapshot of the reference counts is written
+#define BLOB_JOURNAL_LIMIT  1000
+
+Q_GLOBAL_STATIC(ImageBlobStore, imageBlobStore);
+
+ImageBlobStore::ImageBlobStore(QObject *parent) : QObject(parent)
+{
+}
+
+ImageBlobStore *ImageBlobStore::instance()
+{
+    return imageBlobStore;
+}
+
+QString ImageBlobStore::hash(const QByteArray &data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex();
+}
+
+bool ImageBlobStore::store(QString hash, const QByteArray &data, QString format, QString owner)
+{
+    QMutexLocker locker(&_mutex);
+    load();
+
+    if(!_blobs.contains(hash))
+    {
+        QString path = blobPath(hash);
+        QDir().mkpath(QFileInfo(path).absolutePath());
+
+        QSaveFile file(path);
+        if(!file.open(QFile::WriteOnly) || file.write(data) != data.size() || !file.commit())
+        {
+            qWarning()<<"Warning: Could not write blob -"<<path<<file.errorString();
+            return false;
+        }
+    }
+
+    QVariantMap change;
+    change["op"] = "store";
+    change["hash"] = hash;
+    change["owner"] = owner;
+    change["format"] = format;
+    change["size"] = data.size();
+    return record(change);
+}
+
+bool ImageBlobStore::addReference(QString hash, QString owner)
+{
+    QMutexLocker locker(&_mutex);
+    load();
+
+    // the data was sent by somebody else, a hash alone must not grant access to it
+    if(!_blobs.contains(hash) || !_blobs.value(hash).owners.contains(owner))
+        return false;
+
+    QVariantMap change;
+    change["op"] = "ref";
+    change["hash"] = hash;
+    change["owner"] = owner;
+    return record(change);
+}
+
+void ImageBlobStore::release(QString hash, QString owner)
+{
+    QMutexLocker locker(&_mutex);
+    load();
+
+    if(!_blobs.contains(hash))
+        return;
+
+    QVariantMap change;
+    change["op"] = "release";
+    change["hash"] = hash;
+    change["owner"] = owner;
+
+    // a release which is not journaled would be undone by a restart, the blob is only leaked then
+    if(!record(change))
+        return;
+
+    if(!_blobs.contains(hash))
+        QFile::remove(blobPath(hash));
+}
+
+bool ImageBlobStore::contains(QString hash)
+{
+    QMutexLocker locker(&_mutex);
+    load();
+    return _blobs.contains(hash);
+}
+
+QVariantMap ImageBlobStore::info(QString hash)
+{
+    QMutexLocker locker(&_mutex);
+    load();
+
+    QVariantMap info;
+    if(!_blobs.contains(hash))
+        return info;
+
+    info["format"] = _blobs.value(hash).format;
+    info["size"] = _blobs.value(hash).size;
+    return info;
+}
+
+QByteArray ImageBlobStore::read(QString hash)
+{
+    // opened under the lock, so release() can't delete the blob in between. An open file stays readable.
+    QFile file;
+    _mutex.lock();
+    load();
+    file.setFileName(blobPath(hash));
+    bool open = _blobs.contains(hash) && file.open(QFile::ReadOnly);
+    _mutex.unlock();
+
+    if(!open)
+        return QByteArray();
+
+    return file.readAll();
+}
+
+void ImageBlobStore::load()
+{
+    if(_loaded)
+        return;
+
+    _loaded = true;
+    _path = FileSystemPaths::instance()->getStoragePath() + "blobs/";
+    QDir().mkpath(_path);
+
+    QFile file(_path + "blobs.json");
+    PersistenceScheduler::waitForWritten(file.fileName());
+    QVariantMap snapshot;
+    if(file.open(QFile::ReadOnly))
+        snapshot = QJsonDocument::fromJson(file.readAll()).toVariant().toMap();
+
+    // files of older versions contain the blobs only
+    QVariantMap blobs = snapshot;
+    _generation = 0;
+    if(snapshot.contains("generation"))
+    {
+        _generation = snapshot["generation"].toInt();
+        blobs = snapshot["blobs"].toMap();
+    }
+
+    QMapIterator<QString, QVariant> it(blobs);
+    while(it.hasNext())
+    {
+        it.next();
+        QVariantMap entry = it.value().toMap();
+        Blob blob;
+        blob.references = entry["refs"].toInt();
+        QVariantMap owners = entry["owners"].toMap();
+        QMapIterator<QString, QVariant> owner(owners);
+        while(owner.hasNext())
+        {
+            owner.next();
+            blob.owners.insert(owner.key(), owner.value().toInt());
+        }
+        blob.format = entry["format"].toString();
+        blob.size = entry["size"].toLongLong();
+        _blobs.insert(it.key(), blob);
+    }
+
+    // replay the journals which are newer than the snapshot, delete the older ones
+    _snapshotGeneration = _generation;
+    removeJournals(_snapshotGeneration);
+
+    QStringList journals = QDir(_path).entryList(QStringList() << "blobs.*.journal", QDir::Files);
+    QMap<int, QString> replay;
+    for(int i = 0; i < journals.count(); i++)
+        replay.insert(journals.at(i).section('.', 1, 1).toInt(), journals.at(i));
+
+    QMapIterator<int, QString> journal(replay);
+    while(journal.hasNext())
+    {
+        journal.next();
+        QFile records(_path + journal.value());
+        if(!records.open(QFile::ReadOnly))
+            continue;
+
+        while(!records.atEnd())
+        {
+            // a torn last line of a crash is skipped
+            QVariantMap change = QJsonDocument::fromJson(records.readLine()).toVariant().toMap();
+            if(!change.isEmpty())
+                apply(change);
+        }
+        _generation = journal.key();
+    }
+
+    // the replayed journals are merged into a new snapshot
+    compact();
+}
+
+bool ImageBlobStore::record(const QVariantMap &change)
+{
+    if(!_journal.isOpen() && !openJournal())
+        return false;
+
+    QByteArray line = QJsonDocument::fromVariant(change).toJson(QJsonDocument::Compact) + "\n";
+    if(_journal.write(line) != line.size() || !_journal.flush())
+    {
+        qWarning()<<"Warning: Could not write blob journal -"<<_journal.fileName()<<_journal.errorString();
+        _journal.close();
+        return false;
+    }
+
+    apply(change);
+    if(++_records >= BLOB_JOURNAL_LIMIT)
+        compact();
+    return true;
+}
+
+void ImageBlobStore::apply(const QVariantMap &change)
+{
+    QString op = change["op"].toString();
+    QString hash = change["hash"].toString();
+    QString owner = change["owner"].toString();
+
+    if(op == "store" && !_blobs.contains(hash))
+    {
+        Blob blob;
+        blob.format = change["format"].toString();
+        blob.size = change["size"].toLongLong();
+        _blobs.insert(hash, blob);
+    }
+
+    if(!_blobs.contains(hash))
+        return;
+
+    Blob& blob = _blobs[hash];
+    if(op == "store" || op == "ref")
+    {
+        blob.references++;
+        blob.owners[owner]++;
+        return;
+    }
+
+    if(op == "release")
+    {
+        if(--blob.owners[owner] <= 0)
+            blob.owners.remove(owner);
+
+        if(--blob.references <= 0)
+            _blobs.remove(hash);
+    }
+}
+
+bool ImageBlobStore::openJournal()
+{
+    _journal.setFileName(journalPath(_generation));
+    if(!_journal.open(QFile::WriteOnly | QFile::Append))
+    {
+        qWarning()<<"Warning: Could not open blob journal -"<<_journal.fileName()<<_journal.errorString();
+        return false;
+    }
+    return true;
+}
+
+void ImageBlobStore::compact()
+{
+    // once the snapshot of the last compaction is on disk, the journals it contains are obsolete
+    if(PersistenceScheduler::waitForWritten(_path + "blobs.json"))
+        removeJournals(_snapshotGeneration);
+
+    QVariantMap blobs;
+    QHashIterator<QString, Blob> it(_blobs);
+    while(it.hasNext())
+    {
+        it.next();
+        QVariantMap entry;
+        entry["refs"] = it.value().references;
+        QVariantMap owners;
+        QHashIterator<QString, int> owner(it.value().owners);
+        while(owner.hasNext())
+        {
+            owner.next();
+            owners.insert(owner.key(), owner.value());
+        }
+        entry["owners"] = owners;
+        entry["format"] = it.value().format;
+        entry["size"] = it.value().size;
+        blobs.insert(it.key(), entry);
+    }
+
+    // new changes go to a new journal, the snapshot covers everything before it
+    _journal.close();
+    _generation++;
+    _records = 0;
+
+    QVariantMap snapshot;
+    snapshot["generation"] = _generation;
+    snapshot["blobs"] = blobs;
+    if(!PersistenceScheduler::save(_path + "blobs.json", snapshot, PersistenceScheduler::BATCHED))
+        qWarning()<<"Warning: The last snapshot of the blob store could not be written, the journals are kept.";
+    _snapshotGeneration = _generation;
+
+    openJournal();
+}
+
+void ImageBlobStore::removeJournals(int below)
+{
+    QStringList journals = QDir(_path).entryList(QStringList() << "blobs.*.journal", QDir::Files);
+    for(int i = 0; i < journals.count(); i++)
+    {
+        if(journals.at(i).section('.', 1, 1).toInt() < below)
+            QFile::remove(_path + journals.at(i));
+    }
+}
+
+QString ImageBlobStore::journalPath(int generation) const
+{
+    return _path + "blobs." + QString::number(generation) + ".journal";
+}
+
+QString ImageBlobStore::blobPath(QString hash) const
+{
+    return _path + hash.left(2) + "/" + hash;
+}
@@ -0,0 +1,91 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef IMAGEBLOBSTORE_H
+#define IMAGEBLOBSTORE_H
+
+#include <QObject>
+#include <QVariant>
+#include <QHash>
+#include <QMutex>
+#include <QFile>
+
+/*!
+    \class ImageBlobStore
+    \brief Content addressed storage for image data which is shared by all image collections.
+
+    Every distinct image is stored once in <storage path>/blobs/<first two hex digits>/<sha256>.
+    Collections only keep a reference (the hash). The blob store counts the references and deletes
+    a blob as soon as the last reference is released. References are counted per owner (the identity
+    which stored the image): a blob can only be referenced by its hash if the same owner already
+    references it, so knowing a hash doesn't give access to the data.
+
+    The reference counts, format and size of the blobs are kept in <storage path>/blobs/blobs.json. A change
+    doesn't rewrite this file: it is appended as one line to the journal blobs.<generation>.journal. Every
+    BLOB_JOURNAL_LIMIT records, the journal is rotated and a snapshot is handed to the PersistenceScheduler
+    (BATCHED). load() replays all journals which are not yet part of the snapshot, older journals are deleted
+    once their snapshot is on disk. Journal records are flushed to the operating system but not synced, so
+    they survive a crash of the server but not a power loss.
+
+    \sa ImageResourceFilesystemStorage
+*/
+
+class ImageBlobStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ImageBlobStore(QObject* parent = nullptr);
+
+    static ImageBlobStore* instance();
+
+    static QString  hash(const QByteArray& data);
+
+    /*!
+        \fn bool ImageBlobStore::store(QString hash, const QByteArray& data, QString format, QString owner)
+        Adds a reference of owner to the blob. The data is only written if the blob doesn't exist yet.
+    */
+    bool            store(QString hash, const QByteArray& data, QString format, QString owner);
+
+    /*!
+        \fn bool ImageBlobStore::addReference(QString hash, QString owner)
+        Adds a reference to an existing blob. Returns false if the blob is unknown or not yet referenced by owner.
+    */
+    bool            addReference(QString hash, QString owner);
+    void            release(QString hash, QString owner);
+    bool            contains(QString hash);
+    QVariantMap     info(QString hash);
+    QByteArray      read(QString hash);
+
+private:
+    struct Blob
+    {
+        int     references = 0;
+        QHash<QString, int> owners; // identity -> references
+        QString format;
+        qint64  size = 0;
+    };
+
+    void            load();
+    bool            record(const QVariantMap& change);
+    void            apply(const QVariantMap& change);
+    bool            openJournal();
+    void            compact();
+    void            removeJournals(int below);
+    QString         journalPath(int generation) const;
+    QString         blobPath(QString hash) const;
+
+    QMutex                  _mutex;
+    QHash<QString, Blob>    _blobs;
+    QString                 _path;
+    bool                    _loaded = false;
+    QFile                   _journal;
+    int                     _generation = 0; // generation of the current journal
+    int                     _snapshotGeneration = 0; // the last snapshot contains all journals before it
+    int                     _records = 0; // records in the current journal
+};
+
+#endif // IMAGEBLOBSTORE_H
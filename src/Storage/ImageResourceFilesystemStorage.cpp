@@ -6,9 +6,54 @@
 
 #include "ImageResourceFilesystemStorage.h"
 #include <QDir>
+#include <QFileInfo>
 #include <QDebug>
 #include <QJsonDocument>
+#include <QBuffer>
+#include <QCache>
+#include <QMutex>
+#include <QSaveFile>
 #include "FileSystemPaths.h"
+#include "PersistenceScheduler.h"
+#include "ImageBlobStore.h"
+
+// maximum number of bytes of encoded images which are kept in memory (shared by all collections)
+#define IMAGE_CACHE_SIZE    32 * 1024 * 1024
+
+namespace
+{
+    struct ImageCache
+    {
+        ImageCache(){ cache.setMaxCost(IMAGE_CACHE_SIZE); }
+        QMutex                          mutex;
+        QCache<QString, QByteArray>     cache;
+    };
+
+    Q_GLOBAL_STATIC(ImageCache, imageCache)
+
+    bool cacheLookup(const QString& path, QByteArray* data)
+    {
+        QMutexLocker locker(&imageCache->mutex);
+        QByteArray* cached = imageCache->cache.object(path);
+        if(!cached)
+            return false;
+
+        *data = *cached;
+        return true;
+    }
+
+    void cacheInsert(const QString& path, const QByteArray& data)
+    {
+        QMutexLocker locker(&imageCache->mutex);
+        imageCache->cache.insert(path, new QByteArray(data), data.size());
+    }
+
+    void cacheRemove(const QString& path)
+    {
+        QMutexLocker locker(&imageCache->mutex);
+        imageCache->cache.remove(path);
+    }
+}
 
 ImageResourceFilesystemStorage::ImageResourceFilesystemStorage(QString qualifiedResourceName, QObject *parent) : IImageResourceStorage(parent),
     _file(FileSystemPaths::instance()->getStoragePath()+qualifiedResourceName+"/pictureCollection.json"),
@@ -18,42 +63,87 @@ ImageResourceFilesystemStorage::ImageResourceFilesystemStorage(QString qualified
 }
 
 bool ImageResourceFilesystemStorage::insertImage(QImage image, QVariantMap metadata, QString uid)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    if(!image.save(&buffer, "PNG"))
+        return false;
+
+    return insertImageData(data, metadata, uid);
+}
+
+bool ImageResourceFilesystemStorage::insertImageData(QByteArray data, QVariantMap metadata, QString uid)
 {
     load();
-    if(!_images.contains(uid))
-    {
-        save();
-        QString filename = FileSystemPaths::instance()->getStoragePath()+ _resourceName+"/"+uid;
-        if(image.save(filename))
-            qInfo()<<"File saved!" << filename;
-        else
-        {
-            qCritical()<<"Could not save file: "<<filename;
-        }
+    if(_metadata.contains(uid))
+        return false;
 
-        _images.insert(uid, image);
-        _metadata.insert(uid, metadata);
-        return save();
-    }
-    else
+    // the original bytes are stored, the image is never decoded
+    QString hash = ImageBlobStore::hash(data);
+    if(!ImageBlobStore::instance()->store(hash, data, metadata.value("format").toString(), metadata.value("userid").toString()))
+        return false;
+
+    cacheInsert(hash, data);
+    metadata["hash"] = hash;
+    _metadata.insert(uid, metadata);
+    return save();
+}
+
+bool ImageResourceFilesystemStorage::insertImageReference(QString hash, QVariantMap metadata, QString uid)
+{
+    load();
+    if(_metadata.contains(uid))
+        return false;
+
+    if(!ImageBlobStore::instance()->addReference(hash, metadata.value("userid").toString()))
         return false;
+
+    QVariantMap info = ImageBlobStore::instance()->info(hash);
+    metadata["format"] = info["format"];
+    metadata["size"] = info["size"];
+    metadata["hash"] = hash;
+    _metadata.insert(uid, metadata);
+    return save();
 }
 
 bool ImageResourceFilesystemStorage::deleteImage(QString uid)
 {
     load();
-    if(!_images.contains(uid))
+    if(!_metadata.contains(uid))
         return false;
 
-    _images.remove(uid);
-    _metadata.remove(uid);
+    QVariantMap metadata = _metadata.take(uid).toMap();
+    QString hash = metadata.value("hash").toString();
+    QString filename = imagePath(uid);
+    if(hash.isEmpty())
+    {
+        cacheRemove(filename);
+        QFile::remove(filename);
+    }
+    else
+    {
+        // the blob may still be referenced by other images, the cache entry expires on its own
+        ImageBlobStore::instance()->release(hash, metadata.value("userid").toString());
+    }
+
+    QFileInfo info(filename);
+    QDir dir(info.absolutePath());
+    QStringList thumbnails = dir.entryList(QStringList()<<info.fileName()+"_*px", QDir::Files);
+    QListIterator<QString> it(thumbnails);
+    while(it.hasNext())
+    {
+        QString thumbnail = dir.absoluteFilePath(it.next());
+        cacheRemove(thumbnail);
+        QFile::remove(thumbnail);
+    }
     return save();
 }
 
 QStringList ImageResourceFilesystemStorage::getAllImageIds()
 {
     load();
-    return _images.keys();
+    return _metadata.keys();
 }
 
 QVariant ImageResourceFilesystemStorage::getMetadata(QString uid)
@@ -70,20 +160,68 @@ QVariantMap ImageResourceFilesystemStorage::getAllMetadata()
 
 QImage ImageResourceFilesystemStorage::getImage(QString uid)
 {
-    QString path = FileSystemPaths::instance()->getStoragePath()+_resourceName+"/"+uid;
-    if(QFile::exists(path))
-        return QImage(path);
+    QByteArray data = getImageData(uid);
+    if(data.isEmpty())
+        return QImage();
+
+    return QImage::fromData(data);
+}
+
+QByteArray ImageResourceFilesystemStorage::getImageData(QString uid)
+{
+    load();
+    QString hash = _metadata.value(uid).toMap().value("hash").toString();
+    if(hash.isEmpty())
+        return readFile(imagePath(uid));
+
+    QByteArray data;
+    if(cacheLookup(hash, &data))
+        return data;
+
+    data = ImageBlobStore::instance()->read(hash);
+    if(!data.isEmpty())
+        cacheInsert(hash, data);
+
+    return data;
+}
+
+bool ImageResourceFilesystemStorage::insertThumbnail(QString uid, int size, QByteArray data)
+{
+    load();
+    if(!_metadata.contains(uid))
+        return false;
+
+    QString filename = thumbnailPath(uid, size);
+    QDir().mkpath(QFileInfo(filename).absolutePath());
+    QSaveFile file(filename);
+    if(!file.open(QFile::WriteOnly) || file.write(data) != data.size() || !file.commit())
+    {
+        qWarning()<<"Warning: Could not save thumbnail -"<<filename<<file.errorString();
+        return false;
+    }
 
-    return QImage();
+    cacheInsert(filename, data);
+    return true;
+}
+
+QByteArray ImageResourceFilesystemStorage::getThumbnail(QString uid, int size)
+{
+    return readFile(thumbnailPath(uid, size));
 }
 
 bool ImageResourceFilesystemStorage::load()
 {
-    if(_contentLoaded)
+    // readers of the image resource call this concurrently, only the first one loads
+    if(_contentLoaded.load(std::memory_order_acquire))
         return true;
 
-    _contentLoaded = true;
-    if( _file.open(QFile::ReadOnly))
+    QMutexLocker locker(&_loadMutex);
+    if(_contentLoaded.load(std::memory_order_relaxed))
+        return true;
+
+    PersistenceScheduler::waitForWritten(_file.fileName());
+    bool success = _file.open(QFile::ReadOnly);
+    if(success)
     {
         QVariantList file =  QJsonDocument::fromJson(_file.readAll()).toVariant().toList();
         _file.close();
@@ -92,14 +230,14 @@ bool ImageResourceFilesystemStorage::load()
             QVariantMap item = file[i].toMap();
             _metadata.insert(item["id"].toString(), item["metadata"]);
         }
-
-        return true;
     }
     else
     {
         qWarning()<<"Warning: Could not open File:  "<<_resourceName<<" - "<<_file.errorString();
-        return false;
     }
+
+    _contentLoaded.store(true, std::memory_order_release);
+    return success;
 }
 
 bool ImageResourceFilesystemStorage::save()
@@ -115,22 +253,36 @@ bool ImageResourceFilesystemStorage::save()
         list <<item;
     }
 
-    QFileInfo info(_file);
-    QDir dir(info.absolutePath());
-    if(!dir.exists())
-    {
-        dir.mkpath(info.absolutePath());
-    }
-
-    if(_file.open(QFile::WriteOnly))
-    {
-        _file.write(QJsonDocument::fromVariant(list).toJson());
-        _file.close();
-        return true;
-    }
-    else
+    // only the metadata is written, the images are stored in their own files
+    if(!PersistenceScheduler::save(_file.fileName(), list))
     {
-        qWarning()<<"Warning: Could not open file -"<<_file.errorString();
+        qWarning()<<"Warning: Could not save metadata of"<<_resourceName;
         return false;
     }
+    return true;
+}
+
+QString ImageResourceFilesystemStorage::imagePath(QString uid) const
+{
+    return FileSystemPaths::instance()->getStoragePath()+_resourceName+"/"+uid;
+}
+
+QString ImageResourceFilesystemStorage::thumbnailPath(QString uid, int size) const
+{
+    return imagePath(uid)+"_"+QString::number(size)+"px";
+}
+
+QByteArray ImageResourceFilesystemStorage::readFile(QString path)
+{
+    QByteArray data;
+    if(cacheLookup(path, &data))
+        return data;
+
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly))
+        return QByteArray();
+
+    data = file.readAll();
+    cacheInsert(path, data);
+    return data;
 }
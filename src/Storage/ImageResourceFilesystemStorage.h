@@ -12,9 +12,22 @@
 #include <QImage>
 #include <QVariant>
 #include <QFile>
+#include <QMutex>
+#include <atomic>
 
 #include "../Server/Resources/ImageResource/IImageResourceStorage.h"
 
+/*!
+    \class ImageResourceFilesystemStorage
+    \brief Stores the images of a collection in the ImageBlobStore and their metadata in <resource>/pictureCollection.json.
+
+    Images are stored as they were uploaded, they are neither decoded nor re-encoded. The metadata of every image
+    contains the hash of its data, identical images of all collections share one blob. Images of older versions
+    which were stored in <resource>/<uid> are still read from there. Recently used images
+    are kept encoded in a LRU cache which is shared by all collections (IMAGE_CACHE_SIZE bytes).
+    Thumbnails are stored next to the original (<resource>/<uid>_<size>px).
+*/
+
 class ImageResourceFilesystemStorage : public IImageResourceStorage
 {
     Q_OBJECT
@@ -22,20 +35,28 @@ class ImageResourceFilesystemStorage : public IImageResourceStorage
 public:
     explicit ImageResourceFilesystemStorage(QString qualifiedResourceName, QObject *parent = nullptr);
     bool insertImage(QImage image, QVariantMap metadata, QString uid) override;
+    bool insertImageData(QByteArray data, QVariantMap metadata, QString uid) override;
+    bool insertImageReference(QString hash, QVariantMap metadata, QString uid) override;
     bool deleteImage(QString uid) override;
     QStringList getAllImageIds() override;
     QVariant getMetadata(QString uid) override;
     QVariantMap getAllMetadata() override;
     virtual QImage getImage(QString uid) override;
+    QByteArray getImageData(QString uid) override;
+    bool insertThumbnail(QString uid, int size, QByteArray data) override;
+    QByteArray getThumbnail(QString uid, int size) override;
     bool load();
     bool save();
 
 private:
+    QString imagePath(QString uid) const;
+    QString thumbnailPath(QString uid, int size) const;
+    QByteArray readFile(QString path);
     QFile _file;
-    QMap<QString, QImage>       _images;
     QMap<QString, QVariant>     _metadata;
     QString                     _resourceName;
-    bool                        _contentLoaded = false;
+    QMutex                      _loadMutex;
+    std::atomic<bool>           _contentLoaded{false};
 
 
 signals:
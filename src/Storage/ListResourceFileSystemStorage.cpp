@@ -7,92 +7,175 @@
 #include "ListResourceFileSystemStorage.h"
 #include <QDir>
 #include <QJsonDocument>
+#include <QtConcurrent>
 #include <QDebug>
 #include "FileSystemPaths.h"
+
+// the journal is compacted into a new snapshot as soon as it is larger than
+// JOURNAL_COMPACTION_RATIO * snapshot size (but not before it has reached JOURNAL_COMPACTION_MIN_SIZE)
+#define JOURNAL_COMPACTION_RATIO    1.0
+#define JOURNAL_COMPACTION_MIN_SIZE 64 * 1024
+
 ListResourceFileSystemStorage::ListResourceFileSystemStorage(QString qualifiedResourceName, QObject *parent) :
     IListResourceStorage(parent),
-    _file(FileSystemPaths::instance()->getStoragePath()+qualifiedResourceName+".json"),
+    _file(FileSystemPaths::instance()->getStoragePath()+qualifiedResourceName+".snapshot"),
+    _snapshotPath(FileSystemPaths::instance()->getStoragePath()+qualifiedResourceName+".snapshot"),
+    _alternateSnapshotPath(FileSystemPaths::instance()->getStoragePath()+qualifiedResourceName+".snapshot.alt"),
+    _legacyFilePath(FileSystemPaths::instance()->getStoragePath()+qualifiedResourceName+".json"),
+    _journal(FileSystemPaths::instance()->getStoragePath()+qualifiedResourceName+".journal"),
+    _rotatedJournalPath(FileSystemPaths::instance()->getStoragePath()+qualifiedResourceName+".journal.compacting"),
     _qualifiedResourceName(qualifiedResourceName)
 {
+    connect(&_compactionWatcher, &QFutureWatcher<qint64>::finished, this, &ListResourceFileSystemStorage::compactionFinished);
     load();
 }
 
+ListResourceFileSystemStorage::~ListResourceFileSystemStorage()
+{
+    _compaction.waitForFinished();
+    _journal.close();
+}
+
 bool ListResourceFileSystemStorage::appendItem(QVariant data)
 {
-    _listData.append(data);
-    return save();
+    QVariantMap record;
+    record["op"] = "append";
+    record["data"] = data;
+    return commit(record);
 }
 
 bool ListResourceFileSystemStorage::insertAt(QVariant data, IListResourceStorage::ItemUID item)
 {
-    _listData.insert(item.index, data);
-    return save();
+    QVariantMap record;
+    record["op"] = "insert";
+    record["idx"] = item.index;
+    record["data"] = data;
+    return commit(record);
 }
 
 bool ListResourceFileSystemStorage::appendList(QVariantList data)
 {
-    _listData.append(data);
-    return save();
+    QVariantMap record;
+    record["op"] = "appendlist";
+    record["data"] = data;
+    return commit(record);
 }
 
 bool ListResourceFileSystemStorage::removeItem(IListResourceStorage::ItemUID item)
 {
     int idx = checkAndCorrectIndex(item);
-    _listData.removeAt(idx);
-    return save();
+    if(idx < 0)
+        return false;
+
+    QVariantMap record;
+    record["op"] = "remove";
+    record["idx"] = idx;
+    return commit(record);
+}
+
+bool ListResourceFileSystemStorage::removeItems(int index, int count)
+{
+    if(index < 0 || count <= 0 || index + count > _entries.count())
+        return false;
+
+    QVariantMap record;
+    record["op"] = "removerange";
+    record["idx"] = index;
+    record["count"] = count;
+    return commit(record);
 }
 
 bool ListResourceFileSystemStorage::deleteList()
 {
-    _listData.clear();
+    _compaction.waitForFinished();
+    _compaction = QFuture<qint64>();
+    _compactedEntries.clear();
+    _compacting = false;
+    _journal.close();
+    _entries.clear();
     _metadata.clear();
-    return _file.remove();
+    _snapshot.reset();
+    _journal.remove();
+    QFile::remove(_rotatedJournalPath);
+    QFile::remove(_legacyFilePath);
+    QFile::remove(_alternateSnapshotPath);
+    return QFile::remove(_snapshotPath) || !QFile::exists(_snapshotPath);
 }
 
 bool ListResourceFileSystemStorage::clearList()
 {
-    _listData.clear();
-    return save();
+    QVariantMap record;
+    record["op"] = "clear";
+    bool success = commit(record);
+
+    // an empty list is cheap to write - get rid of the outdated journal right away
+    compact();
+    return success;
 }
 
 bool ListResourceFileSystemStorage::set(QVariant data, IListResourceStorage::ItemUID item)
 {
     int idx = checkAndCorrectIndex(item);
-    _listData.replace(idx, data);
-    return save();
+    if(idx < 0)
+        return false;
+
+    QVariantMap record;
+    record["op"] = "set";
+    record["idx"] = idx;
+    record["data"] = data;
+    return commit(record);
 }
 
 bool ListResourceFileSystemStorage::setProperty(QString property, QVariant data, IListResourceStorage::ItemUID item)
 {
     int idx = checkAndCorrectIndex(item);
-    QVariantMap itemToModifiy = _listData.at(idx).toMap();
-    itemToModifiy[property] = data;
-    _listData.replace(idx, itemToModifiy);
-    return save();
+    if(idx < 0)
+        return false;
+
+    QVariantMap record;
+    record["op"] = "setproperty";
+    record["idx"] = idx;
+    record["property"] = property;
+    record["data"] = data;
+    return commit(record);
 }
 
 bool ListResourceFileSystemStorage::sync()
 {
-    if(!_listData.isEmpty() || !_metadata.isEmpty())
-        return save();
+    // every modification is already part of the journal
+    if(_journal.isOpen())
+        return _journal.flush();
     return true;
 }
 
 bool ListResourceFileSystemStorage::setMetadata(QVariant metadata)
 {
-    _metadata = metadata.toMap();
-    return save();
+    QVariantMap record;
+    record["op"] = "metadata";
+    record["data"] = metadata;
+    return commit(record);
 }
 
 QVariantList ListResourceFileSystemStorage::getList() const
 {
-    return _listData;
+    QVariantList list;
+    list.reserve(_entries.count());
+    QVectorIterator<ListSnapshot::Entry> it(_entries);
+    while(it.hasNext())
+    {
+        list.append(_snapshot.isNull() ? it.next().data : _snapshot->decode(it.next()));
+    }
+    return list;
 }
 
 QVariant ListResourceFileSystemStorage::getItem(ItemUID uid) const
 {
     int index = checkAndCorrectIndex(uid);
-    return _listData.at(index);
+    if(index < 0)
+        return QVariant();
+
+    const ListSnapshot::Entry& entry = _entries.at(index);
+    return _snapshot.isNull() ? entry.data : _snapshot->decode(entry);
 }
 
 QVariant ListResourceFileSystemStorage::getMetadata() const
@@ -102,7 +185,7 @@ QVariant ListResourceFileSystemStorage::getMetadata() const
 
 int ListResourceFileSystemStorage::getCount() const
 {
-    return _listData.count();
+    return _entries.count();
 }
 
 bool ListResourceFileSystemStorage::isReady() const
@@ -115,27 +198,26 @@ int ListResourceFileSystemStorage::checkAndCorrectIndex(IListResourceStorage::It
     int index = uid.index;
     QString uuid = uid.uuid;
 
-    if(_listData.isEmpty())
+    if(_entries.isEmpty())
         return -1;
 
-    if(index >= 0 && _listData.count() > index)
+    if(index >= 0 && _entries.count() > index)
     {
         if(uuid.isEmpty())
             return index;
 
-        QVariantMap item = _listData.at(index).toMap();
-        if(item["uuid"].toString() == uuid)
+        if(_entries.at(index).uuid == uuid)
         {
             return index;
         }
     }
 
-    // need to search the appropriate index
-    QListIterator<QVariant> it(_listData);
+    // need to search the appropriate index - the uuids are part of the snapshot index, no item needs to be decoded
+    QVectorIterator<ListSnapshot::Entry> it(_entries);
     int i = 0;
     while(it.hasNext())
     {
-        if(it.next().toMap()["uuid"].toString() == uuid)
+        if(it.next().uuid == uuid)
         {
             return i;
         }
@@ -145,43 +227,322 @@ int ListResourceFileSystemStorage::checkAndCorrectIndex(IListResourceStorage::It
     return -1;
 }
 
-bool ListResourceFileSystemStorage::save()
+bool ListResourceFileSystemStorage::commit(QVariantMap record)
+{
+    record["seq"] = ++_seq;
+    apply(record);
+    bool success = appendToJournal(record);
+
+    if(needsCompaction())
+        compact();
+
+    return success;
+}
+
+void ListResourceFileSystemStorage::apply(const QVariantMap &record)
 {
-    QVariantMap data;
-    data["listdata"] = _listData;
-    data["metadata"] = _metadata;
+    QString op = record["op"].toString();
+    int idx = record["idx"].toInt();
+
+    if(op == "append")
+    {
+        _entries.append(ListSnapshot::createEntry(record["data"]));
+    }
+    else if(op == "insert")
+    {
+        _entries.insert(qBound(0, idx, _entries.count()), ListSnapshot::createEntry(record["data"]));
+    }
+    else if(op == "appendlist")
+    {
+        QListIterator<QVariant> it(record["data"].toList());
+        while(it.hasNext())
+            _entries.append(ListSnapshot::createEntry(it.next()));
+    }
+    else if(op == "remove")
+    {
+        if(idx >= 0 && idx < _entries.count())
+            _entries.removeAt(idx);
+    }
+    else if(op == "removerange")
+    {
+        int count = record["count"].toInt();
+        if(idx >= 0 && count > 0 && idx + count <= _entries.count())
+            _entries.remove(idx, count);
+    }
+    else if(op == "clear")
+    {
+        _entries.clear();
+    }
+    else if(op == "set")
+    {
+        if(idx >= 0 && idx < _entries.count())
+            _entries.replace(idx, ListSnapshot::createEntry(record["data"]));
+    }
+    else if(op == "setproperty")
+    {
+        if(idx >= 0 && idx < _entries.count())
+        {
+            QVariantMap itemToModifiy = getItem({QString(), idx}).toMap();
+            itemToModifiy[record["property"].toString()] = record["data"];
+            _entries.replace(idx, ListSnapshot::createEntry(itemToModifiy));
+        }
+    }
+    else if(op == "metadata")
+    {
+        _metadata = record["data"].toMap();
+    }
+    else
+    {
+        qWarning()<<"Warning: Unknown journal operation"<<op<<"in"<<_qualifiedResourceName;
+    }
+}
 
-    QFileInfo info(_file);
-    QDir dir(info.absolutePath());
-    if(!dir.exists())
+bool ListResourceFileSystemStorage::appendToJournal(const QVariantMap &record)
+{
+    if(!_journal.isOpen())
     {
-        dir.mkpath(info.absolutePath());
+        QFileInfo info(_journal);
+        QDir dir(info.absolutePath());
+        if(!dir.exists())
+        {
+            dir.mkpath(info.absolutePath());
+        }
+
+        if(!_journal.open(QFile::WriteOnly | QFile::Append))
+        {
+            qWarning()<<"Warning: Could not open journal -"<<_journal.errorString();
+            return false;
+        }
     }
 
-    if(_file.open(QFile::WriteOnly))
+    // compact JSON never contains raw line breaks, so one line is exactly one record
+    QByteArray line = QJsonDocument::fromVariant(record).toJson(QJsonDocument::Compact);
+    line.append('\n');
+    if(_journal.write(line) != line.size() || !_journal.flush())
     {
-        _file.write(QJsonDocument::fromVariant(data).toJson());
-        _file.close();
+        qWarning()<<"Warning: Could not write journal -"<<_journal.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool ListResourceFileSystemStorage::replayJournal(QString path)
+{
+    QFile journal(path);
+    if(!journal.open(QFile::ReadOnly))
         return true;
+
+    while(!journal.atEnd())
+    {
+        QByteArray line = journal.readLine();
+        if(!line.endsWith('\n'))
+        {
+            qWarning()<<"Warning: Discarding incomplete journal record in"<<path;
+            return false;
+        }
+
+        QJsonParseError error;
+        QVariantMap record = QJsonDocument::fromJson(line, &error).toVariant().toMap();
+        if(error.error != QJsonParseError::NoError)
+        {
+            qWarning()<<"Warning: Discarding corrupt journal record in"<<path<<"-"<<error.errorString();
+            return false;
+        }
+
+        // records which are already part of the snapshot are skipped
+        qint64 seq = record["seq"].toLongLong();
+        if(seq <= _seq)
+            continue;
+
+        apply(record);
+        _seq = seq;
     }
-    else
+    return true;
+}
+
+bool ListResourceFileSystemStorage::needsCompaction()
+{
+    if(_compacting)
+        return false;
+
+    qint64 journalSize = _journal.size();
+    return journalSize > JOURNAL_COMPACTION_MIN_SIZE && journalSize > _snapshotSize * JOURNAL_COMPACTION_RATIO;
+}
+
+void ListResourceFileSystemStorage::compact()
+{
+    if(_compacting)
+        return;
+
+    _journal.close();
+
+    // A rotated journal is only left behind if the last snapshot could not be written.
+    // Its records are still needed until the next snapshot was committed successfully.
+    if(QFile::exists(_rotatedJournalPath))
+    {
+        QFile rotated(_rotatedJournalPath);
+        if(_journal.open(QFile::ReadOnly) && rotated.open(QFile::WriteOnly | QFile::Append))
+        {
+            rotated.write(_journal.readAll());
+            rotated.close();
+            _journal.close();
+            _journal.remove();
+        }
+        else
+        {
+            _journal.close();
+            qWarning()<<"Warning: Could not rotate journal of"<<_qualifiedResourceName;
+            return;
+        }
+    }
+    else if(_journal.exists() && !QFile::rename(_journal.fileName(), _rotatedJournalPath))
+    {
+        qWarning()<<"Warning: Could not rotate journal of"<<_qualifiedResourceName;
+        return;
+    }
+
+    QString snapshotPath = alternateSnapshotPath();
+    QVector<ListSnapshot::Entry> entries = _entries;
+    listSnapshotPtr source = _snapshot;
+    QVariantMap metadata = _metadata;
+    qint64 seq = _seq;
+
+    // the current snapshot stays mapped until the new one is installed - unmodified items are copied from it
+    _compacting = true;
+    _compactedEntries = entries;
+    _compaction = QtConcurrent::run([=]()
+    {
+        return ListSnapshot::write(snapshotPath, entries, source, metadata, seq);
+    });
+    _compactionWatcher.setFuture(_compaction);
+}
+
+void ListResourceFileSystemStorage::compactionFinished()
+{
+    // the list was deleted meanwhile
+    if(!_compacting || _compaction.resultCount() == 0)
+        return;
+
+    qint64 size = _compaction.result();
+    QVector<ListSnapshot::Entry> written = _compactedEntries;
+    _compaction = QFuture<qint64>();
+    _compactedEntries.clear();
+    _compacting = false;
+
+    // on failure the rotated journal is kept, the next compaction retries
+    if(size >= 0)
+        installSnapshot(alternateSnapshotPath(), written, size);
+}
+
+void ListResourceFileSystemStorage::writeSnapshot()
+{
+    QString path = alternateSnapshotPath();
+    qint64 size = ListSnapshot::write(path, _entries, _snapshot, _metadata, _seq);
+    if(size >= 0 && installSnapshot(path, _entries, size))
+        _journal.remove();
+}
+
+bool ListResourceFileSystemStorage::installSnapshot(QString path, const QVector<ListSnapshot::Entry> &written, qint64 size)
+{
+    listSnapshotPtr snapshot(new ListSnapshot(path));
+    if(!snapshot->open())
     {
-        qWarning()<<"Warning: Could not open file -"<<_file.errorString();
+        qWarning()<<"Warning: Could not open new snapshot of"<<_qualifiedResourceName;
         return false;
     }
+
+    // the items which are still encoded in the old snapshot are moved to their copy in the new one
+    QVector<ListSnapshot::Entry> entries = snapshot->entries();
+    QHash<qint64, int> moved;
+    for(int i = 0; i < written.count() && i < entries.count(); i++)
+    {
+        if(written.at(i).offset >= 0)
+            moved.insert(written.at(i).offset, i);
+    }
+
+    for(int i = 0; i < _entries.count(); i++)
+    {
+        ListSnapshot::Entry& entry = _entries[i];
+        if(entry.offset < 0)
+            continue;
+
+        int index = moved.value(entry.offset, -1);
+        if(index >= 0)
+            entry = entries.at(index);
+        else
+            entry = ListSnapshot::createEntry(_snapshot->decode(entry));
+    }
+
+    // releasing the old snapshot unmaps it, only then it can be deleted
+    QString oldPath = _file.fileName();
+    _snapshot = snapshot;
+    _file.setFileName(path);
+    _snapshotSize = size;
+    QFile::remove(oldPath);
+    QFile::remove(_rotatedJournalPath);
+    QFile::remove(_legacyFilePath);
+    return true;
+}
+
+QString ListResourceFileSystemStorage::alternateSnapshotPath() const
+{
+    return _file.fileName() == _snapshotPath ? _alternateSnapshotPath : _snapshotPath;
 }
 
 void ListResourceFileSystemStorage::load()
 {
-    if( _file.open(QFile::ReadOnly))
+    // an interrupted compaction may leave both snapshot files, the newer one wins
+    listSnapshotPtr snapshot;
+    QString snapshotPath;
+    QStringList paths = QStringList() << _snapshotPath << _alternateSnapshotPath;
+    for(int i = 0; i < paths.count(); i++)
+    {
+        listSnapshotPtr candidate(new ListSnapshot(paths.at(i)));
+        if(candidate->open() && (snapshot.isNull() || candidate->seq() > snapshot->seq()))
+        {
+            snapshot = candidate;
+            snapshotPath = paths.at(i);
+        }
+    }
+
+    QFile legacyFile(_legacyFilePath);
+
+    if(!snapshot.isNull())
     {
-        QVariantMap file =  QJsonDocument::fromJson(_file.readAll()).toVariant().toMap();
-        _file.close();
-        _listData = file["listdata"].toList();
+        _file.setFileName(snapshotPath);
+        QFile::remove(alternateSnapshotPath());
+
+        // items stay encoded in the mapped file until they are accessed
+        _snapshot = snapshot;
+        _entries = snapshot->entries();
+        _metadata = snapshot->metadata();
+        _seq = snapshot->seq();
+        _snapshotSize = snapshot->size();
+    }
+    else if(legacyFile.open(QFile::ReadOnly))
+    {
+        QVariantMap file =  QJsonDocument::fromJson(legacyFile.readAll()).toVariant().toMap();
+        _snapshotSize = legacyFile.size();
+        legacyFile.close();
+
+        QListIterator<QVariant> it(file["listdata"].toList());
+        while(it.hasNext())
+            _entries.append(ListSnapshot::createEntry(it.next()));
+
         _metadata = file["metadata"].toMap();
+        _seq = file["seq"].toLongLong();
     }
-    else
+    else if(!_journal.exists())
     {
-        qWarning()<<"Warning: Could not open File:  "<<_qualifiedResourceName<<" - "<<_file.errorString();
+        qWarning()<<"Warning: Could not open File:  "<<_qualifiedResourceName<<" - "<<legacyFile.errorString();
     }
+
+    bool rotated = QFile::exists(_rotatedJournalPath);
+    bool complete = replayJournal(_rotatedJournalPath);
+    complete = replayJournal(_journal.fileName()) && complete;
+
+    // Leftovers of an interrupted compaction or a torn record at the end of the journal:
+    // write a clean snapshot before new records are appended.
+    if(rotated || !complete)
+        writeSnapshot();
 }
@@ -11,8 +11,11 @@
 #include <QVariant>
 #include <QFile>
 #include <QFileInfo>
+#include <QFuture>
+#include <QFutureWatcher>
 
 #include "../Server/Resources/ListResource/IListResourceStorage.h"
+#include "ListSnapshot.h"
 
 class ListResourceFileSystemStorage : public IListResourceStorage
 {
@@ -21,16 +24,30 @@ class ListResourceFileSystemStorage : public IListResourceStorage
     /*!
         \class ListResourceFileSystemStorage
         \brief This class implements the QuickHub default list storage.
-        This class persists List in the form of JSON files on disk.
+        This class persists lists as binary snapshot (<resource>.snapshot) and journal on disk.
+
+        Modifications are not written as a whole. Every change is appended as a single
+        JSON record to a journal file next to the snapshot (<resource>.journal).
+        As soon as the journal grows larger than the snapshot, the journal is rotated and
+        a new snapshot is written in the background. Snapshots alternate between two files
+        (<resource>.snapshot and <resource>.snapshot.alt): the new snapshot never replaces the mapped one.
+        When it is written, the items are rebased onto the new mapping in the owning thread and the
+        old file is unmapped and deleted. On load, the snapshot with the higher sequence number wins.
+        On load, the snapshot is mapped and all journal records which are newer than the
+        snapshot are replayed. Items of the snapshot are only decoded when they are accessed.
+        Lists stored in the former JSON format (<resource>.json) are converted on first compaction.
+        \sa ListSnapshot
         \sa IListResourceStorageFactory, IListResourceStorage, ListResourceFactory
     */
 
 public:
     explicit ListResourceFileSystemStorage(QString path, QObject* parent = nullptr);
+    ~ListResourceFileSystemStorage() override;
     bool appendItem(QVariant data) override;
     bool insertAt(QVariant data, ItemUID item) override;
     bool appendList(QVariantList data) override;
     bool removeItem(ItemUID item) override;
+    bool removeItems(int index, int count) override;
     bool deleteList() override;
     bool clearList() override;
     bool set(QVariant data, ItemUID item) override;
@@ -53,13 +70,36 @@ public:
 
 private:
     int checkAndCorrectIndex(ItemUID uid) const;
-    bool save();
+    bool commit(QVariantMap record);
+    void apply(const QVariantMap& record);
+    bool appendToJournal(const QVariantMap& record);
+    bool replayJournal(QString path);
+    bool needsCompaction();
+    void compact();
     void load();
+    void writeSnapshot();
+    bool installSnapshot(QString path, const QVector<ListSnapshot::Entry>& written, qint64 size);
+    QString alternateSnapshotPath() const;
 
-    QFile           _file;
+    QFile           _file; // current snapshot
+    QString         _snapshotPath;
+    QString         _alternateSnapshotPath;
+    QString         _legacyFilePath;
+    QFile           _journal;
+    QString         _rotatedJournalPath;
     QString         _qualifiedResourceName;
-    QVariantList    _listData;
+    listSnapshotPtr _snapshot;
+    QVector<ListSnapshot::Entry> _entries;
     QVariantMap     _metadata;
+    qint64          _seq = 0;
+    qint64          _snapshotSize = 0;
+    QFuture<qint64> _compaction;
+    QFutureWatcher<qint64> _compactionWatcher;
+    QVector<ListSnapshot::Entry> _compactedEntries; // entries written by the running compaction
+    bool            _compacting = false;
+
+private slots:
+    void compactionFinished();
 };
 
 #endif // LISTRESOURCEFILESYSTEMSTORAGE_H
@@ -0,0 +1,351 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "ListResourceSQLiteStorage.h"
+#include <QUuid>
+#include <QDebug>
+#include <algorithm>
+#include "SQLiteDatabase.h"
+
+// positions of neighbours closer than this (relative to their magnitude) are renumbered before inserting in between
+#define LIST_POSITION_MIN_GAP   1e-9
+
+ListResourceSQLiteStorage::ListResourceSQLiteStorage(QString qualifiedResourceName, QObject *parent) :
+    IListResourceStorage(parent),
+    _qualifiedResourceName(qualifiedResourceName)
+{
+    load();
+}
+
+bool ListResourceSQLiteStorage::appendItem(QVariant data)
+{
+    double position = _positions.isEmpty() ? 0 : _positions.last() + 1;
+    return insertRow(data, position, _uuids.count());
+}
+
+bool ListResourceSQLiteStorage::insertAt(QVariant data, IListResourceStorage::ItemUID item)
+{
+    int index = qBound(0, item.index, _uuids.count());
+    return insertRow(data, positionAt(index), index);
+}
+
+bool ListResourceSQLiteStorage::appendList(QVariantList data)
+{
+    QSqlDatabase db = SQLiteDatabase::database();
+    db.transaction();
+
+    bool success = true;
+    QListIterator<QVariant> it(data);
+    while(it.hasNext() && success)
+    {
+        success = appendItem(it.next());
+    }
+
+    if(success && db.commit())
+        return true;
+
+    db.rollback();
+    load();
+    return false;
+}
+
+bool ListResourceSQLiteStorage::removeItem(IListResourceStorage::ItemUID item)
+{
+    int idx = checkAndCorrectIndex(item);
+    if(idx < 0)
+        return false;
+
+    QSqlQuery query = SQLiteDatabase::query("DELETE FROM list_items WHERE resource = ? AND uuid = ?");
+    query.addBindValue(_qualifiedResourceName);
+    query.addBindValue(_uuids.at(idx));
+    if(!SQLiteDatabase::exec(query))
+        return false;
+
+    _uuidPositions.remove(_uuids.at(idx));
+    _uuids.remove(idx);
+    _positions.remove(idx);
+    return true;
+}
+
+bool ListResourceSQLiteStorage::removeItems(int index, int count)
+{
+    if(index < 0 || count <= 0 || index + count > _uuids.count())
+        return false;
+
+    // positions are ordered, so the whole range is removed with a single statement
+    QSqlQuery query = SQLiteDatabase::query("DELETE FROM list_items WHERE resource = ? AND position >= ? AND position <= ?");
+    query.addBindValue(_qualifiedResourceName);
+    query.addBindValue(_positions.at(index));
+    query.addBindValue(_positions.at(index + count - 1));
+    if(!SQLiteDatabase::exec(query))
+        return false;
+
+    for(int i = index; i < index + count; i++)
+        _uuidPositions.remove(_uuids.at(i));
+    _uuids.remove(index, count);
+    _positions.remove(index, count);
+    return true;
+}
+
+bool ListResourceSQLiteStorage::deleteList()
+{
+    QSqlQuery query = SQLiteDatabase::query("DELETE FROM lists WHERE resource = ?");
+    query.addBindValue(_qualifiedResourceName);
+    bool success = SQLiteDatabase::exec(query);
+    _metadata.clear();
+    return clearList() && success;
+}
+
+bool ListResourceSQLiteStorage::clearList()
+{
+    QSqlQuery query = SQLiteDatabase::query("DELETE FROM list_items WHERE resource = ?");
+    query.addBindValue(_qualifiedResourceName);
+    if(!SQLiteDatabase::exec(query))
+        return false;
+
+    _uuids.clear();
+    _positions.clear();
+    _uuidPositions.clear();
+    return true;
+}
+
+bool ListResourceSQLiteStorage::set(QVariant data, IListResourceStorage::ItemUID item)
+{
+    int idx = checkAndCorrectIndex(item);
+    if(idx < 0)
+        return false;
+
+    return updateRow(idx, data);
+}
+
+bool ListResourceSQLiteStorage::setProperty(QString property, QVariant data, IListResourceStorage::ItemUID item)
+{
+    int idx = checkAndCorrectIndex(item);
+    if(idx < 0)
+        return false;
+
+    ItemUID uid;
+    uid.index = idx;
+    QVariantMap map = getItem(uid).toMap();
+    map[property] = data;
+    return updateRow(idx, map);
+}
+
+bool ListResourceSQLiteStorage::sync()
+{
+    // every modification is written immediately
+    return true;
+}
+
+bool ListResourceSQLiteStorage::setMetadata(QVariant metadata)
+{
+    QSqlQuery query = SQLiteDatabase::query("INSERT OR REPLACE INTO lists (resource, metadata) VALUES (?, ?)");
+    query.addBindValue(_qualifiedResourceName);
+    query.addBindValue(SQLiteDatabase::encode(metadata));
+    if(!SQLiteDatabase::exec(query))
+        return false;
+
+    _metadata = metadata;
+    return true;
+}
+
+QVariantList ListResourceSQLiteStorage::getList() const
+{
+    QVariantList list;
+    list.reserve(_uuids.count());
+
+    QSqlQuery query = SQLiteDatabase::query("SELECT data FROM list_items WHERE resource = ? ORDER BY position, rowid");
+    query.addBindValue(_qualifiedResourceName);
+    if(!SQLiteDatabase::exec(query))
+        return list;
+
+    while(query.next())
+    {
+        list.append(SQLiteDatabase::decode(query.value(0).toByteArray()));
+    }
+    query.finish();
+    return list;
+}
+
+QVariant ListResourceSQLiteStorage::getItem(IListResourceStorage::ItemUID uid) const
+{
+    int index = checkAndCorrectIndex(uid);
+    if(index < 0)
+        return QVariant();
+
+    QSqlQuery query = SQLiteDatabase::query("SELECT data FROM list_items WHERE resource = ? AND uuid = ?");
+    query.addBindValue(_qualifiedResourceName);
+    query.addBindValue(_uuids.at(index));
+    QVariant data;
+    if(SQLiteDatabase::exec(query) && query.next())
+        data = SQLiteDatabase::decode(query.value(0).toByteArray());
+
+    query.finish();
+    return data;
+}
+
+QVariant ListResourceSQLiteStorage::getMetadata() const
+{
+    return _metadata;
+}
+
+int ListResourceSQLiteStorage::getCount() const
+{
+    return _uuids.count();
+}
+
+bool ListResourceSQLiteStorage::isReady() const
+{
+    return SQLiteDatabase::database().isOpen();
+}
+
+int ListResourceSQLiteStorage::checkAndCorrectIndex(IListResourceStorage::ItemUID uid) const
+{
+    int index = uid.index;
+    QString uuid = uid.uuid;
+
+    if(_uuids.isEmpty())
+        return -1;
+
+    if(index >= 0 && _uuids.count() > index)
+    {
+        if(uuid.isEmpty() || _uuids.at(index) == uuid)
+            return index;
+    }
+
+    return indexOf(uuid);
+}
+
+int ListResourceSQLiteStorage::indexOf(const QString &uuid) const
+{
+    auto it = _uuidPositions.find(uuid);
+    if(it == _uuidPositions.end())
+        return -1;
+
+    auto position = std::lower_bound(_positions.begin(), _positions.end(), it.value());
+    if(position == _positions.end() || *position != it.value())
+        return -1;
+
+    return int(position - _positions.begin());
+}
+
+bool ListResourceSQLiteStorage::insertRow(QVariant data, double position, int index)
+{
+    // items without uuid still need a unique key, it is not part of the data
+    QString uuid = data.toMap().value("uuid").toString();
+    if(uuid.isEmpty())
+    {
+        uuid = QUuid::createUuid().toString();
+    }
+    else if(_uuidPositions.contains(uuid))
+    {
+        qWarning()<<"Warning: Item"<<uuid<<"already exists in"<<_qualifiedResourceName;
+        return false;
+    }
+
+    QSqlQuery query = SQLiteDatabase::query("INSERT INTO list_items (resource, uuid, position, data) VALUES (?, ?, ?, ?)");
+    query.addBindValue(_qualifiedResourceName);
+    query.addBindValue(uuid);
+    query.addBindValue(position);
+    query.addBindValue(SQLiteDatabase::encode(data));
+    if(!SQLiteDatabase::exec(query))
+        return false;
+
+    _uuids.insert(index, uuid);
+    _positions.insert(index, position);
+    _uuidPositions.insert(uuid, position);
+    return true;
+}
+
+bool ListResourceSQLiteStorage::updateRow(int index, const QVariant &data)
+{
+    QSqlQuery query = SQLiteDatabase::query("UPDATE list_items SET data = ? WHERE resource = ? AND uuid = ?");
+    query.addBindValue(SQLiteDatabase::encode(data));
+    query.addBindValue(_qualifiedResourceName);
+    query.addBindValue(_uuids.at(index));
+    return SQLiteDatabase::exec(query);
+}
+
+double ListResourceSQLiteStorage::positionAt(int index)
+{
+    if(_positions.isEmpty())
+        return 0;
+
+    if(index >= _positions.count())
+        return _positions.last() + 1;
+
+    if(index == 0)
+        return _positions.first() - 1;
+
+    // a midpoint which is not strictly between its neighbours would duplicate a position
+    double before = _positions.at(index - 1);
+    double after = _positions.at(index);
+    double position = (before + after) / 2;
+    if(after - before < LIST_POSITION_MIN_GAP * qMax(1.0, qAbs(before)) || position <= before || position >= after)
+    {
+        renumber();
+        position = (_positions.at(index - 1) + _positions.at(index)) / 2;
+    }
+
+    return position;
+}
+
+void ListResourceSQLiteStorage::renumber()
+{
+    QSqlDatabase db = SQLiteDatabase::database();
+    bool ownTransaction = db.transaction();
+
+    QSqlQuery query = SQLiteDatabase::query("UPDATE list_items SET position = ? WHERE resource = ? AND uuid = ?");
+    for(int i = 0; i < _uuids.count(); i++)
+    {
+        query.addBindValue(double(i));
+        query.addBindValue(_qualifiedResourceName);
+        query.addBindValue(_uuids.at(i));
+        SQLiteDatabase::exec(query);
+        _positions[i] = i;
+        _uuidPositions.insert(_uuids.at(i), i);
+    }
+
+    if(ownTransaction)
+        db.commit();
+}
+
+void ListResourceSQLiteStorage::load()
+{
+    _uuids.clear();
+    _positions.clear();
+    _uuidPositions.clear();
+
+    QSqlQuery query = SQLiteDatabase::query("SELECT uuid, position FROM list_items WHERE resource = ? ORDER BY position, rowid");
+    query.addBindValue(_qualifiedResourceName);
+    if(SQLiteDatabase::exec(query))
+    {
+        while(query.next())
+        {
+            _uuids.append(query.value(0).toString());
+            _positions.append(query.value(1).toDouble());
+            _uuidPositions.insert(_uuids.last(), _positions.last());
+        }
+        query.finish();
+    }
+
+    // duplicate positions of older versions break removeItems() and indexOf()
+    for(int i = 1; i < _positions.count(); i++)
+    {
+        if(_positions.at(i) <= _positions.at(i - 1))
+        {
+            renumber();
+            break;
+        }
+    }
+
+    QSqlQuery metadataQuery = SQLiteDatabase::query("SELECT metadata FROM lists WHERE resource = ?");
+    metadataQuery.addBindValue(_qualifiedResourceName);
+    if(SQLiteDatabase::exec(metadataQuery) && metadataQuery.next())
+        _metadata = SQLiteDatabase::decode(metadataQuery.value(0).toByteArray());
+
+    metadataQuery.finish();
+}
@@ -0,0 +1,75 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef LISTRESOURCESQLITESTORAGE_H
+#define LISTRESOURCESQLITESTORAGE_H
+
+#include <QObject>
+#include <QVariant>
+#include <QVector>
+#include <QHash>
+
+#include "../Server/Resources/ListResource/IListResourceStorage.h"
+
+class ListResourceSQLiteStorage : public IListResourceStorage
+{
+    Q_OBJECT
+
+    /*!
+        \class ListResourceSQLiteStorage
+        \brief List storage on top of the embedded SQLite database.
+
+        Every item is stored in its own row, keyed by resource name and uuid. The order of the list
+        is kept in a separate REAL position column: appended items get the last position + 1,
+        inserted items the midpoint of their neighbours. Only when two neighbours get too close,
+        the positions of the list are renumbered.
+
+        Only uuids and positions are held in memory, so set() and setProperty() are single row
+        updates and items are read from the database on access. A hash maps every uuid to its position,
+        the index of an item is found by binary search over the ordered positions.
+        Items with a uuid which is already part of the list are rejected.
+        \sa SQLiteDatabase, ListResourceSQLiteStorageFactory
+    */
+
+public:
+    explicit ListResourceSQLiteStorage(QString qualifiedResourceName, QObject* parent = nullptr);
+    bool appendItem(QVariant data) override;
+    bool insertAt(QVariant data, ItemUID item) override;
+    bool appendList(QVariantList data) override;
+    bool removeItem(ItemUID item) override;
+    bool removeItems(int index, int count) override;
+    bool deleteList() override;
+    bool clearList() override;
+    bool set(QVariant data, ItemUID item) override;
+    bool setProperty(QString property, QVariant data, ItemUID item) override;
+    bool sync() override;
+    bool setMetadata(QVariant metadata) override;
+
+    /*------   getter */
+
+    QVariantList    getList() const override;
+    QVariant        getItem(ItemUID uid) const override;
+    QVariant        getMetadata() const override;
+    int             getCount() const override;
+    bool            isReady() const override;
+
+private:
+    int checkAndCorrectIndex(ItemUID uid) const;
+    int indexOf(const QString& uuid) const;
+    bool insertRow(QVariant data, double position, int index);
+    bool updateRow(int index, const QVariant& data);
+    double positionAt(int index);
+    void renumber();
+    void load();
+
+    QString         _qualifiedResourceName;
+    QVector<QString> _uuids;
+    QVector<double> _positions;
+    QHash<QString, double> _uuidPositions; // uuid -> position
+    QVariant        _metadata;
+};
+
+#endif // LISTRESOURCESQLITESTORAGE_H
@@ -0,0 +1,27 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef LISTRESOURCESQLITESTORAGEFACTORY_H
+#define LISTRESOURCESQLITESTORAGEFACTORY_H
+
+#include "../Server/Resources/ListResource/IListResourceStorageFactory.h"
+
+/*!
+    \class ListResourceSQLiteStorageFactory
+    Creates ListResourceSQLiteStorage instances. Pass an instance to
+    SocketServer::setListResourceStorageFactory() to store list resources in SQLite.
+*/
+
+class ListResourceSQLiteStorageFactory : public IListResourceStorageFactory
+{
+    Q_OBJECT
+
+public:
+    explicit ListResourceSQLiteStorageFactory(QObject* parent = nullptr);
+    IListResourceStorage* createInstance(QString qualifiedResourceName, QObject* parent = nullptr) override;
+};
+
+#endif // LISTRESOURCESQLITESTORAGEFACTORY_H
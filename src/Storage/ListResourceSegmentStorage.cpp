@@ -0,0 +1,252 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "ListResourceSegmentStorage.h"
+#include "SegmentStore.h"
+#include "ListResourceFileSystemStorage.h"
+#include "FileSystemPaths.h"
+#include <QUuid>
+#include <algorithm>
+#include <QDebug>
+
+// positions of neighbours closer than this are renumbered before inserting in between
+#define LIST_POSITION_MIN_GAP   1e-9
+
+ListResourceSegmentStorage::ListResourceSegmentStorage(QString qualifiedResourceName, QObject *parent) : ListResourceTemporaryStorage(parent),
+    _key("lists/" + qualifiedResourceName),
+    _itemPrefix("listitems/" + qualifiedResourceName + "/"),
+    _filePath(FileSystemPaths::instance()->getStoragePath() + qualifiedResourceName)
+{
+    load(qualifiedResourceName);
+}
+
+bool ListResourceSegmentStorage::appendItem(QVariant data)
+{
+    return insertItem(_ids.count(), data);
+}
+
+bool ListResourceSegmentStorage::insertAt(QVariant data, IListResourceStorage::ItemUID item)
+{
+    return insertItem(qBound(0, item.index, _ids.count()), data);
+}
+
+bool ListResourceSegmentStorage::appendList(QVariantList data)
+{
+    bool success = true;
+    for(int i = 0; i < data.count(); i++)
+    {
+        if(!insertItem(_ids.count(), data.at(i)))
+            success = false;
+    }
+    return success;
+}
+
+bool ListResourceSegmentStorage::removeItem(IListResourceStorage::ItemUID item)
+{
+    int index = checkAndCorrectIndex(item);
+    if(index < 0)
+        return false;
+
+    item.index = index;
+    ListResourceTemporaryStorage::removeItem(item);
+    QString id = _ids.at(index);
+    _ids.remove(index);
+    _positions.remove(index);
+    return SegmentStore::remove(itemKey(id));
+}
+
+bool ListResourceSegmentStorage::deleteList()
+{
+    ListResourceTemporaryStorage::deleteList();
+    bool success = removeAllItems();
+
+    // the imported files would bring the list back on the next load
+    QStringList suffixes = QStringList()<<".snapshot"<<".snapshot.alt"<<".json"<<".journal"<<".journal.compacting";
+    for(int i = 0; i < suffixes.count(); i++)
+        QFile::remove(_filePath + suffixes.at(i));
+
+    return SegmentStore::remove(_key) && success;
+}
+
+bool ListResourceSegmentStorage::clearList()
+{
+    ListResourceTemporaryStorage::clearList();
+    return removeAllItems();
+}
+
+bool ListResourceSegmentStorage::set(QVariant data, IListResourceStorage::ItemUID item)
+{
+    int index = checkAndCorrectIndex(item);
+    if(index < 0)
+        return false;
+
+    item.index = index;
+    ListResourceTemporaryStorage::set(data, item);
+    return putItem(index);
+}
+
+bool ListResourceSegmentStorage::setProperty(QString property, QVariant data, IListResourceStorage::ItemUID item)
+{
+    int index = checkAndCorrectIndex(item);
+    if(index < 0)
+        return false;
+
+    item.index = index;
+    ListResourceTemporaryStorage::setProperty(property, data, item);
+    return putItem(index);
+}
+
+bool ListResourceSegmentStorage::setMetadata(QVariant metadata)
+{
+    ListResourceTemporaryStorage::setMetadata(metadata);
+
+    QVariantMap data;
+    data["metadata"] = getMetadata();
+    return SegmentStore::put(_key, data);
+}
+
+void ListResourceSegmentStorage::load(QString qualifiedResourceName)
+{
+    QVariantMap data = SegmentStore::get(_key).toMap();
+    ListResourceTemporaryStorage::setMetadata(data["metadata"]);
+
+    // older versions stored the whole list in a single value
+    if(data.contains("list"))
+    {
+        // items and manifest are queued together, failed writes are retried by the store
+        appendList(data["list"].toList());
+        setMetadata(data["metadata"]);
+        return;
+    }
+
+    struct Entry
+    {
+        double      position;
+        QString     id;
+        QVariant    data;
+    };
+
+    QVector<Entry> entries;
+    QStringList keys = SegmentStore::keys(_itemPrefix);
+    for(int i = 0; i < keys.count(); i++)
+    {
+        // keys of lists below this resource share the prefix
+        QString id = keys.at(i).mid(_itemPrefix.count());
+        if(id.contains('/'))
+            continue;
+
+        QVariantMap item = SegmentStore::get(keys.at(i)).toMap();
+        if(item.isEmpty())
+            continue;
+
+        Entry entry;
+        entry.position = item["p"].toDouble();
+        entry.id = id;
+        entry.data = item["d"];
+        entries.append(entry);
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b){ return a.position < b.position; });
+
+    QVariantList list;
+    for(int i = 0; i < entries.count(); i++)
+    {
+        _ids.append(entries.at(i).id);
+        _positions.append(entries.at(i).position);
+        list.append(entries.at(i).data);
+    }
+    ListResourceTemporaryStorage::appendList(list);
+
+    // lists which were kept in files before are imported once, the manifest marks the list as known
+    if(!SegmentStore::contains(_key))
+    {
+        if(_ids.isEmpty())
+            importFileStorage(qualifiedResourceName);
+        setMetadata(getMetadata());
+    }
+}
+
+void ListResourceSegmentStorage::importFileStorage(QString qualifiedResourceName)
+{
+    if(!QFile::exists(_filePath + ".snapshot") && !QFile::exists(_filePath + ".json") && !QFile::exists(_filePath + ".journal"))
+        return;
+
+    // the files are left untouched as a backup
+    ListResourceFileSystemStorage files(qualifiedResourceName);
+    if(!appendList(files.getList()) || !setMetadata(files.getMetadata()))
+        qWarning()<<"Warning: Could not import list"<<qualifiedResourceName<<"into the segment store";
+}
+
+bool ListResourceSegmentStorage::putItem(int index)
+{
+    IListResourceStorage::ItemUID uid;
+    uid.index = index;
+
+    QVariantMap item;
+    item["p"] = _positions.at(index);
+    item["d"] = getItem(uid);
+    return SegmentStore::put(itemKey(_ids.at(index)), item);
+}
+
+bool ListResourceSegmentStorage::insertItem(int index, QVariant data)
+{
+    // may renumber the existing items, so it has to happen before the list changes
+    double position = positionAt(index);
+
+    IListResourceStorage::ItemUID uid;
+    uid.index = index;
+    ListResourceTemporaryStorage::insertAt(data, uid);
+    _ids.insert(index, QUuid::createUuid().toString(QUuid::WithoutBraces));
+    _positions.insert(index, position);
+    return putItem(index);
+}
+
+double ListResourceSegmentStorage::positionAt(int index)
+{
+    if(_positions.isEmpty())
+        return 0;
+
+    if(index >= _positions.count())
+        return _positions.last() + 1;
+
+    if(index == 0)
+        return _positions.first() - 1;
+
+    if(_positions.at(index) - _positions.at(index - 1) < LIST_POSITION_MIN_GAP)
+        renumber();
+
+    return (_positions.at(index - 1) + _positions.at(index)) / 2;
+}
+
+bool ListResourceSegmentStorage::renumber()
+{
+    bool success = true;
+    for(int i = 0; i < _positions.count(); i++)
+    {
+        _positions[i] = i;
+        if(!putItem(i))
+            success = false;
+    }
+    return success;
+}
+
+bool ListResourceSegmentStorage::removeAllItems()
+{
+    bool success = true;
+    for(int i = 0; i < _ids.count(); i++)
+    {
+        if(!SegmentStore::remove(itemKey(_ids.at(i))))
+            success = false;
+    }
+    _ids.clear();
+    _positions.clear();
+    return success;
+}
+
+QString ListResourceSegmentStorage::itemKey(QString id) const
+{
+    return _itemPrefix + id;
+}
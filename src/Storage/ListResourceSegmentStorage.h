@@ -0,0 +1,56 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef LISTRESOURCESEGMENTSTORAGE_H
+#define LISTRESOURCESEGMENTSTORAGE_H
+
+#include "ListResourceTemporaryStorage.h"
+
+/*!
+    \class ListResourceSegmentStorage
+    \brief List storage which keeps the list in memory and persists it in the shared SegmentStore.
+    Every item is stored under its own key ("listitems/<resource>/<id>") together with a position
+    which defines the order, the metadata under "lists/<resource>". A modification writes only the
+    records of the touched items, new items get a position between their neighbours. Lists of older
+    versions which were stored as a single value are split up on load, lists without a manifest are
+    imported once from the files of ListResourceFileSystemStorage.
+    \sa SegmentStore, ListResourceSegmentStorageFactory
+*/
+
+class ListResourceSegmentStorage : public ListResourceTemporaryStorage
+{
+    Q_OBJECT
+
+public:
+    explicit ListResourceSegmentStorage(QString qualifiedResourceName, QObject* parent = nullptr);
+    bool appendItem(QVariant data) override;
+    bool insertAt(QVariant data, ItemUID item) override;
+    bool appendList(QVariantList data) override;
+    bool removeItem(ItemUID item) override;
+    bool deleteList() override;
+    bool clearList() override;
+    bool set(QVariant data, ItemUID item) override;
+    bool setProperty(QString property, QVariant data, ItemUID item) override;
+    bool setMetadata(QVariant metadata) override;
+
+private:
+    void    load(QString qualifiedResourceName);
+    void    importFileStorage(QString qualifiedResourceName);
+    bool    putItem(int index);
+    bool    insertItem(int index, QVariant data);
+    double  positionAt(int index);
+    bool    renumber();
+    bool    removeAllItems();
+    QString itemKey(QString id) const;
+
+    QString             _key;
+    QString             _itemPrefix;
+    QString             _filePath;  // files of ListResourceFileSystemStorage, imported once
+    QVector<QString>    _ids;       // in list order
+    QVector<double>     _positions; // ascending, parallel to _ids
+};
+
+#endif // LISTRESOURCESEGMENTSTORAGE_H
@@ -0,0 +1,27 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef LISTRESOURCESEGMENTSTORAGEFACTORY_H
+#define LISTRESOURCESEGMENTSTORAGEFACTORY_H
+
+#include "../Server/Resources/ListResource/IListResourceStorageFactory.h"
+
+/*!
+    \class ListResourceSegmentStorageFactory
+    Creates ListResourceSegmentStorage instances. Pass an instance to
+    SocketServer::setListResourceStorageFactory() to store list resources in the shared SegmentStore.
+*/
+
+class ListResourceSegmentStorageFactory : public IListResourceStorageFactory
+{
+    Q_OBJECT
+
+public:
+    explicit ListResourceSegmentStorageFactory(QObject* parent = nullptr);
+    IListResourceStorage* createInstance(QString qualifiedResourceName, QObject* parent = nullptr) override;
+};
+
+#endif // LISTRESOURCESEGMENTSTORAGEFACTORY_H
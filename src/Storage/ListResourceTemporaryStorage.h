@@ -44,8 +44,10 @@ public:
     int             getCount() const override;
     bool            isReady() const override;
 
-private:
+protected:
     int checkAndCorrectIndex(ItemUID uid) const;
+
+private:
     QVariantList    _listData;
     QVariantMap     _metadata;
 };
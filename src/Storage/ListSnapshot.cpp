@@ -0,0 +1,211 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "ListSnapshot.h"
+#include <QCborValue>
+#include <QDataStream>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QtEndian>
+#include <QDebug>
+
+#define SNAPSHOT_MAGIC      "QHLS"
+#define SNAPSHOT_VERSION    1
+#define SNAPSHOT_HEADER     40 // magic(4) version(4) seq(8) count(4) metadata offset(8) metadata size(4) index offset(8)
+
+ListSnapshot::ListSnapshot(QString path) :
+    _file(path)
+{
+}
+
+ListSnapshot::~ListSnapshot()
+{
+    if(_map)
+        _file.unmap(_map);
+    _file.close();
+}
+
+bool ListSnapshot::open()
+{
+    if(!_file.open(QFile::ReadOnly))
+        return false;
+
+    _size = _file.size();
+    if(_size < SNAPSHOT_HEADER)
+    {
+        qWarning()<<"Warning: Invalid snapshot"<<_file.fileName();
+        return false;
+    }
+
+    _map = _file.map(0, _size);
+    if(!_map)
+    {
+        qWarning()<<"Warning: Could not map snapshot -"<<_file.errorString();
+        return false;
+    }
+
+    const uchar* header = _map;
+    if(memcmp(header, SNAPSHOT_MAGIC, 4) != 0 || qFromBigEndian<quint32>(header + 4) != SNAPSHOT_VERSION)
+    {
+        qWarning()<<"Warning: Unknown snapshot format"<<_file.fileName();
+        return false;
+    }
+
+    _seq = qFromBigEndian<qint64>(header + 8);
+    quint32 count = qFromBigEndian<quint32>(header + 16);
+    quint64 metadataOffset = qFromBigEndian<quint64>(header + 20);
+    quint32 metadataSize = qFromBigEndian<quint32>(header + 28);
+    quint64 indexOffset = qFromBigEndian<quint64>(header + 32);
+
+    if(metadataOffset + metadataSize > quint64(_size) || indexOffset > quint64(_size))
+    {
+        qWarning()<<"Warning: Corrupt snapshot"<<_file.fileName();
+        return false;
+    }
+
+    Entry metadata;
+    metadata.offset = qint64(metadataOffset);
+    metadata.size = metadataSize;
+    _metadata = decode(metadata).toMap();
+
+    // the index is the only part of the snapshot which is read completely
+    _entries.reserve(int(count));
+    const uchar* it = _map + indexOffset;
+    const uchar* end = _map + _size;
+    for(quint32 i = 0; i < count; i++)
+    {
+        if(end - it < 16)
+        {
+            qWarning()<<"Warning: Corrupt snapshot index"<<_file.fileName();
+            _entries.clear();
+            return false;
+        }
+
+        Entry entry;
+        entry.offset = qint64(qFromBigEndian<quint64>(it));
+        entry.size = qFromBigEndian<quint32>(it + 8);
+        quint32 uuidSize = qFromBigEndian<quint32>(it + 12);
+        it += 16;
+
+        if(uuidSize == 0xFFFFFFFF) // null byte array
+            uuidSize = 0;
+
+        if(quint32(end - it) < uuidSize || quint64(entry.offset) + entry.size > quint64(_size))
+        {
+            qWarning()<<"Warning: Corrupt snapshot index"<<_file.fileName();
+            _entries.clear();
+            return false;
+        }
+
+        entry.uuid = QString::fromUtf8(reinterpret_cast<const char*>(it), int(uuidSize));
+        it += uuidSize;
+        _entries.append(entry);
+    }
+
+    return true;
+}
+
+qint64 ListSnapshot::seq() const
+{
+    return _seq;
+}
+
+qint64 ListSnapshot::size() const
+{
+    return _size;
+}
+
+QVariantMap ListSnapshot::metadata() const
+{
+    return _metadata;
+}
+
+QVector<ListSnapshot::Entry> ListSnapshot::entries() const
+{
+    return _entries;
+}
+
+QVariant ListSnapshot::decode(const ListSnapshot::Entry &entry) const
+{
+    if(entry.offset < 0)
+        return entry.data;
+
+    if(!_map)
+        return QVariant();
+
+    QByteArray raw = QByteArray::fromRawData(reinterpret_cast<const char*>(_map + entry.offset), int(entry.size));
+    return QCborValue::fromCbor(raw).toVariant();
+}
+
+ListSnapshot::Entry ListSnapshot::createEntry(QVariant data)
+{
+    Entry entry;
+    entry.data = data;
+    entry.uuid = data.toMap().value("uuid").toString();
+    return entry;
+}
+
+qint64 ListSnapshot::write(QString path, QVector<Entry> entries, listSnapshotPtr source, QVariantMap metadata, qint64 seq)
+{
+    QFileInfo info(path);
+    QDir dir(info.absolutePath());
+    if(!dir.exists())
+    {
+        dir.mkpath(info.absolutePath());
+    }
+
+    // QSaveFile writes to a temporary file and replaces the snapshot on commit
+    QSaveFile file(path);
+    if(!file.open(QFile::WriteOnly))
+    {
+        qWarning()<<"Warning: Could not open file -"<<file.errorString();
+        return -1;
+    }
+
+    QDataStream stream(&file);
+    file.write(QByteArray(SNAPSHOT_HEADER, 0));
+
+    QVector<QPair<quint64, quint32>> positions;
+    positions.reserve(entries.count());
+    QVectorIterator<Entry> it(entries);
+    while(it.hasNext())
+    {
+        const Entry& entry = it.next();
+        QByteArray raw;
+
+        // unmodified items are copied without being decoded
+        if(entry.offset >= 0 && !source.isNull() && source->_map)
+            raw = QByteArray::fromRawData(reinterpret_cast<const char*>(source->_map + entry.offset), int(entry.size));
+        else
+            raw = QCborValue::fromVariant(entry.data).toCbor();
+
+        positions.append(qMakePair(quint64(file.pos()), quint32(raw.size())));
+        file.write(raw);
+    }
+
+    QByteArray rawMetadata = QCborValue::fromVariant(metadata).toCbor();
+    quint64 metadataOffset = quint64(file.pos());
+    file.write(rawMetadata);
+
+    quint64 indexOffset = quint64(file.pos());
+    for(int i = 0; i < entries.count(); i++)
+    {
+        stream << positions.at(i).first << positions.at(i).second << entries.at(i).uuid.toUtf8();
+    }
+
+    qint64 size = file.pos();
+    file.seek(0);
+    file.write(SNAPSHOT_MAGIC, 4);
+    stream << quint32(SNAPSHOT_VERSION) << seq << quint32(entries.count()) << metadataOffset << quint32(rawMetadata.size()) << indexOffset;
+
+    if(stream.status() != QDataStream::Ok || !file.commit())
+    {
+        qWarning()<<"Warning: Could not write file -"<<file.errorString();
+        return -1;
+    }
+    return size;
+}
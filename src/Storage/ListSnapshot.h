@@ -0,0 +1,71 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef LISTSNAPSHOT_H
+#define LISTSNAPSHOT_H
+
+#include <QFile>
+#include <QVariant>
+#include <QVector>
+#include <QSharedPointer>
+
+/*!
+    \class ListSnapshot
+    \brief Memory mapped, binary snapshot of a list.
+
+    The file starts with a fixed size header, followed by the CBOR encoded items, the CBOR encoded
+    metadata and an index with offset, size and uuid of every item:
+
+    \code
+    magic "QHLS" | version | seq | count | metadata offset | metadata size | index offset
+    item 0 | item 1 | ... | metadata | index
+    \endcode
+
+    Opening a snapshot maps the file and reads only the header and the index. Items are decoded
+    on access. Unmodified items can be copied from one snapshot to the next without being decoded.
+*/
+
+class ListSnapshot
+{
+public:
+    /*!
+        \struct ListSnapshot::Entry
+        A list item. Either it is still encoded in the mapped snapshot (offset >= 0)
+        or it has been modified and is held in data.
+    */
+    struct Entry
+    {
+        QVariant    data;
+        qint64      offset = -1;
+        quint32     size = 0;
+        QString     uuid;
+    };
+
+    explicit ListSnapshot(QString path);
+    ~ListSnapshot();
+
+    bool                open();
+    qint64              seq() const;
+    qint64              size() const;
+    QVariantMap         metadata() const;
+    QVector<Entry>      entries() const;
+    QVariant            decode(const Entry& entry) const;
+
+    static Entry        createEntry(QVariant data);
+    static qint64       write(QString path, QVector<Entry> entries, QSharedPointer<ListSnapshot> source, QVariantMap metadata, qint64 seq);
+
+private:
+    QFile               _file;
+    uchar*              _map = nullptr;
+    qint64              _size = 0;
+    qint64              _seq = 0;
+    QVariantMap         _metadata;
+    QVector<Entry>      _entries;
+};
+
+typedef QSharedPointer<ListSnapshot> listSnapshotPtr;
+
+#endif // LISTSNAPSHOT_H
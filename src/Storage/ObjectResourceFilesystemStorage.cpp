@@ -7,8 +7,8 @@
 #include "ObjectResourceFilesystemStorage.h"
 #include <QJsonDocument>
 #include <QDebug>
-#include <QDir>
 #include "FileSystemPaths.h"
+#include "PersistenceScheduler.h"
 
 ObjectResourceFilesystemStorage::ObjectResourceFilesystemStorage(QString qualifiedResourceName, QObject *parent):
     IObjectResourceStorage(parent),
@@ -58,28 +58,17 @@ bool ObjectResourceFilesystemStorage::save()
     data["properties"] = _propertyData;
     data["metadata"] = _metadata;
 
-    QFileInfo info(_file);
-    QDir dir(info.absolutePath());
-    if(!dir.exists())
+    if(!PersistenceScheduler::save(_file.fileName(), data))
     {
-        dir.mkpath(info.absolutePath());
-    }
-
-    if(_file.open(QFile::WriteOnly))
-    {
-        _file.write(QJsonDocument::fromVariant(data).toJson());
-        _file.close();
-        return true;
-    }
-    else
-    {
-        qWarning()<<"Warning: Could not open file -"<<_file.errorString();
+        qWarning()<<"Warning: Could not write"<<_qualifiedResourceName;
         return false;
     }
+    return true;
 }
 
 void ObjectResourceFilesystemStorage::load()
 {
+    PersistenceScheduler::waitForWritten(_file.fileName());
     if( _file.open(QFile::ReadOnly))
     {
         QVariantMap file =  QJsonDocument::fromJson(_file.readAll()).toVariant().toMap();
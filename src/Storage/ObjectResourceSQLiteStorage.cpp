@@ -0,0 +1,81 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "ObjectResourceSQLiteStorage.h"
+#include "SQLiteDatabase.h"
+
+ObjectResourceSQLiteStorage::ObjectResourceSQLiteStorage(QString qualifiedResourceName, QObject *parent) : IObjectResourceStorage(parent),
+    _qualifiedResourceName(qualifiedResourceName)
+{
+    load();
+}
+
+bool ObjectResourceSQLiteStorage::insertProperty(QString name, QVariant value)
+{
+    QSqlQuery query = SQLiteDatabase::query("INSERT OR REPLACE INTO object_properties (resource, name, data) VALUES (?, ?, ?)");
+    query.addBindValue(_qualifiedResourceName);
+    query.addBindValue(name);
+    query.addBindValue(SQLiteDatabase::encode(value));
+    if(!SQLiteDatabase::exec(query))
+        return false;
+
+    _propertyData.insert(name, value);
+    return true;
+}
+
+bool ObjectResourceSQLiteStorage::sync()
+{
+    // every modification is written immediately
+    return true;
+}
+
+bool ObjectResourceSQLiteStorage::setMetadata(QVariant metadata)
+{
+    QSqlQuery query = SQLiteDatabase::query("INSERT OR REPLACE INTO objects (resource, metadata) VALUES (?, ?)");
+    query.addBindValue(_qualifiedResourceName);
+    query.addBindValue(SQLiteDatabase::encode(metadata));
+    if(!SQLiteDatabase::exec(query))
+        return false;
+
+    _metadata = metadata;
+    return true;
+}
+
+QVariant ObjectResourceSQLiteStorage::getProperty(QString name) const
+{
+    return _propertyData[name];
+}
+
+QVariantMap ObjectResourceSQLiteStorage::getAllProperties() const
+{
+    return _propertyData;
+}
+
+QVariant ObjectResourceSQLiteStorage::getMetadata() const
+{
+    return _metadata;
+}
+
+void ObjectResourceSQLiteStorage::load()
+{
+    QSqlQuery query = SQLiteDatabase::query("SELECT name, data FROM object_properties WHERE resource = ?");
+    query.addBindValue(_qualifiedResourceName);
+    if(SQLiteDatabase::exec(query))
+    {
+        while(query.next())
+        {
+            _propertyData.insert(query.value(0).toString(), SQLiteDatabase::decode(query.value(1).toByteArray()));
+        }
+    }
+    query.finish();
+
+    QSqlQuery metadataQuery = SQLiteDatabase::query("SELECT metadata FROM objects WHERE resource = ?");
+    metadataQuery.addBindValue(_qualifiedResourceName);
+    if(SQLiteDatabase::exec(metadataQuery) && metadataQuery.next())
+        _metadata = SQLiteDatabase::decode(metadataQuery.value(0).toByteArray());
+
+    metadataQuery.finish();
+}
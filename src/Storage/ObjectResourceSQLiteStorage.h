@@ -0,0 +1,46 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef OBJECTRESOURCESQLITESTORAGE_H
+#define OBJECTRESOURCESQLITESTORAGE_H
+
+#include <QObject>
+#include <QVariant>
+
+#include "../Server/Resources/ObjectResource/IObjectResourceStorage.h"
+
+/*!
+    \class ObjectResourceSQLiteStorage
+    \brief Object storage on top of the embedded SQLite database.
+    Every property is stored in its own row, so changing a property writes only this property.
+    \sa SQLiteDatabase, ObjectResourceSQLiteStorageFactory
+*/
+
+class ObjectResourceSQLiteStorage : public IObjectResourceStorage
+{
+    Q_OBJECT
+
+public:
+    ObjectResourceSQLiteStorage(QString qualifiedResourceName, QObject* parent = nullptr);
+
+    bool        insertProperty(QString name, QVariant value) override;
+    bool        sync() override; // to write unsaved
+    bool        setMetadata(QVariant metadata) override;
+
+    /*------   getter */
+
+    QVariant    getProperty(QString name) const override;
+    QVariantMap getAllProperties() const override;
+    QVariant    getMetadata() const override;
+
+private:
+    void load();
+    QString     _qualifiedResourceName;
+    QVariantMap _propertyData;
+    QVariant    _metadata;
+};
+
+#endif // OBJECTRESOURCESQLITESTORAGE_H
@@ -0,0 +1,27 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef OBJECTRESOURCESQLITESTORAGEFACTORY_H
+#define OBJECTRESOURCESQLITESTORAGEFACTORY_H
+
+#include "../Server/Resources/ObjectResource/IObjectResourceStorageFactory.h"
+
+/*!
+    \class ObjectResourceSQLiteStorageFactory
+    Creates ObjectResourceSQLiteStorage instances. Pass an instance to
+    SocketServer::setObjectResourceStorageFactory() to store object resources in SQLite.
+*/
+
+class ObjectResourceSQLiteStorageFactory : public IObjectResourceStorageFactory
+{
+    Q_OBJECT
+
+public:
+    explicit ObjectResourceSQLiteStorageFactory(QObject* parent = nullptr);
+    IObjectResourceStorage* createInstance(QString qualifiedResourceName, QObject* parent = nullptr) override;
+};
+
+#endif // OBJECTRESOURCESQLITESTORAGEFACTORY_H
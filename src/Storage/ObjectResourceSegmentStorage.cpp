@@ -0,0 +1,56 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "ObjectResourceSegmentStorage.h"
+#include "SegmentStore.h"
+
+ObjectResourceSegmentStorage::ObjectResourceSegmentStorage(QString qualifiedResourceName, QObject *parent) : IObjectResourceStorage(parent),
+    _key("objects/" + qualifiedResourceName)
+{
+    QVariantMap data = SegmentStore::get(_key).toMap();
+    _propertyData = data["properties"].toMap();
+    _metadata = data["metadata"].toMap();
+}
+
+bool ObjectResourceSegmentStorage::insertProperty(QString name, QVariant value)
+{
+    _propertyData.insert(name, value);
+    return save();
+}
+
+bool ObjectResourceSegmentStorage::sync()
+{
+    return true;
+}
+
+bool ObjectResourceSegmentStorage::setMetadata(QVariant metadata)
+{
+    _metadata = metadata;
+    return save();
+}
+
+QVariant ObjectResourceSegmentStorage::getProperty(QString name) const
+{
+    return _propertyData[name];
+}
+
+QVariantMap ObjectResourceSegmentStorage::getAllProperties() const
+{
+    return _propertyData;
+}
+
+QVariant ObjectResourceSegmentStorage::getMetadata() const
+{
+    return _metadata;
+}
+
+bool ObjectResourceSegmentStorage::save()
+{
+    QVariantMap data;
+    data["properties"] = _propertyData;
+    data["metadata"] = _metadata;
+    return SegmentStore::put(_key, data);
+}
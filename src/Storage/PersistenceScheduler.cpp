@@ -0,0 +1,270 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "PersistenceScheduler.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDebug>
+
+Q_GLOBAL_STATIC(PersistenceScheduler, persistenceScheduler);
+
+PersistenceScheduler::PersistenceScheduler(QObject *parent) : QThread(parent)
+{
+    if(QCoreApplication::instance())
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, [=](){ flush(); }, Qt::DirectConnection);
+}
+
+PersistenceScheduler::~PersistenceScheduler()
+{
+    _mutex.lock();
+    _stop = true;
+    _wakeUp.wakeAll();
+    _mutex.unlock();
+
+    if(isRunning())
+    {
+        wait();
+    }
+    else
+    {
+        // the worker was never started - nothing else can be pending
+        QHashIterator<QString, Job> it(_pending);
+        while(it.hasNext())
+        {
+            it.next();
+            if(it.value().remove)
+                QFile::remove(it.key());
+            else
+                writeFile(it.key(), it.value().data);
+        }
+    }
+}
+
+PersistenceScheduler *PersistenceScheduler::instance()
+{
+    return persistenceScheduler;
+}
+
+bool PersistenceScheduler::save(QString path, QVariant data, Durability durability)
+{
+    PersistenceScheduler* scheduler = instance();
+    if(!scheduler)
+        return writeFile(path, data);
+
+    Job job;
+    job.data = data;
+    job.due = QDateTime::currentMSecsSinceEpoch();
+    if(durability == BATCHED)
+        job.due += scheduler->batchInterval();
+    else if(durability == PERIODIC)
+        job.due += scheduler->periodicInterval();
+
+    scheduler->enqueue(path, job);
+
+    if(durability == IMMEDIATE)
+        return scheduler->flush(path);
+
+    return !scheduler->hasFailed(path);
+}
+
+void PersistenceScheduler::remove(QString path)
+{
+    PersistenceScheduler* scheduler = instance();
+    if(!scheduler)
+    {
+        QFile::remove(path);
+        return;
+    }
+
+    Job job;
+    job.remove = true;
+    scheduler->enqueue(path, job);
+    scheduler->flush(path);
+}
+
+bool PersistenceScheduler::waitForWritten(QString path)
+{
+    PersistenceScheduler* scheduler = instance();
+    if(scheduler)
+        return scheduler->flush(path);
+    return true;
+}
+
+void PersistenceScheduler::flushAll()
+{
+    PersistenceScheduler* scheduler = instance();
+    if(scheduler)
+        scheduler->flush();
+}
+
+void PersistenceScheduler::setBatchInterval(int msecs)
+{
+    QMutexLocker locker(&_mutex);
+    _batchInterval = msecs;
+}
+
+int PersistenceScheduler::batchInterval() const
+{
+    QMutexLocker locker(&_mutex);
+    return _batchInterval;
+}
+
+void PersistenceScheduler::setPeriodicInterval(int msecs)
+{
+    QMutexLocker locker(&_mutex);
+    _periodicInterval = msecs;
+}
+
+int PersistenceScheduler::periodicInterval() const
+{
+    QMutexLocker locker(&_mutex);
+    return _periodicInterval;
+}
+
+bool PersistenceScheduler::writeFile(QString path, const QVariant &data)
+{
+    QFileInfo info(path);
+    QDir dir(info.absolutePath());
+    if(!dir.exists())
+    {
+        dir.mkpath(info.absolutePath());
+    }
+
+    // QSaveFile syncs the data to disk and replaces the old file on commit
+    QSaveFile file(path);
+    if(!file.open(QFile::WriteOnly))
+    {
+        qWarning()<<"Warning: Could not open file -"<<file.errorString();
+        return false;
+    }
+
+    file.write(QJsonDocument::fromVariant(data).toJson());
+    if(!file.commit())
+    {
+        qWarning()<<"Warning: Could not write file -"<<file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void PersistenceScheduler::run()
+{
+    QMutexLocker locker(&_mutex);
+    while(true)
+    {
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+        qint64 nextDue = -1;
+        QHash<QString, Job> dueJobs;
+
+        QMutableHashIterator<QString, Job> it(_pending);
+        while(it.hasNext())
+        {
+            it.next();
+            if(_stop || it.value().due <= now)
+            {
+                dueJobs.insert(it.key(), it.value());
+                _inFlight.insert(it.key());
+                it.remove();
+            }
+            else if(nextDue < 0 || it.value().due < nextDue)
+            {
+                nextDue = it.value().due;
+            }
+        }
+
+        if(dueJobs.isEmpty())
+        {
+            if(_stop)
+                break;
+
+            if(nextDue < 0)
+                _wakeUp.wait(&_mutex);
+            else
+                _wakeUp.wait(&_mutex, static_cast<unsigned long>(nextDue - now));
+            continue;
+        }
+
+        // group commit - everything that is due is written in one go
+        locker.unlock();
+        QSet<QString> failed;
+        QSet<QString> succeeded;
+        QHashIterator<QString, Job> jobIt(dueJobs);
+        while(jobIt.hasNext())
+        {
+            jobIt.next();
+            bool ok = true;
+            if(jobIt.value().remove)
+                QFile::remove(jobIt.key());
+            else
+                ok = writeFile(jobIt.key(), jobIt.value().data);
+
+            if(ok)
+                succeeded.insert(jobIt.key());
+            else
+                failed.insert(jobIt.key());
+        }
+        locker.relock();
+
+        _failed.subtract(succeeded);
+        _failed.unite(failed);
+
+        _inFlight.clear();
+        _written.wakeAll();
+    }
+}
+
+void PersistenceScheduler::enqueue(QString path, Job job)
+{
+    QMutexLocker locker(&_mutex);
+
+    // coalesce with a pending write: the latest data wins, the earliest deadline is kept
+    if(_pending.contains(path) && !job.remove)
+        job.due = qMin(job.due, _pending.value(path).due);
+
+    _pending.insert(path, job);
+
+    if(!isRunning() && !_stop)
+        start(QThread::LowPriority);
+
+    _wakeUp.wakeAll();
+}
+
+bool PersistenceScheduler::flush(QString path)
+{
+    QMutexLocker locker(&_mutex);
+    if(_pending.contains(path))
+    {
+        _pending[path].due = 0;
+        _wakeUp.wakeAll();
+    }
+
+    while(isRunning() && (_pending.contains(path) || _inFlight.contains(path)))
+        _written.wait(&_mutex);
+
+    return !_failed.contains(path);
+}
+
+bool PersistenceScheduler::hasFailed(QString path) const
+{
+    QMutexLocker locker(&_mutex);
+    return _failed.contains(path);
+}
+
+void PersistenceScheduler::flush()
+{
+    QMutexLocker locker(&_mutex);
+    QMutableHashIterator<QString, Job> it(_pending);
+    while(it.hasNext())
+        it.next().value().due = 0;
+    _wakeUp.wakeAll();
+
+    while(isRunning() && (!_pending.isEmpty() || !_inFlight.isEmpty()))
+        _written.wait(&_mutex);
+}
@@ -0,0 +1,121 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef PERSISTENCESCHEDULER_H
+#define PERSISTENCESCHEDULER_H
+
+#include <QThread>
+#include <QVariant>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QWaitCondition>
+
+/*!
+    \class PersistenceScheduler
+    \brief Write-behind scheduler for JSON files.
+
+    Instead of writing files synchronously on the calling thread, storages hand a snapshot of their data
+    to the scheduler. Serialization and disk I/O happen on a dedicated background thread.
+    As long as a file has not been written yet, newer snapshots for the same path replace the pending
+    one, so a burst of modifications results in a single write.
+
+    Files are replaced atomically (QSaveFile). Pending writes are flushed when the application quits
+    and when the scheduler is destroyed.
+
+    \sa PersistenceScheduler::Durability
+*/
+
+class PersistenceScheduler : public QThread
+{
+    Q_OBJECT
+
+public:
+    /*!
+        \enum PersistenceScheduler::Durability
+        IMMEDIATE   the file is written and synced to disk before save() returns
+        BATCHED     the file is written together with all other pending files after the batch interval
+        PERIODIC    the file is written after the periodic interval. Use this for frequently changing data which can be
+                    reconstructed easily.
+
+        BATCHED and PERIODIC writes are asynchronous. Use waitForWritten() to block until the data is on disk.
+    */
+    enum Durability
+    {
+        IMMEDIATE,
+        BATCHED,
+        PERIODIC
+    };
+
+    explicit PersistenceScheduler(QObject* parent = nullptr);
+    ~PersistenceScheduler() override;
+
+    static PersistenceScheduler* instance();
+
+    /*!
+        \fn static bool PersistenceScheduler::save(QString path, QVariant data, Durability durability = BATCHED)
+        Marks the file dirty and schedules a write of data as JSON document. If the scheduler is already destroyed,
+        the file is written synchronously.
+        With IMMEDIATE the function blocks until the file is written and returns false if the write failed. Otherwise
+        it returns false if the previous write of the file failed, the result of this write is reported by
+        waitForWritten().
+    */
+    static bool save(QString path, QVariant data, Durability durability = BATCHED);
+
+    /*!
+        \fn static void PersistenceScheduler::remove(QString path)
+        Discards pending writes for the file and deletes it.
+    */
+    static void remove(QString path);
+
+    /*!
+        \fn static bool PersistenceScheduler::waitForWritten(QString path)
+        Blocks until pending writes for the given file are on disk. Call this before reading a file which
+        might have been saved via the scheduler. Returns false if the last write of the file failed.
+    */
+    static bool waitForWritten(QString path);
+
+    /*!
+        \fn static void PersistenceScheduler::flushAll()
+        Barrier: blocks until all pending writes are on disk.
+    */
+    static void flushAll();
+
+    void setBatchInterval(int msecs);
+    int  batchInterval() const;
+    void setPeriodicInterval(int msecs);
+    int  periodicInterval() const;
+
+    static bool writeFile(QString path, const QVariant& data);
+
+protected:
+    void run() override;
+
+private:
+    struct Job
+    {
+        QVariant data;
+        qint64 due = 0;
+        bool remove = false;
+    };
+
+    void enqueue(QString path, Job job);
+    bool flush(QString path);
+    bool hasFailed(QString path) const;
+    void flush();
+
+    mutable QMutex          _mutex;
+    QWaitCondition          _wakeUp;
+    QWaitCondition          _written;
+    QHash<QString, Job>     _pending;
+    QSet<QString>           _inFlight;
+    QSet<QString>           _failed; // files whose last write failed
+    int                     _batchInterval = 500;
+    int                     _periodicInterval = 1000 * 60;
+    bool                    _stop = false;
+};
+
+#endif // PERSISTENCESCHEDULER_H
@@ -0,0 +1,111 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "SQLiteDatabase.h"
+#include <QThread>
+#include <QThreadStorage>
+#include <QSqlError>
+#include <QJsonDocument>
+#include <QDir>
+#include <QDebug>
+#include "FileSystemPaths.h"
+
+namespace
+{
+    struct ThreadConnection
+    {
+        QString                     name;
+        QHash<QString, QSqlQuery>   statements;
+
+        // QThreadStorage deletes the connection when its thread finishes
+        ~ThreadConnection()
+        {
+            statements.clear();
+            {
+                QSqlDatabase database = QSqlDatabase::database(name, false);
+                database.close();
+            }
+            QSqlDatabase::removeDatabase(name);
+        }
+    };
+
+    QThreadStorage<ThreadConnection*> connections;
+}
+
+QSqlDatabase SQLiteDatabase::database()
+{
+    if(connections.hasLocalData())
+        return QSqlDatabase::database(connections.localData()->name);
+
+    ThreadConnection* connection = new ThreadConnection;
+    connection->name = "quickhub_sqlite_" + QString::number(reinterpret_cast<quintptr>(QThread::currentThread()), 16);
+    connections.setLocalData(connection);
+
+    QString path = FileSystemPaths::instance()->getStoragePath();
+    QDir().mkpath(path);
+
+    QSqlDatabase database = QSqlDatabase::addDatabase("QSQLITE", connection->name);
+    database.setDatabaseName(path + "resources.sqlite");
+    if(!database.open())
+    {
+        qCritical()<<"Could not open SQLite storage -"<<database.lastError().text();
+        return database;
+    }
+
+    QSqlQuery pragma(database);
+    pragma.exec("PRAGMA journal_mode=WAL");
+    pragma.exec("PRAGMA synchronous=NORMAL");
+    pragma.exec("PRAGMA busy_timeout=5000");
+    createSchema(database);
+    return database;
+}
+
+QSqlQuery SQLiteDatabase::query(const QString &statement)
+{
+    QSqlDatabase db = database();
+    ThreadConnection* connection = connections.localData();
+    if(connection->statements.contains(statement))
+        return connection->statements.value(statement);
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if(!query.prepare(statement))
+        qWarning()<<"Warning: Could not prepare statement -"<<query.lastError().text()<<statement;
+
+    connection->statements.insert(statement, query);
+    return query;
+}
+
+bool SQLiteDatabase::exec(QSqlQuery &query)
+{
+    if(query.exec())
+        return true;
+
+    qWarning()<<"Warning: SQLite storage error -"<<query.lastError().text();
+    return false;
+}
+
+QByteArray SQLiteDatabase::encode(const QVariant &data)
+{
+    return QJsonDocument::fromVariant(data).toJson(QJsonDocument::Compact);
+}
+
+QVariant SQLiteDatabase::decode(const QByteArray &data)
+{
+    return QJsonDocument::fromJson(data).toVariant();
+}
+
+void SQLiteDatabase::createSchema(QSqlDatabase database)
+{
+    QSqlQuery query(database);
+    query.exec("CREATE TABLE IF NOT EXISTS lists (resource TEXT PRIMARY KEY, metadata TEXT)");
+    query.exec("CREATE TABLE IF NOT EXISTS list_items (resource TEXT NOT NULL, uuid TEXT NOT NULL, position REAL NOT NULL, "
+               "data TEXT NOT NULL, PRIMARY KEY (resource, uuid))");
+    query.exec("CREATE INDEX IF NOT EXISTS list_items_position ON list_items (resource, position)");
+    query.exec("CREATE TABLE IF NOT EXISTS objects (resource TEXT PRIMARY KEY, metadata TEXT)");
+    query.exec("CREATE TABLE IF NOT EXISTS object_properties (resource TEXT NOT NULL, name TEXT NOT NULL, data TEXT NOT NULL, "
+               "PRIMARY KEY (resource, name))");
+}
@@ -0,0 +1,46 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef SQLITEDATABASE_H
+#define SQLITEDATABASE_H
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QVariant>
+
+/*!
+    \class SQLiteDatabase
+    \brief Connection handling for the SQLite resource storages.
+
+    All list and object resources share one database file (<storage path>/resources.sqlite) in WAL mode.
+    QSqlDatabase connections can only be used in the thread which created them, so every thread
+    gets its own connection. Prepared statements are cached per connection. The connection of a thread is
+    closed and removed when the thread finishes.
+
+    \sa ListResourceSQLiteStorage, ObjectResourceSQLiteStorage
+*/
+
+class SQLiteDatabase
+{
+public:
+    static QSqlDatabase database();
+
+    /*!
+        \fn static QSqlQuery SQLiteDatabase::query(const QString& statement)
+        Returns the prepared query for the given statement. The query is cached, so don't nest two
+        executions of the same statement.
+    */
+    static QSqlQuery    query(const QString& statement);
+    static bool         exec(QSqlQuery& query);
+
+    static QByteArray   encode(const QVariant& data);
+    static QVariant     decode(const QByteArray& data);
+
+private:
+    static void         createSchema(QSqlDatabase database);
+};
+
+#endif // SQLITEDATABASE_H
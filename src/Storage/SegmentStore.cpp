@@ -0,0 +1,677 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#include "SegmentStore.h"
+#include <QCoreApplication>
+#include <QCborValue>
+#include <QDataStream>
+#include <QtEndian>
+#include <QDir>
+#include <QSet>
+#include <algorithm>
+#include <QDebug>
+#include "FileSystemPaths.h"
+
+#if defined(Q_OS_WIN)
+#include <io.h>
+#elif defined(Q_OS_UNIX)
+#include <unistd.h>
+#endif
+
+#define SEGMENT_MAX_SIZE        16 * 1024 * 1024
+#define SEGMENT_RECORD_HEADER   12 // key size(4) value size(4) checksum(4)
+#define SEGMENT_TOMBSTONE       0xFFFFFFFF
+#define SEGMENT_CRC_POLYNOMIAL  0xEDB88320 // CRC-32 (IEEE 802.3), reflected
+
+// a sealed segment is merged as soon as less than SEGMENT_MERGE_RATIO of its bytes are still live
+#define SEGMENT_MERGE_RATIO     0.5
+
+Q_GLOBAL_STATIC(SegmentStore, segmentStore);
+
+namespace {
+
+QVector<quint32> crcTable()
+{
+    QVector<quint32> table(256);
+    for(quint32 i = 0; i < 256; i++)
+    {
+        quint32 crc = i;
+        for(int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ SEGMENT_CRC_POLYNOMIAL : crc >> 1;
+        table[int(i)] = crc;
+    }
+    return table;
+}
+
+quint32 crc32(const QByteArray& data)
+{
+    static const QVector<quint32> table = crcTable();
+
+    quint32 crc = 0xFFFFFFFF;
+    const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+    for(int i = 0; i < data.size(); i++)
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+}
+
+}
+
+SegmentStore::SegmentStore(QObject *parent) : QThread(parent)
+{
+    if(QCoreApplication::instance())
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, [=](){ flush(); }, Qt::DirectConnection);
+}
+
+SegmentStore::~SegmentStore()
+{
+    _mutex.lock();
+    _stop = true;
+    _wakeUp.wakeAll();
+    _mutex.unlock();
+
+    if(isRunning())
+        wait();
+    else if(!_pending.isEmpty())
+        writeBatch(_pending);
+
+    qDeleteAll(_readers);
+    _active.close();
+}
+
+SegmentStore *SegmentStore::instance()
+{
+    return segmentStore;
+}
+
+bool SegmentStore::put(QString key, QVariant value)
+{
+    SegmentStore* store = instance();
+    if(!store)
+    {
+        qWarning()<<"Warning: Segment store already destroyed - could not write"<<key;
+        return false;
+    }
+
+    Pending entry;
+    entry.value = value;
+    return store->enqueue(key, entry);
+}
+
+bool SegmentStore::remove(QString key)
+{
+    SegmentStore* store = instance();
+    if(!store)
+        return false;
+
+    Pending entry;
+    entry.remove = true;
+    return store->enqueue(key, entry);
+}
+
+QVariant SegmentStore::get(QString key)
+{
+    SegmentStore* store = instance();
+    if(!store)
+        return QVariant();
+
+    // a merge may move the record between the lookup and the read, the lookup is repeated then
+    for(int attempt = 0; attempt < 3; attempt++)
+    {
+        QVariant value;
+        Location location;
+        if(store->lookup(key, &value, &location))
+            return value;
+
+        if(location.segment < 0)
+            return QVariant();
+
+        QMutexLocker locker(&store->_readMutex);
+        value = store->read(location);
+        if(value.isValid())
+            return value;
+    }
+
+    qWarning()<<"Warning: Could not read"<<key;
+    return QVariant();
+}
+
+bool SegmentStore::lookup(const QString &key, QVariant *value, Location *location)
+{
+    QMutexLocker locker(&_mutex);
+    ensureOpen();
+
+    // values which are not written yet are served from memory
+    if(_pending.contains(key))
+    {
+        *value = _pending.value(key).value;
+        return true;
+    }
+
+    if(_inFlight.contains(key))
+    {
+        *value = _inFlight.value(key).value;
+        return true;
+    }
+
+    *location = _index.value(key);
+    return false;
+}
+
+QStringList SegmentStore::keys(QString prefix)
+{
+    SegmentStore* store = instance();
+    if(!store)
+        return QStringList();
+
+    QMutexLocker locker(&store->_mutex);
+    store->ensureOpen();
+
+    // the index is ordered, so only the key range of the prefix is visited
+    QSet<QString> keys;
+    QMap<QString, Location>::const_iterator it = store->_index.lowerBound(prefix);
+    for(; it != store->_index.constEnd() && it.key().startsWith(prefix); ++it)
+    {
+        keys.insert(it.key());
+    }
+
+    QList<QHash<QString, Pending>*> queues = QList<QHash<QString, Pending>*>() << &store->_inFlight << &store->_pending;
+    for(int i = 0; i < queues.count(); i++)
+    {
+        QHashIterator<QString, Pending> pending(*queues.at(i));
+        while(pending.hasNext())
+        {
+            pending.next();
+            if(!pending.key().startsWith(prefix))
+                continue;
+
+            if(pending.value().remove)
+                keys.remove(pending.key());
+            else
+                keys.insert(pending.key());
+        }
+    }
+
+    return keys.values();
+}
+
+bool SegmentStore::contains(QString key)
+{
+    SegmentStore* store = instance();
+    if(!store)
+        return false;
+
+    QMutexLocker locker(&store->_mutex);
+    store->ensureOpen();
+
+    if(store->_pending.contains(key))
+        return !store->_pending.value(key).remove;
+
+    if(store->_inFlight.contains(key))
+        return !store->_inFlight.value(key).remove;
+
+    return store->_index.contains(key);
+}
+
+void SegmentStore::flushAll()
+{
+    SegmentStore* store = instance();
+    if(store)
+        store->flush();
+}
+
+void SegmentStore::setBatchInterval(int msecs)
+{
+    QMutexLocker locker(&_mutex);
+    _batchInterval = msecs;
+}
+
+void SegmentStore::run()
+{
+    QMutexLocker locker(&_mutex);
+    while(true)
+    {
+        if(_pending.isEmpty())
+        {
+            if(_stop)
+                break;
+
+            _wakeUp.wait(&_mutex);
+            continue;
+        }
+
+        // give other resources the chance to join the batch
+        if(!_stop && !_flushRequested)
+            _wakeUp.wait(&_mutex, static_cast<unsigned long>(_batchInterval));
+
+        _inFlight = _pending;
+        _pending.clear();
+        _flushRequested = false;
+
+        locker.unlock();
+        bool written = writeBatch(_inFlight);
+        locker.relock();
+
+        // a failed batch is retried with the next one, newer values of the same keys win
+        if(!written)
+        {
+            QHashIterator<QString, Pending> it(_inFlight);
+            while(it.hasNext())
+            {
+                it.next();
+                if(!_pending.contains(it.key()))
+                    _pending.insert(it.key(), it.value());
+            }
+        }
+        _writeError = !written;
+        _inFlight.clear();
+        _written.wakeAll();
+
+        // don't spin on a failing disk
+        if(!written && !_stop)
+        {
+            _wakeUp.wait(&_mutex, static_cast<unsigned long>(_batchInterval * 10));
+            continue;
+        }
+
+        int segment = mergeCandidate();
+        if(segment >= 0 && !_stop)
+        {
+            locker.unlock();
+            merge(segment);
+            locker.relock();
+        }
+    }
+}
+
+bool SegmentStore::enqueue(QString key, Pending entry)
+{
+    QMutexLocker locker(&_mutex);
+    ensureOpen();
+    _pending.insert(key, entry);
+
+    if(!isRunning() && !_stop)
+        start(QThread::LowPriority);
+
+    _wakeUp.wakeAll();
+    return !_writeError;
+}
+
+void SegmentStore::flush()
+{
+    QMutexLocker locker(&_mutex);
+    if(_pending.isEmpty() && _inFlight.isEmpty())
+        return;
+
+    _flushRequested = true;
+    _wakeUp.wakeAll();
+
+    while(isRunning() && !_writeError && (!_pending.isEmpty() || !_inFlight.isEmpty()))
+        _written.wait(&_mutex);
+}
+
+void SegmentStore::ensureOpen()
+{
+    if(_opened)
+        return;
+
+    _opened = true;
+    _path = FileSystemPaths::instance()->getStoragePath() + "segments/";
+    QDir dir(_path);
+    if(!dir.exists())
+        dir.mkpath(_path);
+
+    QList<int> segments;
+    QStringList files = dir.entryList(QStringList()<<"*.segment", QDir::Files);
+    QListIterator<QString> it(files);
+    while(it.hasNext())
+    {
+        bool ok = false;
+        int segment = it.next().section(".", 0, 0).toInt(&ok);
+        if(ok)
+            segments.append(segment);
+    }
+    std::sort(segments.begin(), segments.end());
+
+    for(int i = 0; i < segments.count(); i++)
+    {
+        scan(segments.at(i), i == segments.count() - 1);
+    }
+
+    int active = segments.isEmpty() ? 0 : segments.last();
+    if(_segments.value(active).size >= SEGMENT_MAX_SIZE)
+        active++;
+
+    openActiveSegment(active);
+}
+
+QVariant SegmentStore::read(const SegmentStore::Location &location)
+{
+    QFile* file = _readers.value(location.segment);
+    if(!file)
+    {
+        file = new QFile(segmentPath(location.segment));
+        if(!file->open(QFile::ReadOnly | QFile::Unbuffered))
+        {
+            qWarning()<<"Warning: Could not open segment -"<<file->errorString();
+            delete file;
+            return QVariant();
+        }
+        _readers.insert(location.segment, file);
+    }
+
+    Record record;
+    if(!file->seek(location.offset) || !parseRecord(file->read(location.size), 0, &record))
+    {
+        qWarning()<<"Warning: Corrupt record in segment"<<location.segment;
+        return QVariant();
+    }
+
+    return QCborValue::fromCbor(record.value).toVariant();
+}
+
+void SegmentStore::scan(int segment, bool last)
+{
+    QFile file(segmentPath(segment));
+    if(!file.open(QFile::ReadWrite))
+    {
+        qWarning()<<"Warning: Could not open segment -"<<file.errorString();
+        return;
+    }
+
+    QByteArray data = file.readAll();
+    _segments.insert(segment, Segment());
+
+    qint64 offset = 0;
+    Record record;
+    while(offset < data.size() && parseRecord(data, offset, &record))
+    {
+        Location location;
+        location.segment = segment;
+        location.offset = offset;
+        location.size = record.size;
+        _segments[segment].size += record.size;
+        apply(record.key, location, record.remove);
+        offset += record.size;
+    }
+
+    if(offset < data.size())
+    {
+        if(last)
+        {
+            // the last batch was not written completely
+            qWarning()<<"Warning: Cut off torn record at the end of segment"<<segment;
+            file.resize(offset);
+        }
+        else
+        {
+            qWarning()<<"Warning: Corrupt segment"<<segment<<"- ignoring"<<data.size() - offset<<"bytes";
+        }
+    }
+}
+
+void SegmentStore::apply(const QString &key, const SegmentStore::Location &location, bool remove)
+{
+    if(!_firstSegment.contains(key) || _firstSegment.value(key) > location.segment)
+        _firstSegment.insert(key, location.segment);
+
+    if(_index.contains(key))
+    {
+        Location old = _index.value(key);
+        if(_segments.contains(old.segment))
+            _segments[old.segment].live -= old.size;
+    }
+
+    if(remove)
+    {
+        _index.remove(key);
+        return;
+    }
+
+    _index.insert(key, location);
+    _segments[location.segment].live += location.size;
+}
+
+bool SegmentStore::openActiveSegment(int segment)
+{
+    _active.close();
+    _active.setFileName(segmentPath(segment));
+    if(!_active.open(QFile::WriteOnly | QFile::Append))
+    {
+        qWarning()<<"Warning: Could not open segment -"<<_active.errorString();
+        return false;
+    }
+
+    _activeSegment = segment;
+    if(!_segments.contains(segment))
+        _segments.insert(segment, Segment());
+    return true;
+}
+
+QVector<SegmentStore::Location> SegmentStore::append(const QVector<QByteArray> &records)
+{
+    if(!_active.isOpen())
+        return QVector<Location>();
+
+    QVector<Location> locations;
+    if(_active.size() >= SEGMENT_MAX_SIZE)
+    {
+        QMutexLocker locker(&_mutex);
+        openActiveSegment(_activeSegment + 1);
+    }
+
+    // the whole batch is written at once
+    QByteArray buffer;
+    qint64 offset = _active.size();
+    QVectorIterator<QByteArray> it(records);
+    while(it.hasNext())
+    {
+        const QByteArray& record = it.next();
+        Location location;
+        location.segment = _activeSegment;
+        location.offset = offset + buffer.size();
+        location.size = quint32(record.size());
+        locations.append(location);
+        buffer.append(record);
+    }
+
+    if(_active.write(buffer) != buffer.size() || !_active.flush() || !sync(_active))
+    {
+        qWarning()<<"Warning: Could not write segment -"<<_active.errorString();
+        return QVector<Location>();
+    }
+
+    QMutexLocker locker(&_mutex);
+    _segments[_activeSegment].size += buffer.size();
+    return locations;
+}
+
+bool SegmentStore::writeBatch(const QHash<QString, SegmentStore::Pending> &batch)
+{
+    QStringList keys;
+    QVector<QByteArray> records;
+    QVector<bool> removed;
+
+    QHashIterator<QString, Pending> it(batch);
+    while(it.hasNext())
+    {
+        it.next();
+        keys.append(it.key());
+        records.append(encodeRecord(it.key(), it.value()));
+        removed.append(it.value().remove);
+    }
+
+    QVector<Location> locations = append(records);
+    if(locations.count() != keys.count())
+        return false;
+
+    QMutexLocker locker(&_mutex);
+    for(int i = 0; i < keys.count(); i++)
+    {
+        apply(keys.at(i), locations.at(i), removed.at(i));
+    }
+    return true;
+}
+
+bool SegmentStore::sync(QFile &file)
+{
+    // flush() only hands the data to the OS, a batch counts as written once it is on the disk
+#if defined(Q_OS_WIN)
+    return _commit(file.handle()) == 0;
+#elif defined(Q_OS_UNIX)
+    return ::fsync(file.handle()) == 0;
+#else
+    Q_UNUSED(file)
+    return true;
+#endif
+}
+
+int SegmentStore::mergeCandidate() const
+{
+    QMapIterator<int, Segment> it(_segments);
+    while(it.hasNext())
+    {
+        it.next();
+        if(it.key() != _activeSegment && (it.value().size == 0 || it.value().live < it.value().size * SEGMENT_MERGE_RATIO))
+            return it.key();
+    }
+    return -1;
+}
+
+void SegmentStore::merge(int segment)
+{
+    QFile file(segmentPath(segment));
+    if(!file.open(QFile::ReadOnly))
+        return;
+
+    QByteArray data = file.readAll();
+    file.close();
+
+    QVector<Record> records;
+    qint64 offset = 0;
+    Record record;
+    while(offset < data.size() && parseRecord(data, offset, &record))
+    {
+        records.append(record);
+        offset += record.size;
+    }
+
+    // collect the records which are still live. Deletions have to be kept as long as an older
+    // segment might contain a previous value of the key.
+    QVector<QByteArray> live;
+    QVector<Record> liveRecords;
+    QStringList dropped;
+    _mutex.lock();
+    QVectorIterator<Record> it(records);
+    while(it.hasNext())
+    {
+        const Record& current = it.next();
+        Location location = _index.value(current.key);
+        bool keep = false;
+        if(!current.remove)
+            keep = location.segment == segment && location.offset == current.offset;
+        else if(!_index.contains(current.key))
+            keep = _firstSegment.value(current.key, segment) < segment;
+
+        if(keep)
+        {
+            live.append(data.mid(int(current.offset), int(current.size)));
+            liveRecords.append(current);
+        }
+        else if(current.remove && !_index.contains(current.key))
+        {
+            dropped.append(current.key);
+        }
+    }
+    _mutex.unlock();
+
+    QVector<Location> locations;
+    if(!live.isEmpty())
+    {
+        locations = append(live);
+        if(locations.count() != live.count())
+            return;
+    }
+
+    QMutexLocker locker(&_mutex);
+    for(int i = 0; i < liveRecords.count(); i++)
+    {
+        const Record& current = liveRecords.at(i);
+        Location location = _index.value(current.key);
+        if(!current.remove && location.segment == segment && location.offset == current.offset)
+            apply(current.key, locations.at(i), false);
+    }
+
+    // the records of the merged segment are gone, the oldest remaining segment is a safe lower bound
+    _segments.remove(segment);
+    int oldest = _segments.isEmpty() ? _activeSegment : _segments.firstKey();
+    for(int i = 0; i < records.count(); i++)
+    {
+        const QString& key = records.at(i).key;
+        if(_firstSegment.value(key, -1) == segment)
+            _firstSegment.insert(key, oldest);
+    }
+
+    // a deletion which was not copied leaves no record of the key behind
+    for(int i = 0; i < dropped.count(); i++)
+    {
+        if(!_index.contains(dropped.at(i)))
+            _firstSegment.remove(dropped.at(i));
+    }
+
+    QMutexLocker readLocker(&_readMutex);
+    delete _readers.take(segment);
+    QFile::remove(segmentPath(segment));
+}
+
+QString SegmentStore::segmentPath(int segment) const
+{
+    return _path + QString("%1.segment").arg(segment, 8, 10, QChar('0'));
+}
+
+QByteArray SegmentStore::encodeRecord(const QString &key, const SegmentStore::Pending &entry)
+{
+    QByteArray rawKey = key.toUtf8();
+    QByteArray rawValue = entry.remove ? QByteArray() : QCborValue::fromVariant(entry.value).toCbor();
+    QByteArray payload = rawKey + rawValue;
+
+    QByteArray record;
+    record.reserve(SEGMENT_RECORD_HEADER + payload.size());
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream << quint32(rawKey.size()) << quint32(entry.remove ? SEGMENT_TOMBSTONE : quint32(rawValue.size()))
+           << crc32(payload);
+    record.append(payload);
+    return record;
+}
+
+bool SegmentStore::parseRecord(const QByteArray &data, qint64 offset, SegmentStore::Record *record)
+{
+    if(data.size() - offset < SEGMENT_RECORD_HEADER)
+        return false;
+
+    const uchar* header = reinterpret_cast<const uchar*>(data.constData() + offset);
+    quint32 keySize = qFromBigEndian<quint32>(header);
+    quint32 valueSize = qFromBigEndian<quint32>(header + 4);
+    quint32 checksum = qFromBigEndian<quint32>(header + 8);
+    bool remove = valueSize == SEGMENT_TOMBSTONE;
+    if(remove)
+        valueSize = 0;
+
+    qint64 size = qint64(SEGMENT_RECORD_HEADER) + keySize + valueSize;
+    if(data.size() - offset < size)
+        return false;
+
+    QByteArray payload = data.mid(int(offset + SEGMENT_RECORD_HEADER), int(keySize + valueSize));
+    // segments written before the switch to CRC-32 carry a 16 bit qChecksum
+    if(crc32(payload) != checksum && (checksum > 0xFFFF || quint32(qChecksum(payload.constData(), uint(payload.size()))) != checksum))
+        return false;
+
+    record->key = QString::fromUtf8(payload.left(int(keySize)));
+    record->value = payload.mid(int(keySize));
+    record->offset = offset;
+    record->size = quint32(size);
+    record->remove = remove;
+    return true;
+}
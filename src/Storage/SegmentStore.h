@@ -0,0 +1,150 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ * It is part of the QuickHub framework - www.quickhub.org
+ * Copyright (C) 2021 by Friedemann Metzger - mail@friedemann-metzger.de */
+
+#ifndef SEGMENTSTORE_H
+#define SEGMENTSTORE_H
+
+#include <QThread>
+#include <QVariant>
+#include <QHash>
+#include <QMap>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+
+/*!
+    \class SegmentStore
+    \brief Log structured key value store shared by all resources.
+
+    Instead of one file per resource, all values are appended to a few large segment files
+    (<storage path>/segments/<id>.segment). Every record contains the key, the CBOR encoded value and a CRC-32 checksum:
+
+    \code
+    key size | value size (0xFFFFFFFF = deleted) | checksum | key | value
+    \endcode
+
+    An in-memory index maps every key to the location of its latest record. The index is
+    rebuilt on startup by scanning the segments in order, a torn record at the end of the
+    last segment is cut off.
+
+    Writes are collected on a background thread and appended in batches across all keys. Every batch is
+    synced to disk before its values count as written. As long as a value has not been written, newer
+    values for the same key replace it. A batch which could not be written stays pending and is retried,
+    put() and remove() return false until a write succeeded again.
+    Segments with mostly outdated records are merged in the background: the live records are copied to
+    the current segment and the old segment is deleted. Deletions are only copied as long as an older
+    segment may still contain a value of the key.
+
+    Values are read from the segments without holding the lock of the index, so reads don't block writers.
+
+    \sa ListResourceSegmentStorage, ObjectResourceSegmentStorage
+*/
+
+class SegmentStore : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit SegmentStore(QObject* parent = nullptr);
+    ~SegmentStore() override;
+
+    static SegmentStore* instance();
+
+    /*!
+        \fn static bool SegmentStore::put(QString key, QVariant value)
+        Schedules a write of value. The value is visible to get() immediately.
+        Returns false if the store is destroyed or the segments can't be written at the moment.
+    */
+    static bool     put(QString key, QVariant value);
+    static bool     remove(QString key);
+    static QVariant get(QString key);
+    static bool     contains(QString key);
+
+    /*!
+        \fn static QStringList SegmentStore::keys(QString prefix)
+        Returns all keys which start with prefix. Only the key range of prefix in the ordered index is visited.
+    */
+    static QStringList keys(QString prefix);
+
+    /*!
+        \fn static void SegmentStore::flushAll()
+        Barrier: blocks until all pending writes are on disk.
+    */
+    static void     flushAll();
+
+    void            setBatchInterval(int msecs);
+
+protected:
+    void run() override;
+
+private:
+    struct Location
+    {
+        int     segment = -1;
+        qint64  offset = 0;
+        quint32 size = 0;
+    };
+
+    struct Segment
+    {
+        qint64  size = 0;
+        qint64  live = 0;
+    };
+
+    struct Pending
+    {
+        QVariant value;
+        bool remove = false;
+    };
+
+    struct Record
+    {
+        QString     key;
+        qint64      offset = 0;
+        quint32     size = 0;
+        bool        remove = false;
+        QByteArray  value;
+    };
+
+    bool            enqueue(QString key, Pending entry);
+    bool            lookup(const QString& key, QVariant* value, Location* location);
+    void            flush();
+    void            ensureOpen();
+    QVariant        read(const Location& location);
+    void            scan(int segment, bool last);
+    void            apply(const QString& key, const Location& location, bool remove);
+    bool            openActiveSegment(int segment);
+    QVector<Location> append(const QVector<QByteArray>& records);
+    static bool     sync(QFile& file);
+    bool            writeBatch(const QHash<QString, Pending>& batch);
+    int             mergeCandidate() const;
+    void            merge(int segment);
+    QString         segmentPath(int segment) const;
+
+    static QByteArray encodeRecord(const QString& key, const Pending& entry);
+    static bool     parseRecord(const QByteArray& data, qint64 offset, Record* record);
+
+    mutable QMutex              _mutex;
+    QWaitCondition              _wakeUp;
+    QWaitCondition              _written;
+    QString                     _path;
+    bool                        _opened = false;
+    bool                        _stop = false;
+    bool                        _flushRequested = false;
+    int                         _batchInterval = 200;
+    QMap<QString, Location>     _index; // ordered, keys(prefix) visits a key range
+    QMap<int, Segment>          _segments;
+    QHash<QString, int>         _firstSegment; // key -> oldest segment which may contain a record of the key
+    bool                        _writeError = false;
+    QMutex                      _readMutex; // guards _readers
+    QHash<int, QFile*>          _readers;
+    QHash<QString, Pending>     _pending;
+    QHash<QString, Pending>     _inFlight;
+    QFile                       _active;
+    int                         _activeSegment = -1;
+};
+
+#endif // SEGMENTSTORE_H